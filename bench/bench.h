@@ -0,0 +1,66 @@
+#ifndef WEB_SERVER_BENCH_H
+#define WEB_SERVER_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace web_server::bench
+{
+
+    // Heap allocations made by the process so far, counted by the replaced global
+    // operator new in bench_main.cpp.
+    uint64_t allocationCount();
+
+    // Keeps the compiler from discarding a result that is otherwise unused.
+    template <typename T>
+    inline void doNotOptimize(const T &value)
+    {
+#if defined(__GNUC__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+
+    void report(std::string_view name, uint64_t iterations, std::chrono::nanoseconds elapsed, uint64_t allocations);
+
+    // Calls `op` in growing batches for about 300 ms after a short warm-up (1000
+    // calls or 50 ms, whichever ends first) and prints the time and heap
+    // allocations per call.
+    template <typename Op>
+    void run(std::string_view name, Op &&op)
+    {
+        using clock = std::chrono::steady_clock;
+        auto warm_up_start = clock::now();
+        for (int i = 0; i < 1000 && clock::now() - warm_up_start < std::chrono::milliseconds(50); ++i)
+        {
+            op();
+        }
+        uint64_t iterations = 0;
+        uint64_t batch = 1;
+        uint64_t allocations = allocationCount();
+        auto start = clock::now();
+        auto elapsed = clock::duration::zero();
+        while (elapsed < std::chrono::milliseconds(300))
+        {
+            for (uint64_t i = 0; i < batch; ++i)
+            {
+                op();
+            }
+            iterations += batch;
+            batch = batch < (1u << 20) ? batch * 2 : batch;
+            elapsed = clock::now() - start;
+        }
+        report(name, iterations, elapsed, allocationCount() - allocations);
+    }
+
+    // Benchmark suites, one per area of the server
+    void requestParserSuite();
+    void multipartSuite();
+    void serverSuite();
+
+}
+
+#endif
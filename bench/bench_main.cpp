@@ -0,0 +1,100 @@
+#include "bench.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <iterator>
+
+namespace
+{
+    std::atomic<uint64_t> allocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace web_server::bench
+{
+
+    uint64_t allocationCount()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    void report(std::string_view name, uint64_t iterations, std::chrono::nanoseconds elapsed, uint64_t allocation_count)
+    {
+        double ns_per_op = static_cast<double>(elapsed.count()) / static_cast<double>(iterations);
+        double allocations_per_op = static_cast<double>(allocation_count) / static_cast<double>(iterations);
+        std::printf("%-56.*s %12.1f ns/op %10.2f allocs/op\n", static_cast<int>(name.length()), name.data(),
+                    ns_per_op, allocations_per_op);
+    }
+
+}
+
+namespace
+{
+    struct Suite
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    const Suite SUITES[] = {
+        {"request_parser", web_server::bench::requestParserSuite},
+        {"multipart", web_server::bench::multipartSuite},
+        {"server", web_server::bench::serverSuite},
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    // With arguments, only the named suites are run
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::none_of(std::begin(SUITES), std::end(SUITES), [&](const Suite &suite)
+                         { return std::strcmp(argv[i], suite.name) == 0; }))
+        {
+            std::fprintf(stderr, "Unknown suite: %s\n", argv[i]);
+            std::fprintf(stderr, "Available suites:");
+            for (const Suite &suite : SUITES)
+            {
+                std::fprintf(stderr, " %s", suite.name);
+            }
+            std::fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+    for (const Suite &suite : SUITES)
+    {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            selected = selected || std::strcmp(argv[i], suite.name) == 0;
+        }
+        if (selected)
+        {
+            std::printf("== %s\n", suite.name);
+            suite.run();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,483 @@
+// Loopback HTTP load generator. Each connection runs on its own thread and
+// issues one request at a time over a persistent connection.
+//
+// Closed loop (default): every connection sends its next request as soon as the
+// previous response has arrived, which measures peak throughput.
+// Open loop (--rate=N): requests are scheduled at N per second in total and
+// latency is measured from the scheduled send time, so a stalled server is
+// charged for the requests that queued up behind it (no coordinated omission).
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        std::string host = "127.0.0.1";
+        std::string port = "8080";
+        std::string workload = "static";
+        std::string path; // Defaults per workload
+        size_t connections = 16;
+        double duration_seconds = 10;
+        double rate = 0; // Requests per second over all connections; 0 = closed loop
+        size_t upload_size = 64 * 1024;
+    };
+
+    struct ThreadResult
+    {
+        std::vector<uint64_t> latencies_ns;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+    };
+
+    void printUsage(const char *program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --host=HOST            Server address (default: 127.0.0.1)\n"
+                  << "  --port=PORT            Server port (default: 8080)\n"
+                  << "  --workload=static|listing|upload  What to request (default: static)\n"
+                  << "  --path=PATH            Request target (default: /test.txt, /, /upload?path=/)\n"
+                  << "  --connections=N        Concurrent persistent connections (default: 16)\n"
+                  << "  --duration=SECONDS     Length of the run (default: 10)\n"
+                  << "  --rate=N               Open loop at N requests/s in total (default: closed loop)\n"
+                  << "  --upload-size=N        Bytes per uploaded file (default: 65536)\n";
+    }
+
+    bool matchOption(const std::string &arg, const std::string &name, std::string &value)
+    {
+        std::string prefix = "--" + name + "=";
+        if (arg.rfind(prefix, 0) != 0)
+        {
+            return false;
+        }
+        value = arg.substr(prefix.length());
+        return true;
+    }
+
+    bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        return a.length() == b.length() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+                                                      { return std::tolower(static_cast<unsigned char>(x)) ==
+                                                               std::tolower(static_cast<unsigned char>(y)); });
+    }
+
+    std::string buildRequest(const Config &config, size_t connection_index)
+    {
+        std::string host = config.host + ":" + config.port;
+        if (config.workload != "upload")
+        {
+            return "GET " + config.path + " HTTP/1.1\r\nHost: " + host + "\r\nAccept-Encoding: identity\r\n\r\n";
+        }
+        // One file name per connection, so concurrent uploads never replace each other mid-rename
+        std::string boundary = "------------------------load" + std::to_string(connection_index);
+        std::string body = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"load-" +
+                           std::to_string(connection_index) + ".bin\"\r\nContent-Type: application/octet-stream\r\n\r\n";
+        body.append(config.upload_size, 'x');
+        body += "\r\n--" + boundary + "--\r\n";
+        return "POST " + config.path + " HTTP/1.1\r\nHost: " + host +
+               "\r\nContent-Type: multipart/form-data; boundary=" + boundary +
+               "\r\nContent-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+    }
+
+    // One persistent connection. Responses are framed by Content-Length or
+    // chunked transfer coding; the connection is reopened when the server closes it.
+    class Client
+    {
+    public:
+        explicit Client(const addrinfo &address) : address_(address) {}
+        ~Client() { disconnect(); }
+
+        // Sends `request` and reads the whole response. Returns the status code,
+        // or -1 on a connection or framing error.
+        int roundTrip(const std::string &request, uint64_t &bytes)
+        {
+            if (fd_ == -1 && !connect())
+            {
+                return -1;
+            }
+            if (!sendAll(request))
+            {
+                // The server may have closed an idle keep-alive connection; retry once
+                disconnect();
+                if (!connect() || !sendAll(request))
+                {
+                    return -1;
+                }
+            }
+            int status = readResponse(bytes);
+            if (status < 0 || close_after_)
+            {
+                disconnect();
+            }
+            return status;
+        }
+
+    private:
+        const addrinfo &address_;
+        int fd_ = -1;
+        std::string buffer_;
+        bool close_after_ = false;
+
+        bool connect()
+        {
+            fd_ = socket(address_.ai_family, SOCK_STREAM, 0);
+            if (fd_ == -1)
+            {
+                return false;
+            }
+            if (::connect(fd_, address_.ai_addr, address_.ai_addrlen) != 0)
+            {
+                disconnect();
+                return false;
+            }
+            int one = 1;
+            setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            buffer_.clear();
+            return true;
+        }
+
+        void disconnect()
+        {
+            if (fd_ != -1)
+            {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+
+        bool sendAll(std::string_view data)
+        {
+            while (!data.empty())
+            {
+                ssize_t sent = send(fd_, data.data(), data.length(), MSG_NOSIGNAL);
+                if (sent <= 0)
+                {
+                    return false;
+                }
+                data.remove_prefix(static_cast<size_t>(sent));
+            }
+            return true;
+        }
+
+        bool fill()
+        {
+            char chunk[65536];
+            ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                return false;
+            }
+            buffer_.append(chunk, static_cast<size_t>(received));
+            return true;
+        }
+
+        // Reads until `buffer_` holds `length` bytes
+        bool fillTo(size_t length)
+        {
+            while (buffer_.length() < length)
+            {
+                if (!fill())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Reads one line ending in CRLF and removes it from the buffer
+        bool readLine(std::string &line)
+        {
+            size_t end;
+            while ((end = buffer_.find("\r\n")) == std::string::npos)
+            {
+                if (!fill())
+                {
+                    return false;
+                }
+            }
+            line = buffer_.substr(0, end);
+            buffer_.erase(0, end + 2);
+            return true;
+        }
+
+        int readResponse(uint64_t &bytes)
+        {
+            size_t header_end;
+            while ((header_end = buffer_.find("\r\n\r\n")) == std::string::npos)
+            {
+                if (!fill())
+                {
+                    return -1;
+                }
+            }
+            std::string_view head(buffer_.data(), header_end);
+            if (head.length() < 12 || !head.starts_with("HTTP/1."))
+            {
+                return -1;
+            }
+            int status = std::atoi(buffer_.c_str() + 9);
+
+            size_t content_length = 0;
+            bool chunked = false;
+            close_after_ = false;
+            size_t line_start = head.find("\r\n") + 2;
+            while (line_start < head.length())
+            {
+                size_t line_end = std::min(head.find("\r\n", line_start), head.length());
+                std::string_view line = head.substr(line_start, line_end - line_start);
+                size_t colon = line.find(':');
+                if (colon != std::string_view::npos)
+                {
+                    std::string_view name = line.substr(0, colon);
+                    std::string_view value = line.substr(colon + 1);
+                    value.remove_prefix(std::min(value.find_first_not_of(' '), value.length()));
+                    if (equalsIgnoreCase(name, "Content-Length"))
+                    {
+                        content_length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                    }
+                    else if (equalsIgnoreCase(name, "Transfer-Encoding"))
+                    {
+                        chunked = equalsIgnoreCase(value, "chunked");
+                    }
+                    else if (equalsIgnoreCase(name, "Connection"))
+                    {
+                        close_after_ = equalsIgnoreCase(value, "close");
+                    }
+                }
+                line_start = line_end + 2;
+            }
+            bytes += header_end + 4;
+            buffer_.erase(0, header_end + 4);
+            if (status == 100)
+            {
+                return readResponse(bytes);
+            }
+
+            if (!chunked)
+            {
+                if (!fillTo(content_length))
+                {
+                    return -1;
+                }
+                buffer_.erase(0, content_length);
+                bytes += content_length;
+                return status;
+            }
+            std::string line;
+            while (true)
+            {
+                if (!readLine(line))
+                {
+                    return -1;
+                }
+                size_t size = std::strtoull(line.c_str(), nullptr, 16);
+                if (size == 0)
+                {
+                    // Skip trailers up to the empty line
+                    do
+                    {
+                        if (!readLine(line))
+                        {
+                            return -1;
+                        }
+                    } while (!line.empty());
+                    return status;
+                }
+                if (!fillTo(size + 2))
+                {
+                    return -1;
+                }
+                buffer_.erase(0, size + 2);
+                bytes += size;
+            }
+        }
+    };
+
+    void runConnection(const Config &config, const addrinfo &address, size_t index, clock::time_point start,
+                       clock::time_point end, ThreadResult &result)
+    {
+        Client client(address);
+        std::string request = buildRequest(config, index);
+        bool open_loop = config.rate > 0;
+        // Each connection carries an equal share of the rate, staggered so the
+        // connections do not all fire at the same instant
+        auto interval = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(open_loop ? static_cast<double>(config.connections) / config.rate : 0));
+        clock::time_point scheduled = start + interval * index / config.connections;
+
+        while (true)
+        {
+            clock::time_point sent_at;
+            if (open_loop)
+            {
+                if (scheduled >= end)
+                {
+                    break;
+                }
+                std::this_thread::sleep_until(scheduled);
+                sent_at = scheduled;
+                scheduled += interval;
+            }
+            else
+            {
+                sent_at = clock::now();
+                if (sent_at >= end)
+                {
+                    break;
+                }
+            }
+            int status = client.roundTrip(request, result.bytes);
+            auto latency = clock::now() - sent_at;
+            if (status < 200 || status >= 300)
+            {
+                ++result.errors;
+                if (status < 0)
+                {
+                    // Do not spin on a refused connection
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                continue;
+            }
+            result.latencies_ns.push_back(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+        }
+    }
+
+    double percentileMicros(const std::vector<uint64_t> &sorted, double quantile)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+        size_t index = std::min(sorted.size() - 1, static_cast<size_t>(quantile * static_cast<double>(sorted.size())));
+        return static_cast<double>(sorted[index]) / 1000.0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::string value;
+            if (matchOption(arg, "host", value))
+            {
+                config.host = value;
+            }
+            else if (matchOption(arg, "port", value))
+            {
+                config.port = value;
+            }
+            else if (matchOption(arg, "workload", value) &&
+                     (value == "static" || value == "listing" || value == "upload"))
+            {
+                config.workload = value;
+            }
+            else if (matchOption(arg, "path", value) && value.starts_with('/'))
+            {
+                config.path = value;
+            }
+            else if (matchOption(arg, "connections", value) && std::stoul(value) > 0)
+            {
+                config.connections = std::stoul(value);
+            }
+            else if (matchOption(arg, "duration", value))
+            {
+                config.duration_seconds = std::stod(value);
+            }
+            else if (matchOption(arg, "rate", value))
+            {
+                config.rate = std::stod(value);
+            }
+            else if (matchOption(arg, "upload-size", value))
+            {
+                config.upload_size = std::stoul(value);
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << arg << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    catch (const std::logic_error &)
+    {
+        std::cerr << "Invalid option value\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (config.path.empty())
+    {
+        config.path = config.workload == "static" ? "/test.txt" : config.workload == "listing" ? "/"
+                                                                                             : "/upload?path=/";
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(config.host.c_str(), config.port.c_str(), &hints, &addresses) != 0 || !addresses)
+    {
+        std::cerr << "Cannot resolve " << config.host << ":" << config.port << "\n";
+        return 1;
+    }
+
+    std::vector<ThreadResult> results(config.connections);
+    std::vector<std::thread> threads;
+    auto start = clock::now() + std::chrono::milliseconds(10);
+    auto end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(config.duration_seconds));
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+        threads.emplace_back(runConnection, std::cref(config), std::cref(*addresses), i, start, end, std::ref(results[i]));
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    freeaddrinfo(addresses);
+
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    for (const ThreadResult &result : results)
+    {
+        latencies.insert(latencies.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+        errors += result.errors;
+        bytes += result.bytes;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("%s %s, %zu connections, %s, %.1f s\n", config.workload.c_str(), config.path.c_str(),
+                config.connections, config.rate > 0 ? ("open loop at " + std::to_string(static_cast<uint64_t>(config.rate)) + " req/s").c_str() : "closed loop",
+                elapsed);
+    std::printf("requests   %zu ok, %llu errors\n", latencies.size(), static_cast<unsigned long long>(errors));
+    std::printf("throughput %.1f req/s, %.2f MiB/s received\n", static_cast<double>(latencies.size()) / elapsed,
+                static_cast<double>(bytes) / elapsed / (1024 * 1024));
+    std::printf("latency    p50 %.0f us, p99 %.0f us, p999 %.0f us, max %.0f us\n", percentileMicros(latencies, 0.5),
+                percentileMicros(latencies, 0.99), percentileMicros(latencies, 0.999),
+                latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / 1000.0);
+    return errors > 0 && latencies.empty() ? 1 : 0;
+}
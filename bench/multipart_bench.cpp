@@ -0,0 +1,93 @@
+#include "bench.h"
+#include "multipart_parser.h"
+#include <cstdlib>
+#include <string>
+
+namespace web_server::bench
+{
+
+    namespace
+    {
+        const std::string BOUNDARY = "------------------------d74496d66958873e";
+
+        class CountingHandler : public MultipartParser::Handler
+        {
+        public:
+            size_t parts = 0;
+            size_t bytes = 0;
+
+            bool onPartBegin(std::string_view headers) override
+            {
+                doNotOptimize(headers);
+                ++parts;
+                return true;
+            }
+            bool onPartData(std::string_view data) override
+            {
+                bytes += data.length();
+                return true;
+            }
+            bool onPartEnd() override { return true; }
+        };
+
+        // A form with one `file_size` byte file part and `fields` small text fields,
+        // as curl -F sends it
+        std::string makeBody(size_t file_size, size_t fields)
+        {
+            std::string body;
+            for (size_t i = 0; i < fields; ++i)
+            {
+                body += "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"field" + std::to_string(i) +
+                        "\"\r\n\r\nvalue " + std::to_string(i) + "\r\n";
+            }
+            body += "--" + BOUNDARY +
+                    "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"holiday.jpg\"\r\n"
+                    "Content-Type: image/jpeg\r\n\r\n";
+            // Pseudo-random bytes with the occasional "\r\n-" so the boundary
+            // search sees realistic near misses
+            uint32_t state = 12345;
+            for (size_t i = 0; i < file_size; ++i)
+            {
+                state = state * 1103515245 + 12345;
+                body.push_back((state >> 16) % 512 == 0 ? '\r' : static_cast<char>(state >> 24));
+            }
+            body += "\r\n--" + BOUNDARY + "--\r\n";
+            return body;
+        }
+
+        // Feeds `body` the way UploadReceiver sees it: in `chunk` sized reads,
+        // with unconsumed bytes carried over into the next call
+        void parse(const std::string &body, size_t chunk)
+        {
+            CountingHandler handler;
+            MultipartParser parser(BOUNDARY, handler);
+            std::string pending;
+            for (size_t offset = 0; offset < body.length(); offset += chunk)
+            {
+                pending.append(body, offset, chunk);
+                bool last = offset + chunk >= body.length();
+                pending.erase(0, parser.feed(pending, last));
+            }
+            if (!parser.done())
+            {
+                std::abort();
+            }
+            doNotOptimize(handler.bytes);
+        }
+    }
+
+    void multipartSuite()
+    {
+        std::string small = makeBody(4 * 1024, 4);
+        std::string large = makeBody(1024 * 1024, 1);
+        run("form_4k_file_4_fields/whole", [&]
+            { parse(small, small.length()); });
+        run("form_4k_file_4_fields/1k_reads", [&]
+            { parse(small, 1024); });
+        run("upload_1m/whole", [&]
+            { parse(large, large.length()); });
+        run("upload_1m/32k_reads", [&]
+            { parse(large, 32 * 1024); });
+    }
+
+}
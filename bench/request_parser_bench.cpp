@@ -0,0 +1,247 @@
+#include "bench.h"
+#include "multipart_parser.h"
+#include "request_parser.h"
+#include <algorithm>
+#include <cstdlib>
+#include <regex>
+#include <sstream>
+#include <string>
+
+namespace web_server::bench
+{
+
+    namespace
+    {
+        const std::string BROWSER_GET =
+            "GET /images/holiday%202024/beach.jpg HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+            "Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+            "Connection: keep-alive\r\n"
+            "Referer: http://localhost:8080/images/\r\n"
+            "Sec-Fetch-Dest: image\r\n"
+            "Sec-Fetch-Mode: no-cors\r\n"
+            "\r\n";
+
+        const std::string TREE_GET =
+            "GET /__tree?path=%2Fdocs%2Fmy%20files&offset=500&limit=500 HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "Accept: */*\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n";
+
+        const std::string UPLOAD_POST =
+            "POST /upload?path=%2Fuploads HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "User-Agent: curl/8.5.0\r\n"
+            "Accept: */*\r\n"
+            "Content-Length: 1048576\r\n"
+            "Content-Type: multipart/form-data; boundary=------------------------d74496d66958873e\r\n"
+            "Expect: 100-continue\r\n"
+            "\r\n";
+
+        // The request handling that RequestParser replaced: regexes for the
+        // framing headers and an istringstream for the request line, each working
+        // on a copy of the request.
+        namespace legacy
+        {
+            std::string urlDecode(const std::string &value, bool plus_as_space = false)
+            {
+                std::string decoded;
+                for (size_t i = 0; i < value.length(); ++i)
+                {
+                    if (value[i] == '%' && i + 2 < value.length())
+                    {
+                        std::string hex = value.substr(i + 1, 2);
+                        try
+                        {
+                            decoded += static_cast<char>(std::stoi(hex, nullptr, 16));
+                            i += 2;
+                        }
+                        catch (...)
+                        {
+                            decoded += value[i];
+                        }
+                    }
+                    else if (value[i] == '+' && plus_as_space)
+                    {
+                        decoded += ' ';
+                    }
+                    else
+                    {
+                        decoded += value[i];
+                    }
+                }
+                return decoded;
+            }
+
+            std::pair<std::string, std::string> parseRequest(const std::string &request)
+            {
+                std::istringstream stream(request);
+                std::string method, path, protocol;
+                stream >> method >> path >> protocol;
+                if (method != "GET" && method != "POST")
+                {
+                    return {"", ""};
+                }
+                size_t query_pos = path.find('?');
+                std::string query;
+                if (query_pos != std::string::npos)
+                {
+                    query = path.substr(query_pos);
+                    path = path.substr(0, query_pos);
+                }
+                return {urlDecode(path), method + query};
+            }
+
+            std::string getQueryParameter(const std::string &query, const std::string &name)
+            {
+                size_t pos = 0;
+                while (pos < query.length())
+                {
+                    size_t start = pos == 0 && query[0] == '?' ? 1 : pos;
+                    size_t end = query.find('&', start);
+                    if (end == std::string::npos)
+                    {
+                        end = query.length();
+                    }
+                    size_t equals = query.find('=', start);
+                    if (equals != std::string::npos && equals < end && query.compare(start, equals - start, name) == 0)
+                    {
+                        return urlDecode(query.substr(equals + 1, end - equals - 1), true);
+                    }
+                    pos = end + 1;
+                }
+                return "";
+            }
+
+            bool isKeepAlive(const std::string &request)
+            {
+                size_t line_end = request.find("\r\n");
+                std::string request_line = request.substr(0, line_end);
+                bool http11 = request_line.ends_with("HTTP/1.1");
+
+                size_t header_end = request.find("\r\n\r\n");
+                std::string headers = request.substr(0, header_end);
+                std::regex connection_regex(R"(\r\nConnection:[ \t]*([^\r\n]*))", std::regex::icase);
+                std::smatch match;
+                if (std::regex_search(headers, match, connection_regex))
+                {
+                    std::string value = match[1].str();
+                    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+                    if (value.find("close") != std::string::npos)
+                    {
+                        return false;
+                    }
+                    if (value.find("keep-alive") != std::string::npos)
+                    {
+                        return true;
+                    }
+                }
+                return http11;
+            }
+
+            // Connection::requestComplete, beginRequestBody and the start of handleRequest
+            void handle(const std::string &in)
+            {
+                size_t header_end = in.find("\r\n\r\n") + 4;
+                std::regex content_length_regex(R"(Content-Length: (\d+))");
+                std::smatch match;
+                std::string headers = in.substr(0, header_end);
+                size_t content_length = 0;
+                if (std::regex_search(headers, match, content_length_regex))
+                {
+                    content_length = std::stoul(match[1].str());
+                }
+                doNotOptimize(content_length);
+
+                auto [path, method_query] = parseRequest(headers);
+                std::string method = method_query.substr(0, method_query.find('?'));
+                std::string query = method_query.find('?') != std::string::npos ? method_query.substr(method_query.find('?')) : "";
+                if (method == "POST")
+                {
+                    std::regex boundary_regex(R"(Content-Type: multipart/form-data; boundary=([^\r\n]+))");
+                    std::regex expect_regex(R"(\r\nExpect:[ \t]*100-continue)", std::regex::icase);
+                    std::smatch boundary;
+                    doNotOptimize(std::regex_search(headers, boundary, boundary_regex));
+                    doNotOptimize(std::regex_search(headers, expect_regex));
+                }
+
+                std::string request = in.substr(0, header_end);
+                doNotOptimize(isKeepAlive(request));
+                if (path == "/__tree")
+                {
+                    doNotOptimize(getQueryParameter(query, "path"));
+                    doNotOptimize(getQueryParameter(query, "offset"));
+                    doNotOptimize(getQueryParameter(query, "limit"));
+                }
+                doNotOptimize(path);
+            }
+        }
+
+        // The same work through RequestParser. The decode buffers are reused, as a
+        // server thread would, so steady state allocates nothing.
+        struct Current
+        {
+            RequestParser parser;
+            HttpRequest request;
+            std::string path;
+            std::string value;
+
+            void handle(std::string_view in)
+            {
+                parser.reset();
+                if (parser.parse(in, request) != RequestParser::Result::Complete)
+                {
+                    std::abort();
+                }
+                doNotOptimize(request.content_length);
+                urlDecode(request.path, path);
+                if (request.method == "POST")
+                {
+                    doNotOptimize(multipartBoundary(request.header("Content-Type")));
+                    doNotOptimize(equalsIgnoreCase(request.header("Expect"), "100-continue"));
+                }
+                doNotOptimize(request.keepAlive());
+                if (path == "/__tree")
+                {
+                    doNotOptimize(queryParameter(request.query, "path", value));
+                    doNotOptimize(queryParameter(request.query, "offset", value));
+                    doNotOptimize(queryParameter(request.query, "limit", value));
+                }
+                doNotOptimize(path);
+            }
+        };
+
+        void compare(std::string_view name, const std::string &request)
+        {
+            run(std::string(name) + "/legacy", [&]
+                { legacy::handle(request); });
+            Current current;
+            run(std::string(name) + "/parser", [&]
+                { current.handle(request); });
+        }
+    }
+
+    void requestParserSuite()
+    {
+        compare("browser_get", BROWSER_GET);
+        compare("tree_get", TREE_GET);
+        compare("upload_post", UPLOAD_POST);
+
+        // The head arriving in small reads: each call resumes the terminator scan
+        RequestParser parser;
+        HttpRequest request;
+        run("browser_get/parser_16_byte_reads", [&]
+            {
+                parser.reset();
+                for (size_t length = 16; length < BROWSER_GET.length(); length += 16)
+                {
+                    doNotOptimize(parser.parse(std::string_view(BROWSER_GET).substr(0, length), request));
+                }
+                doNotOptimize(parser.parse(BROWSER_GET, request)); });
+    }
+
+}
@@ -0,0 +1,180 @@
+#include "arena.h"
+#include "bench.h"
+#include "http_server.h"
+#include "logger.h"
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace web_server::bench
+{
+
+    // Access to the private HttpServer handlers benchmarked below
+    struct ServerProbe
+    {
+        static std::string_view mimeType(HttpServer &server, std::string_view path)
+        {
+            return server.getMimeType(path);
+        }
+        static std::string directoryTree(HttpServer &server, const std::string &dir_path)
+        {
+            return server.generateDirectoryTree(dir_path, "/");
+        }
+        static std::string directoryListing(HttpServer &server, const std::string &dir_path)
+        {
+            return server.generateDirectoryListing(dir_path, "/");
+        }
+        static void sendResponse(HttpServer &server, Connection &conn, const std::string &content_type,
+                                 const std::string &content)
+        {
+            server.sendResponse(conn, "200 OK", content_type, content);
+        }
+        static void handleRequest(HttpServer &server, Connection &conn)
+        {
+            server.handleRequest(conn);
+        }
+    };
+
+    namespace
+    {
+        constexpr size_t TREE_FILES = 10000;
+        constexpr size_t TREE_DIRECTORIES = 500;
+
+        // A scratch web root with a directory of TREE_FILES files and
+        // TREE_DIRECTORIES subdirectories, removed again when the suite ends
+        class SyntheticTree
+        {
+        public:
+            SyntheticTree()
+            {
+                root_ = std::filesystem::temp_directory_path() / ("web_server_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+                big_ = root_ / "big";
+                std::filesystem::create_directories(big_);
+                for (size_t i = 0; i < TREE_FILES; ++i)
+                {
+                    std::ofstream(big_ / ("file_" + std::to_string(i * 7919 % TREE_FILES) + ".txt"));
+                }
+                for (size_t i = 0; i < TREE_DIRECTORIES; ++i)
+                {
+                    std::filesystem::create_directory(big_ / ("dir_" + std::to_string(i)));
+                }
+            }
+            ~SyntheticTree()
+            {
+                std::error_code ec;
+                std::filesystem::remove_all(root_, ec);
+            }
+
+            // A small page next to the big directory, for the request benchmarks
+            void addPage(const std::string &name, size_t size)
+            {
+                std::ofstream(root_ / name) << std::string(size, 'x');
+            }
+
+            std::string root() const { return root_.string(); }
+            // Canonical, as the server resolves listings beneath its canonical root
+            std::string big() const { return std::filesystem::canonical(big_).string(); }
+
+        private:
+            std::filesystem::path root_;
+            std::filesystem::path big_;
+        };
+    }
+
+    void serverSuite()
+    {
+        // Missing templates and similar start-up warnings are expected here
+        logging::current_level.store(LogLevel::Error);
+        logging::access_enabled.store(false);
+        SyntheticTree tree;
+        ServerOptions options;
+        options.compression = false;
+        HttpServer server(0, tree.root(), options);
+        ServerOptions full_page_options = options;
+        full_page_options.tree_page_size = TREE_FILES + TREE_DIRECTORIES;
+        HttpServer full_page_server(0, tree.root(), full_page_options);
+
+        const std::vector<std::string> paths = {"/index.html", "/images/Holiday.JPG", "/downloads/archive.tar.gz",
+                                                "/README", "/js/app.min.js", "/fonts/inter.woff2"};
+        size_t next = 0;
+        run("getMimeType", [&]
+            { doNotOptimize(ServerProbe::mimeType(server, paths[next++ % paths.size()])); });
+
+        run("generateDirectoryTree/10k_files_500_dirs/first_page", [&]
+            { doNotOptimize(ServerProbe::directoryTree(server, tree.big())); });
+        run("generateDirectoryTree/10k_files_500_dirs/everything", [&]
+            { doNotOptimize(ServerProbe::directoryTree(full_page_server, tree.big())); });
+        run("generateDirectoryListing/10k_files_500_dirs/first_page", [&]
+            { doNotOptimize(ServerProbe::directoryListing(server, tree.big())); });
+
+        // Output is drained as a transport would, returning buffers to the pool
+        auto drain = [](Connection &client)
+        {
+            while (!client.out.empty())
+            {
+                client.consumeOutput(client.out.front().remaining());
+            }
+        };
+
+        // Response framing into a connection's output queue; nothing is sent
+        Connection conn(-1);
+        std::string small(200, 'x');
+        std::string page(16 * 1024, 'x');
+        run("sendResponse/200_bytes", [&]
+            {
+                {
+                    ArenaScope arena_scope;
+                    ServerProbe::sendResponse(server, conn, "text/plain", small);
+                }
+                drain(conn); });
+        run("sendResponse/16k_html", [&]
+            {
+                {
+                    ArenaScope arena_scope;
+                    ServerProbe::sendResponse(server, conn, "text/html", page);
+                }
+                drain(conn); });
+
+        // One keep-alive request through parsing, routing and response framing. In
+        // steady state the connection buffers are reused, so this shows what each
+        // request still allocates.
+        tree.addPage("page.html", 2048);
+        tree.addPage("style.css", 16 * 1024);
+        auto serve = [&](HttpServer &target, Connection &client, const std::string &request)
+        {
+            client.in += request;
+            if (!client.requestComplete())
+            {
+                std::abort();
+            }
+            ServerProbe::handleRequest(target, client);
+            client.consumeRequest();
+            drain(client);
+        };
+        ServerOptions request_options = options;
+        request_options.max_keep_alive_requests = SIZE_MAX;
+        HttpServer request_server(0, tree.root(), request_options);
+        ServerOptions uncached_options = request_options;
+        uncached_options.cache_max_bytes = 0;
+        HttpServer uncached_server(0, tree.root(), uncached_options);
+        Connection client(-1);
+        const std::string page_request = "GET /page.html HTTP/1.1\r\nHost: localhost\r\nUser-Agent: bench\r\n\r\n";
+        const std::string revalidate_request = "GET /style.css HTTP/1.1\r\nHost: localhost\r\n"
+                                               "If-None-Match: \"nope\"\r\nRange: bytes=0-99\r\n\r\n";
+        const std::string missing_request = "GET /missing.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        run("request/static_get/file_cache", [&]
+            { serve(request_server, client, page_request); });
+        run("request/static_get/open_file_cache", [&]
+            { serve(uncached_server, client, page_request); });
+        run("request/static_get/range", [&]
+            { serve(uncached_server, client, revalidate_request); });
+        run("request/static_get/not_found", [&]
+            { serve(request_server, client, missing_request); });
+        logging::access_enabled.store(true);
+        logging::current_level.store(LogLevel::Info);
+    }
+
+}
@@ -0,0 +1,55 @@
+#ifndef WEB_SERVER_ARENA_H
+#define WEB_SERVER_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+
+namespace web_server
+{
+
+    // Bump allocator for scratch data that lives for one request: decoded and
+    // normalized paths, header blocks and the like are carved from a per-thread
+    // buffer and all released together once the response is queued, instead of
+    // each one going through the heap. Memory beyond the inline buffer comes
+    // from the heap and is returned on reset().
+    class RequestArena
+    {
+    public:
+        static constexpr size_t INLINE_SIZE = 16 * 1024;
+
+        // The arena of the calling thread
+        static RequestArena &local();
+
+        std::pmr::memory_resource *resource() { return &resource_; }
+
+        // Invalidates everything allocated from the arena since the last reset
+        void reset() { resource_.release(); }
+
+        RequestArena(const RequestArena &) = delete;
+        RequestArena &operator=(const RequestArena &) = delete;
+
+    private:
+        RequestArena() : resource_(buffer_, sizeof(buffer_)) {}
+
+        alignas(std::max_align_t) char buffer_[INLINE_SIZE];
+        std::pmr::monotonic_buffer_resource resource_;
+    };
+
+    // A string allocated from a RequestArena; it must not outlive the request
+    using ArenaString = std::pmr::string;
+
+    // Resets the calling thread's arena when the request handling scope ends
+    class ArenaScope
+    {
+    public:
+        ArenaScope() = default;
+        ~ArenaScope() { RequestArena::local().reset(); }
+
+        ArenaScope(const ArenaScope &) = delete;
+        ArenaScope &operator=(const ArenaScope &) = delete;
+    };
+
+}
+
+#endif
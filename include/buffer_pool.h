@@ -0,0 +1,27 @@
+#ifndef WEB_SERVER_BUFFER_POOL_H
+#define WEB_SERVER_BUFFER_POOL_H
+
+#include <cstddef>
+#include <string>
+
+namespace web_server::buffers
+{
+
+    // Per-thread free list of byte buffers for connection input and queued
+    // output. A buffer handed back keeps its capacity, so a steady stream of
+    // requests and responses stops reaching the heap once the pool is warm.
+    // Threads never share a pool; a buffer released on another thread than the
+    // one that acquired it simply moves to that thread's pool.
+
+    constexpr size_t MAX_POOLED_BUFFERS = 64;          // Per thread; further buffers are freed
+    constexpr size_t MAX_POOLED_CAPACITY = 256 * 1024; // Larger buffers are freed rather than kept
+
+    // An empty string, with the capacity of a previously released buffer if one is free
+    std::string acquire();
+
+    // Takes the storage of `buffer` back into the pool and leaves it empty.
+    void release(std::string &buffer);
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef WEB_SERVER_BYTE_RANGE_H
+#define WEB_SERVER_BYTE_RANGE_H
+
+#include "http_cache.h"
+#include "request_parser.h"
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace web_server
+{
+
+    struct ByteRange
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    enum class RangeSelection
+    {
+        Full,         // Send the whole representation with 200
+        Partial,      // Send the selected ranges with 206
+        Unsatisfiable // Send 416 with "Content-Range: bytes */size"
+    };
+
+    // Polymorphic so request handlers can place the list in their RequestArena
+    using ByteRanges = std::pmr::vector<ByteRange>;
+
+    // Requests with more ranges than this, after coalescing, get the whole file
+    constexpr size_t MAX_BYTE_RANGES = 16;
+
+    // Parses a "bytes=" Range header value for a representation of `size` bytes
+    // into sorted, coalesced ranges (RFC 9110 14.2). Unsupported units and
+    // malformed values select the whole representation.
+    RangeSelection parseRange(std::string_view value, uint64_t size, ByteRanges &ranges);
+
+    // Evaluates Range together with If-Range: a Range is only honored if If-Range
+    // is absent or matches the current validators.
+    RangeSelection selectRanges(const HttpRequest &request, uint64_t size, const FileValidators &validators,
+                                ByteRanges &ranges);
+
+}
+
+#endif
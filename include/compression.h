@@ -0,0 +1,112 @@
+#ifndef WEB_SERVER_COMPRESSION_H
+#define WEB_SERVER_COMPRESSION_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace web_server
+{
+
+    enum class ContentEncoding
+    {
+        Identity,
+        Gzip,
+        Brotli
+    };
+
+    enum class CompressionLevel
+    {
+        Fast, // Responses generated per request
+        Best  // Static files, compressed once and cached
+    };
+
+    // Encodings in server preference order
+    constexpr ContentEncoding PREFERRED_ENCODINGS[] = {ContentEncoding::Brotli, ContentEncoding::Gzip};
+
+    // Content-Encoding token ("gzip", "br") and sidecar file extension (".gz", ".br")
+    const char *encodingToken(ContentEncoding encoding);
+    const char *sidecarExtension(ContentEncoding encoding);
+
+    // True if this build can produce `encoding` on the fly.
+    bool compressionSupported(ContentEncoding encoding);
+
+    // True if an Accept-Encoding value allows `encoding` (q > 0, directly or via "*").
+    bool acceptsEncoding(std::string_view accept_encoding, ContentEncoding encoding);
+
+    // Text-like types worth compressing; images and archives are already compressed.
+    bool isCompressible(std::string_view content_type);
+
+    // Compresses `input` into `output`. Returns false if the encoding is unsupported
+    // or the compressor failed.
+    bool compress(ContentEncoding encoding, CompressionLevel level, std::string_view input, std::string &output);
+
+    // Compresses a body that is produced piece by piece. Every piece is flushed
+    // to a byte boundary, so the client can decode it before the next one exists.
+    class StreamCompressor
+    {
+    public:
+        // Null if the encoding is unsupported or the compressor could not be set up
+        static std::unique_ptr<StreamCompressor> create(ContentEncoding encoding, CompressionLevel level);
+        virtual ~StreamCompressor() = default;
+
+        // Appends the compressed form of `input` to `output`; `last` ends the stream.
+        virtual bool write(std::string_view input, bool last, std::string &output) = 0;
+    };
+
+    // Size-bounded LRU of compressed static files. Keys include the file's
+    // validators, so a modified file can never be answered from a stale entry.
+    class CompressionCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            size_t entries;
+            size_t bytes;
+        };
+
+        explicit CompressionCache(size_t max_bytes);
+
+        CompressionCache(const CompressionCache &) = delete;
+        CompressionCache &operator=(const CompressionCache &) = delete;
+
+        std::shared_ptr<const std::string> lookup(const std::string &key);
+        void insert(const std::string &key, std::shared_ptr<const std::string> value);
+        // Claims `key` for a caller about to produce its value; false while
+        // another caller holds the claim. insert() or release() gives it up.
+        bool claim(const std::string &key);
+        void release(const std::string &key);
+        void invalidatePrefix(const std::string &prefix);
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            std::shared_ptr<const std::string> value;
+        };
+
+        size_t max_bytes_;
+        mutable std::mutex mutex_;
+        std::list<Entry> lru_; // Most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+        std::unordered_set<std::string> claimed_;
+        size_t bytes_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+        uint64_t evictions_ = 0;
+
+        void eraseLocked(std::list<Entry>::iterator it);
+    };
+
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef WEB_SERVER_CONNECTION_H
+#define WEB_SERVER_CONNECTION_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include "request_parser.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using socket_t = SOCKET;
+#define CLOSE_SOCKET closesocket
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <unistd.h>
+using socket_t = int;
+#define CLOSE_SOCKET close
+#endif
+
+namespace web_server
+{
+
+    // A piece of queued response output: either bytes held in memory or a range of
+    // an open file that is streamed to the socket without copying it into user space.
+    // Memory is a buffer owned by the segment, into which small pieces such as
+    // headers are coalesced, or a view of an immutable buffer kept alive by
+    // `owner`, so that cached bodies are sent without being copied to frame them.
+    struct OutputSegment
+    {
+        std::string data;
+        std::string_view shared; // Sent instead of `data` when set
+        int file_fd = -1;        // Closed once the range has been sent, unless owner is set
+        // Keeps `shared`, or a descriptor shared with other responses (see
+        // OpenFileCache), alive until the segment has been sent
+        std::shared_ptr<const void> owner;
+        off_t file_offset = 0;
+        size_t file_remaining = 0;
+        size_t data_offset = 0; // Into bytes()
+        // Set while an asynchronous send points into `data`; later writes then
+        // start a new segment instead of reallocating it
+        bool sealed = false;
+        bool zerocopy = false; // Send `shared` with MSG_ZEROCOPY where the transport supports it
+
+        bool isFile() const { return file_fd != -1; }
+        std::string_view bytes() const { return shared.data() ? shared : std::string_view(data); }
+        size_t remaining() const { return isFile() ? file_remaining : bytes().length() - data_offset; }
+    };
+
+    // Receives a request body as it arrives instead of having it buffered in
+    // `Connection::in`.
+    class BodySink
+    {
+    public:
+        virtual ~BodySink() = default;
+        // Consumes a prefix of `data` and returns its length. Unconsumed bytes are
+        // offered again with more appended; `last` means no more body follows.
+        virtual size_t write(std::string_view data, bool last) = 0;
+        // True while the sink cannot take more data yet, or after the last write
+        // until it has finished with the body. An event loop stops reading the
+        // connection meanwhile and waits for `wake`.
+        virtual bool busy() { return false; }
+
+        // Set from Connection::wake before the first write; called from any
+        // thread once busy() may have turned false. Unset in threads mode, where
+        // a sink blocks the receiving thread instead.
+        std::function<void()> wake;
+    };
+
+    // Produces a response body piece by piece while the connection drains, for
+    // generated pages that should not be rendered in memory before they are sent.
+    class BodySource
+    {
+    public:
+        enum class Result
+        {
+            More,  // Further pieces follow; a piece was appended
+            Done,  // The body is complete
+            Failed // The body cannot be finished; the connection is closed
+        };
+
+        virtual ~BodySource() = default;
+        // Appends the next piece of the body to `out`.
+        virtual Result produce(std::string &out) = 0;
+    };
+
+    struct Connection;
+
+    // Takes over a connection after it switched protocols (HTTP/2). The session
+    // consumes `Connection::in` itself and queues its own output; requests are
+    // no longer framed or handed to the transport's request handler.
+    class ProtocolSession
+    {
+    public:
+        virtual ~ProtocolSession() = default;
+        // Processes the bytes received into `conn.in` and queues what can be sent.
+        virtual void receive(Connection &conn) = 0;
+        // Called as queued output drains; queues more while there is room.
+        virtual void drain(Connection &conn) = 0;
+    };
+
+    // Deadlines and size caps that keep slow or oversized requests from tying up
+    // a connection. A request body or a response may not stall for longer than
+    // its timeout, and gets the timeout plus one second for every `min_rate`
+    // bytes transferred in total, so a client trickling a byte at a time is cut
+    // off while a large transfer at a sane speed is not.
+    struct ConnectionLimits
+    {
+        std::chrono::milliseconds idle_timeout{5000};    // Between requests on a persistent connection
+        std::chrono::milliseconds header_timeout{10000}; // For a whole request head, from its first byte
+        std::chrono::milliseconds body_timeout{10000};
+        std::chrono::milliseconds send_timeout{10000};
+        size_t min_rate = 1024; // Bytes per second; 0 only limits the gap between reads or writes
+        size_t max_header_size = RequestParser::DEFAULT_MAX_HEADER_SIZE;
+        size_t max_body_size = size_t(1) << 30; // Declared Content-Length, checked before the body is read
+
+        static const ConnectionLimits &defaults();
+    };
+
+    // Per-connection state shared by the threaded and the event-driven I/O modes.
+    // Bytes are read into `in` until a full request is framed, the handler queues
+    // the response in `out`, and the transport flushes it back to the client.
+    // Persistent connections consume one request at a time from the front of `in`,
+    // so pipelined requests that arrived in the same read are served in order.
+    struct Connection
+    {
+        enum class State
+        {
+            ReadingRequest,
+            WritingResponse,
+            Closed
+        };
+
+        enum class FlushResult
+        {
+            Complete,
+            WouldBlock,
+            Failed
+        };
+
+        explicit Connection(socket_t socket, const ConnectionLimits &limits = ConnectionLimits::defaults());
+        ~Connection();
+
+        // A connection without a socket that carries one multiplexed stream. The
+        // session feeds the request into `in` and takes the response from `out`
+        // with takeOutput(); streamed bodies are not chunked, and nothing is
+        // counted in the connection metrics.
+        static std::unique_ptr<Connection> forStream(const ConnectionLimits &limits);
+
+        Connection(const Connection &) = delete;
+        Connection &operator=(const Connection &) = delete;
+
+        socket_t socket;
+        State state = State::ReadingRequest;
+        std::string in;
+        std::deque<OutputSegment> out;
+        size_t header_end = std::string::npos; // Offset just past "\r\n\r\n"
+        size_t content_length = 0;
+        // The parsed head of the current request. Its views point into `in` and
+        // stay valid until the request is consumed.
+        HttpRequest request;
+        // Status line for a request that could not be parsed. The whole buffer is
+        // then framed as that request, and the handler answers it and closes.
+        const char *parse_error = nullptr;
+        // When the current request's head became complete, and the status the
+        // handler answered it with; both feed the request metrics
+        std::chrono::steady_clock::time_point request_started;
+        int response_status = 0;
+        size_t requests_served = 0;
+        bool close_after_write = false; // Set by the handler when the response ends the connection
+        bool read_paused = false;       // Input is not drained while earlier output is pending
+        std::chrono::steady_clock::time_point last_activity = std::chrono::steady_clock::now();
+        TimerWheel::Timer timer; // For event loops that track deadline() on a TimerWheel
+        // Called once per request when its headers are complete. It may install a
+        // body_sink to stream the body; otherwise the body is buffered in `in`.
+        std::function<void(Connection &)> on_headers;
+        std::unique_ptr<BodySink> body_sink;
+        // Set by event loops: hands the connection back to its loop from another
+        // thread, which then calls requestComplete() again. Unset in threads mode.
+        std::function<void()> wake;
+
+        // Appends bytes read from the socket to `in`.
+        void receive(const char *data, size_t length);
+
+        // The deadline that applies to the connection's current phase, and in
+        // `when` the time it passes. Changes as bytes are received and sent.
+        metrics::Deadline deadline(std::chrono::steady_clock::time_point &when) const;
+
+        // Returns true once `in` holds the complete header block and the body has
+        // been buffered or fully passed to `body_sink`. Always false once the
+        // connection was upgraded; the session is given the input instead.
+        bool requestComplete();
+        size_t requestLength() const { return header_end + (body_sink ? 0 : content_length); }
+
+        // Drops the current request from `in` and resets framing for the next one.
+        void consumeRequest();
+        size_t pendingOutput() const { return pending_output_; }
+
+        // Buffers at most this large are copied into the output queue; larger ones
+        // are queued as segments of their own
+        static constexpr size_t COPY_LIMIT = 4096;
+
+        // Queues response bytes behind any output already pending. Small writes are
+        // coalesced so headers and a small body go out in one piece.
+        void write(std::string_view data);
+        // Like write(), but a large `buffer` is moved into the queue instead of copied.
+        void writeBuffer(std::string &&buffer);
+        // Queues `data` without copying it; `owner` keeps it alive and unchanged
+        // until it has been sent. With `zerocopy`, the kernel sends straight from
+        // it as well (MSG_ZEROCOPY), which pays off for large buffers only.
+        void writeShared(std::string_view data, std::shared_ptr<const void> owner, bool zerocopy = false);
+        // Queues `length` bytes of `file_fd` starting at `offset`. Takes ownership of
+        // the fd, or, when `owner` is given, holds on to it until the range is sent.
+        void writeFile(int file_fd, off_t offset, size_t length, std::shared_ptr<const void> owner = nullptr);
+
+        // Further pieces of a streamed body are produced only while less than this
+        // is pending, so a slow reader holds back the producer instead of the
+        // queue growing without bound
+        static constexpr size_t STREAM_WATERMARK = 32 * 1024;
+
+        // Queues the body produced by `source` with chunked transfer coding behind
+        // the headers already queued. The first piece is produced at once so it
+        // goes out with the headers; the rest as the output drains.
+        void writeStream(std::unique_ptr<BodySource> source);
+        // True while a streamed body is unfinished; no further request is served until it is
+        bool streaming() const { return body_source_ != nullptr; }
+        // True if a streamed body could not be finished
+        bool streamFailed() const { return stream_failed_; }
+
+        // Hands the connection to `session`, from the next requestComplete() on
+        // or at once when installed by `on_headers`.
+        void upgrade(std::unique_ptr<ProtocolSession> session) { session_ = std::move(session); }
+        bool upgraded() const { return session_ != nullptr; }
+
+        // Writes as much of `out` as the socket accepts, gathering consecutive
+        // in-memory segments into one sendmsg() and looping over partial writes.
+        FlushResult flush();
+#ifndef _WIN32
+        // Describes up to `max` in-memory segments at the front of `out` for a
+        // gathered send and seals them, stopping early at a zerocopy segment if
+        // `zerocopy_apart` is set. `more` is set when output follows them.
+        size_t gatherOutput(iovec *iov, size_t max, bool zerocopy_apart, bool &more);
+#endif
+        // For transports that send `out` themselves (io_uring): records that the
+        // first `bytes` of the queued output reached the socket.
+        void consumeOutput(size_t bytes);
+        // Drops the first `bytes` of the queued output without sending them.
+        void skipOutput(size_t bytes);
+        // Moves up to `max` bytes from the front of the queued output to the back
+        // of `to`'s, sharing buffers and files instead of copying where it can,
+        // and returns how many were moved.
+        size_t takeOutput(Connection &to, size_t max);
+        // Handles EPOLLERR: collects zerocopy completions from the socket's error
+        // queue and returns true if the socket itself has failed.
+        bool checkSocketError();
+        // Closes the socket. While MSG_ZEROCOPY sends are still in flight the kernel
+        // may read their buffers, so the socket is shut down instead and handed to
+        // a reaper thread, which keeps it and the buffers until the completions
+        // arrive on its error queue.
+        void closeSocket();
+
+    private:
+        struct StreamTag
+        {
+        };
+        Connection(StreamTag, const ConnectionLimits &limits);
+
+        const ConnectionLimits &limits_;
+        RequestParser parser_;
+        const char *parsed_data_ = nullptr; // in.data() when `request` was parsed
+        std::chrono::steady_clock::duration parse_time_{};
+        size_t pending_output_ = 0;
+        std::chrono::steady_clock::time_point output_started_; // When `out` last went from empty to pending
+        size_t output_sent_ = 0;                               // Bytes sent since then
+        // First byte of the current request head, or the accept for the first request
+        std::chrono::steady_clock::time_point request_begun_ = std::chrono::steady_clock::now();
+        size_t body_streamed_ = 0;
+        bool body_written_ = false;  // The last body bytes were passed to body_sink
+        bool body_finished_ = false; // ... and it is no longer busy
+        std::unique_ptr<BodySource> body_source_;
+        bool stream_failed_ = false;
+        bool stream_ = false; // Created by forStream()
+        std::unique_ptr<ProtocolSession> session_;
+
+        // MSG_ZEROCOPY sends are numbered by the kernel; the buffers of each stay
+        // referenced until its completion is read from the error queue
+        enum class ZeroCopy
+        {
+            Untried,
+            Enabled,
+            Disabled
+        };
+        struct ZeroCopySend
+        {
+            uint32_t sequence;
+            std::shared_ptr<const void> owner;
+        };
+        ZeroCopy zerocopy_ = ZeroCopy::Untried;
+        uint32_t zerocopy_sequence_ = 0;
+        std::vector<ZeroCopySend> zerocopy_pending_;
+        class ZeroCopyReaper;
+
+        bool streamBody();
+        // Queues pieces of the streamed body, framed as chunks, up to the watermark
+        void pullBody(bool once);
+        FlushResult flushFile(OutputSegment &segment);
+        bool enableZeroCopy();
+        void reapZeroCopy();
+        // Drops the sends of `pending` whose completions wait on the error queue of
+        // `socket`; true if the kernel reported that it copied the data anyway
+        static bool reapCompletions(socket_t socket, std::vector<ZeroCopySend> &pending);
+        // Notes the start of a send when output is queued behind an empty queue
+        void beginOutput();
+        // Drops the fully sent front segment, returning its buffer to the pool
+        void popSegment();
+    };
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef WEB_SERVER_EVENT_LOOP_H
+#define WEB_SERVER_EVENT_LOOP_H
+
+#include "connection.h"
+#include "timer_wheel.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace web_server
+{
+
+    // Edge-triggered epoll reactor. A single thread accepts connections, reads
+    // requests into per-connection buffers and flushes responses, so idle or slow
+    // clients cost a Connection object instead of an OS thread. Linux only.
+    class EventLoop
+    {
+    public:
+        // Called once a full request is buffered in `Connection::in`; the handler
+        // appends the response to `Connection::out`.
+        using RequestHandler = std::function<void(Connection &)>;
+
+        // `headers_handler` runs as soon as a request's headers are buffered and may
+        // install a body sink (see Connection::on_headers). Connections are closed
+        // when the deadline for their current phase passes (see ConnectionLimits);
+        // `limits` must outlive the loop.
+        EventLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                  const ConnectionLimits &limits);
+        ~EventLoop();
+        void run();
+
+    private:
+        socket_t listen_socket_;
+        int epoll_fd_;
+        RequestHandler handler_;
+        RequestHandler headers_handler_;
+        const ConnectionLimits &limits_;
+        TimerWheel timers_; // Declared before the connections, whose timers it holds
+        std::unordered_map<socket_t, std::unique_ptr<Connection>> connections_;
+        // Connection::wake: other threads queue the socket and signal the eventfd
+        int wake_fd_;
+        std::mutex woken_mutex_;
+        std::vector<socket_t> woken_;
+
+        void acceptConnections();
+        void onReadable(Connection &conn);
+        void onWritable(Connection &conn);
+        void onWake();
+        void processRequests(Connection &conn);
+        void scheduleDeadline(Connection &conn);
+        void onDeadline(TimerWheel::Timer &timer);
+        void closeConnection(Connection &conn);
+    };
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef WEB_SERVER_FILE_CACHE_H
+#define WEB_SERVER_FILE_CACHE_H
+
+#include "http_cache.h"
+#include "open_file_cache.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace web_server
+{
+
+    // A cached file body together with its pre-built entity headers
+    // ("Content-Type", "Content-Length", "Accept-Ranges", "ETag" and "Last-Modified"),
+    // so a hit only has to add the status line and connection headers.
+    struct CachedFile
+    {
+        std::string headers;
+        std::string body;
+        std::string content_type;
+        FileValidators validators;
+    };
+
+    // Size-bounded LRU cache of small, frequently requested files keyed by
+    // canonical path. The cache is split into independently locked shards so
+    // concurrent hits never contend on a single lock. Entries are dropped through
+    // invalidate() when a FileWatcher reports that the underlying files changed.
+    class FileCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            uint64_t invalidations;
+            size_t entries;
+            size_t bytes;
+        };
+
+        // `max_bytes` bounds the total cached size; files larger than
+        // `max_file_size` are never cached.
+        FileCache(size_t max_bytes, size_t max_file_size);
+
+        FileCache(const FileCache &) = delete;
+        FileCache &operator=(const FileCache &) = delete;
+
+        // Returns the cached file, loading it from `file` (already opened from
+        // `path`) on a miss. Returns nullptr if the file cannot be read or is too
+        // large to cache.
+        std::shared_ptr<const CachedFile> lookup(std::string_view path, const OpenFile &file,
+                                                 std::string_view content_type);
+
+        void invalidate(const std::string &path);
+        void invalidatePrefix(const std::string &prefix);
+        void clear();
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::string path;
+            std::shared_ptr<const CachedFile> file;
+            size_t size;
+        };
+
+        struct Shard
+        {
+            mutable std::mutex mutex;
+            std::list<Entry> lru; // Most recently used at the front
+            std::unordered_map<std::string, std::list<Entry>::iterator, PathHash, std::equal_to<>> index;
+            size_t bytes = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            uint64_t invalidations = 0;
+        };
+
+        static constexpr size_t SHARD_COUNT = 16;
+
+        size_t max_file_size_;
+        size_t shard_capacity_;
+        Shard shards_[SHARD_COUNT];
+        // Bumped on every invalidation; a load that raced with one is not inserted
+        std::atomic<uint64_t> epoch_{0};
+
+        Shard &shardFor(std::string_view path);
+        void insert(Shard &shard, std::string_view path, std::shared_ptr<const CachedFile> file);
+        void eraseLocked(Shard &shard, std::list<Entry>::iterator it);
+    };
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef WEB_SERVER_FILE_INDEX_H
+#define WEB_SERVER_FILE_INDEX_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace web_server
+{
+
+    // In-memory index of the file and directory names below the web root, for
+    // searching by name without touching the disk. Names are kept once each in
+    // a sorted arena, ASCII case folded alongside, with a link to the entry of
+    // their directory in place of a full path. A prefix query is then a binary
+    // search and a substring query one scan over the folded arena.
+    //
+    // The tree is walked by a background thread after start(), which also
+    // applies the changes reported with added() and removed(): they go into a
+    // small sorted set of additions and a set of removed entries that queries
+    // consult alongside the arena, and are merged into a new arena once they
+    // grow. Queries read an immutable snapshot and never wait for the thread.
+    class FileIndex
+    {
+    public:
+        enum class Match
+        {
+            Prefix,   // Names starting with the query
+            Substring // Names containing the query
+        };
+
+        struct Result
+        {
+            std::string path; // Relative to the root, starting with '/'
+            bool is_directory;
+        };
+
+        struct Stats
+        {
+            size_t entries;
+            size_t bytes;
+            bool ready;
+        };
+
+        static constexpr size_t MAX_QUERY_LENGTH = 255; // NAME_MAX
+
+        // `root` must be canonical. Paths below it listed in `excluded`
+        // ("/templates") are left out along with everything beneath them.
+        FileIndex(const std::string &root, std::vector<std::string> excluded);
+        ~FileIndex();
+
+        FileIndex(const FileIndex &) = delete;
+        FileIndex &operator=(const FileIndex &) = delete;
+
+        // Starts the thread that walks the tree and keeps the index current
+        void start();
+
+        // Report changes below the root by absolute path, as FileWatcher does.
+        // They are applied by the index thread, usually within a millisecond;
+        // an added directory is walked for the entries already inside it.
+        void added(const std::string &path, bool is_directory);
+        void removed(const std::string &path);
+        // Walks the whole tree again, when changes may have been missed
+        void rebuild();
+
+        // False until the first walk has finished; queries find nothing before
+        bool ready() const;
+
+        // Case-insensitive (ASCII) match of `query` against the names. Appends
+        // up to `limit` matches in name order and returns how many there are.
+        size_t search(std::string_view query, Match match, size_t limit, std::vector<Result> &results) const;
+        Stats stats() const;
+
+    private:
+        struct Entry;
+        struct Table;
+        struct Snapshot;
+        class Builder;
+
+        struct Change
+        {
+            enum class Type
+            {
+                Added,
+                Removed,
+                Rebuild
+            };
+
+            Type type;
+            std::string path;
+            bool is_directory;
+        };
+
+        // Changes queued beyond this are replaced by a rebuild
+        static constexpr size_t MAX_PENDING_CHANGES = 65536;
+
+        std::string root_;
+        std::vector<std::string> excluded_;
+        std::atomic<std::shared_ptr<const Snapshot>> snapshot_;
+        std::unique_ptr<Snapshot> working_; // Owned by the index thread once started
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::vector<Change> pending_;
+        std::atomic<bool> stopping_{false};
+        std::thread thread_;
+
+        void enqueue(Change change);
+        void run();
+        // Whether `relative` is left out of the index
+        bool excluded(std::string_view relative) const;
+        // A new arena for the tree on disk; null if the index is stopping
+        std::shared_ptr<const Table> walk();
+        void apply(const Change &change);
+        void insert(const std::string &relative, bool is_directory);
+        void erase(const std::string &relative);
+        // Merges the additions and removals into a new arena
+        void compact();
+    };
+
+}
+
+#endif
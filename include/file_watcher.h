@@ -0,0 +1,60 @@
+#ifndef WEB_SERVER_FILE_WATCHER_H
+#define WEB_SERVER_FILE_WATCHER_H
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace web_server
+{
+
+    // Recursively watches a directory tree with inotify and reports changes to
+    // registered listeners from a background thread. Listeners must be added
+    // before start(). On platforms without inotify start() returns false.
+    class FileWatcher
+    {
+    public:
+        struct Event
+        {
+            enum class Type
+            {
+                Created,
+                Modified,
+                Removed,
+                Overflow // Events were dropped; listeners should assume anything changed
+            };
+
+            Type type;
+            std::string path; // Absolute path below the canonical root
+            bool is_directory;
+        };
+
+        using Listener = std::function<void(const Event &)>;
+
+        explicit FileWatcher(const std::string &root);
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher &) = delete;
+        FileWatcher &operator=(const FileWatcher &) = delete;
+
+        void addListener(Listener listener);
+        bool start();
+
+    private:
+        std::string root_;
+        std::vector<Listener> listeners_;
+        int inotify_fd_ = -1;
+        int stop_fd_ = -1;
+        std::unordered_map<int, std::string> watch_paths_; // Owned by the watcher thread once started
+        std::thread thread_;
+
+        void addWatches(const std::string &dir);
+        void notify(const Event &event);
+        void run();
+    };
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef WEB_SERVER_HPACK_H
+#define WEB_SERVER_HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace web_server
+{
+
+    struct HeaderField
+    {
+        std::string name;
+        std::string value;
+    };
+
+    // The index space of one direction of an HTTP/2 connection (RFC 7541 2.3):
+    // the 61 static entries followed by a dynamic FIFO of recently added fields,
+    // bounded by the summed size of its entries.
+    class HpackTable
+    {
+    public:
+        static constexpr size_t DEFAULT_SIZE = 4096;
+        static constexpr size_t STATIC_ENTRIES = 61;
+        static constexpr size_t ENTRY_OVERHEAD = 32;
+
+        // 1-based over the static then the dynamic entries; null when out of range
+        const HeaderField *at(size_t index) const;
+        void add(std::string_view name, std::string_view value);
+        void resize(size_t max_size);
+        size_t maxSize() const { return max_size_; }
+        // Index of an entry with this name and value (`exact` set), or else of
+        // one with this name; 0 if there is neither
+        size_t find(std::string_view name, std::string_view value, bool &exact) const;
+
+    private:
+        std::deque<HeaderField> entries_; // Newest first
+        size_t size_ = 0;
+        size_t max_size_ = DEFAULT_SIZE;
+
+        void evict(size_t limit);
+    };
+
+    // Decodes the header blocks a peer sends. Every block must be decoded in
+    // order, even for streams that are refused, to keep the table in step.
+    class HpackDecoder
+    {
+    public:
+        // `max_table_size` is the SETTINGS_HEADER_TABLE_SIZE advertised to the peer
+        explicit HpackDecoder(size_t max_table_size = HpackTable::DEFAULT_SIZE);
+
+        // Decodes a complete block into `fields`. Returns false on a malformed
+        // block or once the fields exceed `max_list_size` (name and value plus 32
+        // bytes each, as in SETTINGS_MAX_HEADER_LIST_SIZE); either is fatal to
+        // the connection, since the table may no longer match the peer's.
+        bool decode(std::string_view block, std::vector<HeaderField> &fields, size_t max_list_size);
+
+    private:
+        HpackTable table_;
+        size_t max_table_size_;
+    };
+
+    // Encodes response header blocks. Names and values are Huffman coded when
+    // that is shorter, and fields that repeat across responses (content types,
+    // cache policies) enter the table so later responses send them as one byte.
+    class HpackEncoder
+    {
+    public:
+        // Applies the peer's SETTINGS_HEADER_TABLE_SIZE; the table shrinks at
+        // once and the change is signalled at the start of the next block.
+        void setMaxTableSize(size_t size);
+
+        // Starts a header block in `out`.
+        void begin(std::string &out);
+        // Appends one field. Fields that differ with every response (`indexed`
+        // false) are sent as literals without displacing useful entries.
+        void encode(std::string_view name, std::string_view value, std::string &out, bool indexed = true);
+
+    private:
+        HpackTable table_;
+        size_t limit_ = HpackTable::DEFAULT_SIZE; // The peer's latest setting
+        size_t lowest_ = HpackTable::DEFAULT_SIZE; // Smallest setting since the last block
+        bool resized_ = false;
+    };
+
+    // Huffman code of RFC 7541 Appendix B; exposed for the benchmarks
+    bool huffmanDecode(std::string_view input, std::string &out);
+    void huffmanEncode(std::string_view input, std::string &out);
+    size_t huffmanLength(std::string_view input);
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef WEB_SERVER_HTTP2_SESSION_H
+#define WEB_SERVER_HTTP2_SESSION_H
+
+#include "connection.h"
+#include "hpack.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace web_server
+{
+
+    // HTTP/2 over cleartext TCP (h2c, RFC 9113) on a connection that began with
+    // the connection preface or was upgraded from HTTP/1.1. Every stream gets a
+    // socketless Connection: its request is rewritten as an HTTP/1.1 head and
+    // served by the ordinary handlers, and the HTTP/1.1 response they queue is
+    // translated back into HEADERS and DATA frames. Streams are served
+    // concurrently, within the peer's flow-control windows, and the bandwidth
+    // of the connection is shared by weighted fair queuing over the stream
+    // dependency tree the client builds with its priority information.
+    class Http2Session : public ProtocolSession
+    {
+    public:
+        using Handler = std::function<void(Connection &)>;
+
+        static constexpr size_t MAX_FRAME_SIZE = 16384;            // Largest frame payload accepted
+        static constexpr size_t MAX_CONCURRENT_STREAMS = 100;      // More are refused
+        static constexpr uint32_t STREAM_WINDOW = 1024 * 1024;     // Request body in flight per stream
+        static constexpr uint32_t CONNECTION_WINDOW = 16 * 1024 * 1024;
+        static constexpr size_t MAX_PRIORITY_NODES = 256;          // Idle streams kept for their priority
+        // Frames are queued while less than this is pending, so a fair share is
+        // decided per piece instead of for everything the streams have ready
+        static constexpr size_t OUTPUT_WATERMARK = 64 * 1024;
+
+        // `on_headers` and `handler` serve the requests of the streams, as the
+        // transports do for HTTP/1.1; `limits` must outlive the session. The
+        // session starts after "PRI * HTTP/2.0\r\n\r\n", the part of the client
+        // preface that parses as a request head.
+        Http2Session(const ConnectionLimits &limits, Handler on_headers, Handler handler);
+        ~Http2Session() override;
+
+        // For a request with "Upgrade: h2c", which becomes stream 1 and is
+        // answered once the switch is complete. Null if its HTTP2-Settings
+        // header is malformed, in which case the request is served as HTTP/1.1.
+        static std::unique_ptr<Http2Session> fromUpgrade(const Connection &conn, const ConnectionLimits &limits,
+                                                         Handler on_headers, Handler handler);
+
+        void receive(Connection &conn) override;
+        void drain(Connection &conn) override;
+
+    private:
+        struct Stream;
+        struct PriorityNode
+        {
+            uint32_t parent = 0;
+            uint16_t weight = 16;
+            uint64_t cycle = 0;      // Virtual time; the child with the smallest is served next
+            uint64_t last_cycle = 0; // Of the child served last, where new children start
+            std::vector<uint32_t> children;
+        };
+
+        const ConnectionLimits &limits_;
+        Handler on_headers_;
+        Handler handler_;
+        // The connection's Connection::wake, passed on to the streams so a busy
+        // body sink brings the session back to serve and replenish them
+        std::function<void()> wake_;
+        HpackDecoder decoder_;
+        HpackEncoder encoder_;
+        std::string preface_; // Rest of the client preface still expected
+        bool settings_sent_ = false;
+        bool settings_received_ = false;
+        bool closing_ = false;    // A GOAWAY was sent; input is ignored
+        bool peer_closing_ = false; // The client sent GOAWAY; no new streams
+        uint32_t last_stream_id_ = 0;
+        std::map<uint32_t, std::unique_ptr<Stream>> streams_; // Open streams in id order
+        std::unordered_map<uint32_t, PriorityNode> priority_; // Keyed by stream id, 0 is the root
+        // Header block being assembled from HEADERS and CONTINUATION frames
+        std::string header_block_;
+        uint32_t header_stream_ = 0;
+        bool header_end_stream_ = false;
+        std::vector<HeaderField> fields_;
+        // Flow control: what the peer may send us, and what we may send it
+        int64_t receive_window_ = CONNECTION_WINDOW;
+        int64_t send_window_ = 65535;
+        int64_t initial_send_window_ = 65535;
+        size_t peer_max_frame_size_ = 16384;
+
+        bool processFrame(Connection &conn, uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+        bool onHeaders(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload);
+        bool onHeaderBlock(Connection &conn);
+        bool onData(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload);
+        bool onSettings(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload);
+        bool onWindowUpdate(Connection &conn, uint32_t stream_id, std::string_view payload);
+        // Applies a SETTINGS payload from the client; false and `error` if it is invalid
+        bool applySettings(std::string_view payload, uint32_t &error);
+        // Sends GOAWAY with `error`; the connection closes once it is written
+        bool connectionError(Connection &conn, uint32_t error);
+        void resetStream(Connection &conn, uint32_t stream_id, uint32_t error);
+
+        Stream &openStream(uint32_t stream_id);
+        void closeStream(uint32_t stream_id);
+        // Builds the HTTP/1.1 request head of a stream from its decoded fields;
+        // false if they do not form a valid request
+        bool buildRequest(Stream &stream);
+        // Hands the head, and any body collected so far, to the stream's connection
+        void startRequest(Stream &stream);
+        void receiveBody(Connection &conn, Stream &stream, std::string_view data, bool end_stream);
+        // Opens the stream's receive window again once half of it is used and the
+        // body received so far has mostly been taken by the handler
+        void replenishWindow(Connection &conn, Stream &stream);
+        // Runs the handler once the stream's connection has the whole request
+        void serve(Stream &stream);
+        // Queues the response head of `stream` as HEADERS if the handler has
+        // written it, and ends the stream once its response is complete
+        void sendHeaders(Connection &conn, Stream &stream);
+        void sendData(Connection &conn, Stream &stream);
+        // Ends and closes `stream` once its response has been sent in full
+        void finish(Connection &conn, Stream &stream);
+
+        void prioritize(uint32_t stream_id, uint32_t parent, uint16_t weight, bool exclusive);
+        void detach(uint32_t node);
+        void attach(uint32_t node, uint32_t parent, bool exclusive);
+        // The stream to send DATA from next in the subtree of `node`, or 0
+        uint32_t schedule(uint32_t node);
+        void charge(uint32_t stream_id, size_t bytes);
+    };
+
+}
+
+#endif
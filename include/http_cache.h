@@ -0,0 +1,45 @@
+#ifndef WEB_SERVER_HTTP_CACHE_H
+#define WEB_SERVER_HTTP_CACHE_H
+
+#include "request_parser.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+
+namespace web_server
+{
+
+    // Validators of a static file, sent as ETag and Last-Modified and checked
+    // against If-None-Match and If-Modified-Since.
+    struct FileValidators
+    {
+        std::string etag;          // Strong, quoted: "<inode>-<mtime>-<size>" in hex
+        std::string last_modified; // IMF-fixdate
+        int64_t mtime = 0;         // Seconds since the epoch
+    };
+
+    FileValidators fileValidators(const struct stat &file_stat);
+
+    // True if the conditional headers of `request` allow a 304 Not Modified
+    // response. If-None-Match takes precedence over If-Modified-Since (RFC 9110 13.2.2).
+    bool isNotModified(const HttpRequest &request, const FileValidators &validators);
+
+    // Cache-Control value sent for request paths starting with `prefix`.
+    struct CacheControlRule
+    {
+        std::string prefix;
+        std::string value;
+    };
+
+    // The value of the longest matching rule, or an empty view if none matches.
+    std::string_view cacheControlFor(const std::vector<CacheControlRule> &rules, std::string_view path);
+
+    std::string formatHttpDate(int64_t seconds);
+    // Accepts IMF-fixdate, RFC 850 and asctime dates (RFC 9110 5.6.7).
+    bool parseHttpDate(std::string_view text, int64_t &seconds);
+
+}
+
+#endif
@@ -3,52 +3,206 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <filesystem>
 #include <thread>
-
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-using socket_t = SOCKET;
-#define CLOSE_SOCKET closesocket
-#else
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
-using socket_t = int;
-#define CLOSE_SOCKET close
-#endif
+#include <memory>
+#include <atomic>
+#include "connection.h"
+#include "file_cache.h"
+#include "open_file_cache.h"
+#include "file_watcher.h"
+#include "file_index.h"
+#include "http_cache.h"
+#include "byte_range.h"
+#include "metrics.h"
 
 namespace web_server
 {
 
+    class Template;
+    class UploadReceiver;
+    class CompressionCache;
+    enum class ContentEncoding;
+    class ThreadPool;
+    class IdlePoller;
+
+    namespace bench
+    {
+        struct ServerProbe;
+    }
+
+    // How accepted connections are driven
+    enum class IoMode
+    {
+        Threads, // Blocking handlers on a bounded worker pool
+        Epoll,   // Single-threaded edge-triggered epoll reactor (Linux only)
+        Uring    // Single-threaded io_uring completion loop; falls back to Epoll where unavailable
+    };
+
+    struct ServerOptions
+    {
+        IoMode io_mode = IoMode::Threads;
+        int listen_backlog = SOMAXCONN;
+        std::string bind_address = "::"; // Numeric address; "::" is dual-stack IPv6 + IPv4
+        size_t listener_shards = 1;       // SO_REUSEPORT listeners, each on its own pinned thread; 0 = one per hardware thread
+        size_t worker_threads = 0;  // 0 = one per hardware thread
+        size_t queue_depth = 1024;  // Accepted connections waiting for a worker
+        int retry_after_seconds = 1; // Sent with 503 when the queue is full
+        int keep_alive_timeout_ms = 5000;       // Idle time before a persistent connection is closed
+        int header_timeout_ms = 10000;          // Time for a whole request head to arrive
+        int body_timeout_ms = 10000;            // Time for a request body, extended by the minimum rate
+        int send_timeout_ms = 10000;            // Time for a response to be taken, extended by the minimum rate
+        size_t min_transfer_rate = 1024;        // Bytes per second a body or response must average; 0 = per read/write timeouts
+        size_t max_header_size = 64 * 1024;     // Larger request heads get 431
+        size_t max_body_size = size_t(1) << 30; // Larger declared bodies (uploads) get 413
+        size_t max_keep_alive_requests = 100;   // Requests served on one connection before closing it
+        size_t cache_max_bytes = 64 * 1024 * 1024; // In-memory file cache budget, 0 disables the cache
+        size_t cache_max_file_size = 1024 * 1024;  // Larger files are always streamed from disk
+        size_t zerocopy_min_bytes = 64 * 1024;     // In-memory bodies at least this large use MSG_ZEROCOPY, 0 disables
+        size_t open_file_cache_entries = 512;      // Open descriptors and stat results kept, 0 disables reuse
+        int open_file_cache_ttl_ms = 1000;         // How long one is reused without looking at the disk again
+        size_t tree_page_size = 500;               // Directory entries per listing page
+        std::vector<CacheControlRule> cache_control; // Cache-Control for static files, longest prefix wins
+        bool compression = true;                   // gzip/brotli for text responses
+        size_t compression_min_size = 1024;        // Smaller bodies are sent as they are
+        size_t compression_cache_bytes = 16 * 1024 * 1024; // Compressed static files kept in memory
+        std::string metrics_path = "/__metrics";   // Prometheus metrics endpoint, empty disables it
+        size_t upload_threads = 4;                 // Disk writers shared by all uploads, 0 writes on the receiving thread
+        bool http2 = true;                         // h2c by prior knowledge or Upgrade on the same listener
+        bool search_index = true;                  // In-memory filename index behind /search
+    };
+
     class HttpServer
     {
     public:
-        HttpServer(int port, const std::string &web_root);
+        HttpServer(int port, const std::string &web_root, const ServerOptions &options = ServerOptions());
         ~HttpServer();
         void start();
+        FileCache::Stats cacheStats() const;
 
     private:
+        // Lets the micro-benchmarks call the private handlers directly
+        friend struct bench::ServerProbe;
+
         int port_;
         std::string web_root_;
-        socket_t server_socket_;
-        static const std::map<std::string, std::string> MIME_TYPES;
+        std::string canonical_root_;
+        ServerOptions options_;
+        ConnectionLimits limits_;
+        std::unique_ptr<OpenFileCache> open_files_;
+        std::unique_ptr<FileCache> file_cache_;
+        std::unique_ptr<CompressionCache> compression_cache_;
+        // Parsed once and swapped atomically when the template files change
+        std::atomic<std::shared_ptr<const Template>> tree_template_;
+        std::atomic<std::shared_ptr<const Template>> upload_template_;
+        std::unique_ptr<ThreadPool> worker_pool_; // Threads mode only, created by start()
+        std::unique_ptr<IdlePoller> idle_poller_; // Threads mode on Linux: connections between requests
+        std::unique_ptr<ThreadPool> upload_pool_; // Writes uploaded files, created by start()
+        std::unique_ptr<ThreadPool> compression_pool_; // Compresses static files for the cache, created by start()
+        std::vector<socket_t> listen_sockets_;
+        std::unique_ptr<FileIndex> file_index_;     // Kept current by the watcher and the upload path
+        std::unique_ptr<FileWatcher> file_watcher_; // Declared last so its thread stops first
+        static const std::map<std::string, std::string, std::less<>> MIME_TYPES;
 
         void initNetworking();
         void cleanupNetworking();
-        socket_t createServerSocket();
+        socket_t createServerSocket(bool reuse_port);
+        void runEventLoop(socket_t listen_socket);
+        void runUringLoop(socket_t listen_socket);
+        void acceptLoop(socket_t listen_socket);
         void handleClient(socket_t client_socket);
-        std::pair<std::string, std::string> parseRequest(const std::string &request);
-        std::string getMimeType(const std::string &path);
+        // Threads mode: serves requests until the connection closes or goes idle
+        // between requests, when it is parked in the idle poller
+        void serveClient(std::shared_ptr<Connection> conn);
+        // Threads mode: hands a parked connection that became readable back to a worker
+        void resumeClient(std::shared_ptr<Connection> conn);
+        // Threads mode: waits for `events` on the socket until the connection's
+        // deadline; false once it has passed or the socket failed
+        bool awaitSocket(Connection &conn, short events);
+        // Threads mode: writes all pending output within the send deadline
+        bool flushBlocking(Connection &conn);
+        void rejectClient(socket_t client_socket);
+        // Answers 503 with Retry-After without reading the request; the caller closes
+        void sendBusy(socket_t client_socket);
+        void handleRequest(Connection &conn);
+        // Switches to HTTP/2 if the request asks for it with "Upgrade: h2c"; the
+        // request is then answered on stream 1
+        bool upgradeToHttp2(Connection &conn);
+        // Serves the streams of an HTTP/2 connection with the HTTP/1.1 handlers
+        std::unique_ptr<ProtocolSession> createHttp2Session();
+        metrics::Route routeRequest(Connection &conn);
+        void handleMetricsRequest(Connection &conn);
+        std::string_view getMimeType(std::string_view path);
         std::string readFile(const std::string &path);
-        std::string generateDirectoryTree(const std::string &dir_path, const std::string &relative_path, int depth);
+        void loadTemplates();
+        void onFileChanged(const FileWatcher::Event &event);
+        struct DirectoryEntry
+        {
+            std::string name;
+            bool is_directory;
+        };
+        static constexpr size_t MAX_TREE_PAGE_SIZE = 10000;
+        static constexpr size_t SEARCH_PAGE_SIZE = 100;
+        static constexpr size_t MAX_SEARCH_RESULTS = 1000;
+        static constexpr size_t UPLOAD_QUEUE_DEPTH = 1024;
+        static constexpr size_t MAX_COMPRESSED_FILE_SIZE = 16 * 1024 * 1024; // Larger files are sent as they are
+        static constexpr size_t COMPRESSION_THREADS = 2;
+        static constexpr size_t COMPRESSION_QUEUE_DEPTH = 256; // Files beyond this wait for a later request
+
+        class DirectoryListingSource;
+
+        // Lists the directory open as `dir`, whose canonical path is `dir_path`;
+        // throws std::filesystem::filesystem_error if it is not a readable directory
+        size_t listDirectory(const OpenFile &dir, std::string_view dir_path, size_t offset, size_t limit,
+                             std::vector<DirectoryEntry> &page);
+        static void appendDirectoryEntry(std::string &html, const std::string &relative_path, const DirectoryEntry &entry);
+        // `dir_path` is a canonical path below the root, resolved like a request path
+        std::string generateDirectoryTree(const std::string &dir_path, const std::string &relative_path);
+        void handleTreeRequest(Connection &conn, std::string_view query);
+        void handleSearchRequest(Connection &conn, std::string_view query);
         std::string generateDirectoryListing(const std::string &dir_path, const std::string &relative_path);
         std::string generateUploadForm(const std::string &relative_path);
-        std::pair<std::string, std::string> parseMultipartFormData(const std::string &request, const std::string &boundary);
-        bool saveUploadedFile(const std::string &filename, const std::string &content, const std::string &destination_dir);
-        void sendResponse(socket_t client_socket, const std::string &status,
-                          const std::string &content_type, const std::string &content);
+        void beginRequestBody(Connection &conn);
+        std::unique_ptr<UploadReceiver> createUploadReceiver(const HttpRequest &request);
+        bool saveUploadedFile(const std::string &temp_path, const std::string &filename, const std::string &destination_dir);
+        // Moves the files of a finished upload into place and reports the outcome,
+        // as JSON with one entry per file for batches and clients that ask for it
+        void sendUploadResult(Connection &conn, UploadReceiver &upload);
+        // Response helpers take views: headers are assembled in the request arena
+        // and copied once into the connection's output buffer.
+        void writeHeaders(Connection &conn, std::string_view status, std::string_view content_type,
+                          size_t content_length, std::string_view extra_headers = {});
+        // Takes the body by value so generated pages are moved into the output queue
+        void sendResponse(Connection &conn, std::string_view status, std::string_view content_type,
+                          std::string content);
+        // Streams a generated body with chunked transfer coding, compressed on the fly
+        // if the client accepts it; HTTP/1.0 clients get it buffered with a length.
+        void sendStream(Connection &conn, std::string_view status, std::string_view content_type,
+                        std::unique_ptr<BodySource> body);
+        // Whether a body of `length` bytes that outlives the send is worth MSG_ZEROCOPY
+        bool useZeroCopy(size_t length) const;
+        // Serves a sidecar or cached compressed variant of a static file if the
+        // client accepts one; returns false to fall back to the identity response.
+        bool sendEncodedFile(Connection &conn, const std::shared_ptr<const OpenFile> &file,
+                             std::string_view canonical_path, std::string_view content_type,
+                             std::string_view cache_headers);
+        // Compresses a static file at the best level on the compression pool and
+        // caches it under `key`, unless that is already under way
+        void compressStaticFile(std::shared_ptr<const OpenFile> file, std::string_view canonical_path,
+                                ContentEncoding encoding, std::string key);
+        void sendFileResponse(Connection &conn, const std::shared_ptr<const OpenFile> &file,
+                              std::string_view canonical_path, std::string_view content_type,
+                              std::string_view cache_headers);
+        void sendCachedResponse(Connection &conn, const std::shared_ptr<const CachedFile> &file,
+                                std::string_view cache_headers);
+        void sendNotModified(Connection &conn, const FileValidators &validators, std::string_view cache_headers);
+        void sendRangeNotSatisfiable(Connection &conn, uint64_t size);
+        // Sends `ranges` of a file of `size` bytes from `body`, or else from `file`.
+        void sendPartialContent(Connection &conn, const ByteRanges &ranges, uint64_t size,
+                                std::string_view content_type, std::string_view entity_headers,
+                                const std::shared_ptr<const std::string> &body,
+                                const std::shared_ptr<const OpenFile> &file);
     };
 
 }
@@ -0,0 +1,62 @@
+#ifndef WEB_SERVER_IDLE_POLLER_H
+#define WEB_SERVER_IDLE_POLLER_H
+
+#include "connection.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace web_server
+{
+
+    // Threads mode: holds persistent connections between requests, so a client
+    // that keeps its connection open without sending anything costs an epoll
+    // registration instead of a worker blocked in poll(). One thread waits on
+    // every parked socket; a connection is handed to `resume` as soon as it is
+    // readable or hung up, and closed if its deadline passes first. Linux only.
+    class IdlePoller
+    {
+    public:
+        using ResumeHandler = std::function<void(std::shared_ptr<Connection>)>;
+
+        explicit IdlePoller(ResumeHandler resume);
+        ~IdlePoller();
+
+        IdlePoller(const IdlePoller &) = delete;
+        IdlePoller &operator=(const IdlePoller &) = delete;
+
+        // Takes over `conn` until it becomes readable; callable from any thread
+        void park(std::shared_ptr<Connection> conn);
+        size_t size() const { return parked_.load(std::memory_order_relaxed); }
+
+    private:
+        ResumeHandler resume_;
+        int epoll_fd_ = -1;
+        int wake_fd_ = -1;
+        std::atomic<bool> stopping_{false};
+        std::atomic<size_t> parked_{0};
+
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<Connection>> incoming_; // Parked but not yet registered
+
+        // Owned by the poller thread
+        TimerWheel timers_; // Declared before the connections, whose timers it holds
+        std::unordered_map<socket_t, std::shared_ptr<Connection>> connections_;
+        std::thread thread_;
+
+        void run();
+        void registerIncoming();
+        void onEvent(socket_t socket, uint32_t events);
+        void onDeadline(TimerWheel::Timer &timer);
+        // Forgets the connection without closing it and returns it
+        std::shared_ptr<Connection> release(socket_t socket);
+    };
+
+}
+
+#endif
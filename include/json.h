@@ -0,0 +1,15 @@
+#ifndef WEB_SERVER_JSON_H
+#define WEB_SERVER_JSON_H
+
+#include <string>
+#include <string_view>
+
+namespace web_server
+{
+
+    // Appends `value` to `out` as a quoted JSON string literal.
+    void appendJsonString(std::string &out, std::string_view value);
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef WEB_SERVER_LOGGER_H
+#define WEB_SERVER_LOGGER_H
+
+#include <atomic>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace web_server
+{
+
+    enum class LogLevel
+    {
+        Debug,
+        Info,
+        Warn,
+        Error,
+        Off,
+        Access // Access-log lines; enabled separately from the level threshold
+    };
+
+    // Asynchronous process-wide logger. Each thread appends finished lines to its
+    // own lock-free ring buffer, and a background thread drains all rings every
+    // few milliseconds and writes them to the log file in one batch, so request
+    // handlers never block on the stream or on disk. Lines are dropped (and
+    // counted) rather than waiting when a ring is full.
+    namespace logging
+    {
+
+        struct Options
+        {
+            LogLevel level = LogLevel::Info;
+            std::string path;         // Empty writes to stdout
+            bool access_log = true;   // One line per request
+        };
+
+        // Opens the log file and starts the writer thread. Until then, lines are
+        // written synchronously to stdout so tools and early start-up still log.
+        bool start(const Options &options);
+        // Drains every ring and stops the writer thread; also run at exit.
+        void stop();
+
+        extern std::atomic<LogLevel> current_level;
+        extern std::atomic<bool> access_enabled;
+
+        inline bool enabled(LogLevel level)
+        {
+            return level == LogLevel::Access ? access_enabled.load(std::memory_order_relaxed)
+                                             : level >= current_level.load(std::memory_order_relaxed);
+        }
+
+        LogLevel parseLevel(std::string_view name, bool &ok);
+
+        // Lines lost because a thread's ring was full
+        uint64_t droppedLines();
+
+        // Hands a finished line to the calling thread's ring.
+        void submit(LogLevel level, std::string_view message);
+
+        // Streams `text` as a double-quoted value, escaping quotes, backslashes and
+        // control characters so client input can never split or forge a line.
+        struct Quoted
+        {
+            std::string_view text;
+        };
+
+        // Builds one log line in a reusable per-thread buffer and submits it when
+        // it goes out of scope. Only created once the level check has passed.
+        class Line
+        {
+        public:
+            explicit Line(LogLevel level);
+            ~Line();
+
+            Line(const Line &) = delete;
+            Line &operator=(const Line &) = delete;
+
+            Line &operator<<(std::string_view text)
+            {
+                buffer_.append(text);
+                return *this;
+            }
+            Line &operator<<(const char *text) { return *this << std::string_view(text ? text : "(null)"); }
+            Line &operator<<(const std::string &text) { return *this << std::string_view(text); }
+            Line &operator<<(char c)
+            {
+                buffer_.push_back(c);
+                return *this;
+            }
+            template <typename T>
+                requires std::integral<T> || std::floating_point<T>
+            Line &operator<<(T value)
+            {
+                char digits[32];
+                auto result = std::to_chars(digits, digits + sizeof(digits), value);
+                buffer_.append(digits, result.ptr);
+                return *this;
+            }
+            Line &operator<<(Quoted value);
+
+        private:
+            LogLevel level_;
+            std::string &buffer_;
+        };
+
+    }
+
+}
+
+// Usage: LOG_INFO << "Listening on port " << port;
+// Debug lines compile to nothing unless WEB_SERVER_DEBUG_LOG is defined (a CMake
+// option, on by default). A line whose level is filtered out at run time costs
+// one relaxed load and a branch; its arguments are never evaluated.
+#define WEB_SERVER_LOG(level) \
+    if (!::web_server::logging::enabled(level)) \
+    { \
+    } \
+    else \
+        ::web_server::logging::Line(level)
+
+#ifdef WEB_SERVER_DEBUG_LOG
+#define LOG_DEBUG WEB_SERVER_LOG(::web_server::LogLevel::Debug)
+#else
+#define LOG_DEBUG \
+    if (true) \
+    { \
+    } \
+    else \
+        ::web_server::logging::Line(::web_server::LogLevel::Debug)
+#endif
+#define LOG_INFO WEB_SERVER_LOG(::web_server::LogLevel::Info)
+#define LOG_WARN WEB_SERVER_LOG(::web_server::LogLevel::Warn)
+#define LOG_ERROR WEB_SERVER_LOG(::web_server::LogLevel::Error)
+#define LOG_ACCESS WEB_SERVER_LOG(::web_server::LogLevel::Access)
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef WEB_SERVER_METRICS_H
+#define WEB_SERVER_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace web_server
+{
+
+    // Process-wide request metrics. Every thread records into its own block of
+    // single-writer counters, so the hot path is a thread-local lookup and a few
+    // uncontended relaxed stores; blocks are only summed when metrics are rendered.
+    namespace metrics
+    {
+
+        enum class Route
+        {
+            Static,
+            Directory,
+            UploadForm,
+            Upload,
+            Tree,
+            Search,
+            Metrics,
+            Invalid, // Malformed requests and unsupported methods
+            Count
+        };
+
+        enum class Phase
+        {
+            Parse,      // Request head parsing
+            Filesystem, // Path resolution, stat/open/read, listings and upload renames
+            Send,       // From queuing a response until the socket accepted all of it
+            Count
+        };
+
+        // Deadline that cut a connection off (see ConnectionLimits)
+        enum class Deadline
+        {
+            Idle,   // No new request on a persistent connection
+            Header, // Request head not received in time
+            Body,   // Request body below the minimum rate
+            Send,   // Response not taken by the client in time
+            Count
+        };
+
+        // A counter written by one thread and read by any
+        class Counter
+        {
+        public:
+            void add(uint64_t value)
+            {
+                value_.store(value_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+            uint64_t load() const { return value_.load(std::memory_order_relaxed); }
+
+        private:
+            std::atomic<uint64_t> value_{0};
+        };
+
+        // Log-linear latency histogram in the style of HdrHistogram: every power
+        // of two is split into 8 linear sub-buckets, so any recorded duration is
+        // known to within 12.5% across nanoseconds to minutes.
+        class Histogram
+        {
+        public:
+            static constexpr int SUB_BUCKET_BITS = 3;
+            static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+            static constexpr int MAX_EXPONENT = 40; // 2^40 ns is about 18 minutes
+            static constexpr int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+            void record(uint64_t nanoseconds);
+
+            static int bucketIndex(uint64_t nanoseconds);
+            // Smallest value that falls into the bucket after `index`
+            static uint64_t bucketLimit(int index);
+
+            Counter buckets[BUCKET_COUNT];
+            Counter count;
+            Counter sum; // Nanoseconds
+        };
+
+        // Label value used for `route`, e.g. "static"
+        const char *routeName(Route route);
+        const char *deadlineName(Deadline deadline);
+
+        void recordRequest(Route route, int status, std::chrono::steady_clock::duration duration);
+        void recordPhase(Phase phase, std::chrono::steady_clock::duration duration);
+        void addBytesReceived(size_t bytes);
+        void addBytesSent(size_t bytes);
+        void connectionOpened();
+        void connectionClosed();
+        void connectionRejected();
+        void connectionTimedOut(Deadline deadline);
+
+        // Records the time from construction to destruction as `phase`
+        class PhaseTimer
+        {
+        public:
+            explicit PhaseTimer(Phase phase) : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+            ~PhaseTimer() { recordPhase(phase_, std::chrono::steady_clock::now() - start_); }
+
+            PhaseTimer(const PhaseTimer &) = delete;
+            PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        private:
+            Phase phase_;
+            std::chrono::steady_clock::time_point start_;
+        };
+
+        // Appends all metrics in the Prometheus text exposition format (0.0.4).
+        void render(std::string &out);
+
+        // Appends one gauge or counter sample with its HELP and TYPE lines.
+        void appendSample(std::string &out, const char *name, const char *type, const char *help, double value);
+
+    }
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WEB_SERVER_MULTIPART_PARSER_H
+#define WEB_SERVER_MULTIPART_PARSER_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace web_server
+{
+
+    // Incremental multipart/form-data parser. The body is fed in arbitrary chunks;
+    // the parser reports part headers and streams part data to a Handler as soon as
+    // it is known not to be part of a boundary, so memory use does not depend on
+    // the size of the parts.
+    class MultipartParser
+    {
+    public:
+        class Handler
+        {
+        public:
+            virtual ~Handler() = default;
+            // `headers` is the raw header block of the part. Returning false aborts parsing.
+            virtual bool onPartBegin(std::string_view headers) = 0;
+            virtual bool onPartData(std::string_view data) = 0;
+            virtual bool onPartEnd() = 0;
+        };
+
+        MultipartParser(const std::string &boundary, Handler &handler);
+
+        MultipartParser(const MultipartParser &) = delete;
+        MultipartParser &operator=(const MultipartParser &) = delete;
+
+        // Consumes a prefix of `data` and returns its length. Unconsumed bytes (a
+        // possible partial boundary or incomplete part headers) must be passed
+        // again with more data appended. `last` marks the end of the body.
+        size_t feed(std::string_view data, bool last);
+
+        bool done() const { return state_ == State::Done; }
+        bool failed() const { return state_ == State::Failed; }
+
+    private:
+        enum class State
+        {
+            Preamble,
+            AfterBoundary,
+            PartHeaders,
+            PartData,
+            Done,
+            Failed
+        };
+
+        static constexpr size_t MAX_PART_HEADER_SIZE = 16 * 1024;
+
+        std::string delimiter_; // "\r\n--" + boundary
+        Handler &handler_;
+        State state_ = State::Preamble;
+        std::boyer_moore_horspool_searcher<std::string::const_iterator> searcher_;
+
+        size_t step(std::string_view data, bool last);
+        size_t fail();
+    };
+
+    // Extracts the filename="..." parameter from a part's Content-Disposition
+    // header. Returns an empty string if the part is not a file.
+    std::string multipartFilename(std::string_view headers);
+
+    // Returns the boundary parameter of a multipart/form-data Content-Type value,
+    // or an empty view if the value is not multipart/form-data.
+    std::string_view multipartBoundary(std::string_view content_type);
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef WEB_SERVER_OPEN_FILE_CACHE_H
+#define WEB_SERVER_OPEN_FILE_CACHE_H
+
+#include "http_cache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/stat.h>
+
+namespace web_server
+{
+
+    // Hash for path-keyed maps that are probed with string_views, so a lookup
+    // does not have to copy the key into a std::string first
+    struct PathHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view path) const { return std::hash<std::string_view>{}(path); }
+    };
+
+    // A path resolved beneath the web root: an open descriptor with the stat
+    // result taken from it, or the error that resolving it produced. Shared by
+    // every response that serves it; the descriptor is closed with the last one.
+    struct OpenFile
+    {
+        OpenFile() = default;
+        ~OpenFile();
+
+        OpenFile(const OpenFile &) = delete;
+        OpenFile &operator=(const OpenFile &) = delete;
+
+        int fd = -1;   // Read only positionally (pread, sendfile with an offset)
+        int error = 0; // errno; EXDEV when the path leads outside the root
+        struct stat info{};
+        FileValidators validators; // Regular files only
+
+        bool ok() const { return error == 0; }
+        bool isDirectory() const { return ok() && S_ISDIR(info.st_mode); }
+        bool isRegular() const { return ok() && S_ISREG(info.st_mode); }
+    };
+
+    // nginx-style cache of open descriptors and stat results, failures
+    // included, keyed by normalized path. The root is opened once as a directory
+    // descriptor and every path is resolved relative to it with
+    // openat2(RESOLVE_BENEATH), so ".." and symlinks cannot lead outside it and
+    // the check cannot race with a rename. Entries are reused for at most `ttl`
+    // and dropped earlier through invalidate() when a FileWatcher reports a change.
+    class OpenFileCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t invalidations;
+            size_t entries;
+        };
+
+        // `root` must be canonical. `max_entries` of 0 resolves every lookup afresh.
+        OpenFileCache(const std::string &root, size_t max_entries, std::chrono::milliseconds ttl);
+        ~OpenFileCache();
+
+        OpenFileCache(const OpenFileCache &) = delete;
+        OpenFileCache &operator=(const OpenFileCache &) = delete;
+
+        // `path` is the root itself or an absolute, lexically normalized path below
+        // it. Never returns nullptr; check OpenFile::error.
+        std::shared_ptr<const OpenFile> open(std::string_view path);
+
+        void invalidate(const std::string &path);
+        void invalidatePrefix(const std::string &prefix);
+        void clear();
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::string path;
+            std::shared_ptr<const OpenFile> file;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        struct Shard
+        {
+            mutable std::mutex mutex;
+            std::list<Entry> lru; // Most recently used at the front
+            std::unordered_map<std::string, std::list<Entry>::iterator, PathHash, std::equal_to<>> index;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t invalidations = 0;
+        };
+
+        static constexpr size_t SHARD_COUNT = 16;
+
+        std::string root_;
+        int root_fd_ = -1;
+        size_t shard_capacity_;
+        std::chrono::milliseconds ttl_;
+        Shard shards_[SHARD_COUNT];
+        // Bumped on every invalidation; a resolution that raced with one is not inserted
+        std::atomic<uint64_t> epoch_{0};
+
+        Shard &shardFor(std::string_view path);
+        std::shared_ptr<OpenFile> resolve(const std::string &path) const;
+        void eraseLocked(Shard &shard, std::list<Entry>::iterator it);
+    };
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef WEB_SERVER_REQUEST_PARSER_H
+#define WEB_SERVER_REQUEST_PARSER_H
+
+#include <cstddef>
+#include <string>
+#include <memory_resource>
+#include <cstdint>
+#include <string_view>
+
+namespace web_server
+{
+
+    struct HttpHeader
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // A parsed request head. All views point into the buffer that was parsed and
+    // are only valid while that buffer is neither modified nor reallocated.
+    struct HttpRequest
+    {
+        static constexpr size_t MAX_HEADERS = 64;
+
+        std::string_view method;
+        std::string_view target; // Raw request target, e.g. "/a%20b?x=1"
+        std::string_view path;   // Target up to '?', still percent-encoded
+        std::string_view query;  // Text after '?', without it
+        std::string_view version;
+        HttpHeader headers[MAX_HEADERS];
+        size_t header_count = 0;
+        size_t header_length = 0; // Request line and headers including the blank line
+        size_t content_length = 0;
+        bool chunked = false;
+
+        // Case-insensitive lookup; returns an empty view if the header is absent.
+        std::string_view header(std::string_view name) const;
+        bool keepAlive() const;
+    };
+
+    // Incremental parser for an HTTP/1.x request head. It may be called again with
+    // the same, grown buffer after every read; the scan for the end of the headers
+    // resumes where it stopped, and the head is parsed once, without allocating,
+    // when it is complete.
+    class RequestParser
+    {
+    public:
+        enum class Result
+        {
+            Complete,
+            Incomplete,
+            Error
+        };
+
+        static constexpr size_t DEFAULT_MAX_HEADER_SIZE = 64 * 1024;
+
+        // Heads larger than `max_header_size` fail with 431 and declared bodies
+        // larger than `max_body_size` with 413, before any of the body is read.
+        void setLimits(size_t max_header_size, size_t max_body_size)
+        {
+            max_header_size_ = max_header_size;
+            max_body_size_ = max_body_size;
+        }
+
+        Result parse(std::string_view buffer, HttpRequest &request);
+        void reset() { scanned_ = 0; }
+
+        // Status line text for the last Error result, e.g. "400 Bad Request".
+        const char *errorStatus() const { return error_status_; }
+
+    private:
+        size_t scanned_ = 0;
+        size_t max_header_size_ = DEFAULT_MAX_HEADER_SIZE;
+        size_t max_body_size_ = SIZE_MAX;
+        const char *error_status_ = "400 Bad Request";
+
+        Result fail(const char *status);
+    };
+
+    bool equalsIgnoreCase(std::string_view a, std::string_view b);
+
+    // Percent-decodes `value` into `out` (reusing its capacity); with
+    // `plus_as_space`, '+' decodes to ' ' as in form-encoded query strings.
+    void urlDecode(std::string_view value, std::string &out, bool plus_as_space = false);
+    void urlDecode(std::string_view value, std::pmr::string &out, bool plus_as_space = false);
+
+    // Finds `name` in an application/x-www-form-urlencoded query string and
+    // decodes its value into `out`. Returns false if the parameter is absent.
+    bool queryParameter(std::string_view query, std::string_view name, std::string &out);
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef WEB_SERVER_TEMPLATE_H
+#define WEB_SERVER_TEMPLATE_H
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace web_server
+{
+
+    // A value bound to a {{NAME}} slot at render time. Values are HTML-escaped
+    // unless `escape` is false (for fragments that are already markup).
+    struct TemplateVariable
+    {
+        std::string_view name;
+        std::string_view value;
+        bool escape = true;
+    };
+
+    // An HTML template parsed once into literal segments and {{NAME}} slots, so
+    // rendering is a single pass into an output buffer sized up front.
+    class Template
+    {
+    public:
+        Template() = default;
+        explicit Template(const std::string &source);
+
+        std::string render(std::initializer_list<TemplateVariable> variables) const;
+        // Renders what precedes the first {{split}} slot into `head` and what follows
+        // it into `tail`, so the content of that slot can be streamed in between.
+        void renderAround(std::initializer_list<TemplateVariable> variables, std::string_view split,
+                          std::string &head, std::string &tail) const;
+
+    private:
+        struct Segment
+        {
+            size_t literal_offset; // Into literals_
+            size_t literal_length;
+            int slot; // Index into slot_names_, or -1 for a trailing literal only
+        };
+
+        std::string literals_;
+        std::vector<Segment> segments_;
+        std::vector<std::string> slot_names_;
+
+        std::vector<const TemplateVariable *> bind(std::initializer_list<TemplateVariable> variables) const;
+        // Appends segments [first, last); the slot of the last one is left out unless `last_slot`
+        void renderSegments(const std::vector<const TemplateVariable *> &bound, size_t first, size_t last,
+                            bool last_slot, std::string &out) const;
+    };
+
+    // Appends `value` to `out` with &, <, >, " and ' replaced by entities.
+    void appendHtmlEscaped(std::string &out, std::string_view value);
+    size_t htmlEscapedLength(std::string_view value);
+
+}
+
+#endif
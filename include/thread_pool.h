@@ -0,0 +1,72 @@
+#ifndef WEB_SERVER_THREAD_POOL_H
+#define WEB_SERVER_THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace web_server
+{
+
+    // Fixed set of worker threads fed from a bounded FIFO queue. Submissions are
+    // refused once the queue is full so callers can shed load instead of queueing
+    // without limit.
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        struct Stats
+        {
+            uint64_t completed;
+            uint64_t rejected;
+            uint64_t total_wait_us; // Time tasks spent queued before a worker picked them up
+            uint64_t max_wait_us;
+            size_t queued;
+        };
+
+        ThreadPool(size_t thread_count, size_t queue_depth);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // Returns false without running the task if the queue is full.
+        bool trySubmit(Task task);
+        // Queues the task however long the queue is, for callers that bound
+        // the amount of work they submit themselves.
+        void submit(Task task);
+        Stats stats() const;
+        size_t threadCount() const { return workers_.size(); }
+
+    private:
+        struct QueuedTask
+        {
+            Task task;
+            std::chrono::steady_clock::time_point enqueued;
+        };
+
+        size_t queue_depth_;
+        std::deque<QueuedTask> queue_;
+        std::vector<std::thread> workers_;
+        mutable std::mutex mutex_;
+        std::condition_variable ready_;
+        bool stopping_ = false;
+
+        std::atomic<uint64_t> completed_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<uint64_t> total_wait_us_{0};
+        std::atomic<uint64_t> max_wait_us_{0};
+
+        void workerLoop();
+    };
+
+}
+
+#endif
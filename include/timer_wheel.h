@@ -0,0 +1,85 @@
+#ifndef WEB_SERVER_TIMER_WHEEL_H
+#define WEB_SERVER_TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace web_server
+{
+
+    // Hierarchical timing wheel (Varghese & Lauck) for per-connection deadlines.
+    // Four levels of 64 slots cover 64^4 ticks; a timer sits in the coarsest
+    // level that still tells its slot apart and moves down a level each time the
+    // finer wheel wraps. Scheduling, rescheduling and cancelling are O(1), and a
+    // tick only touches the timers that expire or move, so tens of thousands of
+    // idle connections cost nothing until one of them is due.
+    class TimerWheel
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // Intrusive timer, usually a member of the object it times out. It
+        // unlinks itself when destroyed.
+        class Timer
+        {
+        public:
+            Timer() = default;
+            ~Timer();
+
+            Timer(const Timer &) = delete;
+            Timer &operator=(const Timer &) = delete;
+
+            bool scheduled() const { return wheel_ != nullptr; }
+
+            uint64_t id = 0; // Identifies the owner to the expiry callback
+
+        private:
+            friend class TimerWheel;
+            TimerWheel *wheel_ = nullptr;
+            Timer *next_ = nullptr;
+            Timer **link_ = nullptr; // The pointer that points at this timer
+            uint64_t expiry_ = 0;    // In ticks
+        };
+
+        static constexpr int LEVEL_BITS = 6;
+        static constexpr int LEVELS = 4;
+        static constexpr size_t SLOTS = size_t(1) << LEVEL_BITS;
+
+        explicit TimerWheel(std::chrono::milliseconds tick, Clock::time_point start = Clock::now());
+
+        TimerWheel(const TimerWheel &) = delete;
+        TimerWheel &operator=(const TimerWheel &) = delete;
+
+        // (Re)schedules `timer` to expire at the first tick at or after `deadline`.
+        // Deadlines beyond the range of the wheel are clamped to its end.
+        void schedule(Timer &timer, Clock::time_point deadline);
+        void cancel(Timer &timer);
+
+        // Moves the wheel to `now` and calls `expired` for every timer that came
+        // due, after unscheduling it; the callback may schedule it again.
+        void advance(Clock::time_point now, const std::function<void(Timer &)> &expired);
+
+        // Milliseconds until the next tick that can expire a timer, for a poll
+        // timeout; -1 while nothing is scheduled.
+        int pollTimeout(Clock::time_point now) const;
+
+        std::chrono::milliseconds tick() const { return tick_; }
+        size_t size() const { return size_; }
+
+    private:
+        std::chrono::milliseconds tick_;
+        Clock::time_point start_;
+        uint64_t current_ = 0; // Next tick to process
+        size_t size_ = 0;
+        Timer *slots_[LEVELS][SLOTS] = {};
+
+        void link(Timer &timer);
+        static void unlink(Timer &timer);
+        void cascade(int level);
+    };
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef WEB_SERVER_UPLOAD_RECEIVER_H
+#define WEB_SERVER_UPLOAD_RECEIVER_H
+
+#include "connection.h"
+#include "multipart_parser.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace web_server
+{
+
+    class ThreadPool;
+
+    // Streams every file part of a multipart/form-data upload into its own hidden
+    // temporary file in the destination directory as the body arrives. Writes go
+    // through a shared pool of disk writers, in order within a file but for
+    // several files and uploads at once, so the disk works while the rest of the
+    // body is still being received. The caller moves finished files into place;
+    // the others are removed once no writer uses them any more.
+    //
+    // On an event loop (the sink has a `wake` function) the receiver never
+    // blocks: it reports busy() while more than MAX_PENDING_BYTES wait for the
+    // disk and after the body until the writers are done, and wakes the loop
+    // when that changes. Without one it blocks the receiving thread instead.
+    class UploadReceiver : public BodySink, private MultipartParser::Handler
+    {
+    public:
+        struct File
+        {
+            std::string filename;
+            std::string temp_path; // Cleared once the file was moved into place
+            size_t size = 0;
+            std::string error; // Why the file cannot be stored; empty if it can
+        };
+
+        static constexpr size_t MAX_FILES = 1000;
+        // Received but not yet written; the receiver is busy (or waits) beyond this
+        static constexpr size_t MAX_PENDING_BYTES = 4 * 1024 * 1024;
+
+        // Without `writers` the files are written on the receiving thread.
+        UploadReceiver(const std::string &boundary, const std::string &directory, ThreadPool *writers);
+        ~UploadReceiver() override;
+
+        // A receiver that discards the body and reports `status` and `message`.
+        static std::unique_ptr<UploadReceiver> rejected(const std::string &status, const std::string &message);
+
+        // A single path component that cannot escape the destination directory.
+        static bool validFilename(std::string_view filename);
+        // Whether `filename` is one of the temporary files bodies are streamed into
+        static bool temporaryFilename(std::string_view filename);
+
+        size_t write(std::string_view data, bool last) override;
+        bool busy() override;
+
+        // True once the body has been parsed and all of its file parts written;
+        // individual files may still have failed.
+        bool ok() const { return status_.empty() && complete_; }
+        const std::string &status() const { return status_; }
+        const std::string &message() const { return message_; }
+        const std::string &directory() const { return directory_; }
+        size_t fileCount() const;
+        File &file(size_t index);
+
+    private:
+        struct Part;
+        struct State;
+
+        UploadReceiver() = default;
+
+        std::string directory_;
+        std::string status_;
+        std::string message_;
+        std::unique_ptr<MultipartParser> parser_;
+        ThreadPool *writers_ = nullptr;
+        // Shared with the writer tasks, which may outlive the receiver
+        std::shared_ptr<State> state_;
+        Part *current_ = nullptr; // The file part being received
+        bool complete_ = false;
+
+        void fail(const std::string &status, const std::string &message);
+        // Hands queued data of `part` to a writer unless one already owns it
+        void schedule(Part &part, std::unique_lock<std::mutex> &lock);
+        static void drain(const std::shared_ptr<State> &state, Part &part);
+        // Records files that could not be written, once every writer is done
+        static void settle(State &state);
+        static void removeFiles(State &state);
+        static bool busyLocked(const State &state);
+        // Ends the body: waits for the writers, or has the last of them settle
+        void finish();
+
+        bool onPartBegin(std::string_view headers) override;
+        bool onPartData(std::string_view data) override;
+        bool onPartEnd() override;
+    };
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WEB_SERVER_URING_LOOP_H
+#define WEB_SERVER_URING_LOOP_H
+
+#include "connection.h"
+#include "timer_wheel.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace web_server
+{
+
+    // Completion-based reactor on io_uring. Like EventLoop a single thread drives
+    // every connection of one listener, but accepts, receives, file reads and sends
+    // are queued as ring submissions and handed to the kernel in one io_uring_enter
+    // per loop iteration instead of one syscall each. Linux only; supported()
+    // reports whether the running kernel provides the required operations.
+    class UringLoop
+    {
+    public:
+        using RequestHandler = std::function<void(Connection &)>;
+
+        // True when io_uring can be set up here and supports every operation used
+        static bool supported();
+
+        // Same contract as EventLoop's constructor
+        UringLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                  const ConnectionLimits &limits);
+        ~UringLoop();
+        void run();
+
+    private:
+        class Ring;
+        struct Client;
+
+        socket_t listen_socket_;
+        std::unique_ptr<Ring> ring_;
+        RequestHandler handler_;
+        RequestHandler headers_handler_;
+        const ConnectionLimits &limits_;
+        TimerWheel timers_; // Declared before the clients, whose timers it holds
+        uint64_t next_client_id_ = 1;
+        std::unordered_map<uint64_t, std::unique_ptr<Client>> clients_;
+        // Connection::wake: other threads queue the client id and signal the
+        // eventfd, which has a read armed on the ring into wake_count_
+        int wake_fd_ = -1;
+        uint64_t wake_count_ = 0;
+        std::mutex woken_mutex_;
+        std::vector<uint64_t> woken_;
+
+        void dispatch(uint64_t user_data, int result);
+        void armAccept();
+        void armRecv(Client &client);
+        void armSweep();
+        void armWake();
+        void onWake();
+        void onAccept(int result);
+        void onRecv(Client &client, int result);
+        void onSend(Client &client, int result);
+        void onFileRead(Client &client, int result);
+        void processRequests(Client &client);
+        void startSend(Client &client);
+        void closeClient(Client &client);
+        void onDeadline(TimerWheel::Timer &timer);
+    };
+
+}
+
+#endif
@@ -0,0 +1,12 @@
+#include "arena.h"
+
+namespace web_server
+{
+
+    RequestArena &RequestArena::local()
+    {
+        thread_local RequestArena arena;
+        return arena;
+    }
+
+}
@@ -0,0 +1,41 @@
+#include "buffer_pool.h"
+#include <vector>
+
+namespace web_server::buffers
+{
+
+    namespace
+    {
+        struct Pool
+        {
+            Pool() { free.reserve(MAX_POOLED_BUFFERS); }
+            std::vector<std::string> free;
+        };
+
+        thread_local Pool pool;
+    }
+
+    std::string acquire()
+    {
+        if (pool.free.empty())
+        {
+            return std::string();
+        }
+        std::string buffer = std::move(pool.free.back());
+        pool.free.pop_back();
+        return buffer;
+    }
+
+    void release(std::string &buffer)
+    {
+        // Buffers that fit the small-string optimization have no storage to keep
+        if (buffer.capacity() > std::string().capacity() && buffer.capacity() <= MAX_POOLED_CAPACITY &&
+            pool.free.size() < MAX_POOLED_BUFFERS)
+        {
+            buffer.clear();
+            pool.free.push_back(std::move(buffer));
+        }
+        buffer = std::string();
+    }
+
+}
@@ -0,0 +1,164 @@
+#include "byte_range.h"
+#include <algorithm>
+
+namespace web_server
+{
+
+    namespace
+    {
+        std::string_view trim(std::string_view value)
+        {
+            size_t begin = value.find_first_not_of(" \t");
+            size_t end = value.find_last_not_of(" \t");
+            return begin == std::string_view::npos ? std::string_view() : value.substr(begin, end - begin + 1);
+        }
+
+        bool parseNumber(std::string_view text, uint64_t &value)
+        {
+            if (text.empty() || text.length() > 19)
+            {
+                return false;
+            }
+            value = 0;
+            for (char c : text)
+            {
+                if (c < '0' || c > '9')
+                {
+                    return false;
+                }
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+            }
+            return true;
+        }
+    }
+
+    RangeSelection parseRange(std::string_view value, uint64_t size, ByteRanges &ranges)
+    {
+        ranges.clear();
+        value = trim(value);
+        if (value.length() < 6 || !equalsIgnoreCase(value.substr(0, 6), "bytes="))
+        {
+            return RangeSelection::Full;
+        }
+        value.remove_prefix(6);
+        // A malformed element invalidates the ranges parsed before it as well
+        auto whole = [&ranges]
+        {
+            ranges.clear();
+            return RangeSelection::Full;
+        };
+
+        bool any_range = false;
+        while (!value.empty())
+        {
+            size_t comma = value.find(',');
+            std::string_view spec = trim(value.substr(0, comma));
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+            if (spec.empty())
+            {
+                continue; // Empty list elements are allowed
+            }
+            size_t dash = spec.find('-');
+            if (dash == std::string_view::npos)
+            {
+                return whole();
+            }
+            std::string_view first_text = spec.substr(0, dash);
+            std::string_view last_text = spec.substr(dash + 1);
+            any_range = true;
+
+            uint64_t first, last;
+            if (first_text.empty())
+            {
+                // "-N": the last N bytes
+                uint64_t suffix;
+                if (!parseNumber(last_text, suffix))
+                {
+                    return whole();
+                }
+                if (suffix > 0 && size > 0)
+                {
+                    suffix = std::min(suffix, size);
+                    ranges.push_back({size - suffix, suffix});
+                }
+                continue;
+            }
+            if (!parseNumber(first_text, first))
+            {
+                return whole();
+            }
+            if (last_text.empty())
+            {
+                last = UINT64_MAX; // "N-": to the end
+            }
+            else if (!parseNumber(last_text, last) || last < first)
+            {
+                return whole();
+            }
+            if (first < size)
+            {
+                last = std::min(last, size - 1);
+                ranges.push_back({first, last - first + 1});
+            }
+        }
+        if (!any_range)
+        {
+            return RangeSelection::Full;
+        }
+        if (ranges.empty())
+        {
+            return RangeSelection::Unsatisfiable;
+        }
+
+        // Overlapping and adjacent ranges are merged, so no byte is sent twice
+        std::sort(ranges.begin(), ranges.end(), [](const ByteRange &a, const ByteRange &b)
+                  { return a.offset < b.offset; });
+        size_t merged = 0;
+        for (size_t i = 1; i < ranges.size(); ++i)
+        {
+            ByteRange &current = ranges[merged];
+            if (ranges[i].offset <= current.offset + current.length)
+            {
+                uint64_t end = std::max(current.offset + current.length, ranges[i].offset + ranges[i].length);
+                current.length = end - current.offset;
+            }
+            else
+            {
+                ranges[++merged] = ranges[i];
+            }
+        }
+        ranges.resize(merged + 1);
+        if (ranges.size() > MAX_BYTE_RANGES)
+        {
+            ranges.clear();
+            return RangeSelection::Full;
+        }
+        return RangeSelection::Partial;
+    }
+
+    RangeSelection selectRanges(const HttpRequest &request, uint64_t size, const FileValidators &validators,
+                                ByteRanges &ranges)
+    {
+        std::string_view range = request.header("Range");
+        if (range.empty() || request.method != "GET")
+        {
+            return RangeSelection::Full;
+        }
+        std::string_view if_range = trim(request.header("If-Range"));
+        if (!if_range.empty())
+        {
+            // An entity-tag must match strongly; a date must be exactly the
+            // Last-Modified time (RFC 9110 13.1.5)
+            bool is_tag = if_range.front() == '"' || if_range.starts_with("W/");
+            int64_t date;
+            bool matches = is_tag ? if_range == validators.etag
+                                  : parseHttpDate(if_range, date) && date == validators.mtime;
+            if (!matches)
+            {
+                return RangeSelection::Full;
+            }
+        }
+        return parseRange(range, size, ranges);
+    }
+
+}
@@ -0,0 +1,411 @@
+#include "compression.h"
+#include "request_parser.h"
+#include <stdexcept>
+
+#ifdef WEB_SERVER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WEB_SERVER_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace web_server
+{
+
+    namespace
+    {
+        std::string_view trim(std::string_view value)
+        {
+            size_t begin = value.find_first_not_of(" \t");
+            size_t end = value.find_last_not_of(" \t");
+            return begin == std::string_view::npos ? std::string_view() : value.substr(begin, end - begin + 1);
+        }
+
+        // q-value of a coding parameter list such as ";q=0.5"; 1 if absent
+        double qValue(std::string_view parameters)
+        {
+            while (!parameters.empty())
+            {
+                size_t semicolon = parameters.find(';');
+                std::string_view parameter = trim(parameters.substr(0, semicolon));
+                parameters = semicolon == std::string_view::npos ? std::string_view() : parameters.substr(semicolon + 1);
+                if (parameter.length() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+                {
+                    try
+                    {
+                        return std::stod(std::string(parameter.substr(2)));
+                    }
+                    catch (const std::logic_error &)
+                    {
+                        return 0;
+                    }
+                }
+            }
+            return 1;
+        }
+
+#ifdef WEB_SERVER_HAVE_ZLIB
+        bool gzipCompress(int level, std::string_view input, std::string &output)
+        {
+            z_stream stream{};
+            // 15 window bits + 16 selects the gzip wrapper
+            if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                return false;
+            }
+            output.resize(deflateBound(&stream, static_cast<uLong>(input.length())));
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+            stream.avail_in = static_cast<uInt>(input.length());
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = static_cast<uInt>(output.length());
+            int result = deflate(&stream, Z_FINISH);
+            output.resize(stream.total_out);
+            deflateEnd(&stream);
+            return result == Z_STREAM_END;
+        }
+#endif
+
+#ifdef WEB_SERVER_HAVE_BROTLI
+        bool brotliCompress(int quality, std::string_view input, std::string &output)
+        {
+            size_t length = BrotliEncoderMaxCompressedSize(input.length());
+            if (length == 0)
+            {
+                return false;
+            }
+            output.resize(length);
+            if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, input.length(),
+                                       reinterpret_cast<const uint8_t *>(input.data()), &length,
+                                       reinterpret_cast<uint8_t *>(output.data())))
+            {
+                return false;
+            }
+            output.resize(length);
+            return true;
+        }
+#endif
+
+        int compressionLevel(ContentEncoding encoding, CompressionLevel level)
+        {
+            // Quality 11 is an order of magnitude slower for a few percent; 9 is
+            // affordable once per file version
+            if (encoding == ContentEncoding::Brotli)
+            {
+                return level == CompressionLevel::Best ? 9 : 4;
+            }
+            return level == CompressionLevel::Best ? 9 : 5;
+        }
+
+#ifdef WEB_SERVER_HAVE_ZLIB
+        class GzipStream : public StreamCompressor
+        {
+        public:
+            bool init(int level)
+            {
+                initialized_ = deflateInit2(&stream_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+                return initialized_;
+            }
+
+            ~GzipStream() override
+            {
+                if (initialized_)
+                {
+                    deflateEnd(&stream_);
+                }
+            }
+
+            bool write(std::string_view input, bool last, std::string &output) override
+            {
+                stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+                stream_.avail_in = static_cast<uInt>(input.length());
+                int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+                while (true)
+                {
+                    // A sync flush ends on a byte boundary, so the output may need more room than the bound
+                    size_t start = output.length();
+                    size_t room = deflateBound(&stream_, stream_.avail_in) + 16;
+                    output.resize(start + room);
+                    stream_.next_out = reinterpret_cast<Bytef *>(output.data() + start);
+                    stream_.avail_out = static_cast<uInt>(room);
+                    int result = deflate(&stream_, flush);
+                    output.resize(start + room - stream_.avail_out);
+                    if (last ? result == Z_STREAM_END : stream_.avail_out > 0)
+                    {
+                        return true;
+                    }
+                    if (result != Z_OK && result != Z_BUF_ERROR)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+        private:
+            z_stream stream_{};
+            bool initialized_ = false;
+        };
+#endif
+
+#ifdef WEB_SERVER_HAVE_BROTLI
+        class BrotliStream : public StreamCompressor
+        {
+        public:
+            bool init(int quality)
+            {
+                state_ = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+                return state_ && BrotliEncoderSetParameter(state_, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(quality)) &&
+                       BrotliEncoderSetParameter(state_, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+            }
+
+            ~BrotliStream() override
+            {
+                if (state_)
+                {
+                    BrotliEncoderDestroyInstance(state_);
+                }
+            }
+
+            bool write(std::string_view input, bool last, std::string &output) override
+            {
+                size_t available_in = input.length();
+                const uint8_t *next_in = reinterpret_cast<const uint8_t *>(input.data());
+                BrotliEncoderOperation operation = last ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+                do
+                {
+                    size_t available_out = 0;
+                    if (!BrotliEncoderCompressStream(state_, operation, &available_in, &next_in, &available_out, nullptr, nullptr))
+                    {
+                        return false;
+                    }
+                    size_t length = 0;
+                    const uint8_t *data = BrotliEncoderTakeOutput(state_, &length);
+                    output.append(reinterpret_cast<const char *>(data), length);
+                } while (available_in > 0 || BrotliEncoderHasMoreOutput(state_));
+                return true;
+            }
+
+        private:
+            BrotliEncoderState *state_ = nullptr;
+        };
+#endif
+    }
+
+    const char *encodingToken(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+            return "gzip";
+        case ContentEncoding::Brotli:
+            return "br";
+        case ContentEncoding::Identity:
+            break;
+        }
+        return "identity";
+    }
+
+    const char *sidecarExtension(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+            return ".gz";
+        case ContentEncoding::Brotli:
+            return ".br";
+        case ContentEncoding::Identity:
+            break;
+        }
+        return "";
+    }
+
+    bool compressionSupported(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+#ifdef WEB_SERVER_HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case ContentEncoding::Brotli:
+#ifdef WEB_SERVER_HAVE_BROTLI
+            return true;
+#else
+            return false;
+#endif
+        case ContentEncoding::Identity:
+            break;
+        }
+        return true;
+    }
+
+    bool acceptsEncoding(std::string_view accept_encoding, ContentEncoding encoding)
+    {
+        std::string_view token = encodingToken(encoding);
+        double explicit_q = -1;
+        double wildcard_q = -1;
+        while (!accept_encoding.empty())
+        {
+            size_t comma = accept_encoding.find(',');
+            std::string_view element = accept_encoding.substr(0, comma);
+            accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+            size_t semicolon = element.find(';');
+            std::string_view coding = trim(element.substr(0, semicolon));
+            double q = semicolon == std::string_view::npos ? 1 : qValue(element.substr(semicolon + 1));
+            if (equalsIgnoreCase(coding, token) || (encoding == ContentEncoding::Gzip && equalsIgnoreCase(coding, "x-gzip")))
+            {
+                explicit_q = q;
+            }
+            else if (coding == "*")
+            {
+                wildcard_q = q;
+            }
+        }
+        return explicit_q >= 0 ? explicit_q > 0 : wildcard_q > 0;
+    }
+
+    bool isCompressible(std::string_view content_type)
+    {
+        return content_type.starts_with("text/") || content_type == "application/javascript" ||
+               content_type == "application/json" || content_type == "image/svg+xml";
+    }
+
+    bool compress(ContentEncoding encoding, CompressionLevel level, std::string_view input, std::string &output)
+    {
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+#ifdef WEB_SERVER_HAVE_ZLIB
+            return gzipCompress(compressionLevel(encoding, level), input, output);
+#else
+            return false;
+#endif
+        case ContentEncoding::Brotli:
+#ifdef WEB_SERVER_HAVE_BROTLI
+            return brotliCompress(compressionLevel(encoding, level), input, output);
+#else
+            return false;
+#endif
+        case ContentEncoding::Identity:
+            break;
+        }
+        output.assign(input);
+        return true;
+    }
+
+    std::unique_ptr<StreamCompressor> StreamCompressor::create(ContentEncoding encoding, CompressionLevel level)
+    {
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+#ifdef WEB_SERVER_HAVE_ZLIB
+        {
+            auto stream = std::make_unique<GzipStream>();
+            if (stream->init(compressionLevel(encoding, level)))
+            {
+                return stream;
+            }
+        }
+#endif
+            break;
+        case ContentEncoding::Brotli:
+#ifdef WEB_SERVER_HAVE_BROTLI
+        {
+            auto stream = std::make_unique<BrotliStream>();
+            if (stream->init(compressionLevel(encoding, level)))
+            {
+                return stream;
+            }
+        }
+#endif
+            break;
+        case ContentEncoding::Identity:
+            break;
+        }
+        return nullptr;
+    }
+
+    CompressionCache::CompressionCache(size_t max_bytes) : max_bytes_(max_bytes)
+    {
+    }
+
+    std::shared_ptr<const std::string> CompressionCache::lookup(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end())
+        {
+            ++misses_;
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++hits_;
+        return it->second->value;
+    }
+
+    void CompressionCache::insert(const std::string &key, std::shared_ptr<const std::string> value)
+    {
+        size_t size = key.length() + value->length();
+        std::lock_guard<std::mutex> lock(mutex_);
+        claimed_.erase(key);
+        if (size > max_bytes_)
+        {
+            return;
+        }
+        auto existing = index_.find(key);
+        if (existing != index_.end())
+        {
+            eraseLocked(existing->second);
+        }
+        while (!lru_.empty() && bytes_ + size > max_bytes_)
+        {
+            eraseLocked(std::prev(lru_.end()));
+            ++evictions_;
+        }
+        lru_.push_front({key, std::move(value)});
+        index_[key] = lru_.begin();
+        bytes_ += size;
+    }
+
+    bool CompressionCache::claim(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !index_.contains(key) && claimed_.insert(key).second;
+    }
+
+    void CompressionCache::release(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        claimed_.erase(key);
+    }
+
+    void CompressionCache::eraseLocked(std::list<Entry>::iterator it)
+    {
+        bytes_ -= it->key.length() + it->value->length();
+        index_.erase(it->key);
+        lru_.erase(it);
+    }
+
+    void CompressionCache::invalidatePrefix(const std::string &prefix)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = lru_.begin(); it != lru_.end();)
+        {
+            auto next = std::next(it);
+            if (it->key.starts_with(prefix))
+            {
+                eraseLocked(it);
+            }
+            it = next;
+        }
+    }
+
+    CompressionCache::Stats CompressionCache::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {hits_, misses_, evictions_, lru_.size(), bytes_};
+    }
+
+}
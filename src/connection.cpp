@@ -0,0 +1,833 @@
+#include "connection.h"
+#include "buffer_pool.h"
+#include "metrics.h"
+#include <cerrno>
+#include <algorithm>
+#include <charconv>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#endif
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr size_t MAX_GATHER = 64; // iovecs per sendmsg(), well below IOV_MAX
+
+        void releaseFile(OutputSegment &segment)
+        {
+            if (!segment.owner)
+            {
+                close(segment.file_fd);
+            }
+            segment.owner.reset();
+            segment.file_fd = -1;
+        }
+
+        // Closes a descriptor once every segment that refers to it has been sent
+        class FileCloser
+        {
+        public:
+            explicit FileCloser(int fd) : fd_(fd) {}
+            ~FileCloser() { close(fd_); }
+            FileCloser(const FileCloser &) = delete;
+            FileCloser &operator=(const FileCloser &) = delete;
+
+        private:
+            int fd_;
+        };
+    }
+
+    const ConnectionLimits &ConnectionLimits::defaults()
+    {
+        static const ConnectionLimits limits;
+        return limits;
+    }
+
+    Connection::Connection(socket_t socket, const ConnectionLimits &limits)
+        : socket(socket), in(buffers::acquire()), limits_(limits)
+    {
+        parser_.setLimits(limits.max_header_size, limits.max_body_size);
+        metrics::connectionOpened();
+    }
+
+    Connection::Connection(StreamTag, const ConnectionLimits &limits)
+        : socket(-1), in(buffers::acquire()), limits_(limits), stream_(true)
+    {
+        parser_.setLimits(limits.max_header_size, limits.max_body_size);
+    }
+
+    std::unique_ptr<Connection> Connection::forStream(const ConnectionLimits &limits)
+    {
+        return std::unique_ptr<Connection>(new Connection(StreamTag{}, limits));
+    }
+
+    void Connection::receive(const char *data, size_t length)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (in.empty() && header_end == std::string::npos)
+        {
+            request_begun_ = now;
+        }
+        in.append(data, length);
+        metrics::addBytesReceived(length);
+        last_activity = now;
+    }
+
+    metrics::Deadline Connection::deadline(std::chrono::steady_clock::time_point &when) const
+    {
+        auto allowance = [this](std::chrono::milliseconds timeout, std::chrono::steady_clock::time_point start,
+                                size_t bytes)
+        {
+            // Never stalled for longer than the timeout, and on average no slower than min_rate
+            auto stalled = last_activity + timeout;
+            if (limits_.min_rate == 0)
+            {
+                return stalled;
+            }
+            return std::min(stalled, start + timeout + std::chrono::milliseconds(bytes * 1000 / limits_.min_rate));
+        };
+        if (pending_output_ > 0)
+        {
+            when = allowance(limits_.send_timeout, output_started_, output_sent_);
+            return metrics::Deadline::Send;
+        }
+        if (session_)
+        {
+            // Streams in progress keep frames flowing; a silent session is idle
+            when = last_activity + limits_.idle_timeout;
+            return metrics::Deadline::Idle;
+        }
+        if (header_end != std::string::npos)
+        {
+            when = allowance(limits_.body_timeout, request_started, body_streamed_ + (in.length() - header_end));
+            return metrics::Deadline::Body;
+        }
+        if (in.empty() && requests_served > 0)
+        {
+            when = last_activity + limits_.idle_timeout;
+            return metrics::Deadline::Idle;
+        }
+        when = request_begun_ + limits_.header_timeout;
+        return metrics::Deadline::Header;
+    }
+
+    bool Connection::requestComplete()
+    {
+        if (session_)
+        {
+            session_->receive(*this);
+            return false;
+        }
+        if (header_end == std::string::npos)
+        {
+            auto parse_start = std::chrono::steady_clock::now();
+            RequestParser::Result result = parser_.parse(in, request);
+            request_started = std::chrono::steady_clock::now();
+            // A head that arrives in pieces is parsed in several calls; report their sum once
+            parse_time_ += request_started - parse_start;
+            if (result == RequestParser::Result::Incomplete)
+            {
+                return false;
+            }
+            metrics::recordPhase(metrics::Phase::Parse, parse_time_);
+            parse_time_ = {};
+            if (result == RequestParser::Result::Error)
+            {
+                parse_error = parser_.errorStatus();
+                header_end = in.length();
+                return true;
+            }
+            header_end = request.header_length;
+            content_length = request.content_length;
+            parsed_data_ = in.data();
+            if (on_headers)
+            {
+                on_headers(*this);
+            }
+            if (body_sink)
+            {
+                body_sink->wake = wake;
+            }
+            if (session_)
+            {
+                // The head was a connection preface; what follows is the session's
+                in.erase(0, header_end);
+                header_end = std::string::npos;
+                content_length = 0;
+                parser_.reset();
+                session_->receive(*this);
+                return false;
+            }
+        }
+        bool complete = body_sink ? streamBody() : in.length() >= requestLength();
+        if (complete && in.data() != parsed_data_)
+        {
+            // The buffer grew while the body arrived and the views in `request`
+            // point at the old allocation; parsing the head again rebases them
+            parser_.reset();
+            parser_.parse(in, request);
+            parsed_data_ = in.data();
+        }
+        return complete;
+    }
+
+    bool Connection::streamBody()
+    {
+        // Hand buffered body bytes to the sink and drop what it consumed, so only
+        // a small unconsumed tail ever stays in memory.
+        size_t remaining = content_length - body_streamed_;
+        size_t available = std::min(in.length() - header_end, remaining);
+        if (!body_written_ && (available > 0 || remaining == 0) && !body_sink->busy())
+        {
+            bool last = available == remaining;
+            size_t consumed = body_sink->write(std::string_view(in).substr(header_end, available), last);
+            if (last)
+            {
+                consumed = available;
+                body_written_ = true;
+            }
+            in.erase(header_end, consumed);
+            body_streamed_ += consumed;
+        }
+        body_finished_ = body_written_ && !body_sink->busy();
+        return body_finished_;
+    }
+
+    void Connection::consumeRequest()
+    {
+        in.erase(0, requestLength());
+        if (!in.empty())
+        {
+            request_begun_ = std::chrono::steady_clock::now(); // A pipelined request follows
+        }
+        header_end = std::string::npos;
+        content_length = 0;
+        body_sink.reset();
+        body_streamed_ = 0;
+        body_written_ = false;
+        body_finished_ = false;
+        parser_.reset();
+        parse_error = nullptr;
+        response_status = 0;
+        ++requests_served;
+    }
+
+    Connection::~Connection()
+    {
+        // Zerocopy sends still in flight were handed to the reaper by closeSocket()
+        for (auto &segment : out)
+        {
+            if (segment.isFile())
+            {
+                releaseFile(segment);
+            }
+            buffers::release(segment.data);
+        }
+        buffers::release(in);
+        if (!stream_)
+        {
+            metrics::connectionClosed();
+        }
+    }
+
+    void Connection::write(std::string_view data)
+    {
+        // Coalesce with a trailing in-memory segment so headers and small bodies go out in one send
+        if (data.empty())
+        {
+            return;
+        }
+        beginOutput();
+        if (out.empty() || out.back().isFile() || out.back().shared.data() || out.back().sealed)
+        {
+            out.emplace_back().data = buffers::acquire();
+        }
+        out.back().data += data;
+        pending_output_ += data.length();
+    }
+
+    void Connection::writeBuffer(std::string &&buffer)
+    {
+        if (buffer.length() <= COPY_LIMIT)
+        {
+            write(buffer);
+            return;
+        }
+        beginOutput();
+        pending_output_ += buffer.length();
+        OutputSegment &segment = out.emplace_back();
+        segment.data = std::move(buffer);
+        segment.sealed = true; // Nothing is appended to a buffer the handler handed over
+    }
+
+    void Connection::writeShared(std::string_view data, std::shared_ptr<const void> owner, bool zerocopy)
+    {
+        if (data.length() <= COPY_LIMIT && (data.empty() || !zerocopy))
+        {
+            write(data);
+            return;
+        }
+        beginOutput();
+        pending_output_ += data.length();
+        OutputSegment &segment = out.emplace_back();
+        segment.shared = data;
+        segment.owner = std::move(owner);
+        segment.zerocopy = zerocopy;
+    }
+
+    void Connection::writeFile(int file_fd, off_t offset, size_t length, std::shared_ptr<const void> owner)
+    {
+        if (length == 0)
+        {
+            if (!owner)
+            {
+                close(file_fd);
+            }
+            return;
+        }
+        beginOutput();
+        OutputSegment segment;
+        segment.file_fd = file_fd;
+        segment.file_offset = offset;
+        segment.file_remaining = length;
+        segment.owner = std::move(owner);
+        out.push_back(std::move(segment));
+        pending_output_ += length;
+    }
+
+    void Connection::writeStream(std::unique_ptr<BodySource> source)
+    {
+        body_source_ = std::move(source);
+        pullBody(true);
+    }
+
+    void Connection::pullBody(bool once)
+    {
+        while (body_source_ && pending_output_ < STREAM_WATERMARK)
+        {
+            std::string piece = buffers::acquire();
+            BodySource::Result result = body_source_->produce(piece);
+            if (!piece.empty() && stream_)
+            {
+                writeBuffer(std::move(piece)); // The session frames it
+            }
+            else if (!piece.empty())
+            {
+                // chunk = chunk-size (hex) CRLF chunk-data CRLF (RFC 9112 7.1)
+                char size[sizeof(size_t) * 2 + 2];
+                char *end = std::to_chars(size, size + sizeof(size) - 2, piece.length(), 16).ptr;
+                *end++ = '\r';
+                *end++ = '\n';
+                write(std::string_view(size, static_cast<size_t>(end - size)));
+                writeBuffer(std::move(piece));
+                write("\r\n");
+            }
+            buffers::release(piece);
+            if (result == BodySource::Result::Done)
+            {
+                if (!stream_)
+                {
+                    write("0\r\n\r\n");
+                }
+                body_source_.reset();
+            }
+            else if (result == BodySource::Result::Failed)
+            {
+                // Without the last chunk the client sees the body as incomplete
+                close_after_write = true;
+                stream_failed_ = true;
+                body_source_.reset();
+            }
+            if (once)
+            {
+                break;
+            }
+        }
+    }
+
+#ifndef _WIN32
+    size_t Connection::gatherOutput(iovec *iov, size_t max, bool zerocopy_apart, bool &more)
+    {
+        size_t count = 0;
+        auto it = out.begin();
+        for (; it != out.end() && count < max && !it->isFile(); ++it)
+        {
+            if (zerocopy_apart && it->zerocopy && count > 0)
+            {
+                break;
+            }
+            std::string_view bytes = it->bytes().substr(it->data_offset);
+            iov[count].iov_base = const_cast<char *>(bytes.data());
+            iov[count].iov_len = bytes.length();
+            it->sealed = true;
+            ++count;
+        }
+        more = it != out.end();
+        return count;
+    }
+#endif
+
+    Connection::FlushResult Connection::flush()
+    {
+#ifdef MSG_NOSIGNAL
+        int flags = MSG_NOSIGNAL;
+#else
+        int flags = 0;
+#endif
+        reapZeroCopy();
+        while (!out.empty())
+        {
+            OutputSegment &segment = out.front();
+            if (segment.isFile())
+            {
+                FlushResult result = flushFile(segment);
+                if (result != FlushResult::Complete)
+                {
+                    return result;
+                }
+                popSegment();
+                continue;
+            }
+
+#ifdef _WIN32
+            std::string_view bytes = segment.bytes().substr(segment.data_offset);
+            auto sent = send(socket, bytes.data(), static_cast<int>(bytes.length()), flags);
+            if (sent < 0)
+            {
+                return WSAGetLastError() == WSAEWOULDBLOCK ? FlushResult::WouldBlock : FlushResult::Failed;
+            }
+#else
+            // A large shared buffer goes out on its own with MSG_ZEROCOPY; the
+            // buffers gathered around it are pooled and may be reused at once
+            iovec iov[MAX_GATHER];
+            bool more = false;
+            bool zerocopy = segment.zerocopy && enableZeroCopy();
+            size_t count = 0;
+            if (zerocopy)
+            {
+                std::string_view bytes = segment.bytes().substr(segment.data_offset);
+                iov[0].iov_base = const_cast<char *>(bytes.data());
+                iov[0].iov_len = bytes.length();
+                count = 1;
+                more = out.size() > 1;
+            }
+            else
+            {
+                count = gatherOutput(iov, MAX_GATHER, zerocopy_ != ZeroCopy::Disabled, more);
+            }
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            // MSG_MORE holds back a partial packet when a file or further buffers
+            // follow, so headers and body share segments instead of waiting for an ACK
+#ifdef MSG_MORE
+            int send_flags = flags | (more ? MSG_MORE : 0);
+#else
+            int send_flags = flags;
+#endif
+#ifdef MSG_ZEROCOPY
+            if (zerocopy)
+            {
+                send_flags |= MSG_ZEROCOPY;
+            }
+#endif
+            ssize_t sent = sendmsg(socket, &message, send_flags);
+#ifdef MSG_ZEROCOPY
+            if (sent < 0 && zerocopy && errno == ENOBUFS)
+            {
+                // Out of option memory for pinned pages; send this one the ordinary way
+                sent = sendmsg(socket, &message, send_flags & ~MSG_ZEROCOPY);
+                zerocopy = false;
+            }
+#endif
+            if (sent < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return FlushResult::WouldBlock;
+                }
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return FlushResult::Failed;
+            }
+            if (zerocopy)
+            {
+                zerocopy_pending_.push_back({zerocopy_sequence_++, segment.owner});
+            }
+#endif
+            consumeOutput(static_cast<size_t>(sent));
+        }
+        return FlushResult::Complete;
+    }
+
+    void Connection::consumeOutput(size_t bytes)
+    {
+        output_sent_ += bytes;
+        last_activity = std::chrono::steady_clock::now();
+        metrics::addBytesSent(bytes);
+        skipOutput(bytes);
+        pullBody(false);
+        if (session_)
+        {
+            session_->drain(*this);
+        }
+    }
+
+    void Connection::skipOutput(size_t bytes)
+    {
+        pending_output_ -= bytes;
+        while (bytes > 0)
+        {
+            OutputSegment &segment = out.front();
+            size_t taken = std::min(bytes, segment.remaining());
+            if (segment.isFile())
+            {
+                segment.file_offset += static_cast<off_t>(taken);
+                segment.file_remaining -= taken;
+            }
+            else
+            {
+                segment.data_offset += taken;
+            }
+            bytes -= taken;
+            if (segment.remaining() == 0)
+            {
+                popSegment();
+            }
+        }
+    }
+
+    size_t Connection::takeOutput(Connection &to, size_t max)
+    {
+        size_t moved = 0;
+        while (moved < max && !out.empty())
+        {
+            OutputSegment &segment = out.front();
+            size_t taken = std::min(max - moved, segment.remaining());
+            if (segment.isFile())
+            {
+                if (!segment.owner)
+                {
+                    // The range leaves in several pieces; the last one closes the file
+                    segment.owner = std::make_shared<FileCloser>(segment.file_fd);
+                }
+                to.writeFile(segment.file_fd, segment.file_offset, taken, segment.owner);
+            }
+            else
+            {
+                if (!segment.shared.data() && segment.data.length() > COPY_LIMIT)
+                {
+                    // Share a large buffer between its pieces instead of copying each
+                    auto buffer = std::make_shared<const std::string>(std::move(segment.data));
+                    segment.shared = *buffer;
+                    segment.owner = std::move(buffer);
+                }
+                std::string_view bytes = segment.bytes().substr(segment.data_offset, taken);
+                if (segment.shared.data())
+                {
+                    to.writeShared(bytes, segment.owner, segment.zerocopy);
+                }
+                else
+                {
+                    to.write(bytes);
+                }
+            }
+            skipOutput(taken);
+            moved += taken;
+        }
+        pullBody(false);
+        return moved;
+    }
+
+    void Connection::beginOutput()
+    {
+        if (out.empty())
+        {
+            output_started_ = std::chrono::steady_clock::now();
+            output_sent_ = 0;
+        }
+    }
+
+    void Connection::popSegment()
+    {
+        OutputSegment &segment = out.front();
+        if (segment.isFile())
+        {
+            releaseFile(segment);
+        }
+        buffers::release(segment.data);
+        out.pop_front();
+        if (out.empty() && !stream_)
+        {
+            metrics::recordPhase(metrics::Phase::Send, std::chrono::steady_clock::now() - output_started_);
+        }
+    }
+
+    bool Connection::enableZeroCopy()
+    {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+        if (zerocopy_ == ZeroCopy::Untried)
+        {
+            int on = 1;
+            zerocopy_ = setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0 ? ZeroCopy::Enabled
+                                                                                          : ZeroCopy::Disabled;
+        }
+        return zerocopy_ == ZeroCopy::Enabled;
+#else
+        return false;
+#endif
+    }
+
+    void Connection::reapZeroCopy()
+    {
+        if (!zerocopy_pending_.empty() && reapCompletions(socket, zerocopy_pending_))
+        {
+            // The kernel had to copy anyway (loopback, or a device without
+            // scatter-gather); plain sends are cheaper from now on
+            zerocopy_ = ZeroCopy::Disabled;
+        }
+    }
+
+    bool Connection::reapCompletions(socket_t socket, std::vector<ZeroCopySend> &pending)
+    {
+        bool copied = false;
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+        while (!pending.empty())
+        {
+            char control[128];
+            msghdr message{};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (recvmsg(socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            {
+                break; // Nothing more has completed yet
+            }
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+            {
+                bool recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                               (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                auto *error = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cmsg));
+                if (!recverr || error->ee_errno != 0 || error->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                {
+                    continue;
+                }
+                copied = copied || (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+                // One notification completes the inclusive range of sends [ee_info, ee_data]
+                uint32_t first = error->ee_info;
+                uint32_t span = error->ee_data - first;
+                std::erase_if(pending, [first, span](const ZeroCopySend &send)
+                              { return send.sequence - first <= span; });
+            }
+        }
+#else
+        (void)socket;
+        (void)pending;
+#endif
+        return copied;
+    }
+
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    // Sockets closed with zerocopy sends in flight. A completion (or an error)
+    // on the error queue raises EPOLLERR; once all sends have completed, or the
+    // peer has not taken the data within LINGER_TIMEOUT, the socket is closed.
+    class Connection::ZeroCopyReaper
+    {
+    public:
+        static ZeroCopyReaper &instance()
+        {
+            static ZeroCopyReaper reaper;
+            return reaper;
+        }
+
+        void adopt(socket_t socket, std::vector<ZeroCopySend> pending)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                sockets_[socket] = {std::move(pending), std::chrono::steady_clock::now() + LINGER_TIMEOUT};
+            }
+            // EPOLLERR is always reported; edge-triggered because the shut down
+            // socket reports EPOLLHUP for good. Should this fail, the deadline
+            // sweep still closes the socket.
+            epoll_event event{};
+            event.events = EPOLLET;
+            event.data.fd = socket;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &event);
+        }
+
+    private:
+        static constexpr std::chrono::seconds LINGER_TIMEOUT{30};
+
+        struct Lingering
+        {
+            std::vector<ZeroCopySend> pending;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        int epoll_fd_;
+        int stop_fd_;
+        std::mutex mutex_;
+        std::unordered_map<socket_t, Lingering> sockets_;
+        std::thread thread_;
+
+        ZeroCopyReaper() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), stop_fd_(eventfd(0, EFD_CLOEXEC))
+        {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = stop_fd_;
+            if (epoll_fd_ != -1 && stop_fd_ != -1)
+            {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event);
+            }
+            thread_ = std::thread([this]
+                                  { run(); });
+        }
+
+        ~ZeroCopyReaper()
+        {
+            uint64_t one = 1;
+            (void)!::write(stop_fd_, &one, sizeof(one));
+            thread_.join();
+            for (auto &[socket, lingering] : sockets_)
+            {
+                close(socket);
+            }
+            close(stop_fd_);
+            close(epoll_fd_);
+        }
+
+        void run()
+        {
+            epoll_event events[64];
+            while (true)
+            {
+                int count = epoll_wait(epoll_fd_, events, 64, 1000);
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (int i = 0; i < count; ++i)
+                {
+                    if (events[i].data.fd == stop_fd_)
+                    {
+                        return;
+                    }
+                    auto it = sockets_.find(events[i].data.fd);
+                    if (it != sockets_.end())
+                    {
+                        reapCompletions(it->first, it->second.pending);
+                        if (it->second.pending.empty())
+                        {
+                            it = release(it, false);
+                        }
+                    }
+                }
+                auto now = std::chrono::steady_clock::now();
+                for (auto it = sockets_.begin(); it != sockets_.end();)
+                {
+                    it = it->second.deadline <= now ? release(it, true) : std::next(it);
+                }
+            }
+        }
+
+        std::unordered_map<socket_t, Lingering>::iterator release(std::unordered_map<socket_t, Lingering>::iterator it,
+                                                                  bool abort)
+        {
+            if (abort)
+            {
+                // Resetting the connection drops the unsent data, and with it the
+                // kernel's last references to the buffers
+                linger option{1, 0};
+                setsockopt(it->first, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+            }
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->first, nullptr);
+            close(it->first);
+            return sockets_.erase(it);
+        }
+    };
+#endif
+
+    void Connection::closeSocket()
+    {
+        reapZeroCopy();
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+        if (!zerocopy_pending_.empty())
+        {
+            // Sends the queued data and the FIN as close() would, and refuses input
+            shutdown(socket, SHUT_RDWR);
+            ZeroCopyReaper::instance().adopt(socket, std::move(zerocopy_pending_));
+            zerocopy_pending_.clear();
+            return;
+        }
+#endif
+        CLOSE_SOCKET(socket);
+    }
+
+    bool Connection::checkSocketError()
+    {
+        reapZeroCopy();
+        int error = 0;
+        socklen_t length = sizeof(error);
+        return getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &length) != 0 || error != 0;
+    }
+
+    Connection::FlushResult Connection::flushFile(OutputSegment &segment)
+    {
+        while (segment.file_remaining > 0)
+        {
+#if defined(__linux__)
+            // The kernel advances file_offset by the number of bytes sent
+            size_t chunk = std::min<size_t>(segment.file_remaining, 1 << 30);
+            ssize_t sent = sendfile(socket, segment.file_fd, &segment.file_offset, chunk);
+#elif !defined(_WIN32)
+            char buffer[65536];
+            size_t chunk = std::min<size_t>(segment.file_remaining, sizeof(buffer));
+            ssize_t bytes_read = pread(segment.file_fd, buffer, chunk, segment.file_offset);
+            if (bytes_read <= 0)
+            {
+                return FlushResult::Failed;
+            }
+            ssize_t sent = send(socket, buffer, static_cast<size_t>(bytes_read), 0);
+            if (sent > 0)
+            {
+                segment.file_offset += sent;
+            }
+#else
+            ssize_t sent = -1;
+#endif
+            if (sent < 0)
+            {
+#ifndef _WIN32
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return FlushResult::WouldBlock;
+                }
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+#endif
+                return FlushResult::Failed;
+            }
+            if (sent == 0)
+            {
+                return FlushResult::Failed; // File shrank underneath us
+            }
+            segment.file_remaining -= static_cast<size_t>(sent);
+            pending_output_ -= static_cast<size_t>(sent);
+            output_sent_ += static_cast<size_t>(sent);
+            last_activity = std::chrono::steady_clock::now();
+            metrics::addBytesSent(static_cast<size_t>(sent));
+        }
+        return FlushResult::Complete;
+    }
+
+}
@@ -0,0 +1,403 @@
+#include "event_loop.h"
+#include "logger.h"
+#include "metrics.h"
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr int MAX_EVENTS = 256;
+        constexpr std::chrono::milliseconds DEADLINE_TICK{100};
+        // Stop handling pipelined requests while this much output is still unsent
+        constexpr size_t MAX_PENDING_OUTPUT = 64 * 1024;
+        // Process (and stream away request bodies) once this much input is buffered
+        constexpr size_t READ_BATCH_SIZE = 256 * 1024;
+
+        void setNonBlocking(socket_t socket)
+        {
+            int flags = fcntl(socket, F_GETFL, 0);
+            if (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1)
+            {
+                throw std::runtime_error("Failed to make socket non-blocking");
+            }
+        }
+    }
+
+    EventLoop::EventLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                         const ConnectionLimits &limits)
+        : listen_socket_(listen_socket), epoll_fd_(-1), handler_(std::move(handler)),
+          headers_handler_(std::move(headers_handler)), limits_(limits), timers_(DEADLINE_TICK), wake_fd_(-1)
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ == -1)
+        {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+        setNonBlocking(listen_socket_);
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = listen_socket_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_socket_, &event) == -1)
+        {
+            close(epoll_fd_);
+            throw std::runtime_error("Failed to register listening socket with epoll");
+        }
+
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = wake_fd_;
+        if (wake_fd_ == -1 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) == -1)
+        {
+            if (wake_fd_ != -1)
+            {
+                close(wake_fd_);
+            }
+            close(epoll_fd_);
+            throw std::runtime_error("Failed to register wake eventfd with epoll");
+        }
+    }
+
+    EventLoop::~EventLoop()
+    {
+        for (auto &[fd, conn] : connections_)
+        {
+            CLOSE_SOCKET(fd);
+        }
+        if (wake_fd_ != -1)
+        {
+            close(wake_fd_);
+        }
+        if (epoll_fd_ != -1)
+        {
+            close(epoll_fd_);
+        }
+    }
+
+    void EventLoop::run()
+    {
+        epoll_event events[MAX_EVENTS];
+        while (true)
+        {
+            int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timers_.pollTimeout(std::chrono::steady_clock::now()));
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("epoll_wait failed");
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                socket_t fd = events[i].data.fd;
+                if (fd == listen_socket_)
+                {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == wake_fd_)
+                {
+                    onWake();
+                    continue;
+                }
+
+                auto it = connections_.find(fd);
+                if (it == connections_.end())
+                {
+                    continue;
+                }
+                Connection &conn = *it->second;
+                // Zerocopy completions also raise EPOLLERR without the socket having failed
+                if ((events[i].events & EPOLLERR) && conn.checkSocketError())
+                {
+                    closeConnection(conn);
+                }
+                if (conn.state != Connection::State::Closed && (events[i].events & (EPOLLIN | EPOLLHUP)))
+                {
+                    onReadable(conn);
+                }
+                if (conn.state != Connection::State::Closed && (events[i].events & EPOLLOUT))
+                {
+                    onWritable(conn);
+                }
+                if (conn.state == Connection::State::Closed)
+                {
+                    connections_.erase(it);
+                }
+                else
+                {
+                    scheduleDeadline(conn);
+                }
+            }
+            timers_.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer &timer)
+                            { onDeadline(timer); });
+        }
+    }
+
+    void EventLoop::onWake()
+    {
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0)
+        {
+        }
+        std::vector<socket_t> woken;
+        {
+            std::lock_guard<std::mutex> lock(woken_mutex_);
+            woken.swap(woken_);
+        }
+        for (socket_t fd : woken)
+        {
+            // The connection may have closed, and its descriptor been reused, since
+            // the wake was queued; processing a request again is harmless then
+            auto it = connections_.find(fd);
+            if (it == connections_.end())
+            {
+                continue;
+            }
+            Connection &conn = *it->second;
+            if (conn.state == Connection::State::ReadingRequest)
+            {
+                processRequests(conn);
+            }
+            // Reading was paused on a busy body sink that may now take more
+            if (conn.read_paused && conn.state == Connection::State::ReadingRequest &&
+                conn.in.length() < READ_BATCH_SIZE)
+            {
+                conn.read_paused = false;
+                onReadable(conn);
+            }
+            if (conn.state == Connection::State::Closed)
+            {
+                connections_.erase(it);
+            }
+            else
+            {
+                scheduleDeadline(conn);
+            }
+        }
+    }
+
+    void EventLoop::scheduleDeadline(Connection &conn)
+    {
+        std::chrono::steady_clock::time_point when;
+        conn.deadline(when);
+        timers_.schedule(conn.timer, when);
+    }
+
+    void EventLoop::onDeadline(TimerWheel::Timer &timer)
+    {
+        auto it = connections_.find(static_cast<socket_t>(timer.id));
+        if (it == connections_.end())
+        {
+            return;
+        }
+        Connection &conn = *it->second;
+        std::chrono::steady_clock::time_point when;
+        metrics::Deadline deadline = conn.deadline(when);
+        if (std::chrono::steady_clock::now() < when)
+        {
+            timers_.schedule(conn.timer, when);
+            return;
+        }
+        if (deadline != metrics::Deadline::Idle)
+        {
+            LOG_DEBUG << "Closing connection: " << metrics::deadlineName(deadline) << " deadline passed";
+        }
+        metrics::connectionTimedOut(deadline);
+        closeConnection(conn);
+        connections_.erase(it);
+    }
+
+    void EventLoop::acceptConnections()
+    {
+        // Edge-triggered: drain the accept queue until the kernel reports EAGAIN
+        while (true)
+        {
+            socket_t client_socket = accept4(listen_socket_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_socket == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    LOG_WARN << "Failed to accept connection";
+                }
+                return;
+            }
+
+            // Registered once for both directions; with EPOLLET we are only woken on
+            // state changes, so write interest does not cause busy wakeups.
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            event.data.fd = client_socket;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_socket, &event) == -1)
+            {
+                LOG_ERROR << "Failed to register client socket with epoll";
+                CLOSE_SOCKET(client_socket);
+                continue;
+            }
+            auto conn = std::make_unique<Connection>(client_socket, limits_);
+            conn->on_headers = headers_handler_;
+            conn->wake = [this, client_socket]
+            {
+                {
+                    std::lock_guard<std::mutex> lock(woken_mutex_);
+                    woken_.push_back(client_socket);
+                }
+                uint64_t one = 1;
+                if (write(wake_fd_, &one, sizeof(one)) < 0)
+                {
+                    // EAGAIN: the counter is saturated, so the loop wakes anyway
+                }
+            };
+            conn->timer.id = static_cast<uint64_t>(client_socket);
+            scheduleDeadline(*conn);
+            connections_[client_socket] = std::move(conn);
+        }
+    }
+
+    void EventLoop::onReadable(Connection &conn)
+    {
+        char buffer[32768];
+        bool peer_closed = false;
+        while (true)
+        {
+            ssize_t bytes_received = recv(conn.socket, buffer, sizeof(buffer), 0);
+            if (bytes_received > 0)
+            {
+                conn.receive(buffer, static_cast<size_t>(bytes_received));
+                if (conn.in.length() >= READ_BATCH_SIZE)
+                {
+                    processRequests(conn);
+                    if (conn.state == Connection::State::Closed)
+                    {
+                        return;
+                    }
+                    if (conn.in.length() >= READ_BATCH_SIZE)
+                    {
+                        // Nothing more can be consumed until the client reads our output;
+                        // stop draining the socket and resume from onWritable().
+                        conn.read_paused = true;
+                        return;
+                    }
+                }
+                continue;
+            }
+            if (bytes_received == 0)
+            {
+                peer_closed = true;
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            closeConnection(conn);
+            return;
+        }
+
+        processRequests(conn);
+        if (peer_closed && conn.state != Connection::State::Closed)
+        {
+            // The client will send nothing more: finish any pending output, then close
+            conn.close_after_write = true;
+            if (conn.state == Connection::State::ReadingRequest)
+            {
+                closeConnection(conn);
+            }
+        }
+    }
+
+    void EventLoop::processRequests(Connection &conn)
+    {
+        // Serve every complete (possibly pipelined) request already buffered,
+        // pausing while the client is slow to drain earlier responses or a
+        // streamed body has not been produced in full.
+        while (!conn.close_after_write && !conn.streaming() && conn.pendingOutput() < MAX_PENDING_OUTPUT &&
+               conn.requestComplete())
+        {
+            handler_(conn);
+            conn.consumeRequest();
+        }
+        if (conn.pendingOutput() > 0)
+        {
+            conn.state = Connection::State::WritingResponse;
+            onWritable(conn);
+        }
+        else if (conn.close_after_write)
+        {
+            closeConnection(conn);
+        }
+    }
+
+    void EventLoop::onWritable(Connection &conn)
+    {
+        if (conn.state != Connection::State::WritingResponse)
+        {
+            return;
+        }
+        switch (conn.flush())
+        {
+        case Connection::FlushResult::WouldBlock:
+            return; // Resume on the next EPOLLOUT edge
+        case Connection::FlushResult::Failed:
+            closeConnection(conn);
+            return;
+        case Connection::FlushResult::Complete:
+            conn.state = Connection::State::ReadingRequest;
+            processRequests(conn);
+            if (conn.read_paused && conn.state == Connection::State::ReadingRequest)
+            {
+                conn.read_paused = false;
+                onReadable(conn);
+            }
+            return;
+        }
+    }
+
+    void EventLoop::closeConnection(Connection &conn)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.socket, nullptr);
+        conn.closeSocket();
+        conn.state = Connection::State::Closed;
+    }
+
+}
+
+#else
+
+namespace web_server
+{
+
+    EventLoop::EventLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                         const ConnectionLimits &limits)
+        : listen_socket_(listen_socket), epoll_fd_(-1), handler_(std::move(handler)),
+          headers_handler_(std::move(headers_handler)), limits_(limits), timers_(std::chrono::milliseconds(100)),
+          wake_fd_(-1)
+    {
+        throw std::runtime_error("The epoll I/O mode is only available on Linux");
+    }
+
+    EventLoop::~EventLoop() {}
+
+    void EventLoop::run() {}
+
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "file_cache.h"
+#include <cerrno>
+#include <fstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace web_server
+{
+
+    FileCache::FileCache(size_t max_bytes, size_t max_file_size)
+        : max_file_size_(max_file_size), shard_capacity_(max_bytes / SHARD_COUNT)
+    {
+    }
+
+    FileCache::Shard &FileCache::shardFor(std::string_view path)
+    {
+        return shards_[PathHash{}(path) % SHARD_COUNT];
+    }
+
+    std::shared_ptr<const CachedFile> FileCache::lookup(std::string_view path, const OpenFile &file,
+                                                        std::string_view content_type)
+    {
+        Shard &shard = shardFor(path);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(path);
+            if (it != shard.index.end())
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                ++shard.hits;
+                return it->second->file;
+            }
+            ++shard.misses;
+        }
+
+        // Load outside the lock so a slow disk read does not stall other hits
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        if (!file.isRegular())
+        {
+            return nullptr;
+        }
+        auto size = static_cast<size_t>(file.info.st_size);
+        if (size > max_file_size_ || size > shard_capacity_)
+        {
+            return nullptr;
+        }
+        std::string body(size, '\0');
+#ifdef _WIN32
+        std::ifstream stream(std::string(path), std::ios::binary);
+        if (!stream.read(body.data(), static_cast<std::streamsize>(size)))
+        {
+            return nullptr;
+        }
+#else
+        // The descriptor may be shared, so read positionally
+        for (size_t offset = 0; offset < size;)
+        {
+            ssize_t bytes_read = pread(file.fd, body.data() + offset, size - offset, static_cast<off_t>(offset));
+            if (bytes_read <= 0)
+            {
+                if (bytes_read < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                return nullptr; // Shrank or failed while being read
+            }
+            offset += static_cast<size_t>(bytes_read);
+        }
+#endif
+
+        auto cached = std::make_shared<CachedFile>();
+        cached->body = std::move(body);
+        cached->content_type = content_type;
+        cached->validators = file.validators;
+        cached->headers = "Content-Type: " + cached->content_type + "; charset=UTF-8\r\n" +
+                          "Content-Length: " + std::to_string(cached->body.length()) + "\r\n" +
+                          "Accept-Ranges: bytes\r\n" +
+                          "ETag: " + cached->validators.etag + "\r\n" +
+                          "Last-Modified: " + cached->validators.last_modified + "\r\n";
+
+        if (epoch_.load(std::memory_order_acquire) == epoch)
+        {
+            insert(shard, path, cached);
+        }
+        return cached;
+    }
+
+    void FileCache::insert(Shard &shard, std::string_view path, std::shared_ptr<const CachedFile> file)
+    {
+        size_t size = path.length() + file->headers.length() + file->body.length();
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto existing = shard.index.find(path);
+        if (existing != shard.index.end())
+        {
+            eraseLocked(shard, existing->second);
+        }
+        while (!shard.lru.empty() && shard.bytes + size > shard_capacity_)
+        {
+            eraseLocked(shard, std::prev(shard.lru.end()));
+            ++shard.evictions;
+        }
+        shard.lru.push_front({std::string(path), std::move(file), size});
+        shard.index.emplace(shard.lru.front().path, shard.lru.begin());
+        shard.bytes += size;
+    }
+
+    void FileCache::eraseLocked(Shard &shard, std::list<Entry>::iterator it)
+    {
+        shard.bytes -= it->size;
+        shard.index.erase(it->path);
+        shard.lru.erase(it);
+    }
+
+    void FileCache::invalidate(const std::string &path)
+    {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+        Shard &shard = shardFor(path);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end())
+        {
+            eraseLocked(shard, it->second);
+            ++shard.invalidations;
+        }
+    }
+
+    void FileCache::invalidatePrefix(const std::string &prefix)
+    {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+        for (auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto it = shard.lru.begin(); it != shard.lru.end();)
+            {
+                auto next = std::next(it);
+                if (it->path.starts_with(prefix))
+                {
+                    eraseLocked(shard, it);
+                    ++shard.invalidations;
+                }
+                it = next;
+            }
+        }
+    }
+
+    void FileCache::clear()
+    {
+        invalidatePrefix("");
+    }
+
+    FileCache::Stats FileCache::stats() const
+    {
+        Stats stats{};
+        for (const auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.evictions += shard.evictions;
+            stats.invalidations += shard.invalidations;
+            stats.entries += shard.lru.size();
+            stats.bytes += shard.bytes;
+        }
+        return stats;
+    }
+
+}
@@ -0,0 +1,685 @@
+#include "file_index.h"
+#include "logger.h"
+#include "upload_receiver.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr uint32_t NO_ENTRY = UINT32_MAX; // Parent of the names in the root, or nothing found
+        constexpr size_t MAX_NAME_LENGTH = 255;
+        // The additions and removals are merged into a new arena once there are
+        // more than this, or than the arena's size divided by COMPACT_RATIO
+        constexpr size_t MIN_COMPACT_CHANGES = 1024;
+        constexpr size_t COMPACT_RATIO = 64;
+
+        void appendFolded(std::string &out, std::string_view name)
+        {
+            for (char c : name)
+            {
+                out += c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+        }
+
+        // For paths relative to the root ("/dir/name") and absolute ones alike
+        std::string_view baseName(std::string_view path)
+        {
+            return path.substr(path.rfind('/') + 1);
+        }
+
+        std::string_view parentOf(std::string_view path)
+        {
+            return path.substr(0, path.rfind('/'));
+        }
+
+        // The first occurrence of `needle` in [first, last), or `last`
+        const char *findBytes(const char *first, const char *last, std::string_view needle)
+        {
+#ifdef __linux__
+            // glibc's memmem scans with the vectorized memchr for short needles
+            // and the two-way algorithm for long ones
+            const void *hit = memmem(first, last - first, needle.data(), needle.length());
+            return hit ? static_cast<const char *>(hit) : last;
+#else
+            return std::search(first, last, std::boyer_moore_horspool_searcher(needle.begin(), needle.end()));
+#endif
+        }
+
+        bool isBelow(std::string_view path, std::string_view directory)
+        {
+            return path.size() > directory.size() && path.starts_with(directory) && path[directory.size()] == '/';
+        }
+    }
+
+    struct FileIndex::Entry
+    {
+        uint32_t offset; // Of the name, in both arenas
+        uint32_t parent; // Entry of the directory holding it
+        uint8_t length;
+        bool is_directory;
+    };
+
+    struct FileIndex::Table
+    {
+        // Every name followed by '\0', in the order of `entries`, and the same
+        // bytes case folded at the same offsets for matching
+        std::string names;
+        std::string keys;
+        std::vector<Entry> entries; // Sorted by key, then name
+
+        std::string_view key(const Entry &entry) const { return {keys.data() + entry.offset, entry.length}; }
+        std::string_view name(const Entry &entry) const { return {names.data() + entry.offset, entry.length}; }
+
+        void appendPath(uint32_t index, std::string &out) const
+        {
+            const Entry &entry = entries[index];
+            if (entry.parent != NO_ENTRY)
+            {
+                appendPath(entry.parent, out);
+            }
+            out += '/';
+            out += name(entry);
+        }
+
+        // The entry at `relative`, or NO_ENTRY
+        uint32_t find(std::string_view relative) const
+        {
+            uint32_t parent = NO_ENTRY;
+            std::string_view parent_path = parentOf(relative);
+            if (!parent_path.empty() && (parent = find(parent_path)) == NO_ENTRY)
+            {
+                return NO_ENTRY;
+            }
+            std::string_view name = baseName(relative);
+            std::string folded;
+            appendFolded(folded, name);
+            auto it = std::partition_point(entries.begin(), entries.end(),
+                                           [&](const Entry &entry)
+                                           { return key(entry) < folded; });
+            for (; it != entries.end() && key(*it) == folded; ++it)
+            {
+                if (it->parent == parent && this->name(*it) == name)
+                {
+                    return static_cast<uint32_t>(it - entries.begin());
+                }
+            }
+            return NO_ENTRY;
+        }
+
+        size_t bytes() const { return names.capacity() + keys.capacity() + entries.capacity() * sizeof(Entry); }
+    };
+
+    struct FileIndex::Snapshot
+    {
+        struct Addition
+        {
+            std::string key;  // The name case folded
+            std::string path; // Relative to the root
+            bool is_directory;
+
+            bool operator<(const Addition &other) const
+            {
+                return key != other.key ? key < other.key : path < other.path;
+            }
+        };
+
+        std::shared_ptr<const Table> base = std::make_shared<const Table>();
+        std::vector<Addition> additions;       // Sorted; not in `base`
+        std::unordered_set<uint32_t> removals; // Entries of `base` hidden along with everything below them
+        bool ready = false;
+
+        bool hidden(uint32_t index) const
+        {
+            if (removals.empty())
+            {
+                return false;
+            }
+            for (; index != NO_ENTRY; index = base->entries[index].parent)
+            {
+                if (removals.contains(index))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool contains(std::string_view relative) const
+        {
+            uint32_t index = base->find(relative);
+            if (index != NO_ENTRY && !hidden(index))
+            {
+                return true;
+            }
+            Addition probe{{}, std::string(relative), false};
+            appendFolded(probe.key, baseName(relative));
+            auto it = std::lower_bound(additions.begin(), additions.end(), probe);
+            return it != additions.end() && it->path == relative;
+        }
+    };
+
+    // Collects names in any order, each with the id of its directory, and
+    // sorts them into a Table
+    class FileIndex::Builder
+    {
+    public:
+        // The id of the new entry, counting from 0; NO_ENTRY if it cannot be held
+        uint32_t add(uint32_t parent, std::string_view name, bool is_directory)
+        {
+            if (name.empty() || name.length() > MAX_NAME_LENGTH || names_.size() + name.length() + 1 >= NO_ENTRY)
+            {
+                return NO_ENTRY;
+            }
+            entries_.push_back({static_cast<uint32_t>(names_.size()), parent, static_cast<uint8_t>(name.length()), is_directory});
+            names_.append(name) += '\0';
+            appendFolded(keys_, name);
+            keys_ += '\0';
+            return static_cast<uint32_t>(entries_.size() - 1);
+        }
+
+        std::shared_ptr<const Table> finish()
+        {
+            auto key = [this](uint32_t id)
+            { return std::string_view(keys_.data() + entries_[id].offset, entries_[id].length); };
+            auto name = [this](uint32_t id)
+            { return std::string_view(names_.data() + entries_[id].offset, entries_[id].length); };
+            std::vector<uint32_t> order(entries_.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                      {
+                          int compared = key(a).compare(key(b));
+                          return compared != 0 ? compared < 0 : name(a) < name(b); });
+            std::vector<uint32_t> rank(order.size());
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                rank[order[i]] = static_cast<uint32_t>(i);
+            }
+
+            auto table = std::make_shared<Table>();
+            table->names.reserve(names_.size());
+            table->keys.reserve(keys_.size());
+            table->entries.reserve(entries_.size());
+            for (uint32_t id : order)
+            {
+                const Entry &entry = entries_[id];
+                table->entries.push_back({static_cast<uint32_t>(table->names.size()),
+                                          entry.parent == NO_ENTRY ? NO_ENTRY : rank[entry.parent],
+                                          entry.length, entry.is_directory});
+                table->names.append(names_, entry.offset, entry.length + 1);
+                table->keys.append(keys_, entry.offset, entry.length + 1);
+            }
+            return table;
+        }
+
+    private:
+        std::string names_;
+        std::string keys_;
+        std::vector<Entry> entries_; // `parent` holds ids until finish()
+    };
+
+    FileIndex::FileIndex(const std::string &root, std::vector<std::string> excluded)
+        : root_(root), excluded_(std::move(excluded)), snapshot_(std::make_shared<const Snapshot>()),
+          working_(std::make_unique<Snapshot>())
+    {
+    }
+
+    FileIndex::~FileIndex()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_one();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    void FileIndex::start()
+    {
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread(&FileIndex::run, this);
+        }
+    }
+
+    void FileIndex::added(const std::string &path, bool is_directory)
+    {
+        enqueue({Change::Type::Added, path, is_directory});
+    }
+
+    void FileIndex::removed(const std::string &path)
+    {
+        enqueue({Change::Type::Removed, path, false});
+    }
+
+    void FileIndex::rebuild()
+    {
+        enqueue({Change::Type::Rebuild, {}, false});
+    }
+
+    void FileIndex::enqueue(Change change)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_.size() >= MAX_PENDING_CHANGES)
+            {
+                // The walk catches up with all of them at once
+                pending_.clear();
+                change = {Change::Type::Rebuild, {}, false};
+            }
+            pending_.push_back(std::move(change));
+        }
+        changed_.notify_one();
+    }
+
+    bool FileIndex::ready() const
+    {
+        return snapshot_.load()->ready;
+    }
+
+    FileIndex::Stats FileIndex::stats() const
+    {
+        std::shared_ptr<const Snapshot> snapshot = snapshot_.load();
+        Stats stats{snapshot->base->entries.size() + snapshot->additions.size(), snapshot->base->bytes(), snapshot->ready};
+        for (const auto &addition : snapshot->additions)
+        {
+            stats.bytes += sizeof(addition) + addition.key.capacity() + addition.path.capacity();
+        }
+        return stats;
+    }
+
+    size_t FileIndex::search(std::string_view query, Match match, size_t limit, std::vector<Result> &results) const
+    {
+        if (query.empty() || query.find('\0') != std::string_view::npos)
+        {
+            return 0;
+        }
+        std::shared_ptr<const Snapshot> snapshot = snapshot_.load();
+        const Table &base = *snapshot->base;
+        std::string key;
+        appendFolded(key, query);
+
+        // Matches in the arena, in key order
+        std::vector<uint32_t> found;
+        size_t total = 0;
+        auto collect = [&](uint32_t index)
+        {
+            if (!snapshot->hidden(index))
+            {
+                ++total;
+                if (found.size() < limit)
+                {
+                    found.push_back(index);
+                }
+            }
+        };
+        if (match == Match::Prefix)
+        {
+            auto first = std::partition_point(base.entries.begin(), base.entries.end(), [&](const Entry &entry)
+                                              { return base.key(entry) < key; });
+            auto last = std::partition_point(first, base.entries.end(), [&](const Entry &entry)
+                                             { return base.key(entry).starts_with(key); });
+            for (auto it = first; it != last; ++it)
+            {
+                if (snapshot->removals.empty() && found.size() == limit)
+                {
+                    total += last - it;
+                    break;
+                }
+                collect(static_cast<uint32_t>(it - base.entries.begin()));
+            }
+        }
+        else
+        {
+            // One pass over the folded arena. Names are separated by '\0', which
+            // a query cannot contain, so every hit lies within a single name.
+            const char *data = base.keys.data();
+            const char *end = data + base.keys.size();
+            auto entry = base.entries.begin();
+            for (const char *at = data;;)
+            {
+                const char *hit = findBytes(at, end, key);
+                if (hit == end)
+                {
+                    break;
+                }
+                auto offset = static_cast<uint32_t>(hit - data);
+                entry = std::upper_bound(entry, base.entries.end(), offset, [](uint32_t value, const Entry &candidate)
+                                         { return value < candidate.offset; }) -
+                        1;
+                collect(static_cast<uint32_t>(entry - base.entries.begin()));
+                at = data + entry->offset + entry->length;
+                ++entry;
+            }
+        }
+
+        std::vector<const Snapshot::Addition *> added;
+        for (const auto &addition : snapshot->additions)
+        {
+            if (match == Match::Prefix ? addition.key.starts_with(key) : addition.key.find(key) != std::string::npos)
+            {
+                ++total;
+                if (added.size() < limit)
+                {
+                    added.push_back(&addition);
+                }
+            }
+        }
+
+        // Both are in key order; merge them up to the limit
+        auto next_found = found.begin();
+        auto next_added = added.begin();
+        for (size_t count = 0; count < limit && (next_found != found.end() || next_added != added.end()); ++count)
+        {
+            if (next_added == added.end() ||
+                (next_found != found.end() && base.key(base.entries[*next_found]) <= (*next_added)->key))
+            {
+                Result result{{}, base.entries[*next_found].is_directory};
+                base.appendPath(*next_found++, result.path);
+                results.push_back(std::move(result));
+            }
+            else
+            {
+                results.push_back({(*next_added)->path, (*next_added)->is_directory});
+                ++next_added;
+            }
+        }
+        return total;
+    }
+
+    void FileIndex::run()
+    {
+        bool rebuild = true;
+        while (true)
+        {
+            if (rebuild)
+            {
+                auto started = std::chrono::steady_clock::now();
+                std::shared_ptr<const Table> table = walk();
+                if (!table)
+                {
+                    return;
+                }
+                working_->base = std::move(table);
+                working_->additions.clear();
+                working_->removals.clear();
+                working_->ready = true;
+                snapshot_.store(std::make_shared<const Snapshot>(*working_));
+                LOG_INFO << "Indexed " << working_->base->entries.size() << " names in "
+                         << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+                         << " ms";
+            }
+
+            std::vector<Change> changes;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [this]
+                              { return stopping_ || !pending_.empty(); });
+                if (stopping_)
+                {
+                    return;
+                }
+                changes.swap(pending_);
+            }
+            // A walk sees the outcome of every change made before it
+            rebuild = std::any_of(changes.begin(), changes.end(), [](const Change &change)
+                                  { return change.type == Change::Type::Rebuild; });
+            if (rebuild)
+            {
+                continue;
+            }
+            for (const Change &change : changes)
+            {
+                apply(change);
+            }
+            if (working_->additions.size() + working_->removals.size() >
+                std::max(MIN_COMPACT_CHANGES, working_->base->entries.size() / COMPACT_RATIO))
+            {
+                compact();
+            }
+            snapshot_.store(std::make_shared<const Snapshot>(*working_));
+        }
+    }
+
+    bool FileIndex::excluded(std::string_view relative) const
+    {
+        if (UploadReceiver::temporaryFilename(baseName(relative)))
+        {
+            return true;
+        }
+        for (const auto &path : excluded_)
+        {
+            if (relative == path || isBelow(relative, path))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<const FileIndex::Table> FileIndex::walk()
+    {
+        Builder builder;
+        std::vector<std::pair<std::string, uint32_t>> directories{{root_, NO_ENTRY}};
+        while (!directories.empty())
+        {
+            auto [directory, parent] = std::move(directories.back());
+            directories.pop_back();
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if (stopping_.load(std::memory_order_relaxed))
+                {
+                    return nullptr;
+                }
+                std::string path = it->path().string();
+                if (excluded(std::string_view(path).substr(root_.size())))
+                {
+                    continue;
+                }
+                std::error_code type_ec;
+                bool is_directory = it->is_directory(type_ec) && !it->is_symlink(type_ec);
+                uint32_t id = builder.add(parent, baseName(path), is_directory);
+                if (id != NO_ENTRY && is_directory)
+                {
+                    directories.emplace_back(std::move(path), id);
+                }
+            }
+        }
+        return builder.finish();
+    }
+
+    void FileIndex::apply(const Change &change)
+    {
+        if (!isBelow(change.path, root_))
+        {
+            return;
+        }
+        std::string relative = change.path.substr(root_.size());
+        if (excluded(relative))
+        {
+            return;
+        }
+        if (change.type == Change::Type::Removed)
+        {
+            erase(relative);
+            return;
+        }
+        insert(relative, change.is_directory);
+        if (!change.is_directory)
+        {
+            return;
+        }
+
+        // A directory moved or copied in may hold entries no event reports
+        std::vector<std::string> directories{change.path};
+        while (!directories.empty())
+        {
+            std::string directory = std::move(directories.back());
+            directories.pop_back();
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if (stopping_.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+                std::string path = it->path().string();
+                std::string_view child = std::string_view(path).substr(root_.size());
+                if (excluded(child))
+                {
+                    continue;
+                }
+                std::error_code type_ec;
+                bool is_directory = it->is_directory(type_ec) && !it->is_symlink(type_ec);
+                insert(std::string(child), is_directory);
+                if (is_directory)
+                {
+                    directories.push_back(std::move(path));
+                }
+            }
+        }
+    }
+
+    void FileIndex::insert(const std::string &relative, bool is_directory)
+    {
+        Snapshot &index = *working_;
+        std::string_view name = baseName(relative);
+        if (name.empty() || name.length() > MAX_NAME_LENGTH || index.contains(relative))
+        {
+            return;
+        }
+        std::string parent(parentOf(relative));
+        if (!parent.empty() && !index.contains(parent))
+        {
+            insert(parent, true);
+        }
+        Snapshot::Addition addition{{}, relative, is_directory};
+        appendFolded(addition.key, name);
+        index.additions.insert(std::upper_bound(index.additions.begin(), index.additions.end(), addition),
+                               std::move(addition));
+    }
+
+    void FileIndex::erase(const std::string &relative)
+    {
+        Snapshot &index = *working_;
+        uint32_t entry = index.base->find(relative);
+        if (entry != NO_ENTRY && !index.hidden(entry))
+        {
+            index.removals.insert(entry);
+        }
+        std::erase_if(index.additions, [&](const Snapshot::Addition &addition)
+                      { return addition.path == relative || isBelow(addition.path, relative); });
+    }
+
+    void FileIndex::compact()
+    {
+        Snapshot &index = *working_;
+        const Table &base = *index.base;
+        size_t count = base.entries.size();
+
+        // An entry survives unless it or a directory above it was removed. Each
+        // is resolved once, with the unresolved entries on the way up its path.
+        constexpr uint8_t UNKNOWN = 0;
+        constexpr uint8_t LIVE = 1;
+        constexpr uint8_t DEAD = 2;
+        std::vector<uint8_t> state(count, UNKNOWN);
+        std::vector<uint32_t> chain;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t at = i;
+            while (at != NO_ENTRY && state[at] == UNKNOWN && !index.removals.contains(at))
+            {
+                chain.push_back(at);
+                at = base.entries[at].parent;
+            }
+            uint8_t outcome = at == NO_ENTRY ? LIVE : state[at] != UNKNOWN ? state[at] : DEAD;
+            if (at != NO_ENTRY)
+            {
+                state[at] = outcome;
+            }
+            for (uint32_t resolved : chain)
+            {
+                state[resolved] = outcome;
+            }
+            chain.clear();
+        }
+
+        // Surviving entries are added in arena order, so their ids are known up front
+        std::vector<uint32_t> ids(count, NO_ENTRY);
+        uint32_t next = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (state[i] == LIVE)
+            {
+                ids[i] = next++;
+            }
+        }
+        Builder builder;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (state[i] == LIVE)
+            {
+                const Entry &entry = base.entries[i];
+                builder.add(entry.parent == NO_ENTRY ? NO_ENTRY : ids[entry.parent], base.name(entry), entry.is_directory);
+            }
+        }
+
+        // In path order every directory comes before the names inside it
+        std::vector<const Snapshot::Addition *> additions;
+        additions.reserve(index.additions.size());
+        for (const auto &addition : index.additions)
+        {
+            additions.push_back(&addition);
+        }
+        std::sort(additions.begin(), additions.end(), [](const Snapshot::Addition *a, const Snapshot::Addition *b)
+                  { return a->path < b->path; });
+        std::unordered_map<std::string_view, uint32_t> directories;
+        for (const Snapshot::Addition *addition : additions)
+        {
+            uint32_t parent = NO_ENTRY;
+            std::string_view parent_path = parentOf(addition->path);
+            if (!parent_path.empty())
+            {
+                auto directory = directories.find(parent_path);
+                if (directory != directories.end())
+                {
+                    parent = directory->second;
+                }
+                else
+                {
+                    uint32_t entry = base.find(parent_path);
+                    if (entry == NO_ENTRY || state[entry] != LIVE)
+                    {
+                        continue;
+                    }
+                    parent = ids[entry];
+                }
+            }
+            uint32_t id = builder.add(parent, baseName(addition->path), addition->is_directory);
+            if (id != NO_ENTRY && addition->is_directory)
+            {
+                directories.emplace(addition->path, id);
+            }
+        }
+
+        std::shared_ptr<const Table> table = builder.finish();
+        LOG_DEBUG << "Merged " << index.additions.size() << " additions and " << index.removals.size()
+                  << " removals into the file index";
+        index.base = std::move(table);
+        index.additions.clear();
+        index.removals.clear();
+    }
+
+}
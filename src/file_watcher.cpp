@@ -0,0 +1,187 @@
+#include "file_watcher.h"
+#include "logger.h"
+#include <filesystem>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace web_server
+{
+
+    FileWatcher::FileWatcher(const std::string &root)
+        : root_(std::filesystem::canonical(root).string())
+    {
+    }
+
+    void FileWatcher::addListener(Listener listener)
+    {
+        listeners_.push_back(std::move(listener));
+    }
+
+    void FileWatcher::notify(const Event &event)
+    {
+        for (const auto &listener : listeners_)
+        {
+            listener(event);
+        }
+    }
+
+#ifdef __linux__
+
+    namespace
+    {
+        constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                        IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+        if (thread_.joinable())
+        {
+            uint64_t one = 1;
+            if (::write(stop_fd_, &one, sizeof(one)) == sizeof(one))
+            {
+                thread_.join();
+            }
+            else
+            {
+                thread_.detach();
+            }
+        }
+        if (inotify_fd_ != -1)
+        {
+            close(inotify_fd_);
+        }
+        if (stop_fd_ != -1)
+        {
+            close(stop_fd_);
+        }
+    }
+
+    bool FileWatcher::start()
+    {
+        if (thread_.joinable())
+        {
+            return true;
+        }
+        inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        stop_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (inotify_fd_ == -1 || stop_fd_ == -1)
+        {
+            LOG_ERROR << "Failed to initialize inotify";
+            return false;
+        }
+        addWatches(root_);
+        thread_ = std::thread(&FileWatcher::run, this);
+        return true;
+    }
+
+    void FileWatcher::addWatches(const std::string &dir)
+    {
+        int wd = inotify_add_watch(inotify_fd_, dir.c_str(), WATCH_MASK);
+        if (wd == -1)
+        {
+            LOG_WARN << "Failed to watch directory: " << dir;
+            return;
+        }
+        watch_paths_[wd] = dir;
+
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+        {
+            if (entry.is_directory(ec) && !entry.is_symlink(ec))
+            {
+                addWatches(entry.path().string());
+            }
+        }
+    }
+
+    void FileWatcher::run()
+    {
+        alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        while (true)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                continue;
+            }
+            if (fds[1].revents & POLLIN)
+            {
+                return;
+            }
+
+            ssize_t length;
+            while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *ptr = buffer; ptr < buffer + length;)
+                {
+                    auto *event = reinterpret_cast<inotify_event *>(ptr);
+                    ptr += sizeof(inotify_event) + event->len;
+
+                    if (event->mask & IN_Q_OVERFLOW)
+                    {
+                        notify({Event::Type::Overflow, root_, true});
+                        continue;
+                    }
+                    auto dir = watch_paths_.find(event->wd);
+                    if (dir == watch_paths_.end())
+                    {
+                        continue;
+                    }
+                    if (event->mask & IN_IGNORED)
+                    {
+                        watch_paths_.erase(dir);
+                        continue;
+                    }
+                    if (event->len == 0)
+                    {
+                        // Events on the watched directory itself; only its removal matters
+                        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                        {
+                            notify({Event::Type::Removed, dir->second, true});
+                        }
+                        continue;
+                    }
+
+                    Event change{Event::Type::Modified, dir->second + "/" + event->name, (event->mask & IN_ISDIR) != 0};
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        change.type = Event::Type::Created;
+                        if (change.is_directory)
+                        {
+                            addWatches(change.path);
+                        }
+                    }
+                    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    {
+                        change.type = Event::Type::Removed;
+                    }
+                    notify(change);
+                }
+            }
+        }
+    }
+
+#else
+
+    FileWatcher::~FileWatcher() {}
+
+    bool FileWatcher::start()
+    {
+        LOG_WARN << "File change notifications are not supported on this platform";
+        return false;
+    }
+
+    void FileWatcher::addWatches(const std::string &dir) {}
+
+    void FileWatcher::run() {}
+
+#endif
+
+}
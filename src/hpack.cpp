@@ -0,0 +1,545 @@
+#include "hpack.h"
+#include <algorithm>
+#include <array>
+
+namespace web_server
+{
+
+    namespace
+    {
+        const HeaderField STATIC_TABLE[HpackTable::STATIC_ENTRIES] = {
+            {":authority", ""},
+            {":method", "GET"},
+            {":method", "POST"},
+            {":path", "/"},
+            {":path", "/index.html"},
+            {":scheme", "http"},
+            {":scheme", "https"},
+            {":status", "200"},
+            {":status", "204"},
+            {":status", "206"},
+            {":status", "304"},
+            {":status", "400"},
+            {":status", "404"},
+            {":status", "500"},
+            {"accept-charset", ""},
+            {"accept-encoding", "gzip, deflate"},
+            {"accept-language", ""},
+            {"accept-ranges", ""},
+            {"accept", ""},
+            {"access-control-allow-origin", ""},
+            {"age", ""},
+            {"allow", ""},
+            {"authorization", ""},
+            {"cache-control", ""},
+            {"content-disposition", ""},
+            {"content-encoding", ""},
+            {"content-language", ""},
+            {"content-length", ""},
+            {"content-location", ""},
+            {"content-range", ""},
+            {"content-type", ""},
+            {"cookie", ""},
+            {"date", ""},
+            {"etag", ""},
+            {"expect", ""},
+            {"expires", ""},
+            {"from", ""},
+            {"host", ""},
+            {"if-match", ""},
+            {"if-modified-since", ""},
+            {"if-none-match", ""},
+            {"if-range", ""},
+            {"if-unmodified-since", ""},
+            {"last-modified", ""},
+            {"link", ""},
+            {"location", ""},
+            {"max-forwards", ""},
+            {"proxy-authenticate", ""},
+            {"proxy-authorization", ""},
+            {"range", ""},
+            {"referer", ""},
+            {"refresh", ""},
+            {"retry-after", ""},
+            {"server", ""},
+            {"set-cookie", ""},
+            {"strict-transport-security", ""},
+            {"transfer-encoding", ""},
+            {"user-agent", ""},
+            {"vary", ""},
+            {"via", ""},
+            {"www-authenticate", ""},
+        };
+
+        struct HuffmanCode
+        {
+            uint32_t code;
+            uint8_t bits;
+        };
+
+        // Indexed by symbol; 256 is EOS
+        constexpr HuffmanCode HUFFMAN_CODES[257] = {
+            {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+            {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+            {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+            {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+            {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+            {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+            {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+            {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+            {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+            {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+            {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+            {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+            {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+            {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+            {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+            {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+            {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+            {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+            {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+            {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+            {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+            {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+            {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+            {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+            {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+            {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+            {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+            {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+            {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+            {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+            {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+            {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+            {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+            {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+            {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+            {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+            {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+            {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+            {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+            {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+            {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+            {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+            {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+            {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+            {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+            {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+            {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+            {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+            {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+            {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+            {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+            {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+            {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+            {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+            {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+            {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+            {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+            {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+            {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+            {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+            {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+            {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+            {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+            {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+            {0x3fffffff, 30},
+        };
+
+        // Decoding walks a binary tree built from the codes, one bit at a time
+        struct HuffmanNode
+        {
+            int16_t child[2] = {-1, -1};
+            int16_t symbol = -1;
+        };
+
+        const std::vector<HuffmanNode> &huffmanTree()
+        {
+            static const std::vector<HuffmanNode> tree = []
+            {
+                std::vector<HuffmanNode> nodes(1);
+                for (int symbol = 0; symbol < 257; ++symbol)
+                {
+                    size_t node = 0;
+                    for (int bit = HUFFMAN_CODES[symbol].bits - 1; bit >= 0; --bit)
+                    {
+                        int branch = (HUFFMAN_CODES[symbol].code >> bit) & 1;
+                        if (nodes[node].child[branch] < 0)
+                        {
+                            nodes[node].child[branch] = static_cast<int16_t>(nodes.size());
+                            nodes.emplace_back();
+                        }
+                        node = static_cast<size_t>(nodes[node].child[branch]);
+                    }
+                    nodes[node].symbol = static_cast<int16_t>(symbol);
+                }
+                return nodes;
+            }();
+            return tree;
+        }
+
+        // Integer with an N-bit prefix (RFC 7541 5.1); `first` holds the flag bits
+        void encodeInteger(std::string &out, uint8_t first, int prefix, uint64_t value)
+        {
+            uint64_t limit = (uint64_t(1) << prefix) - 1;
+            if (value < limit)
+            {
+                out += static_cast<char>(first | value);
+                return;
+            }
+            out += static_cast<char>(first | limit);
+            value -= limit;
+            while (value >= 128)
+            {
+                out += static_cast<char>((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+            out += static_cast<char>(value);
+        }
+
+        bool decodeInteger(std::string_view &in, int prefix, uint64_t &value)
+        {
+            if (in.empty())
+            {
+                return false;
+            }
+            uint64_t limit = (uint64_t(1) << prefix) - 1;
+            value = static_cast<uint8_t>(in.front()) & limit;
+            in.remove_prefix(1);
+            if (value < limit)
+            {
+                return true;
+            }
+            for (int shift = 0; shift <= 28; shift += 7)
+            {
+                if (in.empty())
+                {
+                    return false;
+                }
+                uint8_t byte = static_cast<uint8_t>(in.front());
+                in.remove_prefix(1);
+                value += uint64_t(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                {
+                    return true;
+                }
+            }
+            return false; // Longer than any sane length or index
+        }
+
+        void encodeString(std::string &out, std::string_view value)
+        {
+            size_t huffman_length = huffmanLength(value);
+            if (huffman_length < value.length())
+            {
+                encodeInteger(out, 0x80, 7, huffman_length);
+                huffmanEncode(value, out);
+            }
+            else
+            {
+                encodeInteger(out, 0x00, 7, value.length());
+                out.append(value);
+            }
+        }
+
+        bool decodeString(std::string_view &in, std::string &out)
+        {
+            if (in.empty())
+            {
+                return false;
+            }
+            bool huffman = static_cast<uint8_t>(in.front()) & 0x80;
+            uint64_t length;
+            if (!decodeInteger(in, 7, length) || length > in.length())
+            {
+                return false;
+            }
+            std::string_view bytes = in.substr(0, length);
+            in.remove_prefix(length);
+            out.clear();
+            if (huffman)
+            {
+                return huffmanDecode(bytes, out);
+            }
+            out.assign(bytes);
+            return true;
+        }
+    }
+
+    bool huffmanDecode(std::string_view input, std::string &out)
+    {
+        const std::vector<HuffmanNode> &tree = huffmanTree();
+        size_t node = 0;
+        int pending_bits = 0; // Bits read since the last complete symbol
+        bool all_ones = true;
+        for (char c : input)
+        {
+            auto byte = static_cast<uint8_t>(c);
+            for (int bit = 7; bit >= 0; --bit)
+            {
+                int branch = (byte >> bit) & 1;
+                int16_t next = tree[node].child[branch];
+                if (next < 0)
+                {
+                    return false;
+                }
+                node = static_cast<size_t>(next);
+                ++pending_bits;
+                all_ones = all_ones && branch;
+                if (tree[node].symbol >= 0)
+                {
+                    if (tree[node].symbol == 256)
+                    {
+                        return false; // EOS must not appear in a string
+                    }
+                    out += static_cast<char>(tree[node].symbol);
+                    node = 0;
+                    pending_bits = 0;
+                    all_ones = true;
+                }
+            }
+        }
+        // Padding is a prefix of EOS: at most 7 bits, all ones (RFC 7541 5.2)
+        return pending_bits < 8 && all_ones;
+    }
+
+    size_t huffmanLength(std::string_view input)
+    {
+        size_t bits = 0;
+        for (char c : input)
+        {
+            bits += HUFFMAN_CODES[static_cast<uint8_t>(c)].bits;
+        }
+        return (bits + 7) / 8;
+    }
+
+    void huffmanEncode(std::string_view input, std::string &out)
+    {
+        uint64_t buffer = 0;
+        int bits = 0;
+        for (char c : input)
+        {
+            const HuffmanCode &code = HUFFMAN_CODES[static_cast<uint8_t>(c)];
+            buffer = (buffer << code.bits) | code.code;
+            bits += code.bits;
+            while (bits >= 8)
+            {
+                bits -= 8;
+                out += static_cast<char>(buffer >> bits);
+            }
+            buffer &= (uint64_t(1) << bits) - 1;
+        }
+        if (bits > 0)
+        {
+            out += static_cast<char>((buffer << (8 - bits)) | ((1u << (8 - bits)) - 1));
+        }
+    }
+
+    const HeaderField *HpackTable::at(size_t index) const
+    {
+        if (index == 0)
+        {
+            return nullptr;
+        }
+        if (index <= STATIC_ENTRIES)
+        {
+            return &STATIC_TABLE[index - 1];
+        }
+        index -= STATIC_ENTRIES + 1;
+        return index < entries_.size() ? &entries_[index] : nullptr;
+    }
+
+    void HpackTable::add(std::string_view name, std::string_view value)
+    {
+        size_t size = name.length() + value.length() + ENTRY_OVERHEAD;
+        if (size > max_size_)
+        {
+            // Too large for the table: it only empties it (RFC 7541 4.4)
+            entries_.clear();
+            size_ = 0;
+            return;
+        }
+        evict(max_size_ - size);
+        entries_.push_front({std::string(name), std::string(value)});
+        size_ += size;
+    }
+
+    void HpackTable::resize(size_t max_size)
+    {
+        max_size_ = max_size;
+        evict(max_size);
+    }
+
+    void HpackTable::evict(size_t limit)
+    {
+        while (size_ > limit)
+        {
+            const HeaderField &oldest = entries_.back();
+            size_ -= oldest.name.length() + oldest.value.length() + ENTRY_OVERHEAD;
+            entries_.pop_back();
+        }
+    }
+
+    size_t HpackTable::find(std::string_view name, std::string_view value, bool &exact) const
+    {
+        size_t name_match = 0;
+        exact = false;
+        for (size_t i = 0; i < STATIC_ENTRIES; ++i)
+        {
+            if (STATIC_TABLE[i].name == name)
+            {
+                if (STATIC_TABLE[i].value == value)
+                {
+                    exact = true;
+                    return i + 1;
+                }
+                name_match = name_match ? name_match : i + 1;
+            }
+        }
+        for (size_t i = 0; i < entries_.size(); ++i)
+        {
+            if (entries_[i].name == name)
+            {
+                if (entries_[i].value == value)
+                {
+                    exact = true;
+                    return STATIC_ENTRIES + 1 + i;
+                }
+                name_match = name_match ? name_match : STATIC_ENTRIES + 1 + i;
+            }
+        }
+        return name_match;
+    }
+
+    HpackDecoder::HpackDecoder(size_t max_table_size) : max_table_size_(max_table_size)
+    {
+        table_.resize(max_table_size);
+    }
+
+    bool HpackDecoder::decode(std::string_view block, std::vector<HeaderField> &fields, size_t max_list_size)
+    {
+        fields.clear();
+        size_t list_size = 0;
+        auto emit = [&](std::string_view name, std::string_view value)
+        {
+            list_size += name.length() + value.length() + HpackTable::ENTRY_OVERHEAD;
+            fields.push_back({std::string(name), std::string(value)});
+            return list_size <= max_list_size;
+        };
+        std::string name;
+        std::string value;
+        while (!block.empty())
+        {
+            auto first = static_cast<uint8_t>(block.front());
+            uint64_t index;
+            if (first & 0x80)
+            {
+                // Indexed field (6.1)
+                const HeaderField *field;
+                if (!decodeInteger(block, 7, index) || !(field = table_.at(index)) || !emit(field->name, field->value))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if ((first & 0xE0) == 0x20)
+            {
+                // Dynamic table size update (6.3), only before the first field
+                if (!fields.empty() || !decodeInteger(block, 5, index) || index > max_table_size_)
+                {
+                    return false;
+                }
+                table_.resize(index);
+                continue;
+            }
+            // Literal with incremental indexing (6.2.1), without indexing (6.2.2)
+            // or never indexed (6.2.3); the name is indexed or a literal itself
+            bool incremental = (first & 0xC0) == 0x40;
+            if (!decodeInteger(block, incremental ? 6 : 4, index))
+            {
+                return false;
+            }
+            if (index == 0)
+            {
+                if (!decodeString(block, name))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                const HeaderField *field = table_.at(index);
+                if (!field)
+                {
+                    return false;
+                }
+                name = field->name;
+            }
+            if (!decodeString(block, value) || !emit(name, value))
+            {
+                return false;
+            }
+            if (incremental)
+            {
+                table_.add(name, value);
+            }
+        }
+        return true;
+    }
+
+    void HpackEncoder::setMaxTableSize(size_t size)
+    {
+        // Entries beyond the default would only cost memory; the peer's limit is
+        // an upper bound, not a request
+        limit_ = std::min(size, HpackTable::DEFAULT_SIZE);
+        lowest_ = std::min(lowest_, limit_);
+        resized_ = true;
+        table_.resize(limit_);
+    }
+
+    void HpackEncoder::begin(std::string &out)
+    {
+        if (!resized_)
+        {
+            return;
+        }
+        // After several changes the smallest one must be signalled first, so the
+        // peer evicts what it evicted too (RFC 7541 4.2)
+        if (lowest_ < limit_)
+        {
+            encodeInteger(out, 0x20, 5, lowest_);
+        }
+        encodeInteger(out, 0x20, 5, limit_);
+        lowest_ = limit_;
+        resized_ = false;
+    }
+
+    void HpackEncoder::encode(std::string_view name, std::string_view value, std::string &out, bool indexed)
+    {
+        bool exact;
+        size_t index = table_.find(name, value, exact);
+        if (exact)
+        {
+            encodeInteger(out, 0x80, 7, index);
+            return;
+        }
+        if (indexed)
+        {
+            encodeInteger(out, 0x40, 6, index);
+        }
+        else
+        {
+            encodeInteger(out, 0x00, 4, index);
+        }
+        if (index == 0)
+        {
+            encodeString(out, name);
+        }
+        encodeString(out, value);
+        if (indexed)
+        {
+            table_.add(name, value);
+        }
+    }
+
+}
@@ -0,0 +1,1169 @@
+#include "http2_session.h"
+#include "logger.h"
+#include "request_parser.h"
+#include <algorithm>
+#include <limits>
+
+namespace web_server
+{
+
+    namespace
+    {
+        // Frame types (RFC 9113 6)
+        constexpr uint8_t DATA = 0x0;
+        constexpr uint8_t HEADERS = 0x1;
+        constexpr uint8_t PRIORITY = 0x2;
+        constexpr uint8_t RST_STREAM = 0x3;
+        constexpr uint8_t SETTINGS = 0x4;
+        constexpr uint8_t PUSH_PROMISE = 0x5;
+        constexpr uint8_t PING = 0x6;
+        constexpr uint8_t GOAWAY = 0x7;
+        constexpr uint8_t WINDOW_UPDATE = 0x8;
+        constexpr uint8_t CONTINUATION = 0x9;
+
+        // Frame flags
+        constexpr uint8_t FLAG_END_STREAM = 0x1;
+        constexpr uint8_t FLAG_ACK = 0x1;
+        constexpr uint8_t FLAG_END_HEADERS = 0x4;
+        constexpr uint8_t FLAG_PADDED = 0x8;
+        constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+        // Error codes (RFC 9113 7)
+        constexpr uint32_t NO_ERROR = 0x0;
+        constexpr uint32_t PROTOCOL_ERROR = 0x1;
+        constexpr uint32_t INTERNAL_ERROR = 0x2;
+        constexpr uint32_t FLOW_CONTROL_ERROR = 0x3;
+        constexpr uint32_t STREAM_CLOSED = 0x5;
+        constexpr uint32_t FRAME_SIZE_ERROR = 0x6;
+        constexpr uint32_t REFUSED_STREAM = 0x7;
+        constexpr uint32_t COMPRESSION_ERROR = 0x9;
+        constexpr uint32_t ENHANCE_YOUR_CALM = 0xb;
+
+        // Settings (RFC 9113 6.5.2)
+        constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+        constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+        constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+        constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+        constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+        constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+        constexpr size_t FRAME_HEADER_SIZE = 9;
+        constexpr int64_t MAX_WINDOW = 0x7FFFFFFF;
+        constexpr uint32_t DEFAULT_WINDOW = 65535;
+        constexpr std::string_view CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+        uint32_t readUint32(std::string_view bytes)
+        {
+            return (uint32_t(uint8_t(bytes[0])) << 24) | (uint32_t(uint8_t(bytes[1])) << 16) |
+                   (uint32_t(uint8_t(bytes[2])) << 8) | uint32_t(uint8_t(bytes[3]));
+        }
+
+        void appendUint32(std::string &out, uint32_t value)
+        {
+            out += static_cast<char>(value >> 24);
+            out += static_cast<char>(value >> 16);
+            out += static_cast<char>(value >> 8);
+            out += static_cast<char>(value);
+        }
+
+        void appendSetting(std::string &out, uint16_t id, uint32_t value)
+        {
+            out += static_cast<char>(id >> 8);
+            out += static_cast<char>(id);
+            appendUint32(out, value);
+        }
+
+        void writeFrameHeader(Connection &conn, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id)
+        {
+            // 24-bit length, type, flags, 31-bit stream identifier (RFC 9113 4.1)
+            char header[FRAME_HEADER_SIZE] = {static_cast<char>(length >> 16),    static_cast<char>(length >> 8),
+                                              static_cast<char>(length),          static_cast<char>(type),
+                                              static_cast<char>(flags),           static_cast<char>(stream_id >> 24),
+                                              static_cast<char>(stream_id >> 16), static_cast<char>(stream_id >> 8),
+                                              static_cast<char>(stream_id)};
+            conn.write(std::string_view(header, sizeof(header)));
+        }
+
+        void writeFrame(Connection &conn, uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload)
+        {
+            writeFrameHeader(conn, payload.length(), type, flags, stream_id);
+            conn.write(payload);
+        }
+
+        // Removes the padding of a DATA or HEADERS frame; false if it is malformed
+        bool stripPadding(uint8_t flags, std::string_view &payload)
+        {
+            if (!(flags & FLAG_PADDED))
+            {
+                return true;
+            }
+            if (payload.empty())
+            {
+                return false;
+            }
+            size_t padding = static_cast<uint8_t>(payload.front());
+            payload.remove_prefix(1);
+            if (padding > payload.length())
+            {
+                return false;
+            }
+            payload.remove_suffix(padding);
+            return true;
+        }
+
+        // Field names are lowercase tokens; a colon only starts a pseudo-header (RFC 9113 8.2.1)
+        bool validName(std::string_view name)
+        {
+            if (name.empty())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < name.length(); ++i)
+            {
+                auto c = static_cast<unsigned char>(name[i]);
+                if (c <= 0x20 || c >= 0x7F || (c >= 'A' && c <= 'Z') || (c == ':' && i > 0))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Values must not break the HTTP/1.1 head they are copied into
+        bool validValue(std::string_view value)
+        {
+            if (!value.empty() && (value.front() == ' ' || value.front() == '\t' || value.back() == ' ' ||
+                                   value.back() == '\t'))
+            {
+                return false;
+            }
+            return value.find_first_of(std::string_view("\0\r\n", 3)) == std::string_view::npos;
+        }
+
+        bool connectionSpecific(std::string_view name)
+        {
+            return equalsIgnoreCase(name, "connection") || equalsIgnoreCase(name, "keep-alive") ||
+                   equalsIgnoreCase(name, "proxy-connection") || equalsIgnoreCase(name, "transfer-encoding") ||
+                   equalsIgnoreCase(name, "upgrade");
+        }
+
+        // HTTP2-Settings is base64url without padding (RFC 7540 3.2.1)
+        bool decodeBase64Url(std::string_view input, std::string &out)
+        {
+            while (!input.empty() && input.back() == '=')
+            {
+                input.remove_suffix(1);
+            }
+            uint32_t buffer = 0;
+            int bits = 0;
+            for (char c : input)
+            {
+                int value;
+                if (c >= 'A' && c <= 'Z')
+                {
+                    value = c - 'A';
+                }
+                else if (c >= 'a' && c <= 'z')
+                {
+                    value = c - 'a' + 26;
+                }
+                else if (c >= '0' && c <= '9')
+                {
+                    value = c - '0' + 52;
+                }
+                else if (c == '-' || c == '+')
+                {
+                    value = 62;
+                }
+                else if (c == '_' || c == '/')
+                {
+                    value = 63;
+                }
+                else
+                {
+                    return false;
+                }
+                buffer = (buffer << 6) | static_cast<uint32_t>(value);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    out += static_cast<char>(buffer >> bits);
+                }
+            }
+            return bits < 6;
+        }
+    }
+
+    struct Http2Session::Stream
+    {
+        uint32_t id;
+        std::unique_ptr<Connection> conn; // Serves the request as if it came over HTTP/1.1
+        int64_t send_window;
+        int64_t receive_window = STREAM_WINDOW;
+        std::string head;          // The request as an HTTP/1.1 head, until it is handed over
+        std::string body;          // Body of a request without content-length, until it is complete
+        bool length_known = false; // The request declared a content-length
+        uint64_t declared_length = 0;
+        uint64_t received = 0;
+        bool started = false;       // The head was handed to `conn`
+        bool request_ended = false; // The client sent END_STREAM
+        bool handled = false;       // The handler has answered
+        bool headers_sent = false;  // The final response head went out
+        bool end_sent = false;      // END_STREAM went out
+    };
+
+    Http2Session::Http2Session(const ConnectionLimits &limits, Handler on_headers, Handler handler)
+        : limits_(limits), on_headers_(std::move(on_headers)), handler_(std::move(handler)),
+          preface_(CLIENT_PREFACE.substr(CLIENT_PREFACE.find("SM")))
+    {
+        priority_[0]; // The root of the dependency tree
+    }
+
+    Http2Session::~Http2Session() = default;
+
+    std::unique_ptr<Http2Session> Http2Session::fromUpgrade(const Connection &conn, const ConnectionLimits &limits,
+                                                            Handler on_headers, Handler handler)
+    {
+        std::string settings;
+        uint32_t error;
+        auto session = std::make_unique<Http2Session>(limits, std::move(on_headers), std::move(handler));
+        if (!decodeBase64Url(conn.request.header("HTTP2-Settings"), settings) || settings.length() % 6 != 0 ||
+            !session->applySettings(settings, error))
+        {
+            return nullptr;
+        }
+        // After the 101 the client sends the whole preface
+        session->preface_ = CLIENT_PREFACE;
+        session->last_stream_id_ = 1;
+
+        // The request becomes stream 1, half-closed since it had no body; it is
+        // served once the session has sent its settings
+        const HttpRequest &request = conn.request;
+        Stream &stream = session->openStream(1);
+        std::string &head = stream.conn->in;
+        head.append(request.method).append(" ").append(request.target).append(" HTTP/1.1\r\n");
+        for (size_t i = 0; i < request.header_count; ++i)
+        {
+            const HttpHeader &header = request.headers[i];
+            if (!connectionSpecific(header.name) && !equalsIgnoreCase(header.name, "HTTP2-Settings"))
+            {
+                head.append(header.name).append(": ").append(header.value).append("\r\n");
+            }
+        }
+        head.append("\r\n");
+        stream.length_known = true;
+        stream.started = true;
+        stream.request_ended = true;
+        return session;
+    }
+
+    void Http2Session::receive(Connection &conn)
+    {
+        if (!wake_ && conn.wake)
+        {
+            wake_ = conn.wake;
+            for (auto &[id, stream] : streams_)
+            {
+                stream->conn->wake = wake_;
+            }
+        }
+        if (!settings_sent_)
+        {
+            settings_sent_ = true;
+            std::string settings;
+            appendSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+            appendSetting(settings, SETTINGS_INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+            appendSetting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(limits_.max_header_size));
+            writeFrame(conn, SETTINGS, 0, 0, settings);
+            std::string increment;
+            appendUint32(increment, CONNECTION_WINDOW - DEFAULT_WINDOW);
+            writeFrame(conn, WINDOW_UPDATE, 0, 0, increment);
+            for (auto &[id, stream] : streams_)
+            {
+                serve(*stream); // The request of an upgrade
+            }
+        }
+        if (closing_)
+        {
+            conn.in.clear();
+            return;
+        }
+
+        size_t offset = 0;
+        if (!preface_.empty())
+        {
+            size_t length = std::min(preface_.length(), conn.in.length());
+            if (conn.in.compare(0, length, preface_, 0, length) != 0)
+            {
+                LOG_DEBUG << "Invalid HTTP/2 connection preface";
+                connectionError(conn, PROTOCOL_ERROR);
+                conn.in.clear();
+                return;
+            }
+            preface_.erase(0, length);
+            offset = length;
+        }
+
+        // Frames are handled where they lie in `in`, which is compacted once at the end
+        while (preface_.empty() && !closing_ && conn.in.length() - offset >= FRAME_HEADER_SIZE)
+        {
+            std::string_view header = std::string_view(conn.in).substr(offset, FRAME_HEADER_SIZE);
+            size_t length = (size_t(uint8_t(header[0])) << 16) | (size_t(uint8_t(header[1])) << 8) | uint8_t(header[2]);
+            auto type = static_cast<uint8_t>(header[3]);
+            auto flags = static_cast<uint8_t>(header[4]);
+            uint32_t stream_id = readUint32(header.substr(5)) & 0x7FFFFFFF;
+            if (length > MAX_FRAME_SIZE)
+            {
+                connectionError(conn, FRAME_SIZE_ERROR);
+                break;
+            }
+            if (conn.in.length() - offset - FRAME_HEADER_SIZE < length)
+            {
+                break;
+            }
+            std::string_view payload = std::string_view(conn.in).substr(offset + FRAME_HEADER_SIZE, length);
+            offset += FRAME_HEADER_SIZE + length;
+            if (!settings_received_ && type != SETTINGS)
+            {
+                connectionError(conn, PROTOCOL_ERROR); // The client preface ends with SETTINGS
+                break;
+            }
+            if (!processFrame(conn, type, flags, stream_id, payload))
+            {
+                break;
+            }
+        }
+        if (closing_)
+        {
+            conn.in.clear();
+            return;
+        }
+        conn.in.erase(0, offset);
+        // Bodies held back by a busy sink: serve what it can take now, and let
+        // the client send more of them
+        for (auto &[id, stream] : streams_)
+        {
+            serve(*stream);
+            replenishWindow(conn, *stream);
+        }
+        drain(conn);
+    }
+
+    bool Http2Session::processFrame(Connection &conn, uint8_t type, uint8_t flags, uint32_t stream_id,
+                                    std::string_view payload)
+    {
+        if (header_stream_ != 0 && (type != CONTINUATION || stream_id != header_stream_))
+        {
+            return connectionError(conn, PROTOCOL_ERROR); // A header block must not be interleaved
+        }
+        switch (type)
+        {
+        case DATA:
+            return onData(conn, flags, stream_id, payload);
+        case HEADERS:
+            return onHeaders(conn, flags, stream_id, payload);
+        case PRIORITY:
+        {
+            if (stream_id == 0)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            if (payload.length() != 5)
+            {
+                resetStream(conn, stream_id, FRAME_SIZE_ERROR);
+                return true;
+            }
+            uint32_t dependency = readUint32(payload);
+            uint32_t parent = dependency & 0x7FFFFFFF;
+            if (parent == stream_id)
+            {
+                resetStream(conn, stream_id, PROTOCOL_ERROR);
+                return true;
+            }
+            // Idle streams may be placed in the tree ahead of their requests, up to a limit
+            if (priority_.count(stream_id) || priority_.size() < MAX_CONCURRENT_STREAMS + MAX_PRIORITY_NODES)
+            {
+                prioritize(stream_id, parent, static_cast<uint16_t>(uint8_t(payload[4]) + 1), dependency >> 31);
+            }
+            return true;
+        }
+        case RST_STREAM:
+            if (stream_id == 0 || stream_id > last_stream_id_)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            if (payload.length() != 4)
+            {
+                return connectionError(conn, FRAME_SIZE_ERROR);
+            }
+            closeStream(stream_id);
+            return true;
+        case SETTINGS:
+            return onSettings(conn, flags, stream_id, payload);
+        case PUSH_PROMISE:
+            return connectionError(conn, PROTOCOL_ERROR); // Clients cannot push
+        case PING:
+            if (stream_id != 0)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            if (payload.length() != 8)
+            {
+                return connectionError(conn, FRAME_SIZE_ERROR);
+            }
+            if (!(flags & FLAG_ACK))
+            {
+                writeFrame(conn, PING, FLAG_ACK, 0, payload);
+            }
+            return true;
+        case GOAWAY:
+            if (stream_id != 0)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            if (payload.length() < 8)
+            {
+                return connectionError(conn, FRAME_SIZE_ERROR);
+            }
+            // Streams already open are finished; the connection closes after them
+            peer_closing_ = true;
+            return true;
+        case WINDOW_UPDATE:
+            return onWindowUpdate(conn, stream_id, payload);
+        case CONTINUATION:
+            if (header_stream_ == 0)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            header_block_.append(payload);
+            if (header_block_.length() > 2 * limits_.max_header_size)
+            {
+                return connectionError(conn, ENHANCE_YOUR_CALM);
+            }
+            return (flags & FLAG_END_HEADERS) ? onHeaderBlock(conn) : true;
+        default:
+            return true; // Unknown frame types are ignored (RFC 9113 5.5)
+        }
+    }
+
+    bool Http2Session::onHeaders(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload)
+    {
+        if (stream_id == 0 || stream_id % 2 == 0)
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+        if (!stripPadding(flags, payload))
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+        if (flags & FLAG_PRIORITY)
+        {
+            if (payload.length() < 5)
+            {
+                return connectionError(conn, FRAME_SIZE_ERROR);
+            }
+            uint32_t dependency = readUint32(payload);
+            uint32_t parent = dependency & 0x7FFFFFFF;
+            if (stream_id > last_stream_id_ && parent != stream_id)
+            {
+                prioritize(stream_id, parent, static_cast<uint16_t>(uint8_t(payload[4]) + 1), dependency >> 31);
+            }
+            payload.remove_prefix(5);
+        }
+        header_block_.assign(payload);
+        header_stream_ = stream_id;
+        header_end_stream_ = flags & FLAG_END_STREAM;
+        return (flags & FLAG_END_HEADERS) ? onHeaderBlock(conn) : true;
+    }
+
+    bool Http2Session::onHeaderBlock(Connection &conn)
+    {
+        uint32_t stream_id = header_stream_;
+        header_stream_ = 0;
+        // Every block is decoded, even for streams that are refused or gone,
+        // so the dynamic table stays in step with the client's
+        bool decoded = decoder_.decode(header_block_, fields_, limits_.max_header_size);
+        header_block_.clear();
+        if (!decoded)
+        {
+            LOG_DEBUG << "Failed to decode HTTP/2 header block on stream " << stream_id;
+            return connectionError(conn, COMPRESSION_ERROR);
+        }
+
+        auto it = streams_.find(stream_id);
+        if (it != streams_.end())
+        {
+            // Trailers, which end the request; their fields are not used
+            if (!header_end_stream_ || it->second->request_ended)
+            {
+                resetStream(conn, stream_id, PROTOCOL_ERROR);
+            }
+            else
+            {
+                receiveBody(conn, *it->second, {}, true);
+            }
+            return true;
+        }
+        if (stream_id <= last_stream_id_)
+        {
+            return true; // A stream that was reset while the client was still sending
+        }
+        last_stream_id_ = stream_id;
+        if (closing_ || peer_closing_)
+        {
+            return true;
+        }
+        if (streams_.size() >= MAX_CONCURRENT_STREAMS)
+        {
+            resetStream(conn, stream_id, REFUSED_STREAM);
+            return true;
+        }
+
+        Stream &stream = openStream(stream_id);
+        if (!buildRequest(stream))
+        {
+            LOG_DEBUG << "Malformed HTTP/2 request on stream " << stream_id;
+            resetStream(conn, stream_id, PROTOCOL_ERROR);
+            return true;
+        }
+        stream.request_ended = header_end_stream_;
+        if (stream.length_known || stream.request_ended)
+        {
+            if (stream.request_ended && stream.declared_length > 0)
+            {
+                resetStream(conn, stream_id, PROTOCOL_ERROR); // The promised body never comes
+                return true;
+            }
+            startRequest(stream);
+        }
+        serve(stream);
+        return true;
+    }
+
+    bool Http2Session::buildRequest(Stream &stream)
+    {
+        std::string_view method;
+        std::string_view scheme;
+        std::string_view authority;
+        std::string_view path;
+        std::string headers;
+        std::string cookie;
+        bool regular = false;
+        for (const HeaderField &field : fields_)
+        {
+            if (!validName(field.name) || !validValue(field.value))
+            {
+                return false;
+            }
+            if (field.name.front() == ':')
+            {
+                std::string_view *target = field.name == ":method"      ? &method
+                                           : field.name == ":scheme"    ? &scheme
+                                           : field.name == ":authority" ? &authority
+                                           : field.name == ":path"      ? &path
+                                                                        : nullptr;
+                // Pseudo-headers are known, unique and precede the regular fields
+                if (!target || !target->empty() || field.value.empty() || regular)
+                {
+                    return false;
+                }
+                *target = field.value;
+                continue;
+            }
+            regular = true;
+            if (connectionSpecific(field.name) || (field.name == "te" && field.value != "trailers"))
+            {
+                return false;
+            }
+            if (field.name == "cookie")
+            {
+                // Split cookies are joined again for HTTP/1.1 (RFC 9113 8.2.3)
+                cookie.append(cookie.empty() ? "" : "; ").append(field.value);
+                continue;
+            }
+            if (field.name == "host" && !authority.empty())
+            {
+                continue;
+            }
+            if (field.name == "content-length")
+            {
+                if (field.value.length() > 18 || !std::all_of(field.value.begin(), field.value.end(), [](char c)
+                                                              { return c >= '0' && c <= '9'; }))
+                {
+                    return false;
+                }
+                uint64_t length = std::stoull(field.value);
+                if (stream.length_known && length != stream.declared_length)
+                {
+                    return false;
+                }
+                stream.length_known = true;
+                stream.declared_length = length;
+            }
+            headers.append(field.name).append(": ").append(field.value).append("\r\n");
+        }
+        // CONNECT has neither scheme nor path and is not served
+        if (method.empty() || scheme.empty() || path.empty() || path.find(' ') != std::string_view::npos)
+        {
+            return false;
+        }
+        stream.head.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+        if (!authority.empty())
+        {
+            stream.head.append("host: ").append(authority).append("\r\n");
+        }
+        stream.head.append(headers);
+        if (!cookie.empty())
+        {
+            stream.head.append("cookie: ").append(cookie).append("\r\n");
+        }
+        return true;
+    }
+
+    void Http2Session::startRequest(Stream &stream)
+    {
+        if (!stream.length_known)
+        {
+            // The body was collected, or is too large: either way its length is known now
+            stream.head.append("content-length: ").append(std::to_string(stream.body.length())).append("\r\n");
+        }
+        stream.head.append("\r\n");
+        stream.conn->in.append(stream.head).append(stream.body);
+        stream.head.clear();
+        stream.body.clear();
+        stream.started = true;
+    }
+
+    void Http2Session::serve(Stream &stream)
+    {
+        if (stream.started && !stream.handled && stream.conn->requestComplete())
+        {
+            handler_(*stream.conn);
+            stream.handled = true;
+        }
+    }
+
+    bool Http2Session::onData(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload)
+    {
+        if (stream_id == 0)
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+        // Flow control counts the whole payload, padding included
+        auto length = static_cast<int64_t>(payload.length());
+        if (length > receive_window_)
+        {
+            return connectionError(conn, FLOW_CONTROL_ERROR);
+        }
+        receive_window_ -= length;
+        if (!stripPadding(flags, payload))
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+
+        auto it = streams_.find(stream_id);
+        if (it == streams_.end())
+        {
+            if (stream_id > last_stream_id_)
+            {
+                return connectionError(conn, PROTOCOL_ERROR);
+            }
+            // Data in flight for a stream that was reset is dropped
+        }
+        else if (it->second->request_ended)
+        {
+            resetStream(conn, stream_id, STREAM_CLOSED);
+        }
+        else if (length > it->second->receive_window)
+        {
+            resetStream(conn, stream_id, FLOW_CONTROL_ERROR);
+        }
+        else
+        {
+            Stream &stream = *it->second;
+            stream.receive_window -= length;
+            receiveBody(conn, stream, payload, flags & FLAG_END_STREAM);
+            it = streams_.find(stream_id);
+            if (it != streams_.end())
+            {
+                replenishWindow(conn, *it->second);
+            }
+        }
+        if (receive_window_ < CONNECTION_WINDOW / 2)
+        {
+            std::string increment;
+            appendUint32(increment, static_cast<uint32_t>(CONNECTION_WINDOW - receive_window_));
+            writeFrame(conn, WINDOW_UPDATE, 0, 0, increment);
+            receive_window_ = CONNECTION_WINDOW;
+        }
+        return true;
+    }
+
+    void Http2Session::replenishWindow(Connection &conn, Stream &stream)
+    {
+        // A buffered body is bounded by the size limits; one streamed to a body
+        // sink is held back while the sink is busy and leaves it in `in`
+        if (!stream.request_ended && stream.receive_window < STREAM_WINDOW / 2 &&
+            (!stream.conn->body_sink || stream.conn->in.length() < STREAM_WINDOW / 2))
+        {
+            std::string increment;
+            appendUint32(increment, static_cast<uint32_t>(STREAM_WINDOW - stream.receive_window));
+            writeFrame(conn, WINDOW_UPDATE, 0, stream.id, increment);
+            stream.receive_window = STREAM_WINDOW;
+        }
+    }
+
+    void Http2Session::receiveBody(Connection &conn, Stream &stream, std::string_view data, bool end_stream)
+    {
+        stream.received += data.length();
+        if (stream.length_known && (stream.received > stream.declared_length ||
+                                    (end_stream && stream.received != stream.declared_length)))
+        {
+            resetStream(conn, stream.id, PROTOCOL_ERROR); // Body and content-length disagree (RFC 9113 8.1.1)
+            return;
+        }
+        stream.request_ended = stream.request_ended || end_stream;
+        if (stream.started)
+        {
+            if (!stream.handled)
+            {
+                stream.conn->in.append(data);
+            }
+        }
+        else
+        {
+            stream.body.append(data);
+            // A body beyond the limit is cut short; the declared length then gets a 413
+            if (end_stream || stream.body.length() > limits_.max_body_size)
+            {
+                startRequest(stream);
+            }
+        }
+        serve(stream);
+    }
+
+    bool Http2Session::onSettings(Connection &conn, uint8_t flags, uint32_t stream_id, std::string_view payload)
+    {
+        if (stream_id != 0)
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+        if (flags & FLAG_ACK)
+        {
+            return payload.empty() ? true : connectionError(conn, FRAME_SIZE_ERROR);
+        }
+        if (payload.length() % 6 != 0)
+        {
+            return connectionError(conn, FRAME_SIZE_ERROR);
+        }
+        uint32_t error;
+        if (!applySettings(payload, error))
+        {
+            return connectionError(conn, error);
+        }
+        settings_received_ = true;
+        writeFrame(conn, SETTINGS, FLAG_ACK, 0, {});
+        return true;
+    }
+
+    bool Http2Session::applySettings(std::string_view payload, uint32_t &error)
+    {
+        for (; payload.length() >= 6; payload.remove_prefix(6))
+        {
+            auto id = static_cast<uint16_t>((uint8_t(payload[0]) << 8) | uint8_t(payload[1]));
+            uint32_t value = readUint32(payload.substr(2));
+            switch (id)
+            {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                encoder_.setMaxTableSize(value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1)
+                {
+                    error = PROTOCOL_ERROR;
+                    return false;
+                }
+                break; // Nothing is pushed either way
+            case SETTINGS_INITIAL_WINDOW_SIZE:
+            {
+                if (value > MAX_WINDOW)
+                {
+                    error = FLOW_CONTROL_ERROR;
+                    return false;
+                }
+                // Applies to the windows of open streams as well (RFC 9113 6.9.2)
+                int64_t delta = int64_t(value) - initial_send_window_;
+                initial_send_window_ = value;
+                for (auto &[id, stream] : streams_)
+                {
+                    stream->send_window += delta;
+                    if (stream->send_window > MAX_WINDOW)
+                    {
+                        error = FLOW_CONTROL_ERROR;
+                        return false;
+                    }
+                }
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 0xFFFFFF)
+                {
+                    error = PROTOCOL_ERROR;
+                    return false;
+                }
+                peer_max_frame_size_ = value;
+                break;
+            case SETTINGS_MAX_CONCURRENT_STREAMS:
+            case SETTINGS_MAX_HEADER_LIST_SIZE:
+            default:
+                break; // Limits on pushes and on our own headers; unknown settings are ignored
+            }
+        }
+        return true;
+    }
+
+    bool Http2Session::onWindowUpdate(Connection &conn, uint32_t stream_id, std::string_view payload)
+    {
+        if (payload.length() != 4)
+        {
+            return connectionError(conn, FRAME_SIZE_ERROR);
+        }
+        uint32_t increment = readUint32(payload) & 0x7FFFFFFF;
+        if (stream_id == 0)
+        {
+            send_window_ += increment;
+            if (increment == 0 || send_window_ > MAX_WINDOW)
+            {
+                return connectionError(conn, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+            }
+            return true;
+        }
+        if (stream_id > last_stream_id_)
+        {
+            return connectionError(conn, PROTOCOL_ERROR);
+        }
+        auto it = streams_.find(stream_id);
+        if (it == streams_.end())
+        {
+            return true;
+        }
+        it->second->send_window += increment;
+        if (increment == 0 || it->second->send_window > MAX_WINDOW)
+        {
+            resetStream(conn, stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        }
+        return true;
+    }
+
+    bool Http2Session::connectionError(Connection &conn, uint32_t error)
+    {
+        LOG_DEBUG << "HTTP/2 connection error " << error;
+        std::string payload;
+        appendUint32(payload, last_stream_id_);
+        appendUint32(payload, error);
+        writeFrame(conn, GOAWAY, 0, 0, payload);
+        closing_ = true;
+        conn.close_after_write = true;
+        return false;
+    }
+
+    void Http2Session::resetStream(Connection &conn, uint32_t stream_id, uint32_t error)
+    {
+        std::string payload;
+        appendUint32(payload, error);
+        writeFrame(conn, RST_STREAM, 0, stream_id, payload);
+        closeStream(stream_id);
+    }
+
+    Http2Session::Stream &Http2Session::openStream(uint32_t stream_id)
+    {
+        auto stream = std::make_unique<Stream>();
+        stream->id = stream_id;
+        stream->conn = Connection::forStream(limits_);
+        stream->conn->on_headers = on_headers_;
+        stream->conn->wake = wake_;
+        stream->send_window = initial_send_window_;
+        if (!priority_.count(stream_id))
+        {
+            prioritize(stream_id, 0, 16, false);
+        }
+        Stream &added = *stream;
+        streams_[stream_id] = std::move(stream);
+        return added;
+    }
+
+    void Http2Session::closeStream(uint32_t stream_id)
+    {
+        streams_.erase(stream_id);
+        auto it = priority_.find(stream_id);
+        if (it == priority_.end())
+        {
+            return;
+        }
+        // Its dependents move up to its parent (RFC 9113 5.3.4)
+        PriorityNode &parent = priority_[it->second.parent];
+        for (uint32_t child : it->second.children)
+        {
+            priority_[child].parent = it->second.parent;
+            priority_[child].cycle = parent.last_cycle;
+            parent.children.push_back(child);
+        }
+        detach(stream_id);
+        priority_.erase(stream_id);
+    }
+
+    void Http2Session::prioritize(uint32_t stream_id, uint32_t parent, uint16_t weight, bool exclusive)
+    {
+        if (!priority_.count(parent))
+        {
+            // A dependency on a stream that is not in the tree gets the default priority
+            parent = 0;
+            weight = 16;
+            exclusive = false;
+        }
+        auto it = priority_.find(stream_id);
+        if (it == priority_.end())
+        {
+            priority_[stream_id];
+            priority_[0].children.push_back(stream_id);
+        }
+        // A stream made dependent on one of its own dependents swaps places with it (RFC 7540 5.3.3)
+        for (uint32_t node = parent; node != 0; node = priority_[node].parent)
+        {
+            if (node == stream_id)
+            {
+                uint32_t former_parent = priority_[stream_id].parent;
+                detach(parent);
+                attach(parent, former_parent, false);
+                break;
+            }
+        }
+        detach(stream_id);
+        priority_[stream_id].weight = weight;
+        attach(stream_id, parent, exclusive);
+    }
+
+    void Http2Session::detach(uint32_t node)
+    {
+        std::vector<uint32_t> &siblings = priority_[priority_[node].parent].children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), node), siblings.end());
+    }
+
+    void Http2Session::attach(uint32_t node, uint32_t parent, bool exclusive)
+    {
+        PriorityNode &added = priority_[node];
+        PriorityNode &target = priority_[parent];
+        if (exclusive)
+        {
+            for (uint32_t child : target.children)
+            {
+                priority_[child].parent = node;
+                added.children.push_back(child);
+            }
+            target.children.clear();
+        }
+        added.parent = parent;
+        added.cycle = target.last_cycle;
+        target.children.push_back(node);
+    }
+
+    uint32_t Http2Session::schedule(uint32_t node)
+    {
+        if (node != 0)
+        {
+            // A stream is served ahead of the streams that depend on it
+            auto it = streams_.find(node);
+            if (it != streams_.end())
+            {
+                const Stream &stream = *it->second;
+                if (stream.headers_sent && stream.send_window > 0 &&
+                    (stream.conn->pendingOutput() > 0 || stream.conn->streaming()))
+                {
+                    return node;
+                }
+            }
+        }
+        uint32_t chosen = 0;
+        uint64_t chosen_cycle = std::numeric_limits<uint64_t>::max();
+        for (uint32_t child : priority_[node].children)
+        {
+            uint64_t cycle = priority_[child].cycle;
+            if (cycle < chosen_cycle)
+            {
+                uint32_t stream_id = schedule(child);
+                if (stream_id != 0)
+                {
+                    chosen = stream_id;
+                    chosen_cycle = cycle;
+                }
+            }
+        }
+        return chosen;
+    }
+
+    void Http2Session::charge(uint32_t stream_id, size_t bytes)
+    {
+        // Every node on the path advances in inverse proportion to its weight,
+        // so siblings share in the ratio of their weights
+        for (uint32_t node = stream_id; node != 0;)
+        {
+            PriorityNode &current = priority_[node];
+            priority_[current.parent].last_cycle = current.cycle;
+            current.cycle += bytes * 256 / current.weight;
+            node = current.parent;
+        }
+    }
+
+    void Http2Session::drain(Connection &conn)
+    {
+        if (closing_ || !settings_received_)
+        {
+            return; // After an upgrade, responses wait until the client has confirmed HTTP/2
+        }
+        // Response heads and stream ends are small and not flow controlled, so
+        // they go out as soon as they are ready
+        for (auto it = streams_.begin(); it != streams_.end();)
+        {
+            Stream &stream = *it->second;
+            ++it; // The stream may be closed
+            sendHeaders(conn, stream);
+        }
+        while (conn.pendingOutput() < OUTPUT_WATERMARK && send_window_ > 0)
+        {
+            uint32_t stream_id = schedule(0);
+            if (stream_id == 0)
+            {
+                break;
+            }
+            sendData(conn, *streams_[stream_id]);
+        }
+        if (peer_closing_ && streams_.empty())
+        {
+            conn.close_after_write = true;
+        }
+    }
+
+    void Http2Session::sendHeaders(Connection &conn, Stream &stream)
+    {
+        Connection &source = *stream.conn;
+        while (!stream.headers_sent)
+        {
+            // The handler queues the head before any of the body; find its end
+            std::string head;
+            size_t end = std::string::npos;
+            for (const OutputSegment &segment : source.out)
+            {
+                if (segment.isFile())
+                {
+                    break;
+                }
+                head.append(segment.bytes().substr(segment.data_offset, limits_.max_header_size));
+                if ((end = head.find("\r\n\r\n")) != std::string::npos || head.length() >= limits_.max_header_size)
+                {
+                    break;
+                }
+            }
+            if (end == std::string::npos)
+            {
+                return;
+            }
+            head.resize(end + 2);
+            source.skipOutput(end + 4);
+
+            // "HTTP/1.1 200 OK" becomes :status, the fields follow in lowercase
+            size_t line_end = head.find("\r\n");
+            std::string_view status = std::string_view(head).substr(9, 3);
+            std::string block;
+            encoder_.begin(block);
+            encoder_.encode(":status", status, block);
+            for (size_t start = line_end + 2; start < head.length(); start = line_end + 2)
+            {
+                line_end = head.find("\r\n", start);
+                std::string_view line = std::string_view(head).substr(start, line_end - start);
+                size_t colon = line.find(':');
+                std::string name(line.substr(0, colon));
+                std::transform(name.begin(), name.end(), name.begin(), [](char c)
+                               { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; });
+                std::string_view value = line.substr(colon + 1);
+                value.remove_prefix(std::min(value.find_first_not_of(' '), value.length()));
+                if (connectionSpecific(name))
+                {
+                    continue;
+                }
+                // Values unique to one response would only push useful entries out of the table
+                bool indexed = name != "content-length" && name != "content-range" && name != "etag" &&
+                               name != "last-modified";
+                encoder_.encode(name, value, block, indexed);
+            }
+
+            bool informational = status.front() == '1';
+            stream.headers_sent = !informational;
+            stream.end_sent = !informational && stream.handled && !source.streaming() && source.pendingOutput() == 0 &&
+                              !source.streamFailed();
+            // A block larger than a frame continues in CONTINUATION frames
+            std::string_view fragment = block;
+            uint8_t type = HEADERS;
+            uint8_t flags = stream.end_sent ? FLAG_END_STREAM : 0;
+            do
+            {
+                std::string_view piece = fragment.substr(0, peer_max_frame_size_);
+                fragment.remove_prefix(piece.length());
+                writeFrame(conn, type, flags | (fragment.empty() ? FLAG_END_HEADERS : 0), stream.id, piece);
+                type = CONTINUATION;
+                flags = 0;
+            } while (!fragment.empty());
+        }
+        finish(conn, stream);
+    }
+
+    void Http2Session::sendData(Connection &conn, Stream &stream)
+    {
+        Connection &source = *stream.conn;
+        if (source.pendingOutput() == 0)
+        {
+            source.takeOutput(conn, 0); // Produces the next piece of a streamed body
+        }
+        size_t length = std::min({source.pendingOutput(), peer_max_frame_size_, static_cast<size_t>(stream.send_window),
+                                  static_cast<size_t>(send_window_)});
+        if (length > 0)
+        {
+            stream.end_sent = stream.handled && !source.streaming() && source.pendingOutput() == length &&
+                              !source.streamFailed();
+            writeFrameHeader(conn, length, DATA, stream.end_sent ? FLAG_END_STREAM : 0, stream.id);
+            source.takeOutput(conn, length);
+            stream.send_window -= static_cast<int64_t>(length);
+            send_window_ -= static_cast<int64_t>(length);
+            charge(stream.id, length);
+        }
+        finish(conn, stream);
+    }
+
+    void Http2Session::finish(Connection &conn, Stream &stream)
+    {
+        Connection &source = *stream.conn;
+        if (!stream.headers_sent || !stream.handled || source.streaming() || source.pendingOutput() > 0)
+        {
+            return;
+        }
+        if (source.streamFailed())
+        {
+            resetStream(conn, stream.id, INTERNAL_ERROR); // The body cannot be completed
+            return;
+        }
+        uint32_t stream_id = stream.id;
+        if (!stream.end_sent)
+        {
+            writeFrame(conn, DATA, FLAG_END_STREAM, stream_id, {});
+        }
+        if (!stream.request_ended)
+        {
+            // Answered before the request was complete: the rest is not needed (RFC 9113 8.1)
+            std::string payload;
+            appendUint32(payload, NO_ERROR);
+            writeFrame(conn, RST_STREAM, 0, stream_id, payload);
+        }
+        closeStream(stream_id);
+    }
+
+}
@@ -0,0 +1,236 @@
+#include "http_cache.h"
+#include <cstdio>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr const char *DAY_NAMES[] = {"Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed"}; // 1970-01-01 was a Thursday
+        constexpr const char *MONTH_NAMES[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+        // Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+        int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+        {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+            unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+            unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+            return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+        }
+
+        void civilFromDays(int64_t days, int64_t &year, unsigned &month, unsigned &day)
+        {
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+            unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+            unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+            unsigned mp = (5 * day_of_year + 2) / 153;
+            day = day_of_year - (153 * mp + 2) / 5 + 1;
+            month = mp < 10 ? mp + 3 : mp - 9;
+            year = static_cast<int64_t>(year_of_era) + era * 400 + (month <= 2);
+        }
+
+        // Minimal cursor over a date string
+        struct DateReader
+        {
+            std::string_view text;
+
+            bool expect(char c)
+            {
+                if (text.empty() || text.front() != c)
+                {
+                    return false;
+                }
+                text.remove_prefix(1);
+                return true;
+            }
+
+            void skipSpaces()
+            {
+                while (!text.empty() && text.front() == ' ')
+                {
+                    text.remove_prefix(1);
+                }
+            }
+
+            bool number(size_t min_digits, size_t max_digits, int &value)
+            {
+                size_t digits = 0;
+                value = 0;
+                while (digits < max_digits && digits < text.length() && text[digits] >= '0' && text[digits] <= '9')
+                {
+                    value = value * 10 + (text[digits] - '0');
+                    ++digits;
+                }
+                text.remove_prefix(digits);
+                return digits >= min_digits;
+            }
+
+            bool month(int &value)
+            {
+                for (int i = 0; i < 12; ++i)
+                {
+                    if (text.starts_with(MONTH_NAMES[i]))
+                    {
+                        text.remove_prefix(3);
+                        value = i + 1;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool time(int &hour, int &minute, int &second)
+            {
+                return number(2, 2, hour) && expect(':') && number(2, 2, minute) && expect(':') && number(2, 2, second);
+            }
+        };
+
+        // Opaque tag of an entity-tag, so that W/"x" and "x" compare equal (weak comparison)
+        std::string_view opaqueTag(std::string_view tag)
+        {
+            if (tag.starts_with("W/"))
+            {
+                tag.remove_prefix(2);
+            }
+            return tag;
+        }
+    }
+
+    FileValidators fileValidators(const struct stat &file_stat)
+    {
+#ifdef __linux__
+        int64_t mtime_ns = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+#else
+        int64_t mtime_ns = static_cast<int64_t>(file_stat.st_mtime) * 1000000000;
+#endif
+        char etag[64];
+        std::snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"",
+                      static_cast<unsigned long long>(file_stat.st_ino),
+                      static_cast<unsigned long long>(mtime_ns),
+                      static_cast<unsigned long long>(file_stat.st_size));
+
+        FileValidators validators;
+        validators.etag = etag;
+        validators.mtime = static_cast<int64_t>(file_stat.st_mtime);
+        validators.last_modified = formatHttpDate(validators.mtime);
+        return validators;
+    }
+
+    bool isNotModified(const HttpRequest &request, const FileValidators &validators)
+    {
+        std::string_view if_none_match = request.header("If-None-Match");
+        if (!if_none_match.empty())
+        {
+            while (!if_none_match.empty())
+            {
+                size_t comma = if_none_match.find(',');
+                std::string_view tag = if_none_match.substr(0, comma);
+                size_t begin = tag.find_first_not_of(" \t");
+                size_t end = tag.find_last_not_of(" \t");
+                tag = begin == std::string_view::npos ? std::string_view() : tag.substr(begin, end - begin + 1);
+                if (tag == "*" || opaqueTag(tag) == opaqueTag(validators.etag))
+                {
+                    return true;
+                }
+                if_none_match = comma == std::string_view::npos ? std::string_view() : if_none_match.substr(comma + 1);
+            }
+            return false;
+        }
+
+        std::string_view if_modified_since = request.header("If-Modified-Since");
+        int64_t since;
+        return !if_modified_since.empty() && parseHttpDate(if_modified_since, since) && validators.mtime <= since;
+    }
+
+    std::string_view cacheControlFor(const std::vector<CacheControlRule> &rules, std::string_view path)
+    {
+        const CacheControlRule *best = nullptr;
+        for (const auto &rule : rules)
+        {
+            if (path.starts_with(rule.prefix) && (!best || rule.prefix.length() > best->prefix.length()))
+            {
+                best = &rule;
+            }
+        }
+        return best ? std::string_view(best->value) : std::string_view();
+    }
+
+    std::string formatHttpDate(int64_t seconds)
+    {
+        int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+        int64_t time_of_day = seconds - days * 86400;
+        int64_t year;
+        unsigned month, day;
+        civilFromDays(days, year, month, day);
+
+        char buffer[40];
+        std::snprintf(buffer, sizeof(buffer), "%s, %02u %s %04lld %02d:%02d:%02d GMT",
+                      DAY_NAMES[((days % 7) + 7) % 7], day, MONTH_NAMES[month - 1], static_cast<long long>(year),
+                      static_cast<int>(time_of_day / 3600), static_cast<int>(time_of_day / 60 % 60),
+                      static_cast<int>(time_of_day % 60));
+        return buffer;
+    }
+
+    bool parseHttpDate(std::string_view text, int64_t &seconds)
+    {
+        // Skip the day name, which is followed by ',' except in asctime format
+        size_t name_end = text.find_first_of(", ");
+        if (name_end == std::string_view::npos)
+        {
+            return false;
+        }
+        bool asctime = text[name_end] == ' ';
+        DateReader reader{text.substr(name_end + 1)};
+        reader.skipSpaces();
+
+        int day, month, year, hour, minute, second;
+        if (asctime)
+        {
+            // Sun Nov  6 08:49:37 1994
+            if (!reader.month(month) || !reader.expect(' '))
+            {
+                return false;
+            }
+            reader.skipSpaces();
+            if (!reader.number(1, 2, day) || !reader.expect(' ') || !reader.time(hour, minute, second) ||
+                !reader.expect(' ') || !reader.number(4, 4, year))
+            {
+                return false;
+            }
+        }
+        else if (reader.text.length() > 2 && reader.text[2] == '-')
+        {
+            // Sunday, 06-Nov-94 08:49:37 GMT; two-digit years are taken as 1970-2069
+            if (!reader.number(2, 2, day) || !reader.expect('-') || !reader.month(month) || !reader.expect('-') ||
+                !reader.number(2, 2, year) || !reader.expect(' ') || !reader.time(hour, minute, second) ||
+                !reader.expect(' ') || reader.text != "GMT")
+            {
+                return false;
+            }
+            year += year < 70 ? 2000 : 1900;
+        }
+        else
+        {
+            // Sun, 06 Nov 1994 08:49:37 GMT
+            if (!reader.number(2, 2, day) || !reader.expect(' ') || !reader.month(month) || !reader.expect(' ') ||
+                !reader.number(4, 4, year) || !reader.expect(' ') || !reader.time(hour, minute, second) ||
+                !reader.expect(' ') || reader.text != "GMT")
+            {
+                return false;
+            }
+        }
+        if (day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+        {
+            return false;
+        }
+        seconds = daysFromCivil(year, static_cast<unsigned>(month), static_cast<unsigned>(day)) * 86400 +
+                  hour * 3600 + minute * 60 + second;
+        return true;
+    }
+
+}
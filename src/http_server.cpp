@@ -1,15 +1,297 @@
 #include "http_server.h"
-#include <iostream>
+#include "logger.h"
+#include "event_loop.h"
+#include "uring_loop.h"
+#include "thread_pool.h"
+#include "idle_poller.h"
+#include "template.h"
+#include "json.h"
+#include "upload_receiver.h"
+#include "request_parser.h"
+#include "byte_range.h"
+#include "compression.h"
+#include "metrics.h"
+#include "arena.h"
+#include "buffer_pool.h"
+#include "http2_session.h"
+#include <charconv>
 #include <sstream>
 #include <stdexcept>
 #include <fstream>
-#include <regex>
 #include <algorithm>
+#include <chrono>
+#include <random>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace web_server
 {
 
-    const std::map<std::string, std::string> HttpServer::MIME_TYPES = {
+    namespace
+    {
+        ArenaString arenaString(std::string_view initial = {})
+        {
+            return ArenaString(initial, RequestArena::local().resource());
+        }
+
+        void appendNumber(ArenaString &out, uint64_t value)
+        {
+            char digits[20];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(digits, result.ptr);
+        }
+
+        // "Cache-Control: ...\r\n", or nothing if no policy applies
+        void appendCacheControl(ArenaString &headers, std::string_view cache_control)
+        {
+            if (!cache_control.empty())
+            {
+                headers.append("Cache-Control: ").append(cache_control).append("\r\n");
+            }
+        }
+
+        // ETag and Last-Modified followed by the per-path caching headers
+        void appendValidatorHeaders(ArenaString &headers, const FileValidators &validators, std::string_view cache_headers)
+        {
+            headers.append("ETag: ").append(validators.etag);
+            headers.append("\r\nLast-Modified: ").append(validators.last_modified).append("\r\n");
+            headers.append(cache_headers);
+        }
+
+        // Status line and Content-Type; records the status for the request metrics
+        ArenaString statusHeaders(Connection &conn, std::string_view status, std::string_view content_type)
+        {
+            std::from_chars(status.data(), status.data() + status.length(), conn.response_status);
+            ArenaString response = arenaString("HTTP/1.1 ");
+            response.append(status).append("\r\nContent-Type: ").append(content_type);
+            response.append("; charset=UTF-8\r\n");
+            return response;
+        }
+
+        bool setNonBlocking(socket_t socket)
+        {
+#ifdef _WIN32
+            u_long mode = 1;
+            return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+            int flags = fcntl(socket, F_GETFL, 0);
+            return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+        }
+
+        // True if a failed recv() should be retried once the socket is readable
+        bool receiveWouldBlock()
+        {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+            return error == WSAEWOULDBLOCK || error == WSAEINTR;
+#else
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+        }
+
+        // The item the page script replaces with the entries from `offset` on
+        void appendLoadMore(std::string &html, size_t offset)
+        {
+            html += "<li class='more' data-offset='" + std::to_string(offset) +
+                    "'><a href='#' onclick=\"return loadMore(this);\">Load more&hellip;</a></li>";
+        }
+
+        // Passes each piece of a streamed body through a compressor
+        class CompressedBodySource : public BodySource
+        {
+        public:
+            CompressedBodySource(std::unique_ptr<BodySource> source, std::unique_ptr<StreamCompressor> compressor)
+                : source_(std::move(source)), compressor_(std::move(compressor))
+            {
+            }
+
+            Result produce(std::string &out) override
+            {
+                piece_.clear();
+                Result result = source_->produce(piece_);
+                if (result == Result::Failed || !compressor_->write(piece_, result == Result::Done, out))
+                {
+                    return Result::Failed;
+                }
+                return result;
+            }
+
+        private:
+            std::unique_ptr<BodySource> source_;
+            std::unique_ptr<StreamCompressor> compressor_;
+            std::string piece_;
+        };
+
+        void appendConnectionHeader(ArenaString &headers, const Connection &conn)
+        {
+            headers.append(conn.close_after_write ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n");
+        }
+
+        // Appends `path` (decoded, starting with '/') to the root already in `out`,
+        // normalized the way std::filesystem::path::lexically_normal() would but
+        // without its temporaries: empty and "." segments are dropped and ".."
+        // removes the segment before it. Returns false if ".." climbs above the root.
+        bool appendNormalized(ArenaString &out, std::string_view path)
+        {
+            size_t root_length = out.length();
+            while (!path.empty())
+            {
+                size_t slash = path.find('/');
+                std::string_view segment = path.substr(0, slash);
+                path = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+                if (segment.empty() || segment == ".")
+                {
+                    continue;
+                }
+                if (segment == "..")
+                {
+                    if (out.length() == root_length)
+                    {
+                        return false;
+                    }
+                    out.resize(out.rfind('/'));
+                    continue;
+                }
+                out.append("/").append(segment);
+            }
+            return true;
+        }
+
+        // Whether `path`, normalized by appendNormalized() after `root`, is the
+        // templates directory or below it
+        bool isTemplatesPath(std::string_view path, std::string_view root)
+        {
+            std::string_view below_root = path.substr(root.length());
+            return below_root == "/templates" || below_root.starts_with("/templates/");
+        }
+
+        std::string randomHex(size_t digits)
+        {
+            thread_local std::mt19937_64 generator{std::random_device{}()};
+            static const char HEX[] = "0123456789abcdef";
+            std::string value;
+            while (value.length() < digits)
+            {
+                uint64_t bits = generator();
+                for (int i = 0; i < 16 && value.length() < digits; ++i)
+                {
+                    value += HEX[(bits >> (i * 4)) & 0xF];
+                }
+            }
+            return value;
+        }
+
+        // A receive buffer from the thread's buffer pool, handed back however
+        // serveClient() returns
+        class ReceiveBuffer
+        {
+        public:
+            static constexpr size_t SIZE = 32 * 1024;
+
+            ReceiveBuffer() : data_(buffers::acquire()) { data_.resize(SIZE); }
+            ~ReceiveBuffer() { buffers::release(data_); }
+
+            ReceiveBuffer(const ReceiveBuffer &) = delete;
+            ReceiveBuffer &operator=(const ReceiveBuffer &) = delete;
+
+            char *data() { return data_.data(); }
+
+        private:
+            std::string data_;
+        };
+
+        // Opens a listening socket on `address` (numeric IPv4 or IPv6). An IPv6
+        // wildcard also accepts IPv4 clients as mapped addresses. Returns -1 and
+        // sets `error` on failure.
+        socket_t openListener(const std::string &address, int port, int backlog, bool reuse_port, std::string &error)
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+            addrinfo *result = nullptr;
+            std::string service = std::to_string(port);
+            if (getaddrinfo(address.c_str(), service.c_str(), &hints, &result) != 0 || !result)
+            {
+                error = "invalid bind address " + address;
+                return -1;
+            }
+            socket_t listener = socket(result->ai_family, SOCK_STREAM, 0);
+            if (listener == -1)
+            {
+                freeaddrinfo(result);
+                error = "cannot create socket for " + address;
+                return -1;
+            }
+
+            int on = 1;
+            int off = 0;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char *>(&on), sizeof(on));
+            if (result->ai_family == AF_INET6)
+            {
+                setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<char *>(&off), sizeof(off));
+            }
+#ifdef SO_REUSEPORT
+            if (reuse_port)
+            {
+                setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char *>(&on), sizeof(on));
+            }
+#endif
+            bool ok = bind(listener, result->ai_addr, static_cast<int>(result->ai_addrlen)) == 0 &&
+                      listen(listener, backlog) == 0;
+            freeaddrinfo(result);
+            if (!ok)
+            {
+                CLOSE_SOCKET(listener);
+                error = "cannot listen on " + address + " port " + std::to_string(port);
+                return -1;
+            }
+            return listener;
+        }
+
+        // Keeps the calling thread on the `index`-th CPU it may run on (cycling
+        // if there are fewer), so a shard's connections stay cache-hot
+        void pinCurrentThread(size_t index)
+        {
+#ifdef __linux__
+            cpu_set_t allowed;
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+            {
+                return;
+            }
+            size_t target = index % static_cast<size_t>(CPU_COUNT(&allowed));
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &allowed) && target-- == 0)
+                {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+                    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+                    {
+                        LOG_WARN << "Cannot pin listener thread to CPU " << cpu;
+                    }
+                    return;
+                }
+            }
+#else
+            (void)index;
+#endif
+        }
+    }
+
+    const std::map<std::string, std::string, std::less<>> HttpServer::MIME_TYPES = {
         {".html", "text/html"},
         {".txt", "text/plain"},
         {".jpg", "image/jpeg"},
@@ -17,24 +299,123 @@ namespace web_server
         {".css", "text/css"},
         {".js", "application/javascript"}};
 
-    HttpServer::HttpServer(int port, const std::string &web_root)
-        : port_(port), web_root_(web_root), server_socket_(-1)
+    HttpServer::HttpServer(int port, const std::string &web_root, const ServerOptions &options)
+        : port_(port), web_root_(web_root), options_(options)
     {
+        limits_.idle_timeout = std::chrono::milliseconds(options_.keep_alive_timeout_ms);
+        limits_.header_timeout = std::chrono::milliseconds(options_.header_timeout_ms);
+        limits_.body_timeout = std::chrono::milliseconds(options_.body_timeout_ms);
+        limits_.send_timeout = std::chrono::milliseconds(options_.send_timeout_ms);
+        limits_.min_rate = options_.min_transfer_rate;
+        limits_.max_header_size = options_.max_header_size;
+        limits_.max_body_size = options_.max_body_size;
         if (!std::filesystem::exists(web_root_))
         {
             std::filesystem::create_directory(web_root_);
         }
+        canonical_root_ = std::filesystem::canonical(web_root_).string();
+        open_files_ = std::make_unique<OpenFileCache>(canonical_root_, options_.open_file_cache_entries,
+                                                      std::chrono::milliseconds(options_.open_file_cache_ttl_ms));
+        if (options_.cache_max_bytes > 0)
+        {
+            file_cache_ = std::make_unique<FileCache>(options_.cache_max_bytes, options_.cache_max_file_size);
+        }
+        if (options_.compression && options_.compression_cache_bytes > 0)
+        {
+            compression_cache_ = std::make_unique<CompressionCache>(options_.compression_cache_bytes);
+        }
+        loadTemplates();
+        if (options_.search_index)
+        {
+            // Templates are not served, so they are not found either
+            file_index_ = std::make_unique<FileIndex>(canonical_root_, std::vector<std::string>{"/templates"});
+        }
+
+        file_watcher_ = std::make_unique<FileWatcher>(canonical_root_);
+        file_watcher_->addListener([this](const FileWatcher::Event &event)
+                                   { onFileChanged(event); });
+        if (!file_watcher_->start() && file_cache_)
+        {
+            LOG_WARN << "File changes cannot be tracked, disabling the file cache";
+            file_cache_.reset();
+        }
+        if (file_index_)
+        {
+            // Walked once every directory is watched, so a change is either seen
+            // by the walk or reported afterwards
+            file_index_->start();
+        }
     }
 
     HttpServer::~HttpServer()
     {
-        if (server_socket_ != -1)
+        for (socket_t listener : listen_sockets_)
         {
-            CLOSE_SOCKET(server_socket_);
+            CLOSE_SOCKET(listener);
         }
         cleanupNetworking();
     }
 
+    void HttpServer::onFileChanged(const FileWatcher::Event &event)
+    {
+        // Runs on the watcher thread
+        if (compression_cache_)
+        {
+            // Entries are keyed by validators and never served stale; this only frees their memory early
+            compression_cache_->invalidatePrefix(event.type == FileWatcher::Event::Type::Overflow ? "" : event.path);
+        }
+        if (event.type == FileWatcher::Event::Type::Overflow)
+        {
+            open_files_->clear();
+        }
+        else
+        {
+            // Also drops the directory's own entry and any negative ones below it
+            open_files_->invalidatePrefix(event.path);
+        }
+        if (file_cache_)
+        {
+            if (event.type == FileWatcher::Event::Type::Overflow)
+            {
+                file_cache_->clear();
+            }
+            else if (event.is_directory)
+            {
+                file_cache_->invalidatePrefix(event.path + "/");
+            }
+            else
+            {
+                file_cache_->invalidate(event.path);
+            }
+        }
+        if (file_index_)
+        {
+            switch (event.type)
+            {
+            case FileWatcher::Event::Type::Created:
+                file_index_->added(event.path, event.is_directory);
+                break;
+            case FileWatcher::Event::Type::Removed:
+                file_index_->removed(event.path);
+                break;
+            case FileWatcher::Event::Type::Overflow:
+                file_index_->rebuild();
+                break;
+            case FileWatcher::Event::Type::Modified:
+                break;
+            }
+        }
+        if (event.type == FileWatcher::Event::Type::Overflow || event.path.starts_with(canonical_root_ + "/templates"))
+        {
+            loadTemplates();
+        }
+    }
+
+    FileCache::Stats HttpServer::cacheStats() const
+    {
+        return file_cache_ ? file_cache_->stats() : FileCache::Stats{};
+    }
+
     void HttpServer::initNetworking()
     {
 #ifdef _WIN32
@@ -53,548 +434,1682 @@ namespace web_server
 #endif
     }
 
-    socket_t HttpServer::createServerSocket()
+    socket_t HttpServer::createServerSocket(bool reuse_port)
     {
-        socket_t server_socket = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_socket == -1)
-        {
-            throw std::runtime_error("Failed to create socket");
-        }
-
-        int opt = 1;
-        setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char *>(&opt), sizeof(opt));
-
-        sockaddr_in server_addr{};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(port_);
-
-        if (bind(server_socket, reinterpret_cast<sockaddr *>(&server_addr), sizeof(server_addr)) < 0)
+        std::string error;
+        socket_t server_socket = openListener(options_.bind_address, port_, options_.listen_backlog, reuse_port, error);
+        if (server_socket == -1 && options_.bind_address == "::")
         {
-            CLOSE_SOCKET(server_socket);
-            throw std::runtime_error("Failed to bind socket");
+            // IPv6 is disabled on this host; serve IPv4 only
+            server_socket = openListener("0.0.0.0", port_, options_.listen_backlog, reuse_port, error);
         }
-
-        if (listen(server_socket, 10) < 0)
+        if (server_socket == -1)
         {
-            CLOSE_SOCKET(server_socket);
-            throw std::runtime_error("Failed to listen on socket");
+            throw std::runtime_error("Failed to listen: " + error);
         }
-
         return server_socket;
     }
 
-    std::pair<std::string, std::string> HttpServer::parseRequest(const std::string &request)
+    std::string_view HttpServer::getMimeType(std::string_view path)
     {
-        std::istringstream stream(request);
-        std::string method, path, protocol;
-        stream >> method >> path >> protocol;
-        if (method != "GET" && method != "POST")
+        // Same rule as std::filesystem::path::extension(): the last dot of the
+        // file name, unless the name starts with it (".bashrc")
+        std::string_view name = path.substr(path.rfind('/') + 1);
+        size_t dot = name.rfind('.');
+        if (dot != std::string_view::npos && dot != 0 && name != "..")
         {
-            return {"", ""};
+            auto it = MIME_TYPES.find(name.substr(dot));
+            if (it != MIME_TYPES.end())
+            {
+                return it->second;
+            }
         }
-        size_t query_pos = path.find('?');
-        std::string query;
-        if (query_pos != std::string::npos)
+        return "application/octet-stream";
+    }
+
+    std::string HttpServer::readFile(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
         {
-            query = path.substr(query_pos);
-            path = path.substr(0, query_pos);
+            return "";
         }
-        std::string decoded_path;
-        for (size_t i = 0; i < path.length(); ++i)
+        std::ostringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    namespace
+    {
+        // Directories first, then files, each alphabetically. Only the first
+        // `keep` entries in that order are held while a directory is read, in a
+        // max-heap, so a page of a huge directory needs memory for the page
+        // rather than for every entry.
+        template <typename Entry>
+        class DirectoryPage
         {
-            if (path[i] == '%' && i + 2 < path.length())
+        public:
+            explicit DirectoryPage(size_t keep) : keep_(keep) {}
+
+            void offer(Entry candidate)
             {
-                std::string hex = path.substr(i + 1, 2);
-                try
+                ++total_;
+                if (entries_.size() < keep_)
                 {
-                    char decoded = static_cast<char>(std::stoi(hex, nullptr, 16));
-                    decoded_path += decoded;
-                    i += 2;
+                    entries_.push_back(std::move(candidate));
+                    std::push_heap(entries_.begin(), entries_.end(), before);
                 }
-                catch (...)
+                else if (keep_ > 0 && before(candidate, entries_.front()))
                 {
-                    decoded_path += path[i];
+                    std::pop_heap(entries_.begin(), entries_.end(), before);
+                    entries_.back() = std::move(candidate);
+                    std::push_heap(entries_.begin(), entries_.end(), before);
                 }
             }
-            else
+
+            // Moves the entries from `offset` on into `page`; returns how many were offered
+            size_t take(size_t offset, std::vector<Entry> &page)
+            {
+                std::sort_heap(entries_.begin(), entries_.end(), before);
+                size_t begin = std::min(offset, entries_.size());
+                page.assign(std::make_move_iterator(entries_.begin() + begin), std::make_move_iterator(entries_.end()));
+                return total_;
+            }
+
+        private:
+            size_t keep_;
+            size_t total_ = 0;
+            std::vector<Entry> entries_;
+
+            static bool before(const Entry &a, const Entry &b)
             {
-                decoded_path += path[i];
+                if (a.is_directory != b.is_directory)
+                {
+                    return a.is_directory;
+                }
+                return a.name < b.name;
             }
+        };
+
+        size_t pageEnd(size_t offset, size_t limit)
+        {
+            return offset > SIZE_MAX - limit ? SIZE_MAX : offset + limit;
         }
-        return {decoded_path, method + query};
     }
 
-    std::string HttpServer::getMimeType(const std::string &path)
+    size_t HttpServer::listDirectory(const OpenFile &dir, std::string_view dir_path, size_t offset, size_t limit,
+                                     std::vector<DirectoryEntry> &page)
     {
-        std::string ext = std::filesystem::path(path).extension().string();
-        auto it = MIME_TYPES.find(ext);
-        if (it != MIME_TYPES.end())
+        if (!dir.isDirectory())
         {
-            return it->second;
+            std::error_code ec(dir.ok() ? ENOTDIR : dir.error, std::generic_category());
+            throw std::filesystem::filesystem_error("Cannot read directory", std::filesystem::path(dir_path), ec);
         }
-        return "application/octet-stream";
+        DirectoryPage<DirectoryEntry> entries(pageEnd(offset, limit));
+#ifdef _WIN32
+        for (const auto &entry : std::filesystem::directory_iterator(std::filesystem::path(dir_path)))
+        {
+            std::error_code ec;
+            entries.offer({entry.path().filename().string(), entry.is_directory(ec)});
+        }
+#else
+        // A fresh open file description, since the cached descriptor is shared
+        // and readdir() moves its offset
+        int fd = openat(dir.fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *stream = fd == -1 ? nullptr : fdopendir(fd);
+        if (!stream)
+        {
+            std::error_code ec(errno, std::generic_category());
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            throw std::filesystem::filesystem_error("Cannot read directory", std::filesystem::path(dir_path), ec);
+        }
+        std::string target(dir_path);
+        if (!target.ends_with('/'))
+        {
+            target += '/';
+        }
+        size_t name_start = target.length();
+        while (dirent *entry = readdir(stream))
+        {
+            std::string_view name = entry->d_name;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+            unsigned char type = entry->d_type;
+            struct stat info;
+            if (type == DT_UNKNOWN && fstatat(fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISLNK(info.st_mode) ? DT_LNK : DT_REG;
+            }
+            bool is_directory = type == DT_DIR;
+            if (type == DT_LNK)
+            {
+                // Followed only as far as the root: a link leading outside it is
+                // listed as a file, which is then refused when opened
+                target.resize(name_start);
+                target += name;
+                is_directory = open_files_->open(target)->isDirectory();
+            }
+            entries.offer({std::string(name), is_directory});
+        }
+        closedir(stream);
+#endif
+        return entries.take(offset, page);
     }
 
-    std::string HttpServer::readFile(const std::string &path)
+    void HttpServer::appendDirectoryEntry(std::string &html, const std::string &relative_path, const DirectoryEntry &entry)
     {
-        std::ifstream file(path, std::ios::binary);
-        if (!file)
+        std::string link = relative_path + (relative_path == "/" ? "" : "/") + entry.name;
+        if (entry.is_directory)
         {
-            return "";
+            std::string tree_id = "tree-" + relative_path + "/" + entry.name;
+            std::replace(tree_id.begin(), tree_id.end(), '/', '_'); // Replace / with _ for valid ID
+            html += "<li class='directory'>";
+            html += "<span class='toggle' onclick=\"toggleTree(this.nextElementSibling.id)\">"
+                    "<span class='arrow'>&#9654;</span> <a href='";
+            appendHtmlEscaped(html, link);
+            html += "/' onclick=\"event.stopPropagation();\">";
+            appendHtmlEscaped(html, entry.name);
+            html += "/</a></span><ul id='";
+            appendHtmlEscaped(html, tree_id);
+            html += "' data-path='";
+            appendHtmlEscaped(html, link);
+            html += "' style='display: none;'></ul></li>";
+        }
+        else
+        {
+            html += "<li class='file'><a href='";
+            appendHtmlEscaped(html, link);
+            html += "'>";
+            appendHtmlEscaped(html, entry.name);
+            html += "</a></li>";
         }
-        std::ostringstream content;
-        content << file.rdbuf();
-        return content.str();
     }
 
-    // Comparison function for sorting directory entries
-    bool comparePaths(const std::filesystem::directory_entry &a, const std::filesystem::directory_entry &b)
+    // Streams a listing page: the template up to the tree, then the first page of
+    // entries in pieces of about PIECE_SIZE bytes, then the rest of the template.
+    // The directory is read only once the head has been queued, so the client
+    // starts on the page (and its stylesheet and script) while it is read.
+    class HttpServer::DirectoryListingSource : public BodySource
     {
-        return a.path().filename().string() < b.path().filename().string();
-    }
+    public:
+        static constexpr size_t PIECE_SIZE = 16 * 1024;
+
+        // `dir` is the directory opened beneath the root, `dir_path` its canonical path
+        DirectoryListingSource(HttpServer &server, std::shared_ptr<const OpenFile> dir, std::string dir_path,
+                               std::string relative_path)
+            : server_(server), dir_(std::move(dir)), dir_path_(std::move(dir_path)),
+              relative_path_(std::move(relative_path))
+        {
+            std::string_view clean_relative_path = relative_path_;
+            if (clean_relative_path.ends_with('}'))
+            {
+                clean_relative_path.remove_suffix(1);
+            }
+            server_.tree_template_.load()->renderAround({{"RELATIVE_PATH", clean_relative_path}}, "TREE_CONTENT",
+                                                        head_, tail_);
+        }
+
+        Result produce(std::string &out) override
+        {
+            switch (stage_)
+            {
+            case Stage::Head:
+                out.append(head_);
+                stage_ = Stage::Entries;
+                return Result::More;
+            case Stage::Entries:
+            {
+                size_t start = out.length();
+                if (!listed_)
+                {
+                    list(out);
+                }
+                while (next_ < entries_.size() && out.length() - start < PIECE_SIZE)
+                {
+                    appendDirectoryEntry(out, relative_path_, entries_[next_++]);
+                }
+                if (next_ < entries_.size())
+                {
+                    return Result::More;
+                }
+                if (entries_.size() < total_)
+                {
+                    appendLoadMore(out, entries_.size());
+                }
+                out.append(tail_);
+                return Result::Done;
+            }
+            }
+            return Result::Failed;
+        }
+
+    private:
+        enum class Stage
+        {
+            Head,
+            Entries
+        };
+
+        HttpServer &server_;
+        std::shared_ptr<const OpenFile> dir_;
+        std::string dir_path_;
+        std::string relative_path_;
+        std::string head_;
+        std::string tail_;
+        Stage stage_ = Stage::Head;
+        bool listed_ = false;
+        std::vector<DirectoryEntry> entries_;
+        size_t total_ = 0;
+        size_t next_ = 0;
+
+        void list(std::string &out)
+        {
+            listed_ = true;
+            try
+            {
+                metrics::PhaseTimer filesystem_timer(metrics::Phase::Filesystem);
+                total_ = server_.listDirectory(*dir_, dir_path_, 0, server_.options_.tree_page_size, entries_);
+            }
+            catch (const std::filesystem::filesystem_error &e)
+            {
+                out += "<li>Error reading directory: ";
+                appendHtmlEscaped(out, e.what());
+                out += "</li>";
+            }
+        }
+    };
 
-    std::string HttpServer::generateDirectoryTree(const std::string &dir_path, const std::string &relative_path, int depth)
+    std::string HttpServer::generateDirectoryTree(const std::string &dir_path, const std::string &relative_path)
     {
-        std::ostringstream html;
+        // Only the first page of this level is rendered; deeper levels and further
+        // pages are fetched from /__tree by the page script when the user asks for them.
+        std::string html;
         try
         {
-            std::vector<std::filesystem::directory_entry> directories;
-            std::vector<std::filesystem::directory_entry> files;
+            std::vector<DirectoryEntry> entries;
+            size_t total = listDirectory(*open_files_->open(dir_path), dir_path, 0, options_.tree_page_size, entries);
 
-            // Separate directories and files for sorting
-            for (const auto &entry : std::filesystem::directory_iterator(dir_path))
+            for (const auto &entry : entries)
+            {
+                appendDirectoryEntry(html, relative_path, entry);
+            }
+            if (entries.size() < total)
+            {
+                appendLoadMore(html, entries.size());
+            }
+        }
+        catch (const std::filesystem::filesystem_error &e)
+        {
+            html += "<li>Error reading directory: ";
+            appendHtmlEscaped(html, e.what());
+            html += "</li>";
+        }
+        return html;
+    }
+
+    void HttpServer::handleTreeRequest(Connection &conn, std::string_view query)
+    {
+        std::string relative_path;
+        queryParameter(query, "path", relative_path);
+        if (relative_path.find('\0') != std::string::npos)
+        {
+            sendResponse(conn, "400 Bad Request", "text/plain", "Invalid path");
+            return;
+        }
+        if (relative_path.empty() || relative_path[0] != '/')
+        {
+            relative_path = "/" + relative_path;
+        }
+        size_t offset = 0;
+        size_t limit = options_.tree_page_size;
+        try
+        {
+            std::string value;
+            if (queryParameter(query, "offset", value) && !value.empty())
+            {
+                offset = std::stoul(value);
+            }
+            if (queryParameter(query, "limit", value) && !value.empty())
+            {
+                limit = std::min<size_t>(std::stoul(value), MAX_TREE_PAGE_SIZE);
+            }
+        }
+        catch (const std::logic_error &)
+        {
+            sendResponse(conn, "400 Bad Request", "text/plain", "Invalid offset or limit");
+            return;
+        }
+
+        // Resolved beneath the root like a static file, so neither ".." nor a
+        // symlink can list a directory outside it
+        ArenaString dir_path = arenaString(canonical_root_);
+        if (!appendNormalized(dir_path, relative_path))
+        {
+            sendResponse(conn, "403 Forbidden", "text/plain", "Access denied");
+            return;
+        }
+        if (isTemplatesPath(dir_path, canonical_root_))
+        {
+            sendResponse(conn, "403 Forbidden", "text/plain", "Access to templates directory is forbidden");
+            return;
+        }
+        std::vector<DirectoryEntry> entries;
+        size_t total;
+        try
+        {
+            metrics::PhaseTimer filesystem_timer(metrics::Phase::Filesystem);
+            std::shared_ptr<const OpenFile> dir = open_files_->open(dir_path);
+            if (dir->error == EXDEV)
+            {
+                sendResponse(conn, "403 Forbidden", "text/plain", "Access denied");
+                return;
+            }
+            if (!dir->isDirectory())
+            {
+                sendResponse(conn, "404 Not Found", "text/plain", "Directory not found");
+                return;
+            }
+            total = listDirectory(*dir, dir_path, offset, limit, entries);
+        }
+        catch (const std::filesystem::filesystem_error &)
+        {
+            sendResponse(conn, "404 Not Found", "text/plain", "Directory not found");
+            return;
+        }
+
+        std::string json = "{\"path\":";
+        appendJsonString(json, relative_path);
+        json += ",\"offset\":" + std::to_string(offset) + ",\"total\":" + std::to_string(total) + ",\"entries\":[";
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            json += i == 0 ? "{\"name\":" : ",{\"name\":";
+            appendJsonString(json, entries[i].name);
+            json += entries[i].is_directory ? ",\"type\":\"directory\"}" : ",\"type\":\"file\"}";
+        }
+        json += "],\"next_offset\":";
+        json += offset + entries.size() < total ? std::to_string(offset + entries.size()) : "null";
+        json += "}";
+        sendResponse(conn, "200 OK", "application/json", std::move(json));
+    }
+
+    void HttpServer::handleSearchRequest(Connection &conn, std::string_view query)
+    {
+        if (!file_index_)
+        {
+            sendResponse(conn, "404 Not Found", "text/plain", "Search is disabled");
+            return;
+        }
+        std::string text;
+        if (!queryParameter(query, "q", text) || text.empty() || text.length() > FileIndex::MAX_QUERY_LENGTH ||
+            text.find('\0') != std::string::npos)
+        {
+            sendResponse(conn, "400 Bad Request", "text/plain", "Missing or invalid query");
+            return;
+        }
+        FileIndex::Match match = FileIndex::Match::Substring;
+        size_t limit = SEARCH_PAGE_SIZE;
+        std::string value;
+        if (queryParameter(query, "match", value) && !value.empty())
+        {
+            if (value == "prefix")
+            {
+                match = FileIndex::Match::Prefix;
+            }
+            else if (value != "substring")
+            {
+                sendResponse(conn, "400 Bad Request", "text/plain", "match must be prefix or substring");
+                return;
+            }
+        }
+        try
+        {
+            if (queryParameter(query, "limit", value) && !value.empty())
+            {
+                limit = std::min<size_t>(std::stoul(value), MAX_SEARCH_RESULTS);
+            }
+        }
+        catch (const std::logic_error &)
+        {
+            sendResponse(conn, "400 Bad Request", "text/plain", "Invalid limit");
+            return;
+        }
+        if (!file_index_->ready())
+        {
+            std::string_view body = "The search index is being built";
+            writeHeaders(conn, "503 Service Unavailable", "text/plain", body.length(), "Retry-After: 1\r\n");
+            conn.write(body);
+            return;
+        }
+
+        std::vector<FileIndex::Result> results;
+        size_t total = file_index_->search(text, match, limit, results);
+        std::string json = "{\"query\":";
+        appendJsonString(json, text);
+        json += match == FileIndex::Match::Prefix ? ",\"match\":\"prefix\"" : ",\"match\":\"substring\"";
+        json += ",\"total\":" + std::to_string(total) + ",\"results\":[";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            json += i == 0 ? "{\"path\":" : ",{\"path\":";
+            appendJsonString(json, results[i].path);
+            json += results[i].is_directory ? ",\"type\":\"directory\"}" : ",\"type\":\"file\"}";
+        }
+        json += "]}";
+        sendResponse(conn, "200 OK", "application/json", std::move(json));
+    }
+
+    void HttpServer::handleMetricsRequest(Connection &conn)
+    {
+        std::string body;
+        metrics::render(body);
+        if (file_cache_)
+        {
+            FileCache::Stats stats = file_cache_->stats();
+            metrics::appendSample(body, "web_server_file_cache_hits_total", "counter", "File cache hits.", static_cast<double>(stats.hits));
+            metrics::appendSample(body, "web_server_file_cache_misses_total", "counter", "File cache misses.", static_cast<double>(stats.misses));
+            metrics::appendSample(body, "web_server_file_cache_evictions_total", "counter", "File cache evictions.", static_cast<double>(stats.evictions));
+            metrics::appendSample(body, "web_server_file_cache_entries", "gauge", "Files held in the file cache.", static_cast<double>(stats.entries));
+            metrics::appendSample(body, "web_server_file_cache_bytes", "gauge", "Bytes held in the file cache.", static_cast<double>(stats.bytes));
+        }
+        if (file_index_)
+        {
+            FileIndex::Stats stats = file_index_->stats();
+            metrics::appendSample(body, "web_server_search_index_entries", "gauge", "Names held in the search index.", static_cast<double>(stats.entries));
+            metrics::appendSample(body, "web_server_search_index_bytes", "gauge", "Bytes held by the search index.", static_cast<double>(stats.bytes));
+        }
+        OpenFileCache::Stats open_file_stats = open_files_->stats();
+        metrics::appendSample(body, "web_server_open_file_cache_hits_total", "counter", "Open file cache hits.", static_cast<double>(open_file_stats.hits));
+        metrics::appendSample(body, "web_server_open_file_cache_misses_total", "counter", "Open file cache misses.", static_cast<double>(open_file_stats.misses));
+        metrics::appendSample(body, "web_server_open_file_cache_entries", "gauge", "Resolved paths held in the open file cache.", static_cast<double>(open_file_stats.entries));
+        if (compression_cache_)
+        {
+            CompressionCache::Stats stats = compression_cache_->stats();
+            metrics::appendSample(body, "web_server_compression_cache_hits_total", "counter", "Compression cache hits.", static_cast<double>(stats.hits));
+            metrics::appendSample(body, "web_server_compression_cache_misses_total", "counter", "Compression cache misses.", static_cast<double>(stats.misses));
+            metrics::appendSample(body, "web_server_compression_cache_bytes", "gauge", "Bytes held in the compression cache.", static_cast<double>(stats.bytes));
+        }
+        if (worker_pool_)
+        {
+            ThreadPool::Stats stats = worker_pool_->stats();
+            metrics::appendSample(body, "web_server_worker_queue_length", "gauge", "Connections waiting for a worker thread.", static_cast<double>(stats.queued));
+            metrics::appendSample(body, "web_server_worker_queue_wait_seconds_total", "counter", "Time connections spent waiting for a worker thread.",
+                                  static_cast<double>(stats.total_wait_us) / 1e6);
+        }
+        metrics::appendSample(body, "web_server_log_dropped_lines_total", "counter", "Log lines dropped because a ring buffer was full.",
+                              static_cast<double>(logging::droppedLines()));
+        // Never compressed or cached: scrapers expect a fresh plain-text body
+        writeHeaders(conn, "200 OK", "text/plain; version=0.0.4", body.length(), "Cache-Control: no-store\r\n");
+        conn.writeBuffer(std::move(body));
+    }
+
+    void HttpServer::loadTemplates()
+    {
+        std::string html = readFile(web_root_ + "/templates/tree_template.html");
+        if (html.empty())
+        {
+            LOG_WARN << "Failed to load template, using fallback";
+            html = "<!DOCTYPE html><html><head><title>Directory Listing</title></head><body>"
+                   "<h1>Directory: {{RELATIVE_PATH}}</h1>"
+                   "<form action='/upload?path={{RELATIVE_PATH}}' method='post' enctype='multipart/form-data'>"
+                   "<input type='file' name='file' multiple><input type='submit' value='Upload'>"
+                   "</form><ul>{{TREE_CONTENT}}</ul></body></html>";
+        }
+        tree_template_.store(std::make_shared<const Template>(html));
+
+        html = readFile(web_root_ + "/templates/upload_template.html");
+        if (html.empty())
+        {
+            LOG_WARN << "Failed to load upload template, using fallback";
+            html = "<!DOCTYPE html><html><head><title>Upload File</title></head><body>"
+                   "<h1>Upload to {{RELATIVE_PATH}}</h1>"
+                   "<form action='/upload?path={{RELATIVE_PATH}}' method='post' enctype='multipart/form-data'>"
+                   "<input type='file' name='file' multiple><input type='submit' value='Upload'>"
+                   "</form></body></html>";
+        }
+        upload_template_.store(std::make_shared<const Template>(html));
+    }
+
+    std::string HttpServer::generateDirectoryListing(const std::string &dir_path, const std::string &relative_path)
+    {
+        DirectoryListingSource source(*this, open_files_->open(dir_path), dir_path, relative_path);
+        std::string html;
+        while (source.produce(html) == BodySource::Result::More)
+        {
+        }
+        return html;
+    }
+
+    std::string HttpServer::generateUploadForm(const std::string &relative_path)
+    {
+        std::string clean_relative_path = relative_path;
+        if (clean_relative_path.empty() || clean_relative_path == "/")
+        {
+            clean_relative_path = "/";
+        }
+
+        std::string result = upload_template_.load()->render({{"RELATIVE_PATH", clean_relative_path}});
+        LOG_DEBUG << "Upload form HTML size: " << result.size() << " bytes";
+        return result;
+    }
+
+    std::unique_ptr<UploadReceiver> HttpServer::createUploadReceiver(const HttpRequest &request)
+    {
+        std::string destination_path;
+        queryParameter(request.query, "path", destination_path);
+        if (destination_path.empty())
+        {
+            destination_path = "/";
+        }
+        LOG_DEBUG << "Upload destination path: " << destination_path;
+        // Resolve before anything is written, since the body is streamed straight
+        // into the destination directory
+        std::string directory =
+            (std::filesystem::path(canonical_root_) / destination_path.substr(destination_path[0] == '/' ? 1 : 0))
+                .lexically_normal()
+                .string();
+        if (directory.length() > canonical_root_.length() && directory.back() == '/')
+        {
+            directory.pop_back();
+        }
+        std::shared_ptr<const OpenFile> resolved = open_files_->open(directory);
+        if (resolved->error == EXDEV)
+        {
+            LOG_WARN << "Directory traversal detected in upload path: " << logging::Quoted{destination_path};
+            return UploadReceiver::rejected("403 Forbidden", "Access denied");
+        }
+        if (!resolved->ok())
+        {
+            LOG_DEBUG << "Upload destination not found: " << directory;
+            return UploadReceiver::rejected("404 Not Found", "Upload path not found");
+        }
+        if (!resolved->isDirectory())
+        {
+            LOG_DEBUG << "Upload destination is not a directory: " << directory;
+            return UploadReceiver::rejected("400 Bad Request", "Upload destination must be a directory");
+        }
+        std::string_view boundary = multipartBoundary(request.header("Content-Type"));
+        if (boundary.empty())
+        {
+            LOG_DEBUG << "Invalid multipart/form-data in POST request";
+            return UploadReceiver::rejected("400 Bad Request", "Invalid multipart/form-data");
+        }
+        return std::make_unique<UploadReceiver>(std::string(boundary), directory, upload_pool_.get());
+    }
+
+    void HttpServer::beginRequestBody(Connection &conn)
+    {
+        const HttpRequest &request = conn.request;
+        if (!conn.parse_error && request.method == "PRI" && request.version == "HTTP/2.0")
+        {
+            // The HTTP/2 connection preface of a client with prior knowledge
+            if (options_.http2)
+            {
+                conn.upgrade(createHttp2Session());
+            }
+            return;
+        }
+        if (conn.parse_error || request.method != "POST" || request.path != "/upload")
+        {
+            return; // Other bodies are small and buffered with the request
+        }
+        auto upload = createUploadReceiver(request);
+
+        // Clients that wait for permission before sending a large body may start now
+        if (upload->status().empty() && equalsIgnoreCase(request.header("Expect"), "100-continue"))
+        {
+            conn.write("HTTP/1.1 100 Continue\r\n\r\n");
+        }
+        conn.body_sink = std::move(upload);
+    }
+
+    bool HttpServer::saveUploadedFile(const std::string &temp_path, const std::string &filename, const std::string &destination_dir)
+    {
+        metrics::PhaseTimer filesystem_timer(metrics::Phase::Filesystem);
+        LOG_DEBUG << "Attempting to save file: " << filename << " to " << destination_dir;
+        if (!UploadReceiver::validFilename(filename))
+        {
+            LOG_DEBUG << "Invalid filename: " << filename;
+            return false;
+        }
+        // `destination_dir` was resolved beneath the root by createUploadReceiver()
+        // and the filename is a single path component, so no further checks are needed
+        std::filesystem::path file_path = std::filesystem::path(destination_dir) / filename;
+        LOG_DEBUG << "Constructed file path: " << file_path.string();
+        try
+        {
+            // The body was already streamed to a temporary file in the same
+            // directory, so publishing it is a single atomic rename
+            std::filesystem::rename(temp_path, file_path);
+            LOG_DEBUG << "Successfully wrote file: " << file_path.string();
+            if (file_index_)
+            {
+                // Searchable at once even where inotify is unavailable
+                file_index_->added(file_path.string(), false);
+            }
+            return true;
+        }
+        catch (const std::filesystem::filesystem_error &e)
+        {
+            LOG_ERROR << "Filesystem error: " << e.what();
+            return false;
+        }
+    }
+
+    void HttpServer::sendUploadResult(Connection &conn, UploadReceiver &upload)
+    {
+        size_t stored = 0;
+        for (size_t i = 0; i < upload.fileCount(); ++i)
+        {
+            UploadReceiver::File &file = upload.file(i);
+            if (file.error.empty())
+            {
+                if (saveUploadedFile(file.temp_path, file.filename, upload.directory()))
+                {
+                    file.temp_path.clear();
+                    ++stored;
+                    LOG_INFO << "Upload succeeded: " << file.filename << " to " << upload.directory();
+                    continue;
+                }
+                file.error = "Failed to store file";
+            }
+            LOG_INFO << "Upload failed: filename=" << file.filename << ", size=" << file.size << ", error=" << file.error;
+        }
+
+        // A single file from a client that does not ask for JSON keeps the plain answer
+        std::string_view status = stored > 0 ? "200 OK" : "400 Bad Request";
+        if (upload.fileCount() == 1 && conn.request.header("Accept").find("application/json") == std::string_view::npos)
+        {
+            sendResponse(conn, status, "text/plain", stored > 0 ? "File uploaded successfully" : "Failed to upload file");
+            return;
+        }
+        std::string json = "{\"stored\":" + std::to_string(stored) +
+                           ",\"failed\":" + std::to_string(upload.fileCount() - stored) + ",\"files\":[";
+        for (size_t i = 0; i < upload.fileCount(); ++i)
+        {
+            const UploadReceiver::File &file = upload.file(i);
+            json += i == 0 ? "{\"name\":" : ",{\"name\":";
+            appendJsonString(json, file.filename);
+            json += ",\"size\":" + std::to_string(file.size);
+            if (file.error.empty())
+            {
+                json += ",\"stored\":true}";
+            }
+            else
+            {
+                json += ",\"stored\":false,\"error\":";
+                appendJsonString(json, file.error);
+                json += "}";
+            }
+        }
+        json += "]}";
+        sendResponse(conn, status, "application/json", std::move(json));
+    }
+
+    void HttpServer::writeHeaders(Connection &conn, std::string_view status, std::string_view content_type,
+                                  size_t content_length, std::string_view extra_headers)
+    {
+        ArenaString response = statusHeaders(conn, status, content_type);
+        response.append("Content-Length: ");
+        appendNumber(response, content_length);
+        response.append("\r\n").append(extra_headers);
+        appendConnectionHeader(response, conn);
+        conn.write(response);
+    }
+
+    void HttpServer::sendResponse(Connection &conn, std::string_view status, std::string_view content_type,
+                                  std::string content)
+    {
+        // Generated pages such as directory listings are compressed per request
+        // at a fast level; they change too often to be worth caching
+        if (options_.compression && !conn.parse_error && isCompressible(content_type))
+        {
+            std::string_view accept_encoding = conn.request.header("Accept-Encoding");
+            for (ContentEncoding encoding : PREFERRED_ENCODINGS)
+            {
+                std::string encoded;
+                if (content.length() >= options_.compression_min_size && acceptsEncoding(accept_encoding, encoding) &&
+                    compress(encoding, CompressionLevel::Fast, content, encoded) && encoded.length() < content.length())
+                {
+                    ArenaString headers = arenaString("Content-Encoding: ");
+                    headers.append(encodingToken(encoding)).append("\r\nVary: Accept-Encoding\r\n");
+                    writeHeaders(conn, status, content_type, encoded.length(), headers);
+                    conn.writeBuffer(std::move(encoded));
+                    return;
+                }
+            }
+            writeHeaders(conn, status, content_type, content.length(), "Vary: Accept-Encoding\r\n");
+            conn.writeBuffer(std::move(content));
+            return;
+        }
+        writeHeaders(conn, status, content_type, content.length());
+        conn.writeBuffer(std::move(content));
+    }
+
+    void HttpServer::sendStream(Connection &conn, std::string_view status, std::string_view content_type,
+                                std::unique_ptr<BodySource> body)
+    {
+        if (conn.request.version != "HTTP/1.1")
+        {
+            // HTTP/1.0 has no chunked coding: collect the body and send it with a length
+            std::string content;
+            BodySource::Result result;
+            while ((result = body->produce(content)) == BodySource::Result::More)
+            {
+            }
+            if (result == BodySource::Result::Failed)
+            {
+                sendResponse(conn, "500 Internal Server Error", "text/plain", "Failed to generate response");
+                return;
+            }
+            sendResponse(conn, status, content_type, std::move(content));
+            return;
+        }
+
+        ArenaString headers = statusHeaders(conn, status, content_type);
+        headers.append("Transfer-Encoding: chunked\r\n");
+        if (options_.compression && isCompressible(content_type))
+        {
+            // The length is unknown up front, so any accepted encoding is used
+            std::string_view accept_encoding = conn.request.header("Accept-Encoding");
+            for (ContentEncoding encoding : PREFERRED_ENCODINGS)
+            {
+                std::unique_ptr<StreamCompressor> compressor;
+                if (acceptsEncoding(accept_encoding, encoding) &&
+                    (compressor = StreamCompressor::create(encoding, CompressionLevel::Fast)))
+                {
+                    headers.append("Content-Encoding: ").append(encodingToken(encoding)).append("\r\n");
+                    body = std::make_unique<CompressedBodySource>(std::move(body), std::move(compressor));
+                    break;
+                }
+            }
+            headers.append("Vary: Accept-Encoding\r\n");
+        }
+        appendConnectionHeader(headers, conn);
+        conn.write(headers);
+        conn.writeStream(std::move(body));
+    }
+
+    bool HttpServer::useZeroCopy(size_t length) const
+    {
+        return options_.zerocopy_min_bytes > 0 && length >= options_.zerocopy_min_bytes;
+    }
+
+    namespace
+    {
+        // Reads the whole of a regular file through its open descriptor, so the
+        // content is the file that was resolved and not whatever the path names
+        // by now. False if it cannot be read or changed size meanwhile.
+        bool readOpenFile(const OpenFile &file, std::string_view canonical_path, std::string &content)
+        {
+            auto size = static_cast<size_t>(file.info.st_size);
+#ifdef _WIN32
+            std::ifstream stream(std::string(canonical_path), std::ios::binary);
+            std::ostringstream buffer;
+            buffer << stream.rdbuf();
+            content = buffer.str();
+            return stream && content.length() == size;
+#else
+            (void)canonical_path;
+            content.resize(size);
+            size_t done = 0;
+            while (done < size)
+            {
+                ssize_t n = pread(file.fd, content.data() + done, size - done, static_cast<off_t>(done));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                done += static_cast<size_t>(n);
+            }
+            char extra;
+            return pread(file.fd, &extra, 1, static_cast<off_t>(size)) == 0;
+#endif
+        }
+    }
+
+    void HttpServer::compressStaticFile(std::shared_ptr<const OpenFile> file, std::string_view canonical_path,
+                                        ContentEncoding encoding, std::string key)
+    {
+        // Single flight: requests for the same version that arrive meanwhile are
+        // answered uncompressed instead of compressing it again
+        if (!compression_cache_->claim(key))
+        {
+            return;
+        }
+        auto task = [this, file = std::move(file), path = std::string(canonical_path), encoding, key]
+        {
+            std::string content;
+            auto output = std::make_shared<std::string>();
+            if (!readOpenFile(*file, path, content) || !compress(encoding, CompressionLevel::Best, content, *output))
+            {
+                LOG_DEBUG << "Failed to compress " << path;
+                compression_cache_->release(key); // Tried again by a later request
+                return;
+            }
+            if (output->length() >= content.length())
+            {
+                output->clear(); // Incompressible; remembered so it is not tried again
+            }
+            compression_cache_->insert(key, std::move(output));
+        };
+        if (!compression_pool_)
+        {
+            task();
+        }
+        else if (!compression_pool_->trySubmit(task))
+        {
+            compression_cache_->release(key);
+        }
+    }
+
+    bool HttpServer::sendEncodedFile(Connection &conn, const std::shared_ptr<const OpenFile> &open_file,
+                                     std::string_view canonical_path, std::string_view content_type,
+                                     std::string_view cache_headers)
+    {
+        const OpenFile &file = *open_file;
+        std::string_view accept_encoding = conn.request.header("Accept-Encoding");
+        if (accept_encoding.empty() || !conn.request.header("Range").empty())
+        {
+            return false; // Ranges are served from the identity representation
+        }
+        if (!file.isRegular())
+        {
+            return false;
+        }
+
+        // Precompressed sidecar files (style.css.br, style.css.gz) win, unless they
+        // are older than the file they were made from. Missing ones are remembered
+        // by the open file cache, so checking costs no system calls on most requests.
+        for (ContentEncoding encoding : PREFERRED_ENCODINGS)
+        {
+            if (!acceptsEncoding(accept_encoding, encoding))
+            {
+                continue;
+            }
+            ArenaString sidecar_path = arenaString(canonical_path);
+            sidecar_path.append(sidecarExtension(encoding));
+            std::shared_ptr<const OpenFile> sidecar = open_files_->open(sidecar_path);
+            if (!sidecar->isRegular() || sidecar->info.st_mtime < file.info.st_mtime)
+            {
+                continue;
+            }
+            const FileValidators &validators = sidecar->validators;
+            if (isNotModified(conn.request, validators))
+            {
+                sendNotModified(conn, validators, cache_headers);
+                return true;
+            }
+            ArenaString headers = arenaString("Content-Encoding: ");
+            headers.append(encodingToken(encoding)).append("\r\n");
+            appendValidatorHeaders(headers, validators, cache_headers);
+#ifdef _WIN32
+            std::string content = readFile(std::string(sidecar_path));
+            writeHeaders(conn, "200 OK", content_type, content.length(), headers);
+            conn.writeBuffer(std::move(content));
+#else
+            writeHeaders(conn, "200 OK", content_type, static_cast<size_t>(sidecar->info.st_size), headers);
+            conn.writeFile(sidecar->fd, 0, static_cast<size_t>(sidecar->info.st_size), sidecar);
+#endif
+            return true;
+        }
+
+        auto size = static_cast<size_t>(file.info.st_size);
+        if (size < options_.compression_min_size || size > MAX_COMPRESSED_FILE_SIZE)
+        {
+            return false;
+        }
+        for (ContentEncoding encoding : PREFERRED_ENCODINGS)
+        {
+            if (!acceptsEncoding(accept_encoding, encoding) || !compressionSupported(encoding))
             {
-                if (std::filesystem::is_directory(entry))
+                continue;
+            }
+            // Keyed by path and validators, so a changed file is compressed afresh
+            FileValidators validators = file.validators;
+            std::string key = std::string(canonical_path) + "\n" + encodingToken(encoding) + "\n" + validators.etag;
+            std::shared_ptr<const std::string> encoded;
+            if (compression_cache_)
+            {
+                encoded = compression_cache_->lookup(key);
+                if (!encoded)
                 {
-                    directories.push_back(entry);
+                    // Sent as it is until the compressed copy is cached
+                    compressStaticFile(open_file, canonical_path, encoding, std::move(key));
+                    return false;
                 }
-                else
+            }
+            else
+            {
+                // Nothing to keep it in: compressed for this response only, quickly
+                std::string content;
+                auto output = std::make_shared<std::string>();
+                if (!readOpenFile(file, canonical_path, content) ||
+                    !compress(encoding, CompressionLevel::Fast, content, *output) || output->length() >= size)
                 {
-                    files.push_back(entry);
+                    return false;
                 }
+                encoded = output;
             }
-
-            // Sort directories and files alphabetically
-            std::sort(directories.begin(), directories.end(), comparePaths);
-            std::sort(files.begin(), files.end(), comparePaths);
-
-            // Process directories
-            for (const auto &entry : directories)
+            if (encoded->empty())
             {
-                std::string name = entry.path().filename().string();
-                std::string link = relative_path + (relative_path == "/" ? "" : "/") + name;
-                std::string tree_id = "tree-" + relative_path + "/" + name;
-                std::replace(tree_id.begin(), tree_id.end(), '/', '_'); // Replace / with _ for valid ID
-                html << "<li class='directory'>";
-                html << "<span class='toggle' onclick=\"toggleTree('" << tree_id << "')\">"
-                     << "<span class='arrow'>&#9654;</span> "
-                     << "<a href='" << link << "/' onclick=\"event.stopPropagation();\">" << name << "/</a>"
-                     << "</span>";
-                html << "<ul id='" << tree_id << "' style='display: none;'>";
-                html << generateDirectoryTree(entry.path().string(), link, depth + 1);
-                html << "</ul></li>";
+                return false;
             }
 
-            // Process files
-            for (const auto &entry : files)
+            // The encoded representation needs its own entity-tag
+            validators.etag.insert(validators.etag.length() - 1, std::string("-") + encodingToken(encoding));
+            if (isNotModified(conn.request, validators))
             {
-                std::string name = entry.path().filename().string();
-                std::string link = relative_path + (relative_path == "/" ? "" : "/") + name;
-                html << "<li class='file'><a href='" << link << "'>" << name << "</a></li>";
+                sendNotModified(conn, validators, cache_headers);
+                return true;
             }
+            ArenaString headers = arenaString("Content-Encoding: ");
+            headers.append(encodingToken(encoding)).append("\r\n");
+            appendValidatorHeaders(headers, validators, cache_headers);
+            writeHeaders(conn, "200 OK", content_type, encoded->length(), headers);
+            conn.writeShared(*encoded, encoded, useZeroCopy(encoded->length()));
+            return true;
         }
-        catch (const std::filesystem::filesystem_error &e)
-        {
-            html << "<li>Error reading directory: " << e.what() << "</li>";
-        }
-        std::string result = html.str();
-
-        return result;
+        return false;
     }
 
-    std::string HttpServer::generateDirectoryListing(const std::string &dir_path, const std::string &relative_path)
+    void HttpServer::sendCachedResponse(Connection &conn, const std::shared_ptr<const CachedFile> &file,
+                                        std::string_view cache_headers)
     {
-        std::string template_path = web_root_ + "/templates/tree_template.html";
-        std::string html = readFile(template_path);
-        if (html.empty())
-        {
-            std::cout << "Failed to load template, using fallback\n";
-            html = "<!DOCTYPE html><html><head><title>Directory Listing</title></head><body>"
-                   "<h1>Directory: {{RELATIVE_PATH}}</h1>"
-                   "<form action='/upload?path={{RELATIVE_PATH}}' method='post' enctype='multipart/form-data'>"
-                   "<input type='file' name='file'><input type='submit' value='Upload'>"
-                   "</form><ul>{{TREE_CONTENT}}</ul></body></html>";
-        }
-
-        std::string clean_relative_path = relative_path;
-
-        if (!clean_relative_path.empty() && clean_relative_path.back() == '}')
+        if (isNotModified(conn.request, file->validators))
         {
-            clean_relative_path = clean_relative_path.substr(0, clean_relative_path.length() - 1);
+            sendNotModified(conn, file->validators, cache_headers);
+            return;
         }
-
-        std::string tree_content = generateDirectoryTree(dir_path, relative_path, 0);
-        if (!tree_content.empty() && tree_content.back() == '}')
+        // The body stays in the cache entry and is referenced, not copied, by the output queue
+        std::shared_ptr<const std::string> body(file, &file->body);
+        ByteRanges ranges(RequestArena::local().resource());
+        switch (selectRanges(conn.request, body->length(), file->validators, ranges))
         {
-            tree_content = tree_content.substr(0, tree_content.length() - 1);
-        }
-
-        // Replace placeholders
-        std::string result = html;
-        size_t pos;
-        while ((pos = result.find("{{RELATIVE_PATH}}")) != std::string::npos)
+        case RangeSelection::Unsatisfiable:
+            sendRangeNotSatisfiable(conn, body->length());
+            return;
+        case RangeSelection::Partial:
         {
-            result.replace(pos, 17, clean_relative_path);
+            ArenaString entity_headers = arenaString();
+            appendValidatorHeaders(entity_headers, file->validators, cache_headers);
+            sendPartialContent(conn, ranges, body->length(), file->content_type, entity_headers, body, nullptr);
+            return;
         }
-        while ((pos = result.find("{{TREE_CONTENT}}")) != std::string::npos)
-        {
-            result.replace(pos, 16, tree_content);
+        case RangeSelection::Full:
+            break;
         }
+        conn.response_status = 200;
+        ArenaString headers = arenaString("HTTP/1.1 200 OK\r\n");
+        headers.append(file->headers).append(cache_headers);
+        appendConnectionHeader(headers, conn);
+        conn.write(headers);
+        conn.writeShared(*body, body, useZeroCopy(body->length()));
+    }
 
-        return result;
+    void HttpServer::sendNotModified(Connection &conn, const FileValidators &validators, std::string_view cache_headers)
+    {
+        // A 304 carries the validators and caching headers a 200 would have had, but no body
+        conn.response_status = 304;
+        ArenaString headers = arenaString("HTTP/1.1 304 Not Modified\r\n");
+        appendValidatorHeaders(headers, validators, cache_headers);
+        appendConnectionHeader(headers, conn);
+        conn.write(headers);
     }
 
-    std::string HttpServer::generateUploadForm(const std::string &relative_path)
+    void HttpServer::sendRangeNotSatisfiable(Connection &conn, uint64_t size)
     {
-        std::string template_path = web_root_ + "/templates/upload_template.html";
-        std::string html = readFile(template_path);
-        if (html.empty())
+        ArenaString headers = arenaString("Content-Range: bytes */");
+        appendNumber(headers, size);
+        headers.append("\r\n");
+        writeHeaders(conn, "416 Range Not Satisfiable", "text/plain", 0, headers);
+    }
+
+    void HttpServer::sendPartialContent(Connection &conn, const ByteRanges &ranges, uint64_t size,
+                                        std::string_view content_type, std::string_view entity_headers,
+                                        const std::shared_ptr<const std::string> &body,
+                                        const std::shared_ptr<const OpenFile> &file)
+    {
+        // Each range is queued as its own slice of `body` or of `fd`, so only the
+        // requested bytes are ever read from disk.
+        auto writeRange = [&](const ByteRange &range)
         {
-            std::cout << "Failed to load upload template, using fallback\n";
-            html = "<!DOCTYPE html><html><head><title>Upload File</title></head><body>"
-                   "<h1>Upload to {{RELATIVE_PATH}}</h1>"
-                   "<form action='/upload?path={{RELATIVE_PATH}}' method='post' enctype='multipart/form-data'>"
-                   "<input type='file' name='file'><input type='submit' value='Upload'>"
-                   "</form></body></html>";
-        }
+            if (body)
+            {
+                conn.writeShared(std::string_view(*body).substr(range.offset, range.length), body);
+            }
+            else
+            {
+                // The ranges share the descriptor, which stays open until the last is sent
+                conn.writeFile(file->fd, static_cast<off_t>(range.offset), range.length, file);
+            }
+        };
+        auto appendContentRange = [size](ArenaString &out, const ByteRange &range)
+        {
+            out.append("Content-Range: bytes ");
+            appendNumber(out, range.offset);
+            out.append("-");
+            appendNumber(out, range.offset + range.length - 1);
+            out.append("/");
+            appendNumber(out, size);
+            out.append("\r\n");
+        };
 
-        std::string clean_relative_path = relative_path;
-        if (clean_relative_path.empty() || clean_relative_path == "/")
+        if (ranges.size() == 1)
         {
-            clean_relative_path = "/";
+            ArenaString headers = arenaString();
+            appendContentRange(headers, ranges[0]);
+            headers.append(entity_headers);
+            writeHeaders(conn, "206 Partial Content", content_type, ranges[0].length, headers);
+            writeRange(ranges[0]);
+            return;
         }
 
-        std::string result = html;
-        size_t pos;
-        while ((pos = result.find("{{RELATIVE_PATH}}")) != std::string::npos)
+        // multipart/byteranges (RFC 9110 14.6): the part headers are small and
+        // built up front so the total Content-Length is known before any data is sent
+        std::string boundary = "byteranges-" + randomHex(16);
+        std::pmr::vector<ArenaString> part_headers(RequestArena::local().resource());
+        uint64_t content_length = 0;
+        for (const ByteRange &range : ranges)
         {
-            result.replace(pos, 17, clean_relative_path);
+            ArenaString &part = part_headers.emplace_back("\r\n--");
+            part.append(boundary).append("\r\nContent-Type: ").append(content_type).append("; charset=UTF-8\r\n");
+            appendContentRange(part, range);
+            part.append("\r\n");
+            content_length += part.length() + range.length;
         }
+        ArenaString closing = arenaString("\r\n--");
+        closing.append(boundary).append("--\r\n");
+        content_length += closing.length();
 
-        std::cout << "Upload form HTML size: " << result.size() << " bytes\n";
-        return result;
+        conn.response_status = 206;
+        ArenaString response = arenaString("HTTP/1.1 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary=");
+        response.append(boundary).append("\r\nContent-Length: ");
+        appendNumber(response, content_length);
+        response.append("\r\n").append(entity_headers);
+        appendConnectionHeader(response, conn);
+        conn.write(response);
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            conn.write(part_headers[i]);
+            writeRange(ranges[i]);
+        }
+        conn.write(closing);
     }
 
-    std::pair<std::string, std::string> HttpServer::parseMultipartFormData(const std::string &request, const std::string &boundary)
+    void HttpServer::sendFileResponse(Connection &conn, const std::shared_ptr<const OpenFile> &file,
+                                      std::string_view canonical_path, std::string_view content_type,
+                                      std::string_view cache_headers)
     {
-        std::cout << "Parsing multipart form-data with boundary: " << boundary << "\n";
-        std::string delimiter = "--" + boundary;      // "--abc123"
-        std::string end_delimiter = delimiter + "--"; // "--abc123--"
-
-        size_t start = request.find(delimiter); // Finds the first "--abc123--"
-        if (start == std::string::npos)
+        const FileValidators &validators = file->validators;
+#ifdef _WIN32
+        if (isNotModified(conn.request, validators))
+        {
+            sendNotModified(conn, validators, cache_headers);
+            return;
+        }
+        auto content = std::make_shared<const std::string>(readFile(std::string(canonical_path)));
+        if (content->empty())
         {
-            std::cout << "Failed to find start delimiter: " << delimiter << "\n";
-            return {"", ""};
+            sendResponse(conn, "404 Not Found", "text/plain", "File not found");
+            return;
         }
-        size_t part_start = start + delimiter.length() + 2;          // Skip "--abc123\r\n" (delimeter + CRLF)
-        size_t next_delimiter = request.find(delimiter, part_start); // not necessary but useful for other use cases
-        size_t end = request.find(end_delimiter, start);
-        if (end == std::string::npos)
+        ByteRanges ranges(RequestArena::local().resource());
+        switch (selectRanges(conn.request, content->length(), validators, ranges))
+        {
+        case RangeSelection::Unsatisfiable:
+            sendRangeNotSatisfiable(conn, content->length());
+            return;
+        case RangeSelection::Partial:
         {
-            end = request.length();
-            std::cout << "No end delimiter found, using request length: " << end << "\n";
+            ArenaString entity_headers = arenaString();
+            appendValidatorHeaders(entity_headers, validators, cache_headers);
+            sendPartialContent(conn, ranges, content->length(), content_type, entity_headers, content, nullptr);
+            return;
         }
-        if (next_delimiter != std::string::npos && next_delimiter < end)
+        case RangeSelection::Full:
+            break;
+        }
+        ArenaString headers = arenaString("Accept-Ranges: bytes\r\n");
+        appendValidatorHeaders(headers, validators, cache_headers);
+        writeHeaders(conn, "200 OK", content_type, content->length(), headers);
+        conn.writeShared(*content, content);
+#else
+        // Only the headers are built in memory; the body is streamed from the
+        // shared descriptor by the transport, so memory use does not grow with file size.
+        (void)canonical_path;
+        if (isNotModified(conn.request, validators))
         {
-            end = next_delimiter;
+            sendNotModified(conn, validators, cache_headers);
+            return;
         }
+        auto size = static_cast<uint64_t>(file->info.st_size);
+        ByteRanges ranges(RequestArena::local().resource());
+        switch (selectRanges(conn.request, size, validators, ranges))
+        {
+        case RangeSelection::Unsatisfiable:
+            sendRangeNotSatisfiable(conn, size);
+            return;
+        case RangeSelection::Partial:
+        {
+            ArenaString entity_headers = arenaString();
+            appendValidatorHeaders(entity_headers, validators, cache_headers);
+            sendPartialContent(conn, ranges, size, content_type, entity_headers, nullptr, file);
+            return;
+        }
+        case RangeSelection::Full:
+            break;
+        }
+        ArenaString headers = arenaString("Accept-Ranges: bytes\r\n");
+        appendValidatorHeaders(headers, validators, cache_headers);
+        writeHeaders(conn, "200 OK", content_type, size, headers);
+        conn.writeFile(file->fd, 0, size, file);
+#endif
+    }
 
-        std::string part = request.substr(part_start, end - part_start - 2); // Remove trailing \r\n and extracts a single part
-
-        // Extract filename from header in the part
-        std::regex disposition_regex(R"delim(Content-Disposition:.*filename="([^"]+)")delim");
-        std::smatch match;
-        if (!std::regex_search(part, match, disposition_regex))
+    void HttpServer::handleClient(socket_t client_socket)
+    {
+        // Every wait is a poll() bounded by the connection's deadline, so a client
+        // that trickles its request or stops reading cannot pin this thread
+        if (!setNonBlocking(client_socket))
         {
-            std::cout << "Failed to find filename in Content-Disposition\n";
-            return {"", ""}; // if no filename is found
+            CLOSE_SOCKET(client_socket);
+            return;
         }
-        std::string filename = match[1].str();
-        std::cout << "Extracted filename: " << filename << "\n";
+        auto conn = std::make_shared<Connection>(client_socket, limits_);
+        conn->on_headers = [this](Connection &c)
+        { beginRequestBody(c); };
+        serveClient(std::move(conn));
+    }
 
-        // Find where headers end and content starts in the part
-        size_t content_start = part.find("\r\n\r\n");
-        if (content_start == std::string::npos)
+    void HttpServer::serveClient(std::shared_ptr<Connection> client)
+    {
+        Connection &conn = *client;
+        socket_t client_socket = conn.socket;
+        ReceiveBuffer buffer;
+
+        while (true)
         {
-            std::cout << "Failed to find content start after headers\n";
-            return {"", ""};
+            // Read until the headers and the Content-Length body are buffered. Bytes
+            // of a pipelined follow-up request may already be waiting in `conn.in`.
+            while (!conn.requestComplete())
+            {
+                // Send any interim response (e.g. "100 Continue") before waiting for the body
+                if (conn.pendingOutput() > 0 && conn.flush() == Connection::FlushResult::Failed)
+                {
+                    conn.closeSocket();
+                    return;
+                }
+                if (conn.upgraded() && conn.close_after_write && conn.pendingOutput() == 0)
+                {
+                    conn.closeSocket(); // The HTTP/2 session has ended
+                    return;
+                }
+                int bytes_received = recv(client_socket, buffer.data(), ReceiveBuffer::SIZE, 0);
+                if (bytes_received < 0 && receiveWouldBlock())
+                {
+                    // Between requests the connection waits in the idle poller rather
+                    // than holding this worker for the whole keep-alive timeout
+                    if (idle_poller_ && conn.in.empty() && conn.pendingOutput() == 0 && !conn.body_sink)
+                    {
+                        idle_poller_->park(std::move(client));
+                        return;
+                    }
+                    if (!awaitSocket(conn, conn.pendingOutput() > 0 ? POLLIN | POLLOUT : POLLIN))
+                    {
+                        conn.closeSocket();
+                        return;
+                    }
+                    continue;
+                }
+                if (bytes_received <= 0)
+                {
+                    if ((!conn.in.empty() || conn.requests_served == 0) && !conn.upgraded())
+                    {
+                        LOG_DEBUG << "Failed to receive data from client";
+                    }
+                    conn.closeSocket();
+                    return;
+                }
+                conn.receive(buffer.data(), static_cast<size_t>(bytes_received));
+            }
+
+            handleRequest(conn);
+            conn.consumeRequest();
+            if (!flushBlocking(conn) || conn.close_after_write)
+            {
+                break;
+            }
         }
-        content_start += 4;                               // Skip \r\n\r\n (blank line)
-        std::string content = part.substr(content_start); // Extract the file's binary data as a a string
-        std::cout << "Extracted content length: " << content.length() << " bytes\n";
-        return {filename, content};
+        conn.closeSocket();
     }
 
-    bool HttpServer::saveUploadedFile(const std::string &filename, const std::string &content, const std::string &destination_dir)
+    void HttpServer::resumeClient(std::shared_ptr<Connection> conn)
     {
-        std::cout << "Attempting to save file: " << filename << " to " << destination_dir << "\n";
-        if (filename.empty() || filename.find("..") != std::string::npos || filename.find('/') != std::string::npos || filename.find('\\') != std::string::npos)
+        if (!worker_pool_->trySubmit([this, conn]
+                                     { serveClient(conn); }))
         {
-            std::cout << "Invalid filename: " << filename << "\n";
-            return false;
+            sendBusy(conn->socket);
+            conn->closeSocket();
         }
-        std::filesystem::path file_path = std::filesystem::path(destination_dir) / filename;
-        std::cout << "Constructed file path: " << file_path.string() << "\n";
-        try
+    }
+
+    bool HttpServer::awaitSocket(Connection &conn, short events)
+    {
+        while (true)
         {
-            std::filesystem::create_directories(destination_dir);
-            std::filesystem::path canonical_path = std::filesystem::canonical(destination_dir) / filename;
-            std::cout << "Canonical path: " << canonical_path.string() << "\n";
-            if (!canonical_path.string().starts_with(std::filesystem::canonical(web_root_).string()))
+            std::chrono::steady_clock::time_point when;
+            metrics::Deadline deadline = conn.deadline(when);
+            auto now = std::chrono::steady_clock::now();
+            if (now >= when)
             {
-                std::cout << "Directory traversal detected: " << canonical_path.string() << " not in " << web_root_ << "\n";
+                if (deadline != metrics::Deadline::Idle)
+                {
+                    LOG_DEBUG << "Closing connection: " << metrics::deadlineName(deadline) << " deadline passed";
+                }
+                metrics::connectionTimedOut(deadline);
                 return false;
             }
-            std::ofstream file(file_path, std::ios::binary);
-            if (!file)
+            pollfd descriptor{};
+            descriptor.fd = conn.socket;
+            descriptor.events = events;
+            int wait_ms = static_cast<int>(std::min<int64_t>(
+                std::chrono::ceil<std::chrono::milliseconds>(when - now).count(), INT32_MAX));
+#ifdef _WIN32
+            int ready = WSAPoll(&descriptor, 1, wait_ms);
+#else
+            int ready = poll(&descriptor, 1, wait_ms);
+#endif
+            if (ready > 0)
             {
-                std::cout << "Failed to open file for writing: " << file_path.string() << "\n";
-                return false;
+                return true; // Errors and hangups surface from the following recv() or send()
             }
-            file.write(content.c_str(), content.length());
-            if (!file.good())
+            if (ready < 0 && !receiveWouldBlock())
             {
-                std::cout << "Failed to write content to file: " << file_path.string() << "\n";
                 return false;
             }
-            std::cout << "Successfully wrote file: " << file_path.string() << ", size: " << content.length() << " bytes\n";
-            return true;
         }
-        catch (const std::filesystem::filesystem_error &e)
+    }
+
+    bool HttpServer::flushBlocking(Connection &conn)
+    {
+        Connection::FlushResult result;
+        while ((result = conn.flush()) == Connection::FlushResult::WouldBlock)
         {
-            std::cout << "Filesystem error: " << e.what() << "\n";
-            return false;
+            if (!awaitSocket(conn, POLLOUT))
+            {
+                return false;
+            }
         }
+        return result == Connection::FlushResult::Complete;
+    }
+
+    void HttpServer::rejectClient(socket_t client_socket)
+    {
+        sendBusy(client_socket);
+        CLOSE_SOCKET(client_socket);
     }
 
-    void HttpServer::sendResponse(socket_t client_socket, const std::string &status,
-                                  const std::string &content_type, const std::string &content)
+    void HttpServer::sendBusy(socket_t client_socket)
     {
+        // Answer straight from the accept loop without reading the request, and
+        // never block the acceptor on a slow peer.
+        metrics::connectionRejected();
+        std::string body = "Server is busy, please retry";
         std::ostringstream response;
-        response << "HTTP/1.1 " << status << "\r\n";
-        response << "Content-Type: " << content_type << "; charset=UTF-8\r\n";
-        response << "Content-Length: " << content.length() << "\r\n";
+        response << "HTTP/1.1 503 Service Unavailable\r\n";
+        response << "Content-Type: text/plain; charset=UTF-8\r\n";
+        response << "Content-Length: " << body.length() << "\r\n";
+        response << "Retry-After: " << options_.retry_after_seconds << "\r\n";
         response << "Connection: close\r\n";
         response << "\r\n";
-        response << content;
+        response << body;
 
         std::string response_str = response.str();
-        send(client_socket, response_str.c_str(), response_str.length(), 0);
+#ifdef MSG_DONTWAIT
+        send(client_socket, response_str.c_str(), response_str.length(), MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+        send(client_socket, response_str.c_str(), static_cast<int>(response_str.length()), 0);
+#endif
     }
 
-    void HttpServer::handleClient(socket_t client_socket)
+    std::unique_ptr<ProtocolSession> HttpServer::createHttp2Session()
     {
+        return std::make_unique<Http2Session>(
+            limits_, [this](Connection &c)
+            { beginRequestBody(c); },
+            [this](Connection &c)
+            { handleRequest(c); });
+    }
 
-        char buffer[32768] = {0}; // Increased to 32KB
-        std::string request;
-        size_t total_bytes = 0;
-
-        // Read headers to find Content-Length
-        std::string headers;
-        while (true)
+    bool HttpServer::upgradeToHttp2(Connection &conn)
+    {
+        const HttpRequest &request = conn.request;
+        std::string_view upgrade = request.header("Upgrade");
+        if (!options_.http2 || conn.parse_error || request.version != "HTTP/1.1" || conn.content_length > 0 ||
+            upgrade.find("h2c") == std::string_view::npos || request.header("HTTP2-Settings").empty())
         {
-            int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-            if (bytes_received <= 0)
-            {
-                std::cout << "Failed to receive data from client\n";
-                CLOSE_SOCKET(client_socket);
-                return;
-            }
-            buffer[bytes_received] = '\0';
-            headers += std::string(buffer, bytes_received);
-            total_bytes += bytes_received;
-            if (headers.find("\r\n\r\n") != std::string::npos)
-            {
-                break;
-            }
+            return false;
         }
+        auto session = Http2Session::fromUpgrade(
+            conn, limits_, [this](Connection &c)
+            { beginRequestBody(c); },
+            [this](Connection &c)
+            { handleRequest(c); });
+        if (!session)
+        {
+            LOG_DEBUG << "Ignoring h2c upgrade with invalid HTTP2-Settings";
+            return false;
+        }
+        conn.write("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+        conn.upgrade(std::move(session));
+        return true;
+    }
 
-        // Extract Content-Length
-        size_t content_length = 0;
-        std::regex content_length_regex(R"(Content-Length: (\d+))");
-        std::smatch match;
-        if (std::regex_search(headers, match, content_length_regex))
+    void HttpServer::handleRequest(Connection &conn)
+    {
+        if (upgradeToHttp2(conn))
         {
-            content_length = std::stoul(match[1].str());
-            std::cout << "Content-Length: " << content_length << " bytes\n";
+            return; // Answered on stream 1 once the switch is complete
         }
+        ArenaScope arena_scope; // Scratch strings of this request are released together
+        size_t output_before = conn.pendingOutput();
+        metrics::Route route = routeRequest(conn);
+        auto elapsed = std::chrono::steady_clock::now() - conn.request_started;
+        metrics::recordRequest(route, conn.response_status, elapsed);
+
+        // One logfmt line per request. The views into conn.in stay valid until the
+        // request is consumed; a request that failed to parse has none.
+        std::string_view method = conn.parse_error ? std::string_view("-") : conn.request.method;
+        std::string_view target = conn.parse_error ? std::string_view("-") : conn.request.target;
+        LOG_ACCESS << "method=" << method << " target=" << logging::Quoted{target}
+                   << " status=" << conn.response_status << " bytes=" << conn.pendingOutput() - output_before
+                   << " duration_us=" << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+                   << " route=" << metrics::routeName(route) << " conn_request=" << conn.requests_served + 1;
+    }
 
-        // Read remaining body based on Content-Length
-        request = headers;
-        size_t body_received = headers.length() - (headers.find("\r\n\r\n") + 4);
-        while (body_received < content_length)
+    metrics::Route HttpServer::routeRequest(Connection &conn)
+    {
+        if (conn.parse_error)
         {
-            int bytes_received = recv(client_socket, buffer, std::min<size_t>(sizeof(buffer) - 1, content_length - body_received), 0);
-            if (bytes_received <= 0)
-            {
-                std::cout << "Failed to receive full body, received: " << body_received << "/" << content_length << "\n";
-                CLOSE_SOCKET(client_socket);
-                return;
-            }
-            buffer[bytes_received] = '\0';
-            request += std::string(buffer, bytes_received);
-            body_received += bytes_received;
-            total_bytes += bytes_received;
+            conn.close_after_write = true;
+            LOG_DEBUG << "Malformed request: " << conn.parse_error;
+            sendResponse(conn, conn.parse_error, "text/plain", "Malformed request");
+            return metrics::Route::Invalid;
         }
 
-        auto [path, method_query] = parseRequest(request);
-        std::string method = method_query.substr(0, method_query.find('?'));
-        std::string query = method_query.find('?') != std::string::npos ? method_query.substr(method_query.find('?')) : "";
+        // Views into conn.in, valid until the request is consumed
+        const HttpRequest &request = conn.request;
+        std::string_view method = request.method;
+        std::string_view query = request.query;
+        ArenaString path = arenaString();
+        urlDecode(request.path, path);
+
+        conn.close_after_write = !request.keepAlive() || conn.requests_served + 1 >= options_.max_keep_alive_requests;
 
-        if (method.empty())
+        if (method != "GET" && method != "POST")
         {
-            std::cout << "Unsupported method\n";
-            sendResponse(client_socket, "400 Bad Request", "text/plain", "Only GET and POST requests are supported");
-            CLOSE_SOCKET(client_socket);
-            return;
+            conn.close_after_write = true;
+            LOG_DEBUG << "Unsupported method";
+            sendResponse(conn, "400 Bad Request", "text/plain", "Only GET and POST requests are supported");
+            return metrics::Route::Invalid;
         }
 
         if (method == "POST" && path == "/upload")
         {
-            std::string destination_path = "/";
-            std::regex path_regex(R"(\?path=([^ \r\n]*))");
-            if (std::regex_search(query, match, path_regex))
+            auto *upload = dynamic_cast<UploadReceiver *>(conn.body_sink.get());
+            if (!upload)
             {
-                destination_path = match[1].str();
-                std::cout << "Upload destination path: " << destination_path << "\n";
+                sendResponse(conn, "400 Bad Request", "text/plain", "Invalid multipart/form-data");
             }
-            std::string file_path = web_root_ + (destination_path == "/" ? "" : destination_path);
-            std::cout << "Upload file path: " << file_path << "\n";
-            try
+            else if (!upload->ok())
             {
-                std::filesystem::path canonical_path = std::filesystem::canonical(web_root_) / (destination_path == "/" ? "" : destination_path.substr(1));
-                if (!canonical_path.string().starts_with(std::filesystem::canonical(web_root_).string()))
-                {
-                    std::cout << "Directory traversal detected in upload path: " << canonical_path.string() << "\n";
-                    sendResponse(client_socket, "403 Forbidden", "text/plain", "Access denied");
-                    CLOSE_SOCKET(client_socket);
-                    return;
-                }
-                if (!std::filesystem::is_directory(file_path))
-                {
-                    std::cout << "Upload destination is not a directory: " << file_path << "\n";
-                    sendResponse(client_socket, "400 Bad Request", "text/plain", "Upload destination must be a directory");
-                    CLOSE_SOCKET(client_socket);
-                    return;
-                }
-                std::regex boundary_regex(R"(Content-Type: multipart/form-data; boundary=([^\r\n]+))");
-                if (std::regex_search(request, match, boundary_regex))
-                {
-                    auto [filename, content] = parseMultipartFormData(request, match[1].str());
-                    if (filename.empty() || !saveUploadedFile(filename, content, file_path))
-                    {
-                        std::cout << "Upload failed: filename=" << filename << ", content_length=" << content.length() << "\n";
-                        sendResponse(client_socket, "400 Bad Request", "text/plain", "Failed to upload file");
-                    }
-                    else
-                    {
-                        std::cout << "Upload succeeded: " << filename << " to " << file_path << "\n";
-                        sendResponse(client_socket, "200 OK", "text/plain", "File uploaded successfully");
-                    }
-                }
-                else
-                {
-                    std::cout << "Invalid multipart/form-data in POST request\n";
-                    sendResponse(client_socket, "400 Bad Request", "text/plain", "Invalid multipart/form-data");
-                }
+                sendResponse(conn, upload->status(), "text/plain", upload->message());
             }
-            catch (const std::filesystem::filesystem_error &e)
+            else
             {
-                std::cout << "Filesystem error in upload: " << e.what() << "\n";
-                sendResponse(client_socket, "404 Not Found", "text/plain", "Upload path not found");
+                sendUploadResult(conn, *upload);
             }
-            CLOSE_SOCKET(client_socket);
-            return;
+            return metrics::Route::Upload;
+        }
+
+        if (method == "GET" && path == "/__tree")
+        {
+            handleTreeRequest(conn, query);
+            return metrics::Route::Tree;
+        }
+
+        if (method == "GET" && path == "/search")
+        {
+            handleSearchRequest(conn, query);
+            return metrics::Route::Search;
         }
 
         if (method == "GET" && path == "/upload")
         {
-            std::string destination_path = "/";
-            std::regex path_regex(R"(\?path=([^ \r\n]*))");
-            std::smatch match;
-            if (std::regex_search(query, match, path_regex))
+            std::string destination_path;
+            if (!queryParameter(query, "path", destination_path))
             {
-                destination_path = match[1].str();
+                destination_path.assign(1, '/');
             }
             std::string upload_form = generateUploadForm(destination_path);
-            sendResponse(client_socket, "200 OK", "text/html", upload_form);
-            CLOSE_SOCKET(client_socket);
-            return;
+            sendResponse(conn, "200 OK", "text/html", std::move(upload_form));
+            return metrics::Route::UploadForm;
         }
 
-        std::string file_path = web_root_ + (path == "/" ? "" : path);
-        std::filesystem::path canonical_path;
-        try
+        if (method == "GET" && !options_.metrics_path.empty() && std::string_view(path) == options_.metrics_path)
+        {
+            handleMetricsRequest(conn);
+            return metrics::Route::Metrics;
+        }
+
+        // A NUL would end the path for the system calls, so "/a.txt%00.html" would
+        // open a.txt while its type is taken from the ".html" after the NUL
+        if (path.find('\0') != std::string_view::npos)
+        {
+            sendResponse(conn, "400 Bad Request", "text/plain", "Invalid path");
+            return metrics::Route::Invalid;
+        }
+
+        metrics::PhaseTimer filesystem_timer(metrics::Phase::Filesystem);
+        // Normalized so cache keys are unique; symlinks pointing outside the root
+        // are refused when the path is opened
+        ArenaString canonical_path = arenaString(canonical_root_);
+        if (!appendNormalized(canonical_path, path))
+        {
+            sendResponse(conn, "403 Forbidden", "text/plain", "Access denied");
+            return metrics::Route::Static;
+        }
+        // Checked once normalized, so "//templates/x" or "/./templates/x" do not get past it
+        if (isTemplatesPath(canonical_path, canonical_root_))
+        {
+            sendResponse(conn, "403 Forbidden", "text/plain", "Access to templates directory is forbidden");
+            return metrics::Route::Static;
+        }
+        std::shared_ptr<const OpenFile> file = open_files_->open(canonical_path);
+        if (file->error == EXDEV)
+        {
+            sendResponse(conn, "403 Forbidden", "text/plain", "Access denied");
+            return metrics::Route::Static;
+        }
+        if (!file->ok() || (path.ends_with('/') && !file->isDirectory()))
+        {
+            sendResponse(conn, "404 Not Found", "text/plain", "File not found");
+            return metrics::Route::Static;
+        }
+        if (file->isDirectory())
+        {
+            sendStream(conn, "200 OK", "text/html",
+                       std::make_unique<DirectoryListingSource>(*this, std::move(file), std::string(canonical_path),
+                                                                std::string(path)));
+            return metrics::Route::Directory;
+        }
+
+        std::string_view content_type = getMimeType(canonical_path);
+        ArenaString cache_headers = arenaString();
+        appendCacheControl(cache_headers, cacheControlFor(options_.cache_control, path));
+        if (options_.compression && isCompressible(content_type))
         {
-            if (path.find("/templates/") == 0)
+            // Shared caches must keep the encoded and identity variants apart
+            cache_headers += "Vary: Accept-Encoding\r\n";
+            if (sendEncodedFile(conn, file, canonical_path, content_type, cache_headers))
             {
-                sendResponse(client_socket, "403 Forbidden", "text/plain", "Access to templates directory is forbidden");
-                CLOSE_SOCKET(client_socket);
-                return;
+                return metrics::Route::Static;
             }
-            canonical_path = std::filesystem::canonical(web_root_) / (path == "/" ? "" : path.substr(1));
         }
-        catch (const std::filesystem::filesystem_error &)
+        if (file_cache_)
         {
-            sendResponse(client_socket, "404 Not Found", "text/plain", "Path not found");
-            CLOSE_SOCKET(client_socket);
-            return;
+            auto cached = file_cache_->lookup(canonical_path, *file, content_type);
+            if (cached)
+            {
+                sendCachedResponse(conn, cached, cache_headers);
+                return metrics::Route::Static;
+            }
+        }
+        sendFileResponse(conn, file, canonical_path, content_type, cache_headers);
+        return metrics::Route::Static;
+    }
+
+    void HttpServer::start()
+    {
+        size_t shards = options_.listener_shards;
+        if (shards == 0)
+        {
+            shards = std::max(1u, std::thread::hardware_concurrency());
         }
-        if (!canonical_path.string().starts_with(std::filesystem::canonical(web_root_).string()))
+#ifndef SO_REUSEPORT
+        if (shards > 1)
         {
-            sendResponse(client_socket, "403 Forbidden", "text/plain", "Access denied");
-            CLOSE_SOCKET(client_socket);
-            return;
+            LOG_WARN << "SO_REUSEPORT is not available, using a single listener";
+            shards = 1;
+        }
+#endif
+        for (size_t i = 0; i < shards; ++i)
+        {
+            listen_sockets_.push_back(createServerSocket(shards > 1));
         }
+        LOG_INFO << "Server running on port " << port_ << " (" << shards << (shards > 1 ? " SO_REUSEPORT listeners)" : " listener)");
 
-        if (std::filesystem::is_directory(file_path))
+        if (options_.io_mode == IoMode::Uring && !UringLoop::supported())
         {
-            std::string listing = generateDirectoryListing(file_path, path);
-            sendResponse(client_socket, "200 OK", "text/html", listing);
+            LOG_WARN << "io_uring is not available, falling back to epoll";
+            options_.io_mode = IoMode::Epoll;
         }
-        else
+        if (options_.io_mode == IoMode::Threads)
+        {
+            size_t worker_count = options_.worker_threads;
+            if (worker_count == 0)
+            {
+                worker_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+            worker_pool_ = std::make_unique<ThreadPool>(worker_count, options_.queue_depth);
+            LOG_INFO << "Worker pool: " << worker_count << " threads, queue depth " << options_.queue_depth;
+#ifdef __linux__
+            idle_poller_ = std::make_unique<IdlePoller>([this](std::shared_ptr<Connection> conn)
+                                                        { resumeClient(std::move(conn)); });
+#endif
+        }
+        if (compression_cache_)
+        {
+            compression_pool_ = std::make_unique<ThreadPool>(COMPRESSION_THREADS, COMPRESSION_QUEUE_DEPTH);
+        }
+        if (options_.upload_threads > 0)
+        {
+            // Writers take one queued task per file part with data waiting; a full
+            // queue makes the receiving thread write itself
+            upload_pool_ = std::make_unique<ThreadPool>(options_.upload_threads, UPLOAD_QUEUE_DEPTH);
+        }
+
+        // Every listener gets its own thread: an event loop in epoll and io_uring
+        // mode, an accept loop feeding the shared worker pool otherwise. The kernel spreads
+        // new connections across the listeners; the calling thread runs the first.
+        auto serve = [this, shards](size_t shard)
         {
-            std::string content = readFile(file_path);
-            if (content.empty())
+            if (shards > 1)
+            {
+                pinCurrentThread(shard);
+            }
+            if (options_.io_mode == IoMode::Epoll)
+            {
+                runEventLoop(listen_sockets_[shard]);
+            }
+            else if (options_.io_mode == IoMode::Uring)
             {
-                sendResponse(client_socket, "404 Not Found", "text/plain", "File not found");
+                runUringLoop(listen_sockets_[shard]);
             }
             else
             {
-                std::string mime_type = getMimeType(file_path);
-                sendResponse(client_socket, "200 OK", mime_type, content);
+                acceptLoop(listen_sockets_[shard]);
             }
+        };
+        std::vector<std::thread> threads;
+        for (size_t shard = 1; shard < shards; ++shard)
+        {
+            threads.emplace_back(serve, shard);
+        }
+        serve(0);
+        for (auto &thread : threads)
+        {
+            thread.join();
         }
-        CLOSE_SOCKET(client_socket);
     }
 
-    void HttpServer::start()
+    void HttpServer::runEventLoop(socket_t listen_socket)
+    {
+        EventLoop loop(listen_socket, [this](Connection &conn)
+                       { handleRequest(conn); },
+                       [this](Connection &conn)
+                       { beginRequestBody(conn); },
+                       limits_);
+        loop.run();
+    }
+
+    void HttpServer::runUringLoop(socket_t listen_socket)
     {
-        server_socket_ = createServerSocket();
-        std::cout << "Server running on port " << port_ << "\n";
+        UringLoop loop(listen_socket, [this](Connection &conn)
+                       { handleRequest(conn); },
+                       [this](Connection &conn)
+                       { beginRequestBody(conn); },
+                       limits_);
+        loop.run();
+    }
+
+    void HttpServer::acceptLoop(socket_t listen_socket)
+    {
+        ThreadPool &pool = *worker_pool_;
+        auto last_saturation_log = std::chrono::steady_clock::time_point{};
         while (true)
         {
-            socket_t client_socket = accept(server_socket_, nullptr, nullptr);
+            socket_t client_socket = accept(listen_socket, nullptr, nullptr);
             if (client_socket == -1)
             {
-                std::cerr << "Failed to accept connection\n";
+                LOG_WARN << "Failed to accept connection";
                 continue;
             }
-            // handleClient(client_socket);
-            std::thread client_thread(&HttpServer::handleClient, this, client_socket);
-            client_thread.detach();
+            if (!pool.trySubmit([this, client_socket]
+                                { handleClient(client_socket); }))
+            {
+                rejectClient(client_socket);
+
+                // Report saturation at most once per second so a spike does not flood the log
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_saturation_log >= std::chrono::seconds(1))
+                {
+                    last_saturation_log = now;
+                    ThreadPool::Stats stats = pool.stats();
+                    uint64_t avg_wait_us = stats.completed ? stats.total_wait_us / stats.completed : 0;
+                    LOG_WARN << "Worker pool saturated: rejected " << stats.rejected << " connections, "
+                              << stats.queued << " queued, queue wait avg " << avg_wait_us
+                              << " us, max " << stats.max_wait_us << " us";
+                }
+            }
         }
     }
 
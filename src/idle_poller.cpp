@@ -0,0 +1,211 @@
+#include "idle_poller.h"
+#include "logger.h"
+#include "metrics.h"
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr int MAX_EVENTS = 256;
+        constexpr std::chrono::milliseconds DEADLINE_TICK{100};
+    }
+
+    IdlePoller::IdlePoller(ResumeHandler resume) : resume_(std::move(resume)), timers_(DEADLINE_TICK)
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wake_fd_;
+        if (epoll_fd_ == -1 || wake_fd_ == -1 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) == -1)
+        {
+            if (epoll_fd_ != -1)
+            {
+                close(epoll_fd_);
+            }
+            if (wake_fd_ != -1)
+            {
+                close(wake_fd_);
+            }
+            throw std::runtime_error("Failed to create the idle connection poller");
+        }
+        thread_ = std::thread([this]
+                              { run(); });
+    }
+
+    IdlePoller::~IdlePoller()
+    {
+        stopping_.store(true);
+        uint64_t one = 1;
+        (void)!write(wake_fd_, &one, sizeof(one));
+        thread_.join();
+        for (auto &conn : incoming_)
+        {
+            conn->closeSocket();
+        }
+        for (auto &[socket, conn] : connections_)
+        {
+            conn->closeSocket();
+        }
+        close(wake_fd_);
+        close(epoll_fd_);
+    }
+
+    void IdlePoller::park(std::shared_ptr<Connection> conn)
+    {
+        parked_.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            incoming_.push_back(std::move(conn));
+        }
+        uint64_t one = 1;
+        (void)!write(wake_fd_, &one, sizeof(one));
+    }
+
+    void IdlePoller::run()
+    {
+        epoll_event events[MAX_EVENTS];
+        while (!stopping_.load())
+        {
+            int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timers_.pollTimeout(std::chrono::steady_clock::now()));
+            if (count < 0 && errno != EINTR)
+            {
+                LOG_ERROR << "Idle connection poller failed";
+                return;
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                if (events[i].data.fd == wake_fd_)
+                {
+                    uint64_t value;
+                    (void)!read(wake_fd_, &value, sizeof(value));
+                    registerIncoming();
+                }
+                else
+                {
+                    onEvent(events[i].data.fd, events[i].events);
+                }
+            }
+            timers_.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer &timer)
+                            { onDeadline(timer); });
+        }
+    }
+
+    void IdlePoller::registerIncoming()
+    {
+        std::vector<std::shared_ptr<Connection>> incoming;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            incoming.swap(incoming_);
+        }
+        for (auto &conn : incoming)
+        {
+            // One-shot: the first event hands the socket back to a worker
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.fd = conn->socket;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn->socket, &event) == -1)
+            {
+                LOG_ERROR << "Failed to register idle connection with epoll";
+                conn->closeSocket();
+                parked_.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+            std::chrono::steady_clock::time_point when;
+            conn->deadline(when);
+            conn->timer.id = static_cast<uint64_t>(conn->socket);
+            timers_.schedule(conn->timer, when);
+            connections_[conn->socket] = std::move(conn);
+        }
+    }
+
+    void IdlePoller::onEvent(socket_t socket, uint32_t events)
+    {
+        auto it = connections_.find(socket);
+        if (it == connections_.end())
+        {
+            return;
+        }
+        Connection &conn = *it->second;
+        // Zerocopy completions raise EPOLLERR without the socket having failed
+        bool failed = (events & EPOLLERR) && conn.checkSocketError();
+        if (!failed && !(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+        {
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.fd = socket;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, socket, &event) == 0)
+            {
+                return;
+            }
+            failed = true;
+        }
+        std::shared_ptr<Connection> released = release(socket);
+        if (failed)
+        {
+            released->closeSocket();
+            return;
+        }
+        // The worker reads whatever woke us, including the end of the stream
+        resume_(std::move(released));
+    }
+
+    void IdlePoller::onDeadline(TimerWheel::Timer &timer)
+    {
+        auto it = connections_.find(static_cast<socket_t>(timer.id));
+        if (it == connections_.end())
+        {
+            return;
+        }
+        std::chrono::steady_clock::time_point when;
+        metrics::Deadline deadline = it->second->deadline(when);
+        if (std::chrono::steady_clock::now() < when)
+        {
+            timers_.schedule(it->second->timer, when);
+            return;
+        }
+        if (deadline != metrics::Deadline::Idle)
+        {
+            LOG_DEBUG << "Closing connection: " << metrics::deadlineName(deadline) << " deadline passed";
+        }
+        metrics::connectionTimedOut(deadline);
+        release(it->first)->closeSocket();
+    }
+
+    std::shared_ptr<Connection> IdlePoller::release(socket_t socket)
+    {
+        auto it = connections_.find(socket);
+        std::shared_ptr<Connection> conn = std::move(it->second);
+        connections_.erase(it);
+        timers_.cancel(conn->timer);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, nullptr);
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+        return conn;
+    }
+
+}
+
+#else
+
+namespace web_server
+{
+
+    IdlePoller::IdlePoller(ResumeHandler resume) : resume_(std::move(resume)), timers_(std::chrono::milliseconds(100))
+    {
+        throw std::runtime_error("Idle connection polling is only available on Linux");
+    }
+
+    IdlePoller::~IdlePoller() {}
+
+    void IdlePoller::park(std::shared_ptr<Connection>) {}
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "json.h"
+
+namespace web_server
+{
+
+    void appendJsonString(std::string &out, std::string_view value)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        out += '"';
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    out += "\\u00";
+                    out += HEX[(c >> 4) & 0xF];
+                    out += HEX[c & 0xF];
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
+    }
+
+}
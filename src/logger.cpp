@@ -0,0 +1,401 @@
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace web_server::logging
+{
+
+    std::atomic<LogLevel> current_level{LogLevel::Info};
+    std::atomic<bool> access_enabled{true};
+
+    namespace
+    {
+        constexpr size_t RING_CAPACITY = 256 * 1024; // Per thread
+        constexpr size_t MAX_LINE_LENGTH = 8192;     // Longer lines are truncated
+        constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(10);
+        constexpr int MAX_NESTING = 4; // Lines built while evaluating another line's arguments
+
+        struct RecordHeader
+        {
+            int64_t timestamp_ms;
+            uint32_t length;
+            LogLevel level;
+        };
+
+        // Single-producer, single-consumer byte ring: the owning thread appends
+        // records and only the writer thread removes them. Positions grow without
+        // wrapping; the difference between them is the space in use.
+        class Ring
+        {
+        public:
+            bool push(LogLevel level, int64_t timestamp_ms, std::string_view message)
+            {
+                RecordHeader header{timestamp_ms, static_cast<uint32_t>(message.length()), level};
+                size_t needed = sizeof(header) + message.length();
+                uint64_t head = head_.load(std::memory_order_relaxed);
+                uint64_t tail = tail_.load(std::memory_order_acquire);
+                if (RING_CAPACITY - (head - tail) < needed)
+                {
+                    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return false;
+                }
+                copyIn(head, &header, sizeof(header));
+                copyIn(head + sizeof(header), message.data(), message.length());
+                head_.store(head + needed, std::memory_order_release);
+                return true;
+            }
+
+            template <typename Consumer>
+            void drain(Consumer &&consume)
+            {
+                uint64_t tail = tail_.load(std::memory_order_relaxed);
+                uint64_t head = head_.load(std::memory_order_acquire);
+                while (tail < head)
+                {
+                    RecordHeader header;
+                    copyOut(tail, &header, sizeof(header));
+                    std::string text(header.length, '\0');
+                    copyOut(tail + sizeof(header), text.data(), header.length);
+                    tail += sizeof(header) + header.length;
+                    consume(header, std::move(text));
+                }
+                tail_.store(tail, std::memory_order_release);
+            }
+
+            uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        private:
+            char data_[RING_CAPACITY];
+            std::atomic<uint64_t> head_{0}; // Written by the owning thread
+            std::atomic<uint64_t> tail_{0}; // Written by the writer thread
+            std::atomic<uint64_t> dropped_{0};
+
+            void copyIn(uint64_t position, const void *source, size_t length)
+            {
+                size_t offset = position % RING_CAPACITY;
+                size_t first = std::min(length, RING_CAPACITY - offset);
+                std::memcpy(data_ + offset, source, first);
+                std::memcpy(data_, static_cast<const char *>(source) + first, length - first);
+            }
+
+            void copyOut(uint64_t position, void *destination, size_t length) const
+            {
+                size_t offset = position % RING_CAPACITY;
+                size_t first = std::min(length, RING_CAPACITY - offset);
+                std::memcpy(destination, data_ + offset, first);
+                std::memcpy(static_cast<char *>(destination) + first, data_, length - first);
+            }
+        };
+
+        struct Entry
+        {
+            int64_t timestamp_ms;
+            LogLevel level;
+            std::string text;
+        };
+
+        const char *levelName(LogLevel level)
+        {
+            switch (level)
+            {
+            case LogLevel::Debug:
+                return "DEBUG";
+            case LogLevel::Info:
+                return "INFO";
+            case LogLevel::Warn:
+                return "WARN";
+            case LogLevel::Error:
+                return "ERROR";
+            case LogLevel::Access:
+                return "ACCESS";
+            case LogLevel::Off:
+                break;
+            }
+            return "";
+        }
+
+        int64_t nowMilliseconds()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        // Appends "2024-05-01T12:00:00.123Z LEVEL message\n"
+        void formatLine(std::string &out, int64_t timestamp_ms, LogLevel level, std::string_view message)
+        {
+            std::time_t seconds = static_cast<std::time_t>(timestamp_ms / 1000);
+            std::tm utc{};
+#ifdef _WIN32
+            gmtime_s(&utc, &seconds);
+#else
+            gmtime_r(&seconds, &utc);
+#endif
+            char prefix[64];
+            int length = std::snprintf(prefix, sizeof(prefix), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ %s ",
+                                       utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min,
+                                       utc.tm_sec, static_cast<int>(timestamp_ms % 1000), levelName(level));
+            out.append(prefix, static_cast<size_t>(length));
+            out.append(message);
+            out.push_back('\n');
+        }
+
+        class Writer
+        {
+        public:
+            ~Writer() { stop(); }
+
+            bool start(const Options &options)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (thread_.joinable())
+                {
+                    return true;
+                }
+                if (!options.path.empty())
+                {
+                    std::FILE *file = std::fopen(options.path.c_str(), "a");
+                    if (!file)
+                    {
+                        return false;
+                    }
+                    file_ = file;
+                }
+                current_level.store(options.level, std::memory_order_relaxed);
+                access_enabled.store(options.access_log, std::memory_order_relaxed);
+                stopping_ = false;
+                thread_ = std::thread(&Writer::run, this);
+                running_.store(true, std::memory_order_release);
+                return true;
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!thread_.joinable())
+                    {
+                        return;
+                    }
+                    stopping_ = true;
+                    // Later lines take the synchronous path; the final drain picks up the rest
+                    running_.store(false, std::memory_order_release);
+                }
+                wake_.notify_one();
+                thread_.join();
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (file_ != stdout)
+                {
+                    std::fclose(file_);
+                    file_ = stdout;
+                }
+            }
+
+            void submit(LogLevel level, std::string_view message)
+            {
+                message = message.substr(0, MAX_LINE_LENGTH);
+                if (!running_.load(std::memory_order_acquire))
+                {
+                    // Before start(): tools and early start-up write synchronously
+                    std::string line;
+                    formatLine(line, nowMilliseconds(), level, message);
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    std::fwrite(line.data(), 1, line.length(), file_);
+                    std::fflush(file_);
+                    return;
+                }
+                thread_local Ring *ring = registerRing();
+                ring->push(level, nowMilliseconds(), message);
+            }
+
+            uint64_t dropped()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                uint64_t total = 0;
+                for (const auto &ring : rings_)
+                {
+                    total += ring->dropped();
+                }
+                return total;
+            }
+
+        private:
+            std::mutex mutex_; // Guards rings_, file_ and stopping_
+            std::condition_variable wake_;
+            std::vector<std::unique_ptr<Ring>> rings_; // Never freed: a thread's ring may still hold lines after it exits
+            std::thread thread_;
+            std::atomic<bool> running_{false};
+            bool stopping_ = false;
+            std::FILE *file_ = stdout;
+            uint64_t reported_dropped_ = 0;
+            std::vector<Entry> batch_;
+            std::string output_;
+
+            Ring *registerRing()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                rings_.push_back(std::make_unique<Ring>());
+                return rings_.back().get();
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!stopping_)
+                {
+                    wake_.wait_for(lock, FLUSH_INTERVAL, [this]
+                                   { return stopping_; });
+                    flushLocked();
+                }
+                flushLocked();
+            }
+
+            // Drains every ring and writes the lines in timestamp order with one write
+            void flushLocked()
+            {
+                uint64_t dropped = 0;
+                for (const auto &ring : rings_)
+                {
+                    ring->drain([this](const RecordHeader &header, std::string &&text)
+                                { batch_.push_back({header.timestamp_ms, header.level, std::move(text)}); });
+                    dropped += ring->dropped();
+                }
+                if (dropped > reported_dropped_)
+                {
+                    batch_.push_back({nowMilliseconds(), LogLevel::Warn,
+                                      std::to_string(dropped - reported_dropped_) + " log lines dropped, ring buffer full"});
+                    reported_dropped_ = dropped;
+                }
+                if (batch_.empty())
+                {
+                    return;
+                }
+                std::stable_sort(batch_.begin(), batch_.end(), [](const Entry &a, const Entry &b)
+                                 { return a.timestamp_ms < b.timestamp_ms; });
+                output_.clear();
+                for (const Entry &entry : batch_)
+                {
+                    formatLine(output_, entry.timestamp_ms, entry.level, entry.text);
+                }
+                batch_.clear();
+                std::fwrite(output_.data(), 1, output_.length(), file_);
+                std::fflush(file_);
+            }
+        };
+
+        Writer &writer()
+        {
+            static Writer instance; // Destroyed at exit, which drains the rings
+            return instance;
+        }
+
+        struct LineBuffers
+        {
+            std::string buffers[MAX_NESTING];
+            int depth = 0;
+        };
+
+        thread_local LineBuffers line_buffers;
+
+        std::string &acquireLineBuffer()
+        {
+            std::string &buffer = line_buffers.buffers[std::min(line_buffers.depth, MAX_NESTING - 1)];
+            ++line_buffers.depth;
+            buffer.clear();
+            return buffer;
+        }
+    }
+
+    bool start(const Options &options)
+    {
+        return writer().start(options);
+    }
+
+    void stop()
+    {
+        writer().stop();
+    }
+
+    LogLevel parseLevel(std::string_view name, bool &ok)
+    {
+        ok = true;
+        if (name == "debug")
+        {
+            return LogLevel::Debug;
+        }
+        if (name == "info")
+        {
+            return LogLevel::Info;
+        }
+        if (name == "warn")
+        {
+            return LogLevel::Warn;
+        }
+        if (name == "error")
+        {
+            return LogLevel::Error;
+        }
+        if (name == "off")
+        {
+            return LogLevel::Off;
+        }
+        ok = false;
+        return LogLevel::Info;
+    }
+
+    uint64_t droppedLines()
+    {
+        return writer().dropped();
+    }
+
+    void submit(LogLevel level, std::string_view message)
+    {
+        writer().submit(level, message);
+    }
+
+    Line::Line(LogLevel level) : level_(level), buffer_(acquireLineBuffer())
+    {
+    }
+
+    Line::~Line()
+    {
+        submit(level_, buffer_);
+        --line_buffers.depth;
+    }
+
+    Line &Line::operator<<(Quoted value)
+    {
+        static constexpr char HEX[] = "0123456789abcdef";
+        buffer_.push_back('"');
+        for (char c : value.text)
+        {
+            auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                buffer_.push_back('\\');
+                buffer_.push_back(c);
+            }
+            else if (byte < 0x20 || byte == 0x7f)
+            {
+                buffer_ += "\\x";
+                buffer_.push_back(HEX[byte >> 4]);
+                buffer_.push_back(HEX[byte & 0xf]);
+            }
+            else
+            {
+                buffer_.push_back(c);
+            }
+        }
+        buffer_.push_back('"');
+        return *this;
+    }
+
+}
@@ -1,12 +1,232 @@
 #include "http_server.h"
+#include "logger.h"
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
-int main()
+namespace
 {
+    void printUsage(const char *program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --mode=threads|epoll|uring  Connection handling mode (default: threads)\n"
+                  << "  --port=N               TCP port to listen on (default: 8080)\n"
+                  << "  --backlog=N            listen() backlog (default: SOMAXCONN)\n"
+                  << "  --bind=ADDRESS         Numeric address to listen on; :: is IPv6 and IPv4 (default: ::)\n"
+                  << "  --shards=N             SO_REUSEPORT listeners on pinned threads, 0 = one per core (default: 1)\n"
+                  << "  --workers=N            Worker threads in threads mode (default: hardware threads)\n"
+                  << "  --queue-depth=N        Connections that may wait for a worker before 503 (default: 1024)\n"
+                  << "  --keep-alive-timeout=MS  Idle time before a persistent connection is closed (default: 5000)\n"
+                  << "  --header-timeout=MS    Time for a whole request head to arrive (default: 10000)\n"
+                  << "  --body-timeout=MS      Longest stall in a request body, and its time plus 1 s per --min-rate bytes (default: 10000)\n"
+                  << "  --send-timeout=MS      Longest stall in a response, and its time plus 1 s per --min-rate bytes (default: 10000)\n"
+                  << "  --min-rate=N           Bytes per second a body or response must average; 0 only limits stalls (default: 1024)\n"
+                  << "  --max-header-size=N    Largest request head, larger ones get 431 (default: 65536)\n"
+                  << "  --max-body-size=N      Largest request body, larger ones get 413 (default: 1 GiB)\n"
+                  << "  --upload-threads=N     Disk writers shared by all uploads, 0 writes on the receiving thread (default: 4)\n"
+                  << "  --http2=on|off         HTTP/2 cleartext by prior knowledge or Upgrade: h2c (default: on)\n"
+                  << "  --search-index=on|off  In-memory filename index answering /search (default: on)\n"
+                  << "  --max-requests=N       Requests served per connection before closing it (default: 100)\n"
+                  << "  --cache-bytes=N        In-memory file cache size, 0 disables it (default: 64 MiB)\n"
+                  << "  --cache-max-file=N     Largest file kept in the cache (default: 1 MiB)\n"
+                  << "  --zerocopy-min=N       Send cached bodies of at least N bytes with MSG_ZEROCOPY, 0 disables (default: 65536)\n"
+                  << "  --open-file-cache=N    Open descriptors and stat results kept, 0 disables reuse (default: 512)\n"
+                  << "  --open-file-cache-ttl=MS  How long a cached lookup is trusted (default: 1000)\n"
+                  << "  --cache-control=PREFIX=VALUE  Cache-Control for static files under PREFIX (repeatable)\n"
+                  << "  --compression=on|off   gzip/brotli for text responses (default: on)\n"
+                  << "  --compress-min-size=N  Smallest body that is compressed (default: 1024)\n"
+                  << "  --compress-cache-bytes=N  Memory for compressed static files (default: 16 MiB)\n"
+                  << "  --metrics-path=PATH    Prometheus metrics endpoint, empty disables it (default: /__metrics)\n"
+                  << "  --log-level=LEVEL      debug, info, warn, error or off (default: info)\n"
+                  << "  --log-file=PATH        Append log lines to PATH instead of stdout\n"
+                  << "  --access-log=on|off    One line per request at any log level (default: on)\n";
+    }
+
+    // Matches "--name=value" and stores the value part.
+    bool matchOption(const std::string &arg, const std::string &name, std::string &value)
+    {
+        std::string prefix = "--" + name + "=";
+        if (arg.rfind(prefix, 0) != 0)
+        {
+            return false;
+        }
+        value = arg.substr(prefix.length());
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    web_server::ServerOptions options;
+    web_server::logging::Options log_options;
+    int port = 8080;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::string value;
+            if (matchOption(arg, "mode", value) && (value == "threads" || value == "epoll" || value == "uring"))
+            {
+                options.io_mode = value == "uring"   ? web_server::IoMode::Uring
+                                  : value == "epoll" ? web_server::IoMode::Epoll
+                                                     : web_server::IoMode::Threads;
+            }
+            else if (matchOption(arg, "port", value))
+            {
+                port = std::stoi(value);
+                if (port < 0 || port > 65535)
+                {
+                    throw std::out_of_range(value);
+                }
+            }
+            else if (matchOption(arg, "backlog", value))
+            {
+                options.listen_backlog = std::stoi(value);
+            }
+            else if (matchOption(arg, "bind", value) && !value.empty())
+            {
+                options.bind_address = value;
+            }
+            else if (matchOption(arg, "shards", value))
+            {
+                options.listener_shards = std::stoul(value);
+            }
+            else if (matchOption(arg, "workers", value))
+            {
+                options.worker_threads = std::stoul(value);
+            }
+            else if (matchOption(arg, "queue-depth", value))
+            {
+                options.queue_depth = std::stoul(value);
+            }
+            else if (matchOption(arg, "keep-alive-timeout", value))
+            {
+                options.keep_alive_timeout_ms = std::stoi(value);
+            }
+            else if (matchOption(arg, "header-timeout", value))
+            {
+                options.header_timeout_ms = std::stoi(value);
+            }
+            else if (matchOption(arg, "body-timeout", value))
+            {
+                options.body_timeout_ms = std::stoi(value);
+            }
+            else if (matchOption(arg, "send-timeout", value))
+            {
+                options.send_timeout_ms = std::stoi(value);
+            }
+            else if (matchOption(arg, "min-rate", value))
+            {
+                options.min_transfer_rate = std::stoull(value);
+            }
+            else if (matchOption(arg, "max-header-size", value))
+            {
+                options.max_header_size = std::stoull(value);
+            }
+            else if (matchOption(arg, "max-body-size", value))
+            {
+                options.max_body_size = std::stoull(value);
+            }
+            else if (matchOption(arg, "max-requests", value))
+            {
+                options.max_keep_alive_requests = std::stoul(value);
+            }
+            else if (matchOption(arg, "cache-bytes", value))
+            {
+                options.cache_max_bytes = std::stoull(value);
+            }
+            else if (matchOption(arg, "cache-max-file", value))
+            {
+                options.cache_max_file_size = std::stoull(value);
+            }
+            else if (matchOption(arg, "open-file-cache", value))
+            {
+                options.open_file_cache_entries = std::stoull(value);
+            }
+            else if (matchOption(arg, "zerocopy-min", value))
+            {
+                options.zerocopy_min_bytes = std::stoull(value);
+            }
+            else if (matchOption(arg, "open-file-cache-ttl", value))
+            {
+                options.open_file_cache_ttl_ms = std::stoi(value);
+            }
+            else if (matchOption(arg, "cache-control", value) && value.starts_with('/') &&
+                     value.find('=') != std::string::npos)
+            {
+                size_t equals = value.find('=');
+                options.cache_control.push_back({value.substr(0, equals), value.substr(equals + 1)});
+            }
+            else if (matchOption(arg, "compression", value) && (value == "on" || value == "off"))
+            {
+                options.compression = value == "on";
+            }
+            else if (matchOption(arg, "compress-min-size", value))
+            {
+                options.compression_min_size = std::stoull(value);
+            }
+            else if (matchOption(arg, "compress-cache-bytes", value))
+            {
+                options.compression_cache_bytes = std::stoull(value);
+            }
+            else if (matchOption(arg, "upload-threads", value))
+            {
+                options.upload_threads = std::stoul(value);
+            }
+            else if (matchOption(arg, "http2", value) && (value == "on" || value == "off"))
+            {
+                options.http2 = value == "on";
+            }
+            else if (matchOption(arg, "search-index", value) && (value == "on" || value == "off"))
+            {
+                options.search_index = value == "on";
+            }
+            else if (matchOption(arg, "metrics-path", value) && (value.empty() || value.starts_with('/')))
+            {
+                options.metrics_path = value;
+            }
+            else if (matchOption(arg, "log-level", value))
+            {
+                bool ok;
+                log_options.level = web_server::logging::parseLevel(value, ok);
+                if (!ok)
+                {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (matchOption(arg, "log-file", value))
+            {
+                log_options.path = value;
+            }
+            else if (matchOption(arg, "access-log", value) && (value == "on" || value == "off"))
+            {
+                log_options.access_log = value == "on";
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << arg << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    catch (const std::logic_error &)
+    {
+        std::cerr << "Invalid option value\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!web_server::logging::start(log_options))
+    {
+        std::cerr << "Cannot open log file: " << log_options.path << "\n";
+        return 1;
+    }
+
     try
     {
-        web_server::HttpServer server(8080, "./web");
+        web_server::HttpServer server(port, "./web", options);
         server.start();
     }
     catch (const std::exception &e)
@@ -15,4 +235,4 @@ int main()
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,342 @@
+#include "metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace web_server::metrics
+{
+
+    namespace
+    {
+        constexpr size_t ROUTE_COUNT = static_cast<size_t>(Route::Count);
+        constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::Count);
+        constexpr size_t DEADLINE_COUNT = static_cast<size_t>(Deadline::Count);
+        constexpr int MAX_STATUS = 600;
+
+        constexpr const char *ROUTE_NAMES[ROUTE_COUNT] = {"static", "directory", "upload_form", "upload",
+                                                          "tree", "search", "metrics", "invalid"};
+        constexpr const char *PHASE_NAMES[PHASE_COUNT] = {"parse", "filesystem", "send"};
+        constexpr const char *DEADLINE_NAMES[DEADLINE_COUNT] = {"idle", "header", "body", "send"};
+
+        // Exported histogram buckets: powers of two from 256 ns to about 69 s. They
+        // line up with the internal sub-bucket groups, so the counts are exact.
+        constexpr int FIRST_EXPORTED_EXPONENT = 8;
+        constexpr int LAST_EXPORTED_EXPONENT = 36;
+        constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+        struct ThreadMetrics
+        {
+            Counter requests[ROUTE_COUNT];
+            Counter statuses[MAX_STATUS];
+            Counter bytes_received;
+            Counter bytes_sent;
+            Counter connections_opened;
+            Counter connections_closed;
+            Counter connections_rejected;
+            Counter timeouts[DEADLINE_COUNT];
+            Histogram request_duration[ROUTE_COUNT];
+            Histogram phase_duration[PHASE_COUNT];
+        };
+
+        // Blocks are never freed: their counts must outlive the threads that wrote them
+        std::mutex &registryMutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        std::vector<std::unique_ptr<ThreadMetrics>> &registry()
+        {
+            static std::vector<std::unique_ptr<ThreadMetrics>> blocks;
+            return blocks;
+        }
+
+        ThreadMetrics &local()
+        {
+            thread_local ThreadMetrics *block = []
+            {
+                std::lock_guard<std::mutex> lock(registryMutex());
+                registry().push_back(std::make_unique<ThreadMetrics>());
+                return registry().back().get();
+            }();
+            return *block;
+        }
+
+        uint64_t toNanoseconds(std::chrono::steady_clock::duration duration)
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+        }
+
+        // A histogram summed over all threads
+        struct Snapshot
+        {
+            uint64_t buckets[Histogram::BUCKET_COUNT] = {};
+            uint64_t count = 0;
+            uint64_t sum = 0;
+
+            void add(const Histogram &histogram)
+            {
+                for (int i = 0; i < Histogram::BUCKET_COUNT; ++i)
+                {
+                    buckets[i] += histogram.buckets[i].load();
+                }
+                count += histogram.count.load();
+                sum += histogram.sum.load();
+            }
+
+            // Upper bound of the bucket holding the given quantile, in nanoseconds
+            uint64_t quantile(double q) const
+            {
+                uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+                rank = rank == 0 ? 1 : rank;
+                uint64_t seen = 0;
+                for (int i = 0; i < Histogram::BUCKET_COUNT; ++i)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank)
+                    {
+                        return Histogram::bucketLimit(i);
+                    }
+                }
+                return Histogram::bucketLimit(Histogram::BUCKET_COUNT - 1);
+            }
+        };
+
+        void appendf(std::string &out, const char *format, auto... args)
+        {
+            char line[256];
+            int length = std::snprintf(line, sizeof(line), format, args...);
+            out.append(line, static_cast<size_t>(std::min<int>(length, sizeof(line) - 1)));
+        }
+
+        void appendHistogram(std::string &out, const char *name, const char *label, const char *value, const Snapshot &snapshot)
+        {
+            uint64_t cumulative = 0;
+            int next_bucket = 0;
+            for (int exponent = FIRST_EXPORTED_EXPONENT; exponent <= LAST_EXPORTED_EXPONENT; ++exponent)
+            {
+                int end = (exponent - Histogram::SUB_BUCKET_BITS + 1) * Histogram::SUB_BUCKETS;
+                for (; next_bucket < end; ++next_bucket)
+                {
+                    cumulative += snapshot.buckets[next_bucket];
+                }
+                appendf(out, "%s_bucket{%s=\"%s\",le=\"%.9g\"} %llu\n", name, label, value,
+                        static_cast<double>(uint64_t{1} << exponent) / 1e9, static_cast<unsigned long long>(cumulative));
+            }
+            appendf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value,
+                    static_cast<unsigned long long>(snapshot.count));
+            appendf(out, "%s_sum{%s=\"%s\"} %.9g\n", name, label, value, static_cast<double>(snapshot.sum) / 1e9);
+            appendf(out, "%s_count{%s=\"%s\"} %llu\n", name, label, value, static_cast<unsigned long long>(snapshot.count));
+        }
+
+        void appendQuantiles(std::string &out, const char *name, const char *label, const char *value, const Snapshot &snapshot)
+        {
+            for (double q : QUANTILES)
+            {
+                appendf(out, "%s{%s=\"%s\",quantile=\"%g\"} %.9g\n", name, label, value, q,
+                        static_cast<double>(snapshot.quantile(q)) / 1e9);
+            }
+        }
+    }
+
+    int Histogram::bucketIndex(uint64_t nanoseconds)
+    {
+        if (nanoseconds < SUB_BUCKETS)
+        {
+            return static_cast<int>(nanoseconds);
+        }
+        int exponent = std::bit_width(nanoseconds) - 1;
+        if (exponent > MAX_EXPONENT)
+        {
+            return BUCKET_COUNT - 1;
+        }
+        int sub_bucket = static_cast<int>((nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    uint64_t Histogram::bucketLimit(int index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return static_cast<uint64_t>(index) + 1;
+        }
+        int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        uint64_t sub_bucket = static_cast<uint64_t>(index % SUB_BUCKETS);
+        return (SUB_BUCKETS + sub_bucket + 1) << (exponent - SUB_BUCKET_BITS);
+    }
+
+    void Histogram::record(uint64_t nanoseconds)
+    {
+        buckets[bucketIndex(nanoseconds)].add(1);
+        count.add(1);
+        sum.add(nanoseconds);
+    }
+
+    const char *routeName(Route route)
+    {
+        return ROUTE_NAMES[static_cast<size_t>(route)];
+    }
+
+    const char *deadlineName(Deadline deadline)
+    {
+        return DEADLINE_NAMES[static_cast<size_t>(deadline)];
+    }
+
+    void recordRequest(Route route, int status, std::chrono::steady_clock::duration duration)
+    {
+        ThreadMetrics &block = local();
+        auto index = static_cast<size_t>(route);
+        block.requests[index].add(1);
+        block.request_duration[index].record(toNanoseconds(duration));
+        if (status > 0 && status < MAX_STATUS)
+        {
+            block.statuses[status].add(1);
+        }
+    }
+
+    void recordPhase(Phase phase, std::chrono::steady_clock::duration duration)
+    {
+        local().phase_duration[static_cast<size_t>(phase)].record(toNanoseconds(duration));
+    }
+
+    void addBytesReceived(size_t bytes)
+    {
+        local().bytes_received.add(bytes);
+    }
+
+    void addBytesSent(size_t bytes)
+    {
+        local().bytes_sent.add(bytes);
+    }
+
+    void connectionOpened()
+    {
+        local().connections_opened.add(1);
+    }
+
+    void connectionClosed()
+    {
+        local().connections_closed.add(1);
+    }
+
+    void connectionRejected()
+    {
+        local().connections_rejected.add(1);
+    }
+
+    void connectionTimedOut(Deadline deadline)
+    {
+        local().timeouts[static_cast<size_t>(deadline)].add(1);
+    }
+
+    void appendSample(std::string &out, const char *name, const char *type, const char *help, double value)
+    {
+        appendf(out, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+    }
+
+    void render(std::string &out)
+    {
+        uint64_t requests[ROUTE_COUNT] = {};
+        uint64_t statuses[MAX_STATUS] = {};
+        uint64_t bytes_received = 0, bytes_sent = 0, opened = 0, closed = 0, rejected = 0;
+        uint64_t timeouts[DEADLINE_COUNT] = {};
+        auto request_duration = std::make_unique<Snapshot[]>(ROUTE_COUNT);
+        auto phase_duration = std::make_unique<Snapshot[]>(PHASE_COUNT);
+        {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            for (const auto &block : registry())
+            {
+                for (size_t i = 0; i < ROUTE_COUNT; ++i)
+                {
+                    requests[i] += block->requests[i].load();
+                    request_duration[i].add(block->request_duration[i]);
+                }
+                for (int i = 0; i < MAX_STATUS; ++i)
+                {
+                    statuses[i] += block->statuses[i].load();
+                }
+                for (size_t i = 0; i < PHASE_COUNT; ++i)
+                {
+                    phase_duration[i].add(block->phase_duration[i]);
+                }
+                bytes_received += block->bytes_received.load();
+                bytes_sent += block->bytes_sent.load();
+                opened += block->connections_opened.load();
+                closed += block->connections_closed.load();
+                rejected += block->connections_rejected.load();
+                for (size_t i = 0; i < DEADLINE_COUNT; ++i)
+                {
+                    timeouts[i] += block->timeouts[i].load();
+                }
+            }
+        }
+
+        out += "# HELP web_server_requests_total Requests handled, by route.\n"
+               "# TYPE web_server_requests_total counter\n";
+        for (size_t i = 0; i < ROUTE_COUNT; ++i)
+        {
+            appendf(out, "web_server_requests_total{route=\"%s\"} %llu\n", ROUTE_NAMES[i],
+                    static_cast<unsigned long long>(requests[i]));
+        }
+        out += "# HELP web_server_responses_total Responses sent, by status code.\n"
+               "# TYPE web_server_responses_total counter\n";
+        for (int i = 0; i < MAX_STATUS; ++i)
+        {
+            if (statuses[i] > 0)
+            {
+                appendf(out, "web_server_responses_total{code=\"%d\"} %llu\n", i, static_cast<unsigned long long>(statuses[i]));
+            }
+        }
+        appendSample(out, "web_server_received_bytes_total", "counter", "Bytes read from clients.", static_cast<double>(bytes_received));
+        appendSample(out, "web_server_sent_bytes_total", "counter", "Bytes written to clients.", static_cast<double>(bytes_sent));
+        appendSample(out, "web_server_connections_total", "counter", "Connections accepted.", static_cast<double>(opened));
+        appendSample(out, "web_server_active_connections", "gauge", "Connections currently open.",
+                     static_cast<double>(opened >= closed ? opened - closed : 0));
+        appendSample(out, "web_server_rejected_connections_total", "counter",
+                     "Connections answered with 503 because the worker queue was full.", static_cast<double>(rejected));
+        out += "# HELP web_server_connection_timeouts_total Connections closed because a deadline passed, by deadline.\n"
+               "# TYPE web_server_connection_timeouts_total counter\n";
+        for (size_t i = 0; i < DEADLINE_COUNT; ++i)
+        {
+            appendf(out, "web_server_connection_timeouts_total{deadline=\"%s\"} %llu\n", DEADLINE_NAMES[i],
+                    static_cast<unsigned long long>(timeouts[i]));
+        }
+
+        out += "# HELP web_server_request_duration_seconds Time from a complete request head to the queued response, by route.\n"
+               "# TYPE web_server_request_duration_seconds histogram\n";
+        for (size_t i = 0; i < ROUTE_COUNT; ++i)
+        {
+            appendHistogram(out, "web_server_request_duration_seconds", "route", ROUTE_NAMES[i], request_duration[i]);
+        }
+        out += "# HELP web_server_request_duration_quantile_seconds Request duration quantiles, within 12.5%.\n"
+               "# TYPE web_server_request_duration_quantile_seconds gauge\n";
+        for (size_t i = 0; i < ROUTE_COUNT; ++i)
+        {
+            if (request_duration[i].count > 0)
+            {
+                appendQuantiles(out, "web_server_request_duration_quantile_seconds", "route", ROUTE_NAMES[i], request_duration[i]);
+            }
+        }
+
+        out += "# HELP web_server_phase_duration_seconds Time spent in each phase of request handling.\n"
+               "# TYPE web_server_phase_duration_seconds histogram\n";
+        for (size_t i = 0; i < PHASE_COUNT; ++i)
+        {
+            appendHistogram(out, "web_server_phase_duration_seconds", "phase", PHASE_NAMES[i], phase_duration[i]);
+        }
+        out += "# HELP web_server_phase_duration_quantile_seconds Phase duration quantiles, within 12.5%.\n"
+               "# TYPE web_server_phase_duration_quantile_seconds gauge\n";
+        for (size_t i = 0; i < PHASE_COUNT; ++i)
+        {
+            if (phase_duration[i].count > 0)
+            {
+                appendQuantiles(out, "web_server_phase_duration_quantile_seconds", "phase", PHASE_NAMES[i], phase_duration[i]);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,211 @@
+#include "multipart_parser.h"
+#include "request_parser.h"
+#include <algorithm>
+#include <cctype>
+
+namespace web_server
+{
+
+    MultipartParser::MultipartParser(const std::string &boundary, Handler &handler)
+        : delimiter_("\r\n--" + boundary), handler_(handler),
+          searcher_(delimiter_.cbegin(), delimiter_.cend())
+    {
+    }
+
+    size_t MultipartParser::fail()
+    {
+        state_ = State::Failed;
+        return 0;
+    }
+
+    size_t MultipartParser::feed(std::string_view data, bool last)
+    {
+        size_t consumed = 0;
+        while (state_ != State::Done && state_ != State::Failed)
+        {
+            size_t used = step(data.substr(consumed), last);
+            if (used == 0)
+            {
+                break;
+            }
+            consumed += used;
+        }
+        if (state_ == State::Done)
+        {
+            return data.length(); // Anything after the closing boundary is epilogue
+        }
+        if (last && state_ != State::Failed)
+        {
+            fail(); // The body ended before the closing boundary
+        }
+        return consumed;
+    }
+
+    size_t MultipartParser::step(std::string_view data, bool last)
+    {
+        switch (state_)
+        {
+        case State::Preamble:
+        {
+            // The first boundary may start the body without a leading CRLF
+            std::string_view first = std::string_view(delimiter_).substr(2);
+            if (data.length() < first.length())
+            {
+                return 0;
+            }
+            if (data.starts_with(first))
+            {
+                state_ = State::AfterBoundary;
+                return first.length();
+            }
+            auto it = std::search(data.begin(), data.end(), searcher_);
+            if (it != data.end())
+            {
+                state_ = State::AfterBoundary;
+                return static_cast<size_t>(it - data.begin()) + delimiter_.length();
+            }
+            // Discard preamble bytes that cannot be the start of a boundary
+            return data.length() >= delimiter_.length() ? data.length() - delimiter_.length() + 1 : 0;
+        }
+
+        case State::AfterBoundary:
+        {
+            if (data.length() < 2)
+            {
+                return 0;
+            }
+            if (data.starts_with("--"))
+            {
+                state_ = State::Done;
+                return 2;
+            }
+            // Skip optional transport padding up to the CRLF that ends the boundary line
+            size_t line_end = data.find("\r\n");
+            if (line_end == std::string_view::npos)
+            {
+                return data.length() > 128 ? fail() : 0;
+            }
+            state_ = State::PartHeaders;
+            return line_end + 2;
+        }
+
+        case State::PartHeaders:
+        {
+            if (data.starts_with("\r\n"))
+            {
+                // A part without headers
+                state_ = State::PartData;
+                return handler_.onPartBegin({}) ? 2 : fail();
+            }
+            size_t header_end = data.find("\r\n\r\n");
+            if (header_end == std::string_view::npos)
+            {
+                return data.length() > MAX_PART_HEADER_SIZE ? fail() : 0;
+            }
+            state_ = State::PartData;
+            return handler_.onPartBegin(data.substr(0, header_end)) ? header_end + 4 : fail();
+        }
+
+        case State::PartData:
+        {
+            auto it = std::search(data.begin(), data.end(), searcher_);
+            if (it != data.end())
+            {
+                size_t length = static_cast<size_t>(it - data.begin());
+                if ((length > 0 && !handler_.onPartData(data.substr(0, length))) || !handler_.onPartEnd())
+                {
+                    return fail();
+                }
+                state_ = State::AfterBoundary;
+                return length + delimiter_.length();
+            }
+            // Hold back a tail that could be the start of a boundary split across reads
+            size_t safe = data.length() >= delimiter_.length() ? data.length() - delimiter_.length() + 1 : 0;
+            if (safe == 0 || last)
+            {
+                return 0;
+            }
+            return handler_.onPartData(data.substr(0, safe)) ? safe : fail();
+        }
+
+        case State::Done:
+        case State::Failed:
+            return 0;
+        }
+        return 0;
+    }
+
+    std::string multipartFilename(std::string_view headers)
+    {
+        static constexpr std::string_view DISPOSITION = "content-disposition:";
+        static constexpr std::string_view FILENAME = "filename=\"";
+
+        size_t line_start = 0;
+        while (line_start < headers.length())
+        {
+            size_t line_end = headers.find("\r\n", line_start);
+            if (line_end == std::string_view::npos)
+            {
+                line_end = headers.length();
+            }
+            std::string_view line = headers.substr(line_start, line_end - line_start);
+            line_start = line_end + 2;
+
+            if (line.length() < DISPOSITION.length() ||
+                !std::equal(DISPOSITION.begin(), DISPOSITION.end(), line.begin(), [](char a, char b)
+                            { return a == std::tolower(static_cast<unsigned char>(b)); }))
+            {
+                continue;
+            }
+            size_t value = line.find(FILENAME);
+            if (value == std::string_view::npos)
+            {
+                return "";
+            }
+            value += FILENAME.length();
+            size_t close = line.find('"', value);
+            if (close == std::string_view::npos)
+            {
+                return "";
+            }
+            return std::string(line.substr(value, close - value));
+        }
+        return "";
+    }
+
+    std::string_view multipartBoundary(std::string_view content_type)
+    {
+        auto trim = [](std::string_view value)
+        {
+            size_t begin = value.find_first_not_of(" \t");
+            size_t end = value.find_last_not_of(" \t");
+            return begin == std::string_view::npos ? std::string_view() : value.substr(begin, end - begin + 1);
+        };
+
+        size_t semicolon = content_type.find(';');
+        if (!equalsIgnoreCase(trim(content_type.substr(0, semicolon)), "multipart/form-data"))
+        {
+            return {};
+        }
+        while (semicolon != std::string_view::npos)
+        {
+            content_type.remove_prefix(semicolon + 1);
+            semicolon = content_type.find(';');
+            std::string_view parameter = trim(content_type.substr(0, semicolon));
+            size_t equals = parameter.find('=');
+            if (equals == std::string_view::npos || !equalsIgnoreCase(trim(parameter.substr(0, equals)), "boundary"))
+            {
+                continue;
+            }
+            std::string_view boundary = trim(parameter.substr(equals + 1));
+            if (boundary.length() >= 2 && boundary.front() == '"' && boundary.back() == '"')
+            {
+                boundary = boundary.substr(1, boundary.length() - 2);
+            }
+            // RFC 2046 limits boundaries to 70 characters
+            return boundary.length() <= 70 ? boundary : std::string_view();
+        }
+        return {};
+    }
+
+}
@@ -0,0 +1,271 @@
+#include "open_file_cache.h"
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#endif
+
+namespace web_server
+{
+
+    namespace
+    {
+#ifndef _WIN32
+        // O_NONBLOCK keeps a FIFO planted in the root from blocking the open
+        constexpr int OPEN_FLAGS = O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK;
+#endif
+
+        // Failures that say nothing about the path itself are not cached
+        bool isTransient(int error)
+        {
+            return error == EMFILE || error == ENFILE || error == ENOMEM || error == EINTR || error == EAGAIN;
+        }
+
+        bool isWithin(const std::string &path, const std::string &root)
+        {
+            return path == root || (path.starts_with(root) && path[root.length()] == '/');
+        }
+
+        // Without openat2 (non-Linux, or Linux before 5.6) symlinks are resolved
+        // in user space first. That still confines lookups to the root, but a
+        // rename between the check and the open is not caught.
+        std::string resolveInUserSpace(const std::string &root, const std::string &path)
+        {
+            std::error_code ec;
+            std::string canonical = std::filesystem::canonical(path, ec).string();
+            if (ec)
+            {
+                errno = ec.value();
+                return "";
+            }
+            if (!isWithin(canonical, root))
+            {
+                errno = EXDEV;
+                return "";
+            }
+            return canonical;
+        }
+
+#ifndef _WIN32
+        // Returns a descriptor for `relative` below `root_fd`, or -1 with errno set
+        int openBeneath(int root_fd, const std::string &root, const std::string &relative)
+        {
+#ifdef SYS_openat2
+            static std::atomic<bool> openat2_missing{false};
+            if (!openat2_missing.load(std::memory_order_relaxed))
+            {
+                open_how how{};
+                how.flags = OPEN_FLAGS;
+                how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+                int fd = static_cast<int>(syscall(SYS_openat2, root_fd, relative.c_str(), &how, sizeof(how)));
+                if (fd != -1 || errno != ENOSYS)
+                {
+                    return fd;
+                }
+                openat2_missing.store(true, std::memory_order_relaxed);
+            }
+#else
+            (void)root_fd;
+#endif
+            std::string canonical = resolveInUserSpace(root, root + "/" + relative);
+            return canonical.empty() ? -1 : ::open(canonical.c_str(), OPEN_FLAGS);
+        }
+#endif
+    }
+
+    OpenFile::~OpenFile()
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+
+    OpenFileCache::OpenFileCache(const std::string &root, size_t max_entries, std::chrono::milliseconds ttl)
+        : root_(root),
+          shard_capacity_(max_entries == 0 ? 0 : std::max<size_t>(1, (max_entries + SHARD_COUNT - 1) / SHARD_COUNT)),
+          ttl_(ttl)
+    {
+#ifndef _WIN32
+        root_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+    }
+
+    OpenFileCache::~OpenFileCache()
+    {
+        if (root_fd_ != -1)
+        {
+            close(root_fd_);
+        }
+    }
+
+    OpenFileCache::Shard &OpenFileCache::shardFor(std::string_view path)
+    {
+        return shards_[PathHash{}(path) % SHARD_COUNT];
+    }
+
+    std::shared_ptr<OpenFile> OpenFileCache::resolve(const std::string &path) const
+    {
+        auto file = std::make_shared<OpenFile>();
+        if (!isWithin(path, root_))
+        {
+            file->error = EXDEV;
+            return file;
+        }
+        if (path.find('\0') != std::string::npos)
+        {
+            file->error = EINVAL; // The system calls would stop reading the path at the NUL
+            return file;
+        }
+#ifdef _WIN32
+        std::string canonical = resolveInUserSpace(root_, path);
+        if (canonical.empty() || stat(canonical.c_str(), &file->info) != 0)
+        {
+            file->error = errno;
+            return file;
+        }
+#else
+        if (root_fd_ == -1)
+        {
+            file->error = ENOENT;
+            return file;
+        }
+        std::string relative = path.length() > root_.length() + 1 ? path.substr(root_.length() + 1) : ".";
+        file->fd = openBeneath(root_fd_, root_, relative);
+        if (file->fd == -1 || fstat(file->fd, &file->info) != 0)
+        {
+            file->error = errno;
+            return file;
+        }
+        if (S_ISREG(file->info.st_mode))
+        {
+            // Only needed while opening; later reads should block on the disk as usual
+            fcntl(file->fd, F_SETFL, 0);
+        }
+        else if (!S_ISDIR(file->info.st_mode))
+        {
+            file->error = EACCES; // Devices, FIFOs and sockets are never served
+            return file;
+        }
+#endif
+        if (S_ISREG(file->info.st_mode))
+        {
+            file->validators = fileValidators(file->info);
+        }
+        return file;
+    }
+
+    std::shared_ptr<const OpenFile> OpenFileCache::open(std::string_view path)
+    {
+        if (shard_capacity_ == 0)
+        {
+            return resolve(std::string(path));
+        }
+        Shard &shard = shardFor(path);
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(path);
+            if (it != shard.index.end())
+            {
+                if (now < it->second->expires)
+                {
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                    ++shard.hits;
+                    return it->second->file;
+                }
+                eraseLocked(shard, it->second);
+            }
+            ++shard.misses;
+        }
+
+        // Resolve outside the lock so a slow lookup does not stall other hits
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        std::string key(path);
+        std::shared_ptr<const OpenFile> file = resolve(key);
+        if (isTransient(file->error) || epoch_.load(std::memory_order_acquire) != epoch)
+        {
+            return file;
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto existing = shard.index.find(key);
+        if (existing != shard.index.end())
+        {
+            eraseLocked(shard, existing->second);
+        }
+        while (shard.lru.size() >= shard_capacity_)
+        {
+            eraseLocked(shard, std::prev(shard.lru.end()));
+        }
+        shard.lru.push_front({key, file, now + ttl_});
+        shard.index.emplace(std::move(key), shard.lru.begin());
+        return file;
+    }
+
+    void OpenFileCache::eraseLocked(Shard &shard, std::list<Entry>::iterator it)
+    {
+        shard.index.erase(it->path);
+        shard.lru.erase(it);
+    }
+
+    void OpenFileCache::invalidate(const std::string &path)
+    {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+        Shard &shard = shardFor(path);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end())
+        {
+            eraseLocked(shard, it->second);
+            ++shard.invalidations;
+        }
+    }
+
+    void OpenFileCache::invalidatePrefix(const std::string &prefix)
+    {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+        for (auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto it = shard.lru.begin(); it != shard.lru.end();)
+            {
+                auto next = std::next(it);
+                if (it->path.starts_with(prefix))
+                {
+                    eraseLocked(shard, it);
+                    ++shard.invalidations;
+                }
+                it = next;
+            }
+        }
+    }
+
+    void OpenFileCache::clear()
+    {
+        invalidatePrefix("");
+    }
+
+    OpenFileCache::Stats OpenFileCache::stats() const
+    {
+        Stats stats{};
+        for (const auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.invalidations += shard.invalidations;
+            stats.entries += shard.lru.size();
+        }
+        return stats;
+    }
+
+}
@@ -0,0 +1,285 @@
+#include "request_parser.h"
+#include <algorithm>
+#include <array>
+
+namespace web_server
+{
+
+    namespace
+    {
+        char lower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        // RFC 9110 tchar, as a lookup table since every header name byte is checked
+        constexpr auto TOKEN_CHARS = []
+        {
+            std::array<bool, 256> table{};
+            for (int c = '0'; c <= '9'; ++c)
+            {
+                table[c] = true;
+            }
+            for (int c = 'a'; c <= 'z'; ++c)
+            {
+                table[c] = true;
+                table[c - 'a' + 'A'] = true;
+            }
+            for (char c : std::string_view("!#$%&'*+-.^_`|~"))
+            {
+                table[static_cast<unsigned char>(c)] = true;
+            }
+            return table;
+        }();
+
+        bool isTokenChar(char c)
+        {
+            return TOKEN_CHARS[static_cast<unsigned char>(c)];
+        }
+
+        std::string_view trim(std::string_view value)
+        {
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            {
+                value.remove_prefix(1);
+            }
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            {
+                value.remove_suffix(1);
+            }
+            return value;
+        }
+
+        // True if the comma-separated header value contains `token`.
+        bool containsToken(std::string_view value, std::string_view token)
+        {
+            while (!value.empty())
+            {
+                size_t comma = value.find(',');
+                if (equalsIgnoreCase(trim(value.substr(0, comma)), token))
+                {
+                    return true;
+                }
+                if (comma == std::string_view::npos)
+                {
+                    break;
+                }
+                value.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+        int hexValue(char c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            c = lower(c);
+            return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        }
+
+        template <typename String>
+        void decodeInto(std::string_view value, String &out, bool plus_as_space)
+        {
+            out.clear();
+            out.reserve(value.length());
+            for (size_t i = 0; i < value.length(); ++i)
+            {
+                char c = value[i];
+                if (c == '%' && i + 2 < value.length() && hexValue(value[i + 1]) >= 0 && hexValue(value[i + 2]) >= 0)
+                {
+                    out += static_cast<char>(hexValue(value[i + 1]) * 16 + hexValue(value[i + 2]));
+                    i += 2;
+                }
+                else if (c == '+' && plus_as_space)
+                {
+                    out += ' ';
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+    }
+
+    bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        return a.length() == b.length() &&
+               std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+                          { return lower(x) == lower(y); });
+    }
+
+    std::string_view HttpRequest::header(std::string_view name) const
+    {
+        for (size_t i = 0; i < header_count; ++i)
+        {
+            if (equalsIgnoreCase(headers[i].name, name))
+            {
+                return headers[i].value;
+            }
+        }
+        return {};
+    }
+
+    bool HttpRequest::keepAlive() const
+    {
+        std::string_view connection = header("Connection");
+        if (containsToken(connection, "close"))
+        {
+            return false;
+        }
+        return version == "HTTP/1.1" || containsToken(connection, "keep-alive");
+    }
+
+    RequestParser::Result RequestParser::fail(const char *status)
+    {
+        error_status_ = status;
+        return Result::Error;
+    }
+
+    RequestParser::Result RequestParser::parse(std::string_view buffer, HttpRequest &request)
+    {
+        // Resume the search a few bytes back in case "\r\n\r\n" straddles two reads
+        size_t start = scanned_ >= 3 ? scanned_ - 3 : 0;
+        size_t end = buffer.find("\r\n\r\n", start);
+        if (end == std::string_view::npos)
+        {
+            scanned_ = buffer.length();
+            return buffer.length() > max_header_size_ ? fail("431 Request Header Fields Too Large") : Result::Incomplete;
+        }
+        if (end + 4 > max_header_size_)
+        {
+            return fail("431 Request Header Fields Too Large");
+        }
+        scanned_ = end;
+
+        // Only the fields that are not always overwritten are reset; the header
+        // array is left as is and bounded by header_count
+        request.query = {};
+        request.header_count = 0;
+        request.content_length = 0;
+        request.chunked = false;
+        request.header_length = end + 4;
+        std::string_view head = buffer.substr(0, end + 2); // Every line ends in CRLF
+
+        // Request line: method SP request-target SP HTTP-version
+        size_t line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        head.remove_prefix(line_end + 2);
+
+        size_t first_space = line.find(' ');
+        size_t last_space = line.rfind(' ');
+        if (first_space == std::string_view::npos || first_space == 0 || last_space == first_space)
+        {
+            return fail("400 Bad Request");
+        }
+        request.method = line.substr(0, first_space);
+        request.target = line.substr(first_space + 1, last_space - first_space - 1);
+        request.version = line.substr(last_space + 1);
+        // "PRI * HTTP/2.0" opens the HTTP/2 connection preface (RFC 9113 3.4)
+        bool preface = line == "PRI * HTTP/2.0";
+        if (!std::all_of(request.method.begin(), request.method.end(), isTokenChar) ||
+            request.target.empty() || request.target.find(' ') != std::string_view::npos ||
+            !(request.version.starts_with("HTTP/1.") || preface))
+        {
+            return fail("400 Bad Request");
+        }
+        size_t question = request.target.find('?');
+        request.path = request.target.substr(0, question);
+        if (question != std::string_view::npos)
+        {
+            request.query = request.target.substr(question + 1);
+        }
+
+        bool has_content_length = false;
+        while (!head.empty())
+        {
+            line_end = head.find("\r\n");
+            line = head.substr(0, line_end);
+            head.remove_prefix(line_end + 2);
+
+            size_t colon = line.find(':');
+            // Folded lines and whitespace before the colon are rejected (RFC 9112 5.1, 5.2)
+            if (colon == std::string_view::npos || colon == 0 ||
+                !std::all_of(line.begin(), line.begin() + colon, isTokenChar))
+            {
+                return fail("400 Bad Request");
+            }
+            if (request.header_count == HttpRequest::MAX_HEADERS)
+            {
+                return fail("431 Request Header Fields Too Large");
+            }
+            HttpHeader &header = request.headers[request.header_count++];
+            header.name = line.substr(0, colon);
+            header.value = trim(line.substr(colon + 1));
+
+            if (equalsIgnoreCase(header.name, "Content-Length"))
+            {
+                if (header.value.empty() || header.value.length() > 18 ||
+                    !std::all_of(header.value.begin(), header.value.end(), [](char c)
+                                 { return c >= '0' && c <= '9'; }))
+                {
+                    return fail("400 Bad Request");
+                }
+                size_t length = 0;
+                for (char c : header.value)
+                {
+                    length = length * 10 + static_cast<size_t>(c - '0');
+                }
+                if (has_content_length && length != request.content_length)
+                {
+                    return fail("400 Bad Request");
+                }
+                has_content_length = true;
+                request.content_length = length;
+            }
+            else if (equalsIgnoreCase(header.name, "Transfer-Encoding"))
+            {
+                request.chunked = true;
+            }
+        }
+        if (request.chunked)
+        {
+            // Request bodies are only delimited by Content-Length
+            return fail(has_content_length ? "400 Bad Request" : "501 Not Implemented");
+        }
+        if (request.content_length > max_body_size_)
+        {
+            return fail("413 Content Too Large");
+        }
+        return Result::Complete;
+    }
+
+    void urlDecode(std::string_view value, std::string &out, bool plus_as_space)
+    {
+        decodeInto(value, out, plus_as_space);
+    }
+
+    void urlDecode(std::string_view value, std::pmr::string &out, bool plus_as_space)
+    {
+        decodeInto(value, out, plus_as_space);
+    }
+
+    bool queryParameter(std::string_view query, std::string_view name, std::string &out)
+    {
+        while (!query.empty())
+        {
+            size_t amp = query.find('&');
+            std::string_view pair = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+
+            size_t equals = pair.find('=');
+            std::string_view key = pair.substr(0, equals);
+            if (key == name)
+            {
+                std::string_view value = equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+                urlDecode(value, out, true);
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
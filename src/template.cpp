@@ -0,0 +1,174 @@
+#include "template.h"
+
+namespace web_server
+{
+
+    namespace
+    {
+        const char *entityFor(char c)
+        {
+            switch (c)
+            {
+            case '&':
+                return "&amp;";
+            case '<':
+                return "&lt;";
+            case '>':
+                return "&gt;";
+            case '"':
+                return "&quot;";
+            case '\'':
+                return "&#39;";
+            default:
+                return nullptr;
+            }
+        }
+    }
+
+    size_t htmlEscapedLength(std::string_view value)
+    {
+        size_t length = value.length();
+        for (char c : value)
+        {
+            if (const char *entity = entityFor(c))
+            {
+                length += std::char_traits<char>::length(entity) - 1;
+            }
+        }
+        return length;
+    }
+
+    void appendHtmlEscaped(std::string &out, std::string_view value)
+    {
+        size_t run_start = 0;
+        for (size_t i = 0; i < value.length(); ++i)
+        {
+            if (const char *entity = entityFor(value[i]))
+            {
+                out.append(value.data() + run_start, i - run_start);
+                out.append(entity);
+                run_start = i + 1;
+            }
+        }
+        out.append(value.data() + run_start, value.length() - run_start);
+    }
+
+    Template::Template(const std::string &source)
+    {
+        size_t pos = 0;
+        size_t literal_start = 0;
+        while ((pos = source.find("{{", pos)) != std::string::npos)
+        {
+            size_t close = source.find("}}", pos + 2);
+            if (close == std::string::npos)
+            {
+                break; // Unterminated placeholder is kept as literal text
+            }
+            std::string name = source.substr(pos + 2, close - pos - 2);
+
+            int slot = -1;
+            for (size_t i = 0; i < slot_names_.size(); ++i)
+            {
+                if (slot_names_[i] == name)
+                {
+                    slot = static_cast<int>(i);
+                }
+            }
+            if (slot == -1)
+            {
+                slot = static_cast<int>(slot_names_.size());
+                slot_names_.push_back(name);
+            }
+
+            segments_.push_back({literals_.length(), pos - literal_start, slot});
+            literals_.append(source, literal_start, pos - literal_start);
+            pos = close + 2;
+            literal_start = pos;
+        }
+        segments_.push_back({literals_.length(), source.length() - literal_start, -1});
+        literals_.append(source, literal_start, std::string::npos);
+    }
+
+    std::vector<const TemplateVariable *> Template::bind(std::initializer_list<TemplateVariable> variables) const
+    {
+        std::vector<const TemplateVariable *> bound(slot_names_.size(), nullptr);
+        for (size_t i = 0; i < slot_names_.size(); ++i)
+        {
+            for (const auto &variable : variables)
+            {
+                if (variable.name == slot_names_[i])
+                {
+                    bound[i] = &variable;
+                }
+            }
+        }
+        return bound;
+    }
+
+    void Template::renderSegments(const std::vector<const TemplateVariable *> &bound, size_t first, size_t last,
+                                  bool last_slot, std::string &out) const
+    {
+        // Size the output exactly before writing
+        size_t total = out.length();
+        for (size_t i = first; i < last; ++i)
+        {
+            const Segment &segment = segments_[i];
+            total += segment.literal_length;
+            if (segment.slot >= 0 && bound[segment.slot] && (last_slot || i + 1 < last))
+            {
+                const TemplateVariable &variable = *bound[segment.slot];
+                total += variable.escape ? htmlEscapedLength(variable.value) : variable.value.length();
+            }
+        }
+
+        out.reserve(total);
+        for (size_t i = first; i < last; ++i)
+        {
+            const Segment &segment = segments_[i];
+            out.append(literals_, segment.literal_offset, segment.literal_length);
+            if (segment.slot < 0 || !bound[segment.slot] || (!last_slot && i + 1 == last))
+            {
+                continue; // Unbound slots render as empty
+            }
+            const TemplateVariable &variable = *bound[segment.slot];
+            if (variable.escape)
+            {
+                appendHtmlEscaped(out, variable.value);
+            }
+            else
+            {
+                out.append(variable.value);
+            }
+        }
+    }
+
+    std::string Template::render(std::initializer_list<TemplateVariable> variables) const
+    {
+        std::string out;
+        renderSegments(bind(variables), 0, segments_.size(), true, out);
+        return out;
+    }
+
+    void Template::renderAround(std::initializer_list<TemplateVariable> variables, std::string_view split,
+                                std::string &head, std::string &tail) const
+    {
+        std::vector<const TemplateVariable *> bound = bind(variables);
+        size_t at = segments_.size();
+        for (size_t i = 0; i < segments_.size(); ++i)
+        {
+            if (segments_[i].slot >= 0 && slot_names_[segments_[i].slot] == split)
+            {
+                at = i;
+                break;
+            }
+        }
+        if (at == segments_.size())
+        {
+            renderSegments(bound, 0, segments_.size(), true, head);
+            return;
+        }
+        renderSegments(bound, 0, at + 1, false, head);
+        renderSegments(bound, at + 1, segments_.size(), true, tail);
+    }
+
+}
@@ -0,0 +1,113 @@
+#include "thread_pool.h"
+#include "logger.h"
+
+namespace web_server
+{
+
+    ThreadPool::ThreadPool(size_t thread_count, size_t queue_depth)
+        : queue_depth_(queue_depth)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = 1;
+        }
+        workers_.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            workers_.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    bool ThreadPool::trySubmit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ || queue_.size() >= queue_depth_)
+            {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            queue_.push_back({std::move(task), std::chrono::steady_clock::now()});
+        }
+        ready_.notify_one();
+        return true;
+    }
+
+    void ThreadPool::submit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+            {
+                return;
+            }
+            queue_.push_back({std::move(task), std::chrono::steady_clock::now()});
+        }
+        ready_.notify_one();
+    }
+
+    ThreadPool::Stats ThreadPool::stats() const
+    {
+        Stats stats{};
+        stats.completed = completed_.load(std::memory_order_relaxed);
+        stats.rejected = rejected_.load(std::memory_order_relaxed);
+        stats.total_wait_us = total_wait_us_.load(std::memory_order_relaxed);
+        stats.max_wait_us = max_wait_us_.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.queued = queue_.size();
+        return stats;
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        while (true)
+        {
+            QueuedTask item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this]
+                            { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return; // Stopping and drained
+                }
+                item = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - item.enqueued)
+                              .count();
+            uint64_t wait_us = static_cast<uint64_t>(waited);
+            total_wait_us_.fetch_add(wait_us, std::memory_order_relaxed);
+            uint64_t max_wait = max_wait_us_.load(std::memory_order_relaxed);
+            while (wait_us > max_wait && !max_wait_us_.compare_exchange_weak(max_wait, wait_us, std::memory_order_relaxed))
+            {
+            }
+
+            try
+            {
+                item.task();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR << "Worker task failed: " << e.what();
+            }
+            completed_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+}
@@ -0,0 +1,179 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <limits>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr uint64_t SLOT_MASK = TimerWheel::SLOTS - 1;
+        constexpr uint64_t RANGE = uint64_t(1) << (TimerWheel::LEVEL_BITS * TimerWheel::LEVELS);
+    }
+
+    TimerWheel::Timer::~Timer()
+    {
+        if (wheel_)
+        {
+            wheel_->cancel(*this);
+        }
+    }
+
+    TimerWheel::TimerWheel(std::chrono::milliseconds tick, Clock::time_point start) : tick_(tick), start_(start)
+    {
+    }
+
+    void TimerWheel::schedule(Timer &timer, Clock::time_point deadline)
+    {
+        if (timer.wheel_ == this)
+        {
+            unlink(timer);
+        }
+        else
+        {
+            if (timer.wheel_)
+            {
+                timer.wheel_->cancel(timer);
+            }
+            timer.wheel_ = this;
+            ++size_;
+        }
+        // Rounded up, so a timer never fires before its deadline
+        auto offset = std::chrono::ceil<std::chrono::milliseconds>(std::max(deadline - start_, Clock::duration::zero()));
+        timer.expiry_ = static_cast<uint64_t>((offset.count() + tick_.count() - 1) / tick_.count());
+        link(timer);
+    }
+
+    void TimerWheel::cancel(Timer &timer)
+    {
+        if (timer.wheel_ != this)
+        {
+            return;
+        }
+        unlink(timer);
+        timer.wheel_ = nullptr;
+        --size_;
+    }
+
+    void TimerWheel::link(Timer &timer)
+    {
+        // Past deadlines expire on the next tick processed
+        timer.expiry_ = std::max(timer.expiry_, current_);
+        uint64_t delta = timer.expiry_ - current_;
+        if (delta >= RANGE)
+        {
+            delta = RANGE - 1;
+            timer.expiry_ = current_ + delta;
+        }
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1))))
+        {
+            ++level;
+        }
+        Timer *&head = slots_[level][(timer.expiry_ >> (LEVEL_BITS * level)) & SLOT_MASK];
+        timer.next_ = head;
+        if (head)
+        {
+            head->link_ = &timer.next_;
+        }
+        head = &timer;
+        timer.link_ = &head;
+    }
+
+    void TimerWheel::unlink(Timer &timer)
+    {
+        *timer.link_ = timer.next_;
+        if (timer.next_)
+        {
+            timer.next_->link_ = timer.link_;
+        }
+        timer.next_ = nullptr;
+        timer.link_ = nullptr;
+    }
+
+    void TimerWheel::cascade(int level)
+    {
+        // Timers of this slot are due within the next turn of the finer wheel
+        Timer *moving = slots_[level][(current_ >> (LEVEL_BITS * level)) & SLOT_MASK];
+        slots_[level][(current_ >> (LEVEL_BITS * level)) & SLOT_MASK] = nullptr;
+        if (moving)
+        {
+            moving->link_ = &moving;
+        }
+        while (moving)
+        {
+            Timer &timer = *moving;
+            unlink(timer);
+            link(timer);
+        }
+    }
+
+    void TimerWheel::advance(Clock::time_point now, const std::function<void(Timer &)> &expired)
+    {
+        if (now < start_)
+        {
+            return;
+        }
+        uint64_t target = static_cast<uint64_t>((now - start_) / tick_);
+        if (size_ == 0)
+        {
+            current_ = std::max(current_, target + 1); // Nothing to cascade or expire
+            return;
+        }
+        while (current_ <= target)
+        {
+            size_t index = current_ & SLOT_MASK;
+            if (index == 0)
+            {
+                for (int level = 1; level < LEVELS; ++level)
+                {
+                    cascade(level);
+                    if (((current_ >> (LEVEL_BITS * level)) & SLOT_MASK) != 0)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            Timer *due = slots_[0][index];
+            slots_[0][index] = nullptr;
+            if (due)
+            {
+                due->link_ = &due;
+            }
+            // Advanced first, so a timer the callback schedules in the past lands
+            // in the next tick rather than in the slot being emptied
+            ++current_;
+            while (due)
+            {
+                Timer &timer = *due;
+                unlink(timer);
+                timer.wheel_ = nullptr;
+                --size_;
+                expired(timer);
+            }
+        }
+    }
+
+    int TimerWheel::pollTimeout(Clock::time_point now) const
+    {
+        if (size_ == 0)
+        {
+            return -1;
+        }
+        // The first occupied slot before the next cascade, or else the cascade itself
+        uint64_t next = (current_ | SLOT_MASK) + 1;
+        for (uint64_t tick = current_; tick < next; ++tick)
+        {
+            if (slots_[0][tick & SLOT_MASK])
+            {
+                next = tick;
+                break;
+            }
+        }
+        // Signed, so a tick already overdue waits for nothing rather than wrapping around
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(start_ + static_cast<int64_t>(next) * tick_ - now);
+        return static_cast<int>(std::clamp<int64_t>(wait.count(), 0, std::numeric_limits<int>::max()));
+    }
+
+}
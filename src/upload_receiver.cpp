@@ -0,0 +1,379 @@
+#include "upload_receiver.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include <filesystem>
+#include <condition_variable>
+#include <fstream>
+#include <random>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr std::string_view TEMPORARY_PREFIX = ".upload-";
+        constexpr std::string_view TEMPORARY_SUFFIX = ".part";
+
+        std::string temporaryName()
+        {
+            thread_local std::mt19937_64 generator{std::random_device{}()};
+            static const char HEX[] = "0123456789abcdef";
+            std::string name(TEMPORARY_PREFIX);
+            uint64_t value = generator();
+            for (int i = 0; i < 16; ++i)
+            {
+                name += HEX[(value >> (i * 4)) & 0xF];
+            }
+            return name.append(TEMPORARY_SUFFIX);
+        }
+    }
+
+    struct UploadReceiver::Part
+    {
+        File file;
+        std::ofstream stream;
+        std::string pending;  // Received data not yet handed to the stream
+        bool writing = false; // A writer owns the stream and drains `pending`
+        bool ended = false;   // No more data follows; the stream is closed once written
+    };
+
+    struct UploadReceiver::State
+    {
+        // Guards everything below and the write queues of the parts
+        std::mutex mutex;
+        std::condition_variable written;
+        std::vector<std::unique_ptr<Part>> parts;
+        size_t pending_bytes = 0;
+        size_t active_writers = 0;
+        bool ending = false;    // The whole body was received
+        bool settled = false;   // ... and every file written or marked as failed
+        bool waiting = false;   // The loop saw busy() and waits for `wake`
+        bool abandoned = false; // The receiver is gone; the last writer removes its files
+        std::function<void()> wake;
+    };
+
+    UploadReceiver::UploadReceiver(const std::string &boundary, const std::string &directory, ThreadPool *writers)
+        : directory_(directory),
+          parser_(std::make_unique<MultipartParser>(boundary, static_cast<MultipartParser::Handler &>(*this))),
+          writers_(writers), state_(std::make_shared<State>())
+    {
+    }
+
+    std::unique_ptr<UploadReceiver> UploadReceiver::rejected(const std::string &status, const std::string &message)
+    {
+        std::unique_ptr<UploadReceiver> receiver(new UploadReceiver());
+        receiver->status_ = status;
+        receiver->message_ = message;
+        return receiver;
+    }
+
+    UploadReceiver::~UploadReceiver()
+    {
+        if (!state_)
+        {
+            return;
+        }
+        // Never waits: writers still busy with a file leave the cleanup to the last of them
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->abandoned = true;
+        if (state_->active_writers == 0)
+        {
+            lock.unlock();
+            removeFiles(*state_);
+        }
+    }
+
+    void UploadReceiver::removeFiles(State &state)
+    {
+        for (auto &part : state.parts)
+        {
+            if (part->stream.is_open())
+            {
+                part->stream.close();
+            }
+            if (!part->file.temp_path.empty())
+            {
+                std::error_code ec;
+                std::filesystem::remove(part->file.temp_path, ec);
+            }
+        }
+    }
+
+    bool UploadReceiver::validFilename(std::string_view filename)
+    {
+        return !filename.empty() && filename.find("..") == std::string_view::npos &&
+               filename.find('/') == std::string_view::npos && filename.find('\\') == std::string_view::npos;
+    }
+
+    bool UploadReceiver::temporaryFilename(std::string_view filename)
+    {
+        return filename.starts_with(TEMPORARY_PREFIX) && filename.ends_with(TEMPORARY_SUFFIX);
+    }
+
+    size_t UploadReceiver::fileCount() const
+    {
+        return state_ ? state_->parts.size() : 0;
+    }
+
+    UploadReceiver::File &UploadReceiver::file(size_t index)
+    {
+        return state_->parts[index]->file;
+    }
+
+    void UploadReceiver::fail(const std::string &status, const std::string &message)
+    {
+        // Temporary files are removed on destruction, once no writer uses them
+        if (status_.empty())
+        {
+            status_ = status;
+            message_ = message;
+        }
+    }
+
+    size_t UploadReceiver::write(std::string_view data, bool last)
+    {
+        if (!status_.empty())
+        {
+            return data.length(); // Already failed: drain the body so the connection stays in sync
+        }
+        size_t consumed = parser_->feed(data, last);
+        if (parser_->failed())
+        {
+            if (status_.empty())
+            {
+                LOG_DEBUG << "Failed to parse multipart/form-data body";
+            }
+            fail("400 Bad Request", "Failed to upload file");
+            return data.length();
+        }
+        if (last)
+        {
+            complete_ = !state_->parts.empty();
+            if (!complete_)
+            {
+                LOG_DEBUG << "No file part found in upload";
+                fail("400 Bad Request", "Failed to upload file");
+            }
+            finish();
+        }
+        return consumed;
+    }
+
+    bool UploadReceiver::busy()
+    {
+        if (!state_ || !wake)
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->wake)
+        {
+            state_->wake = wake;
+        }
+        state_->waiting = busyLocked(*state_);
+        return state_->waiting;
+    }
+
+    bool UploadReceiver::busyLocked(const State &state)
+    {
+        return state.ending ? !state.settled : state.pending_bytes >= MAX_PENDING_BYTES;
+    }
+
+    void UploadReceiver::schedule(Part &part, std::unique_lock<std::mutex> &lock)
+    {
+        if (part.writing)
+        {
+            return; // The writer picks the new data up before it lets go of the part
+        }
+        part.writing = true;
+        ++state_->active_writers;
+        if (writers_)
+        {
+            // Queued however busy the pool is: each part has at most one task
+            // queued, and pending_bytes bounds the data behind them
+            writers_->submit([state = state_, &part]
+                             { drain(state, part); });
+            return;
+        }
+        lock.unlock();
+        drain(state_, part);
+        lock.lock();
+    }
+
+    void UploadReceiver::drain(const std::shared_ptr<State> &state, Part &part)
+    {
+        // The loop is woken (outside the lock) as soon as it may go on
+        auto takeWake = [&state]
+        {
+            std::function<void()> wake;
+            if (state->waiting && !busyLocked(*state))
+            {
+                state->waiting = false;
+                wake = state->wake;
+            }
+            return wake;
+        };
+
+        std::string chunk;
+        std::unique_lock<std::mutex> lock(state->mutex);
+        while (!part.pending.empty())
+        {
+            chunk.clear();
+            chunk.swap(part.pending);
+            lock.unlock();
+            part.stream.write(chunk.data(), static_cast<std::streamsize>(chunk.length()));
+            lock.lock();
+            state->pending_bytes -= chunk.length();
+            state->written.notify_all();
+            if (std::function<void()> wake = takeWake())
+            {
+                lock.unlock();
+                wake();
+                lock.lock();
+            }
+        }
+        if (part.ended)
+        {
+            part.stream.close();
+        }
+        part.writing = false;
+        --state->active_writers;
+        if (state->active_writers == 0 && state->abandoned)
+        {
+            lock.unlock();
+            removeFiles(*state);
+            return;
+        }
+        if (state->active_writers == 0 && state->ending)
+        {
+            settle(*state);
+        }
+        state->written.notify_all();
+        std::function<void()> wake = takeWake();
+        lock.unlock();
+        if (wake)
+        {
+            wake();
+        }
+    }
+
+    void UploadReceiver::finish()
+    {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->ending = true;
+        if (state_->active_writers == 0)
+        {
+            settle(*state_);
+        }
+        else if (!wake)
+        {
+            state_->written.wait(lock, [this]
+                                 { return state_->settled; });
+        }
+    }
+
+    void UploadReceiver::settle(State &state)
+    {
+        if (state.settled)
+        {
+            return;
+        }
+        state.settled = true;
+        for (auto &part : state.parts)
+        {
+            File &file = part->file;
+            if (file.error.empty() && (!part->ended || !part->stream))
+            {
+                LOG_ERROR << "Failed to write uploaded file: " << file.temp_path;
+                file.error = "Failed to write file";
+                std::error_code ec;
+                std::filesystem::remove(file.temp_path, ec);
+                file.temp_path.clear();
+            }
+        }
+    }
+
+    bool UploadReceiver::onPartBegin(std::string_view headers)
+    {
+        current_ = nullptr;
+        std::string filename = multipartFilename(headers);
+        if (filename.empty())
+        {
+            return true; // Not a file; its data is skipped
+        }
+        if (state_->parts.size() == MAX_FILES)
+        {
+            LOG_DEBUG << "Upload exceeds " << MAX_FILES << " files";
+            fail("413 Content Too Large", "Too many files");
+            return false;
+        }
+        LOG_DEBUG << "Extracted filename: " << filename;
+
+        auto part = std::make_unique<Part>();
+        part->file.filename = std::move(filename);
+        if (!validFilename(part->file.filename))
+        {
+            LOG_DEBUG << "Invalid filename: " << part->file.filename;
+            part->file.error = "Invalid filename";
+        }
+        else
+        {
+            part->file.temp_path = (std::filesystem::path(directory_) / temporaryName()).string();
+            part->stream.open(part->file.temp_path, std::ios::binary | std::ios::trunc);
+            if (!part->stream)
+            {
+                LOG_ERROR << "Failed to open file for writing: " << part->file.temp_path;
+                part->file.error = "Failed to create file";
+                part->file.temp_path.clear();
+            }
+            else
+            {
+                current_ = part.get();
+            }
+        }
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->parts.push_back(std::move(part));
+        return true;
+    }
+
+    bool UploadReceiver::onPartData(std::string_view data)
+    {
+        if (!current_)
+        {
+            return true;
+        }
+        current_->file.size += data.length();
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        // Back-pressure: a disk slower than the network holds up the receiving
+        // thread instead of buffering the body in memory. An event loop is held
+        // up through busy() instead, which stops it reading from the connection.
+        if (!wake)
+        {
+            state_->written.wait(lock, [this]
+                                 { return state_->pending_bytes < MAX_PENDING_BYTES; });
+        }
+        current_->pending.append(data);
+        state_->pending_bytes += data.length();
+        schedule(*current_, lock);
+        return true;
+    }
+
+    bool UploadReceiver::onPartEnd()
+    {
+        if (!current_)
+        {
+            return true;
+        }
+        Part &part = *current_;
+        current_ = nullptr;
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        part.ended = true;
+        if (!part.writing)
+        {
+            lock.unlock();
+            part.stream.close(); // Everything was written already
+        }
+        return true;
+    }
+
+}
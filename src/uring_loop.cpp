@@ -0,0 +1,774 @@
+#include "uring_loop.h"
+#include "logger.h"
+#include "metrics.h"
+#include <stdexcept>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace web_server
+{
+
+    namespace
+    {
+        constexpr unsigned RING_ENTRIES = 4096;
+        // Deadlines are checked on every tick of a repeating ring timeout
+        constexpr std::chrono::milliseconds DEADLINE_TICK{100};
+        constexpr size_t RECV_BUFFER_SIZE = 32768;
+        // File segments are read into user space in pieces of this size and sent
+        constexpr size_t FILE_CHUNK_SIZE = 64 * 1024;
+        // In-memory output segments gathered into one SENDMSG
+        constexpr size_t MAX_SEND_IOVECS = 16;
+        // Stop handling pipelined requests while this much output is still unsent
+        constexpr size_t MAX_PENDING_OUTPUT = 64 * 1024;
+        // Stop receiving while this much input is buffered and cannot be consumed
+        constexpr size_t READ_BATCH_SIZE = 256 * 1024;
+
+        // Completions carry the client id in the high bits and the operation in the low ones
+        enum class Op : uint64_t
+        {
+            Accept,
+            Sweep,
+            Recv,
+            Send,
+            FileRead,
+            Wake
+        };
+        constexpr int OP_BITS = 3;
+        constexpr uint64_t OP_MASK = (1u << OP_BITS) - 1;
+
+        uint64_t userData(uint64_t client_id, Op op)
+        {
+            return client_id << OP_BITS | static_cast<uint64_t>(op);
+        }
+
+        template <typename T>
+        std::atomic_ref<T> shared(T *value)
+        {
+            return std::atomic_ref<T>(*value);
+        }
+    }
+
+    // A submission/completion queue pair mapped from the kernel, driven with the
+    // raw system calls so no liburing dependency is needed.
+    class UringLoop::Ring
+    {
+    public:
+        explicit Ring(unsigned entries)
+        {
+            // Only the owning thread submits, so completion work can be deferred
+            // until it asks for events instead of interrupting it (Linux 6.1+)
+            io_uring_params params{};
+            params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd_ < 0 && errno == EINVAL)
+            {
+                params = {};
+                fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            }
+            if (fd_ < 0)
+            {
+                throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+            }
+            sq_entries_ = params.sq_entries;
+
+            sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap)
+            {
+                sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+            }
+            sq_map_ = map(sq_size_, IORING_OFF_SQ_RING);
+            cq_map_ = single_mmap ? sq_map_ : map(cq_size_, IORING_OFF_CQ_RING);
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+
+            char *sq = static_cast<char *>(sq_map_);
+            sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            char *cq = static_cast<char *>(cq_map_);
+            cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            sq_local_tail_ = *sq_tail_;
+        }
+
+        ~Ring()
+        {
+            if (sqes_)
+            {
+                munmap(sqes_, sqes_size_);
+            }
+            if (cq_map_ && cq_map_ != sq_map_)
+            {
+                munmap(cq_map_, cq_size_);
+            }
+            if (sq_map_)
+            {
+                munmap(sq_map_, sq_size_);
+            }
+            close(fd_);
+        }
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+
+        bool supports(std::initializer_list<int> opcodes)
+        {
+            constexpr unsigned PROBE_OPS = 256;
+            std::vector<char> buffer(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op));
+            auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+            if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0)
+            {
+                return false;
+            }
+            for (int opcode : opcodes)
+            {
+                if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Returns a cleared submission entry; queued entries are handed to the
+        // kernel first when the queue is full.
+        io_uring_sqe *next()
+        {
+            if (sq_local_tail_ - shared(sq_head_).load(std::memory_order_acquire) >= sq_entries_)
+            {
+                enter(0);
+                if (sq_local_tail_ - shared(sq_head_).load(std::memory_order_acquire) >= sq_entries_)
+                {
+                    throw std::runtime_error("io_uring submission queue is full");
+                }
+            }
+            unsigned index = sq_local_tail_ & sq_mask_;
+            io_uring_sqe *sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array_[index] = index;
+            ++sq_local_tail_;
+            return sqe;
+        }
+
+        // Submits everything queued and sleeps until at least one completion is ready
+        void submitAndWait()
+        {
+            enter(1);
+        }
+
+        // Hands every ready completion to `consume(user_data, result)`. Completions
+        // are copied out first so handlers may queue new submissions.
+        template <typename Consumer>
+        void reap(Consumer &&consume)
+        {
+            unsigned head = *cq_head_;
+            unsigned tail = shared(cq_tail_).load(std::memory_order_acquire);
+            completions_.clear();
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                completions_.push_back({cqe.user_data, cqe.res});
+            }
+            shared(cq_head_).store(head, std::memory_order_release);
+            for (const Completion &completion : completions_)
+            {
+                consume(completion.user_data, completion.result);
+            }
+        }
+
+    private:
+        struct Completion
+        {
+            uint64_t user_data;
+            int result;
+        };
+
+        int fd_ = -1;
+        void *sq_map_ = nullptr;
+        void *cq_map_ = nullptr;
+        size_t sq_size_ = 0;
+        size_t cq_size_ = 0;
+        size_t sqes_size_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        unsigned sq_entries_ = 0;
+        unsigned *sq_head_ = nullptr;
+        unsigned *sq_tail_ = nullptr;
+        unsigned *sq_array_ = nullptr;
+        unsigned sq_mask_ = 0;
+        unsigned sq_local_tail_ = 0; // Entries prepared but not yet published to the kernel
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        unsigned cq_mask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+        std::vector<Completion> completions_;
+
+        void *map(size_t length, off_t offset)
+        {
+            void *address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+            if (address == MAP_FAILED)
+            {
+                throw std::runtime_error("Failed to map io_uring queues");
+            }
+            return address;
+        }
+
+        void enter(unsigned min_complete)
+        {
+            shared(sq_tail_).store(sq_local_tail_, std::memory_order_release);
+            while (true)
+            {
+                unsigned to_submit = sq_local_tail_ - shared(sq_head_).load(std::memory_order_acquire);
+                long result = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                                      min_complete ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+                if (result >= 0)
+                {
+                    return;
+                }
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY)
+                {
+                    return; // Completions must be reaped before more can be submitted
+                }
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+        }
+    };
+
+    struct UringLoop::Client
+    {
+        Client(uint64_t id, socket_t socket, const ConnectionLimits &limits) : id(id), conn(socket, limits)
+        {
+            conn.timer.id = id;
+        }
+
+        uint64_t id;
+        Connection conn;
+        char recv_buffer[RECV_BUFFER_SIZE];
+        // Describe the in-memory segments of the send in flight
+        iovec send_iov[MAX_SEND_IOVECS];
+        msghdr send_message{};
+        // The piece of the front file segment currently being sent
+        std::string file_chunk;
+        size_t file_chunk_sent = 0;
+        int ops_in_flight = 0; // The client is freed only once this drops to zero
+        bool send_armed = false; // A send or a file read for the front output segment
+        bool peer_closed = false;
+        bool closing = false;
+    };
+
+    bool UringLoop::supported()
+    {
+        static const bool available = []
+        {
+            try
+            {
+                Ring ring(8);
+                return ring.supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SENDMSG,
+                                      IORING_OP_READ, IORING_OP_TIMEOUT});
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+        }();
+        return available;
+    }
+
+    UringLoop::UringLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                         const ConnectionLimits &limits)
+        : listen_socket_(listen_socket), ring_(std::make_unique<Ring>(RING_ENTRIES)), handler_(std::move(handler)),
+          headers_handler_(std::move(headers_handler)), limits_(limits), timers_(DEADLINE_TICK)
+    {
+        wake_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (wake_fd_ == -1)
+        {
+            throw std::runtime_error("Failed to create wake eventfd");
+        }
+    }
+
+    UringLoop::~UringLoop()
+    {
+        for (auto &[id, client] : clients_)
+        {
+            CLOSE_SOCKET(client->conn.socket);
+        }
+        // Closed after the ring, which may still have a read of it armed
+        ring_.reset();
+        close(wake_fd_);
+    }
+
+    void UringLoop::run()
+    {
+        armAccept();
+        armSweep();
+        armWake();
+        while (true)
+        {
+            // One system call submits everything queued by the previous batch of
+            // completions and waits for the next
+            ring_->submitAndWait();
+            ring_->reap([this](uint64_t user_data, int result)
+                        { dispatch(user_data, result); });
+        }
+    }
+
+    void UringLoop::dispatch(uint64_t user_data, int result)
+    {
+        auto op = static_cast<Op>(user_data & OP_MASK);
+        if (op == Op::Accept)
+        {
+            onAccept(result);
+            return;
+        }
+        if (op == Op::Sweep)
+        {
+            timers_.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer &timer)
+                            { onDeadline(timer); });
+            armSweep();
+            return;
+        }
+        if (op == Op::Wake)
+        {
+            onWake();
+            armWake();
+            return;
+        }
+
+        auto it = clients_.find(user_data >> OP_BITS);
+        if (it == clients_.end())
+        {
+            return;
+        }
+        Client &client = *it->second;
+        --client.ops_in_flight;
+        if (op != Op::Recv)
+        {
+            client.send_armed = false;
+        }
+        if (!client.closing)
+        {
+            switch (op)
+            {
+            case Op::Recv:
+                onRecv(client, result);
+                break;
+            case Op::Send:
+                onSend(client, result);
+                break;
+            case Op::FileRead:
+                onFileRead(client, result);
+                break;
+            default:
+                break;
+            }
+        }
+        if (!client.closing)
+        {
+            std::chrono::steady_clock::time_point when;
+            client.conn.deadline(when);
+            timers_.schedule(client.conn.timer, when);
+        }
+        if (client.closing && client.ops_in_flight == 0)
+        {
+            CLOSE_SOCKET(client.conn.socket);
+            clients_.erase(it);
+        }
+    }
+
+    void UringLoop::armAccept()
+    {
+        io_uring_sqe *sqe = ring_->next();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_socket_;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData(0, Op::Accept);
+    }
+
+    void UringLoop::armSweep()
+    {
+        static const __kernel_timespec interval{0, std::chrono::nanoseconds(DEADLINE_TICK).count()};
+        io_uring_sqe *sqe = ring_->next();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(&interval);
+        sqe->len = 1;
+        sqe->user_data = userData(0, Op::Sweep);
+    }
+
+    void UringLoop::armWake()
+    {
+        io_uring_sqe *sqe = ring_->next();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wake_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_count_);
+        sqe->len = sizeof(wake_count_);
+        sqe->user_data = userData(0, Op::Wake);
+    }
+
+    void UringLoop::onWake()
+    {
+        std::vector<uint64_t> woken;
+        {
+            std::lock_guard<std::mutex> lock(woken_mutex_);
+            woken.swap(woken_);
+        }
+        for (uint64_t id : woken)
+        {
+            auto it = clients_.find(id);
+            if (it == clients_.end() || it->second->closing)
+            {
+                continue;
+            }
+            Client &client = *it->second;
+            Connection &conn = client.conn;
+            if (conn.state == Connection::State::ReadingRequest)
+            {
+                processRequests(client);
+            }
+            if (client.closing)
+            {
+                if (client.ops_in_flight == 0)
+                {
+                    CLOSE_SOCKET(conn.socket);
+                    clients_.erase(it);
+                }
+                continue;
+            }
+            // Receiving was paused on a busy body sink that may now take more
+            if (conn.read_paused && conn.in.length() < READ_BATCH_SIZE && conn.pendingOutput() == 0)
+            {
+                conn.read_paused = false;
+                armRecv(client);
+            }
+            std::chrono::steady_clock::time_point when;
+            conn.deadline(when);
+            timers_.schedule(conn.timer, when);
+        }
+    }
+
+    void UringLoop::armRecv(Client &client)
+    {
+        io_uring_sqe *sqe = ring_->next();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = client.conn.socket;
+        sqe->addr = reinterpret_cast<uint64_t>(client.recv_buffer);
+        sqe->len = sizeof(client.recv_buffer);
+        sqe->user_data = userData(client.id, Op::Recv);
+        ++client.ops_in_flight;
+    }
+
+    void UringLoop::onAccept(int result)
+    {
+        armAccept();
+        if (result < 0)
+        {
+            if (result != -EINTR && result != -EAGAIN && result != -ECONNABORTED)
+            {
+                LOG_WARN << "Failed to accept connection: " << std::strerror(-result);
+            }
+            return;
+        }
+        uint64_t id = next_client_id_++;
+        auto client = std::make_unique<Client>(id, result, limits_);
+        client->conn.on_headers = headers_handler_;
+        client->conn.wake = [this, id]
+        {
+            {
+                std::lock_guard<std::mutex> lock(woken_mutex_);
+                woken_.push_back(id);
+            }
+            uint64_t one = 1;
+            if (write(wake_fd_, &one, sizeof(one)) < 0)
+            {
+                // Only fails once the counter is saturated, when a read is pending anyway
+            }
+        };
+        Client &added = *client;
+        clients_.emplace(id, std::move(client));
+        armRecv(added);
+        std::chrono::steady_clock::time_point when;
+        added.conn.deadline(when);
+        timers_.schedule(added.conn.timer, when);
+    }
+
+    void UringLoop::onRecv(Client &client, int result)
+    {
+        Connection &conn = client.conn;
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            armRecv(client);
+            return;
+        }
+        if (result < 0)
+        {
+            closeClient(client);
+            return;
+        }
+        if (result == 0)
+        {
+            client.peer_closed = true;
+        }
+        else
+        {
+            conn.receive(client.recv_buffer, static_cast<size_t>(result));
+        }
+
+        processRequests(client);
+        if (client.closing)
+        {
+            return;
+        }
+        if (client.peer_closed)
+        {
+            // The client will send nothing more: finish any pending output, then close
+            conn.close_after_write = true;
+            if (conn.pendingOutput() == 0)
+            {
+                closeClient(client);
+            }
+            return;
+        }
+        if (conn.in.length() >= READ_BATCH_SIZE)
+        {
+            // Nothing more can be consumed until the client reads our output;
+            // resume receiving from onSend() once it has drained.
+            conn.read_paused = true;
+            return;
+        }
+        armRecv(client);
+    }
+
+    void UringLoop::processRequests(Client &client)
+    {
+        // Serve every complete (possibly pipelined) request already buffered,
+        // pausing while the client is slow to drain earlier responses or a
+        // streamed body has not been produced in full.
+        Connection &conn = client.conn;
+        while (!conn.close_after_write && !conn.streaming() && conn.pendingOutput() < MAX_PENDING_OUTPUT &&
+               conn.requestComplete())
+        {
+            handler_(conn);
+            conn.consumeRequest();
+        }
+        if (conn.pendingOutput() > 0)
+        {
+            conn.state = Connection::State::WritingResponse;
+            startSend(client);
+        }
+        else if (conn.close_after_write)
+        {
+            closeClient(client);
+        }
+    }
+
+    void UringLoop::startSend(Client &client)
+    {
+        Connection &conn = client.conn;
+        if (client.send_armed || conn.out.empty())
+        {
+            return;
+        }
+        OutputSegment &segment = conn.out.front();
+        io_uring_sqe *sqe = ring_->next();
+        sqe->fd = conn.socket;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData(client.id, Op::Send);
+        if (!segment.isFile())
+        {
+            // Headers and the bodies queued behind them go out in one gathered send,
+            // held back with MSG_MORE when a file follows
+            bool more = false;
+            client.send_message = {};
+            client.send_message.msg_iov = client.send_iov;
+            client.send_message.msg_iovlen = conn.gatherOutput(client.send_iov, MAX_SEND_IOVECS, false, more);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(&client.send_message);
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+        }
+        else if (client.file_chunk_sent < client.file_chunk.length())
+        {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = reinterpret_cast<uint64_t>(client.file_chunk.data() + client.file_chunk_sent);
+            sqe->len = static_cast<uint32_t>(client.file_chunk.length() - client.file_chunk_sent);
+        }
+        else
+        {
+            // Read the next piece of the file; onFileRead() sends it
+            client.file_chunk.resize(std::min(segment.file_remaining, FILE_CHUNK_SIZE));
+            client.file_chunk_sent = 0;
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = segment.file_fd;
+            sqe->msg_flags = 0;
+            sqe->addr = reinterpret_cast<uint64_t>(client.file_chunk.data());
+            sqe->len = static_cast<uint32_t>(client.file_chunk.length());
+            sqe->off = static_cast<uint64_t>(segment.file_offset);
+            sqe->user_data = userData(client.id, Op::FileRead);
+        }
+        ++client.ops_in_flight;
+        client.send_armed = true;
+    }
+
+    void UringLoop::onFileRead(Client &client, int result)
+    {
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            client.file_chunk.clear();
+            startSend(client);
+            return;
+        }
+        if (result <= 0)
+        {
+            // The file failed or shrank after the headers announced its length
+            LOG_WARN << "Failed to read response file: " << (result < 0 ? std::strerror(-result) : "unexpected end of file");
+            closeClient(client);
+            return;
+        }
+        client.file_chunk.resize(static_cast<size_t>(result));
+        startSend(client);
+    }
+
+    void UringLoop::onSend(Client &client, int result)
+    {
+        Connection &conn = client.conn;
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            startSend(client);
+            return;
+        }
+        if (result < 0)
+        {
+            closeClient(client);
+            return;
+        }
+
+        bool from_file = conn.out.front().isFile();
+        conn.consumeOutput(static_cast<size_t>(result));
+        if (from_file)
+        {
+            client.file_chunk_sent += static_cast<size_t>(result);
+            if (client.file_chunk_sent == client.file_chunk.length())
+            {
+                client.file_chunk.clear();
+                client.file_chunk_sent = 0;
+            }
+        }
+        if (conn.pendingOutput() > 0)
+        {
+            startSend(client);
+            return;
+        }
+
+        conn.state = Connection::State::ReadingRequest;
+        processRequests(client);
+        if (client.closing || conn.pendingOutput() > 0)
+        {
+            return;
+        }
+        if (client.peer_closed)
+        {
+            closeClient(client);
+        }
+        else if (conn.read_paused && conn.in.length() < READ_BATCH_SIZE)
+        {
+            conn.read_paused = false;
+            armRecv(client);
+        }
+    }
+
+    void UringLoop::closeClient(Client &client)
+    {
+        if (client.closing)
+        {
+            return;
+        }
+        // Operations still in flight complete with an error or end of stream once
+        // the socket is shut down; the client is freed after the last of them.
+        client.closing = true;
+        client.conn.state = Connection::State::Closed;
+        timers_.cancel(client.conn.timer);
+        shutdown(client.conn.socket, SHUT_RDWR);
+    }
+
+    void UringLoop::onDeadline(TimerWheel::Timer &timer)
+    {
+        auto it = clients_.find(timer.id);
+        if (it == clients_.end())
+        {
+            return;
+        }
+        Client &client = *it->second;
+        std::chrono::steady_clock::time_point when;
+        metrics::Deadline deadline = client.conn.deadline(when);
+        if (std::chrono::steady_clock::now() < when)
+        {
+            timers_.schedule(client.conn.timer, when);
+            return;
+        }
+        if (deadline != metrics::Deadline::Idle)
+        {
+            LOG_DEBUG << "Closing connection: " << metrics::deadlineName(deadline) << " deadline passed";
+        }
+        metrics::connectionTimedOut(deadline);
+        closeClient(client);
+        if (client.ops_in_flight == 0)
+        {
+            CLOSE_SOCKET(client.conn.socket);
+            clients_.erase(it);
+        }
+    }
+
+}
+
+#else
+
+namespace web_server
+{
+
+    class UringLoop::Ring
+    {
+    };
+
+    struct UringLoop::Client
+    {
+    };
+
+    bool UringLoop::supported()
+    {
+        return false;
+    }
+
+    UringLoop::UringLoop(socket_t listen_socket, RequestHandler handler, RequestHandler headers_handler,
+                         const ConnectionLimits &limits)
+        : listen_socket_(listen_socket), handler_(std::move(handler)), headers_handler_(std::move(headers_handler)),
+          limits_(limits), timers_(std::chrono::milliseconds(100))
+    {
+        throw std::runtime_error("The io_uring I/O mode is only available on Linux");
+    }
+
+    UringLoop::~UringLoop() {}
+
+    void UringLoop::run() {}
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "test.h"
+#include "byte_range.h"
+#include <string>
+
+// Range and If-Range headers (RFC 9110 14.2, 13.1.5): which bytes a request
+// selects, and which requests fall back to the whole representation
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        // The selection as "offset+length" pairs, or "full" or "unsatisfiable"
+        std::string describe(RangeSelection selection, const ByteRanges &ranges)
+        {
+            if (selection == RangeSelection::Full)
+            {
+                return ranges.empty() ? "full" : "full with ranges";
+            }
+            if (selection == RangeSelection::Unsatisfiable)
+            {
+                return ranges.empty() ? "unsatisfiable" : "unsatisfiable with ranges";
+            }
+            std::string text;
+            for (const ByteRange &range : ranges)
+            {
+                text.append(text.empty() ? "" : ",")
+                    .append(std::to_string(range.offset))
+                    .append("+")
+                    .append(std::to_string(range.length));
+            }
+            return text;
+        }
+
+        std::string select(std::string_view value, uint64_t size)
+        {
+            ByteRanges ranges;
+            RangeSelection selection = parseRange(value, size, ranges);
+            return describe(selection, ranges);
+        }
+
+        // The ranges a GET with `headers` selects from a 1000 byte file with `validators`
+        std::string selectFor(const std::string &headers, const FileValidators &validators,
+                              std::string_view method = "GET")
+        {
+            std::string head = std::string(method) + " /file HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n";
+            RequestParser parser;
+            HttpRequest request;
+            if (parser.parse(head, request) != RequestParser::Result::Complete)
+            {
+                return "<parse error>";
+            }
+            ByteRanges ranges;
+            RangeSelection selection = selectRanges(request, 1000, validators, ranges);
+            return describe(selection, ranges);
+        }
+
+        FileValidators validators()
+        {
+            FileValidators result;
+            result.etag = "\"1a-2b-3e8\"";
+            result.mtime = 1700000000;
+            result.last_modified = formatHttpDate(result.mtime);
+            return result;
+        }
+    }
+
+    TEST_CASE(byte_range, single_ranges)
+    {
+        CHECK_EQ(select("bytes=0-99", 1000), "0+100");
+        CHECK_EQ(select("bytes=500-", 1000), "500+500");
+        CHECK_EQ(select("bytes=-100", 1000), "900+100");
+        CHECK_EQ(select("bytes=999-999", 1000), "999+1");
+        CHECK_EQ(select("  Bytes=10-19 ", 1000), "10+10");
+    }
+
+    TEST_CASE(byte_range, clamped_to_size)
+    {
+        CHECK_EQ(select("bytes=900-2000", 1000), "900+100");
+        CHECK_EQ(select("bytes=-5000", 1000), "0+1000");
+        CHECK_EQ(select("bytes=0-18446744073709551615", 1000), "full"); // 20 digits are not a number here
+        CHECK_EQ(select("bytes=0-9999999999999999999", 1000), "0+1000");
+    }
+
+    TEST_CASE(byte_range, unsatisfiable)
+    {
+        CHECK_EQ(select("bytes=1000-", 1000), "unsatisfiable");
+        CHECK_EQ(select("bytes=5000-6000", 1000), "unsatisfiable");
+        CHECK_EQ(select("bytes=-0", 1000), "unsatisfiable");
+        CHECK_EQ(select("bytes=0-", 0), "unsatisfiable");
+        CHECK_EQ(select("bytes=-10", 0), "unsatisfiable");
+        // One satisfiable range is enough
+        CHECK_EQ(select("bytes=5000-6000, 0-0", 1000), "0+1");
+    }
+
+    TEST_CASE(byte_range, malformed_selects_everything)
+    {
+        CHECK_EQ(select("", 1000), "full");
+        CHECK_EQ(select("items=0-10", 1000), "full");
+        CHECK_EQ(select("bytes=", 1000), "full");
+        CHECK_EQ(select("bytes=,,", 1000), "full");
+        CHECK_EQ(select("bytes=10", 1000), "full");
+        CHECK_EQ(select("bytes=20-10", 1000), "full");
+        CHECK_EQ(select("bytes=a-b", 1000), "full");
+        CHECK_EQ(select("bytes=-", 1000), "full");
+        CHECK_EQ(select("bytes=+1-2", 1000), "full");
+        CHECK_EQ(select("bytes=0-10, x", 1000), "full");
+    }
+
+    TEST_CASE(byte_range, multiple_ranges_are_sorted_and_coalesced)
+    {
+        CHECK_EQ(select("bytes=500-599, 0-99", 1000), "0+100,500+100");
+        CHECK_EQ(select("bytes=0-99, 50-149", 1000), "0+150");  // Overlapping
+        CHECK_EQ(select("bytes=0-99, 100-199", 1000), "0+200"); // Adjacent
+        CHECK_EQ(select("bytes=10-20, 0-500, 400-450", 1000), "0+501");
+        CHECK_EQ(select("bytes=0-0, -1", 1000), "0+1,999+1");
+        CHECK_EQ(select("bytes=, 0-1,, 5-6 ,", 1000), "0+2,5+2");
+    }
+
+    TEST_CASE(byte_range, too_many_ranges)
+    {
+        std::string value = "bytes=";
+        for (size_t i = 0; i < MAX_BYTE_RANGES; ++i)
+        {
+            value.append(std::to_string(i * 10)).append("-").append(std::to_string(i * 10)).append(",");
+        }
+        CHECK_EQ(select(value, 1000).find("full"), std::string::npos);
+        value.append("999-999");
+        CHECK_EQ(select(value, 1000), "full");
+
+        // Ranges that coalesce count once
+        std::string overlapping = "bytes=";
+        for (size_t i = 0; i < 100; ++i)
+        {
+            overlapping.append(std::to_string(i)).append("-").append(std::to_string(i + 10)).append(",");
+        }
+        CHECK_EQ(select(overlapping, 1000), "0+110");
+    }
+
+    TEST_CASE(byte_range, if_range)
+    {
+        FileValidators current = validators();
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\n", current), "0+10");
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: \"1a-2b-3e8\"\r\n", current), "0+10");
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: " + current.last_modified + "\r\n", current), "0+10");
+        // A changed representation is sent whole
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: \"other\"\r\n", current), "full");
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: " + formatHttpDate(current.mtime + 1) + "\r\n", current),
+                 "full");
+        // Weak tags never match, and a date must be a valid one
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: W/\"1a-2b-3e8\"\r\n", current), "full");
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\nIf-Range: yesterday\r\n", current), "full");
+    }
+
+    TEST_CASE(byte_range, only_for_get)
+    {
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\n", validators(), "HEAD"), "full");
+        CHECK_EQ(selectFor("Range: bytes=0-9\r\n", validators(), "POST"), "full");
+        CHECK_EQ(selectFor("", validators()), "full");
+    }
+
+}
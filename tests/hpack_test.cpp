@@ -0,0 +1,314 @@
+#include "test.h"
+#include "hpack.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// HPACK decoding of untrusted header blocks (RFC 7541): the Appendix C
+// examples, and the malformed input a peer may send instead
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        constexpr size_t NO_LIST_LIMIT = 1 << 20;
+
+        // Hex digits with optional spaces, as the RFC prints its examples
+        std::string fromHex(std::string_view hex)
+        {
+            auto digit = [](char c) { return c <= '9' ? c - '0' : c - 'a' + 10; };
+            std::string bytes;
+            int high = -1;
+            for (char c : hex)
+            {
+                if (c == ' ')
+                {
+                    continue;
+                }
+                if (high < 0)
+                {
+                    high = digit(c);
+                }
+                else
+                {
+                    bytes += static_cast<char>(high << 4 | digit(c));
+                    high = -1;
+                }
+            }
+            return bytes;
+        }
+
+        using Fields = std::vector<std::pair<std::string, std::string>>;
+
+        Fields decoded(HpackDecoder &decoder, std::string_view hex)
+        {
+            std::vector<HeaderField> fields;
+            if (!decoder.decode(fromHex(hex), fields, NO_LIST_LIMIT))
+            {
+                return {{"<error>", ""}};
+            }
+            Fields result;
+            for (auto &field : fields)
+            {
+                result.emplace_back(field.name, field.value);
+            }
+            return result;
+        }
+
+        Fields single(std::string name, std::string value)
+        {
+            return {{std::move(name), std::move(value)}};
+        }
+
+        bool rejects(HpackDecoder &decoder, const std::string &block)
+        {
+            std::vector<HeaderField> fields;
+            return !decoder.decode(block, fields, NO_LIST_LIMIT);
+        }
+
+        const Fields FIRST_REQUEST = {
+            {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}};
+        const Fields SECOND_REQUEST = {{":method", "GET"},
+                                       {":scheme", "http"},
+                                       {":path", "/"},
+                                       {":authority", "www.example.com"},
+                                       {"cache-control", "no-cache"}};
+        const Fields THIRD_REQUEST = {{":method", "GET"},
+                                      {":scheme", "https"},
+                                      {":path", "/index.html"},
+                                      {":authority", "www.example.com"},
+                                      {"custom-key", "custom-value"}};
+
+        const Fields FIRST_RESPONSE = {{":status", "302"},
+                                       {"cache-control", "private"},
+                                       {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                                       {"location", "https://www.example.com"}};
+        const Fields SECOND_RESPONSE = {{":status", "307"},
+                                        {"cache-control", "private"},
+                                        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                                        {"location", "https://www.example.com"}};
+        const Fields THIRD_RESPONSE = {{":status", "200"},
+                                       {"cache-control", "private"},
+                                       {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+                                       {"location", "https://www.example.com"},
+                                       {"content-encoding", "gzip"},
+                                       {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+    }
+
+    TEST_CASE(hpack, literal_with_indexing)
+    {
+        // C.2.1, then the new entry referenced as index 62
+        HpackDecoder decoder;
+        CHECK(decoded(decoder, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572") ==
+              single("custom-key", "custom-header"));
+        CHECK(decoded(decoder, "be") == single("custom-key", "custom-header"));
+    }
+
+    TEST_CASE(hpack, literal_without_indexing)
+    {
+        // C.2.2 and C.2.3 leave the dynamic table empty
+        HpackDecoder decoder;
+        CHECK(decoded(decoder, "040c 2f73 616d 706c 652f 7061 7468") == single(":path", "/sample/path"));
+        CHECK(decoded(decoder, "1008 7061 7373 776f 7264 0673 6563 7265 74") == single("password", "secret"));
+        CHECK(rejects(decoder, fromHex("be")));
+    }
+
+    TEST_CASE(hpack, requests_without_huffman)
+    {
+        // C.3: one decoder, so later requests index the fields of earlier ones
+        HpackDecoder decoder;
+        CHECK(decoded(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d") == FIRST_REQUEST);
+        CHECK(decoded(decoder, "8286 84be 5808 6e6f 2d63 6163 6865") == SECOND_REQUEST);
+        CHECK(decoded(decoder, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65") ==
+              THIRD_REQUEST);
+    }
+
+    TEST_CASE(hpack, requests_with_huffman)
+    {
+        // C.4
+        HpackDecoder decoder;
+        CHECK(decoded(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff") == FIRST_REQUEST);
+        CHECK(decoded(decoder, "8286 84be 5886 a8eb 1064 9cbf") == SECOND_REQUEST);
+        CHECK(decoded(decoder, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf") == THIRD_REQUEST);
+    }
+
+    TEST_CASE(hpack, responses_with_eviction)
+    {
+        // C.5: a 256 byte table, so every response evicts the oldest entries
+        HpackDecoder decoder(256);
+        CHECK(decoded(decoder, "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 "
+                               "2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 "
+                               "6c65 2e63 6f6d") == FIRST_RESPONSE);
+        CHECK(decoded(decoder, "4803 3330 37c1 c0bf") == SECOND_RESPONSE);
+        // ":status: 302" made room for ":status: 307", so the table holds four entries
+        CHECK(rejects(decoder, fromHex("c2")));
+        CHECK(decoded(decoder, "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d "
+                               "54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049 "
+                               "5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e "
+                               "3d31") == THIRD_RESPONSE);
+    }
+
+    TEST_CASE(hpack, responses_with_huffman)
+    {
+        // C.6
+        HpackDecoder decoder(256);
+        CHECK(decoded(decoder, "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 "
+                               "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3") == FIRST_RESPONSE);
+        CHECK(decoded(decoder, "4883 640e ffc1 c0bf") == SECOND_RESPONSE);
+        CHECK(decoded(decoder, "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab "
+                               "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f "
+                               "9587 3160 65c0 03ed 4ee5 b106 3d50 07") == THIRD_RESPONSE);
+    }
+
+    TEST_CASE(hpack, huffman_padding)
+    {
+        std::string out;
+        // 'a' is 00011; the rest of the byte must be the most significant bits of EOS
+        CHECK(huffmanDecode(fromHex("1f"), out));
+        CHECK_EQ(out, "a");
+        out.clear();
+        CHECK(!huffmanDecode(fromHex("18"), out)); // Padded with zeros
+        out.clear();
+        CHECK(!huffmanDecode(fromHex("1fff"), out)); // More than seven bits of padding
+        out.clear();
+        CHECK(!huffmanDecode(fromHex("ffff fffc"), out)); // EOS itself is an error (5.2)
+        out.clear();
+        CHECK(huffmanDecode("", out));
+        CHECK(out.empty());
+
+        // A Huffman-coded string with bad padding fails the whole block
+        HpackDecoder decoder;
+        CHECK(rejects(decoder, fromHex("0081 18")));
+        CHECK(rejects(decoder, fromHex("0082 1fff")));
+    }
+
+    TEST_CASE(hpack, huffman_round_trip)
+    {
+        std::string input;
+        for (int c = 0; c < 256; ++c)
+        {
+            input += static_cast<char>(c);
+        }
+        input += "text/html; charset=utf-8";
+        std::string encoded;
+        huffmanEncode(input, encoded);
+        CHECK_EQ(encoded.length(), huffmanLength(input));
+        std::string decoded;
+        CHECK(huffmanDecode(encoded, decoded));
+        CHECK(decoded == input);
+    }
+
+    TEST_CASE(hpack, integer_overflow)
+    {
+        HpackDecoder decoder;
+        // An index whose continuation bytes never end within 64 bits
+        CHECK(rejects(decoder, fromHex("ff ffff ffff ffff ffff ff7f")));
+        // A string length beyond what the block holds
+        CHECK(rejects(decoder, fromHex("00 7f ffff ffff ffff ffff ff01")));
+        CHECK(rejects(decoder, fromHex("00 0a 6162")));
+        // A multi-byte integer cut off by the end of the block
+        CHECK(rejects(decoder, fromHex("ff")));
+        CHECK(rejects(decoder, fromHex("ff80")));
+        // Index 0 and indexes past the table
+        CHECK(rejects(decoder, fromHex("80")));
+        CHECK(rejects(decoder, fromHex("bf")));
+    }
+
+    TEST_CASE(hpack, table_size_update)
+    {
+        HpackDecoder decoder;
+        // To the advertised maximum of 4096 (0x3f then 4065 in 7-bit groups)
+        CHECK(decoded(decoder, "3fe1 1f 82") == single(":method", "GET"));
+        // Beyond the advertised maximum
+        CHECK(rejects(decoder, fromHex("3fe1 3f 82")));
+    }
+
+    TEST_CASE(hpack, table_size_update_after_field)
+    {
+        HpackDecoder decoder;
+        CHECK(rejects(decoder, fromHex("82 20")));
+    }
+
+    TEST_CASE(hpack, table_size_update_evicts)
+    {
+        HpackDecoder decoder;
+        CHECK(decoded(decoder, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572") ==
+              single("custom-key", "custom-header"));
+        // Down to zero and back up empties the table
+        CHECK(decoded(decoder, "20 3fe1 1f 82") == single(":method", "GET"));
+        CHECK(rejects(decoder, fromHex("be")));
+    }
+
+    TEST_CASE(hpack, table_eviction)
+    {
+        HpackTable table;
+        table.resize(3 * (HpackTable::ENTRY_OVERHEAD + 2));
+        table.add("a", "1");
+        table.add("b", "2");
+        table.add("c", "3");
+        REQUIRE(table.at(64));
+        CHECK_EQ(table.at(64)->name, "a");
+        table.add("d", "4"); // Evicts "a"
+        CHECK_EQ(table.at(62)->name, "d");
+        CHECK_EQ(table.at(64)->name, "b");
+        CHECK(!table.at(65));
+
+        table.resize(HpackTable::ENTRY_OVERHEAD + 2); // Keeps only the newest
+        CHECK_EQ(table.at(62)->name, "d");
+        CHECK(!table.at(63));
+
+        // An entry larger than the table empties it (4.4)
+        table.add("a-longer-name", "value");
+        CHECK(!table.at(62));
+        CHECK_EQ(table.at(2)->name, ":method");
+        CHECK(!table.at(0));
+    }
+
+    TEST_CASE(hpack, header_list_size)
+    {
+        HpackDecoder decoder;
+        std::vector<HeaderField> fields;
+        std::string block = fromHex("8286 84");
+        // ":method GET", ":scheme http" and ":path /" are 42, 43 and 38 bytes
+        CHECK(decoder.decode(block, fields, 123));
+        CHECK(!decoder.decode(block, fields, 122));
+    }
+
+    TEST_CASE(hpack, encoder_round_trip)
+    {
+        HpackEncoder encoder;
+        HpackDecoder decoder;
+        std::vector<HeaderField> fields;
+        size_t first_length = 0;
+        for (int response = 0; response < 3; ++response)
+        {
+            std::string block;
+            encoder.begin(block);
+            encoder.encode(":status", "200", block);
+            encoder.encode("content-type", "text/html; charset=utf-8", block);
+            encoder.encode("x-request", std::to_string(response), block, false);
+            REQUIRE(decoder.decode(block, fields, NO_LIST_LIMIT));
+            REQUIRE_EQ(fields.size(), size_t(3));
+            CHECK_EQ(fields[0].value, "200");
+            CHECK_EQ(fields[1].value, "text/html; charset=utf-8");
+            CHECK_EQ(fields[2].value, std::to_string(response));
+            if (response == 0)
+            {
+                first_length = block.length();
+            }
+            else if (response == 1)
+            {
+                // The content type is one byte from the dynamic table now
+                CHECK(block.length() + 10 < first_length);
+                // The shrink is signalled at the start of the next block
+                encoder.setMaxTableSize(0);
+            }
+            else
+            {
+                CHECK_EQ(block.front() & 0xE0, 0x20);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,458 @@
+#include "test.h"
+#include "connection.h"
+#include "hpack.h"
+#include "http2_session.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// HTTP/2 framing of untrusted input (RFC 9113): header blocks split over
+// CONTINUATION frames, stream resets and both directions of flow control.
+// The session runs on a socketless connection that the test feeds directly.
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        constexpr uint8_t DATA = 0x0;
+        constexpr uint8_t HEADERS = 0x1;
+        constexpr uint8_t RST_STREAM = 0x3;
+        constexpr uint8_t SETTINGS = 0x4;
+        constexpr uint8_t PING = 0x6;
+        constexpr uint8_t GOAWAY = 0x7;
+        constexpr uint8_t WINDOW_UPDATE = 0x8;
+        constexpr uint8_t CONTINUATION = 0x9;
+
+        constexpr uint8_t END_STREAM = 0x1;
+        constexpr uint8_t ACK = 0x1;
+        constexpr uint8_t END_HEADERS = 0x4;
+
+        constexpr uint32_t PROTOCOL_ERROR = 0x1;
+        constexpr uint32_t FLOW_CONTROL_ERROR = 0x3;
+        constexpr uint32_t FRAME_SIZE_ERROR = 0x6;
+        constexpr uint32_t CANCEL = 0x8;
+
+        constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+
+        // Served for GET /large, in more than one frame of the default size
+        const std::string LARGE_BODY(40000, 'x');
+
+        struct Frame
+        {
+            uint8_t type = 0;
+            uint8_t flags = 0;
+            uint32_t stream_id = 0;
+            std::string payload;
+        };
+
+        std::string uint32Bytes(uint32_t value)
+        {
+            return {static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8),
+                    static_cast<char>(value)};
+        }
+
+        uint32_t readUint32(std::string_view bytes)
+        {
+            return (uint32_t(uint8_t(bytes[0])) << 24) | (uint32_t(uint8_t(bytes[1])) << 16) |
+                   (uint32_t(uint8_t(bytes[2])) << 8) | uint32_t(uint8_t(bytes[3]));
+        }
+
+        std::string frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload)
+        {
+            std::string bytes = {static_cast<char>(payload.length() >> 16), static_cast<char>(payload.length() >> 8),
+                                 static_cast<char>(payload.length()), static_cast<char>(type),
+                                 static_cast<char>(flags)};
+            return bytes.append(uint32Bytes(stream_id)).append(payload);
+        }
+
+        std::string setting(uint16_t id, uint32_t value)
+        {
+            return std::string{static_cast<char>(id >> 8), static_cast<char>(id)}.append(uint32Bytes(value));
+        }
+
+        // Answers GET /large with LARGE_BODY, any other request with its body
+        // length, or "0" without a body
+        void handle(Connection &conn)
+        {
+            std::string body = conn.request.target == "/large" ? LARGE_BODY : std::to_string(conn.content_length);
+            conn.write("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.length()) + "\r\n\r\n");
+            conn.write(body);
+        }
+
+        // The client side of a session: sends frames and collects the server's
+        class Client
+        {
+        public:
+            explicit Client(const std::string &settings = {})
+                : conn_(Connection::forStream(ConnectionLimits::defaults()))
+            {
+                conn_->upgrade(std::make_unique<Http2Session>(ConnectionLimits::defaults(), nullptr, handle));
+                send("SM\r\n\r\n" + frame(SETTINGS, 0, 0, settings));
+                received(); // The server's settings, window and acknowledgement
+            }
+
+            void send(const std::string &bytes)
+            {
+                conn_->in.append(bytes);
+                conn_->requestComplete();
+            }
+
+            // Frames written since the last call, as if the socket accepted them all
+            std::vector<Frame> received()
+            {
+                while (conn_->pendingOutput() > 0)
+                {
+                    for (const OutputSegment &segment : conn_->out)
+                    {
+                        output_.append(segment.bytes().substr(segment.data_offset));
+                    }
+                    conn_->consumeOutput(conn_->pendingOutput()); // Lets the session queue more
+                }
+                std::vector<Frame> frames;
+                while (output_.length() >= 9)
+                {
+                    size_t length = (size_t(uint8_t(output_[0])) << 16) | (size_t(uint8_t(output_[1])) << 8) |
+                                    uint8_t(output_[2]);
+                    Frame next;
+                    next.type = static_cast<uint8_t>(output_[3]);
+                    next.flags = static_cast<uint8_t>(output_[4]);
+                    next.stream_id = readUint32(std::string_view(output_).substr(5)) & 0x7FFFFFFF;
+                    next.payload = output_.substr(9, length);
+                    output_.erase(0, 9 + length);
+                    frames.push_back(std::move(next));
+                }
+                return frames;
+            }
+
+            // A header block for a request; `content_length` adds that field
+            std::string request(std::string_view method, std::string_view path, std::string_view content_length = {})
+            {
+                std::string block;
+                encoder_.begin(block);
+                encoder_.encode(":method", method, block);
+                encoder_.encode(":scheme", "http", block);
+                encoder_.encode(":path", path, block);
+                encoder_.encode(":authority", "localhost", block);
+                if (!content_length.empty())
+                {
+                    encoder_.encode("content-length", content_length, block);
+                }
+                return block;
+            }
+
+            // The :status of a response header block, or "<error>"
+            std::string status(const Frame &headers)
+            {
+                std::vector<HeaderField> fields;
+                if (!decoder_.decode(headers.payload, fields, 1 << 20) || fields.empty() ||
+                    fields.front().name != ":status")
+                {
+                    return "<error>";
+                }
+                return fields.front().value;
+            }
+
+        private:
+            std::unique_ptr<Connection> conn_;
+            HpackEncoder encoder_;
+            HpackDecoder decoder_;
+            std::string output_;
+        };
+
+        // The error code of the first GOAWAY among `frames`, or -1 without one
+        int64_t goaway(const std::vector<Frame> &frames)
+        {
+            for (const Frame &frame : frames)
+            {
+                if (frame.type == GOAWAY && frame.payload.length() >= 8)
+                {
+                    return readUint32(std::string_view(frame.payload).substr(4));
+                }
+            }
+            return -1;
+        }
+
+        // The error code of the first RST_STREAM for `stream_id`, or -1 without one
+        int64_t reset(const std::vector<Frame> &frames, uint32_t stream_id)
+        {
+            for (const Frame &frame : frames)
+            {
+                if (frame.type == RST_STREAM && frame.stream_id == stream_id && frame.payload.length() == 4)
+                {
+                    return readUint32(frame.payload);
+                }
+            }
+            return -1;
+        }
+
+        // The DATA of `stream_id` among `frames`; `ended` is set by END_STREAM
+        std::string body(const std::vector<Frame> &frames, uint32_t stream_id, bool &ended)
+        {
+            std::string data;
+            ended = false;
+            for (const Frame &frame : frames)
+            {
+                if (frame.type == DATA && frame.stream_id == stream_id)
+                {
+                    data += frame.payload;
+                    ended = ended || (frame.flags & END_STREAM);
+                }
+            }
+            return data;
+        }
+
+        const Frame *find(const std::vector<Frame> &frames, uint8_t type, uint32_t stream_id)
+        {
+            for (const Frame &frame : frames)
+            {
+                if (frame.type == type && frame.stream_id == stream_id)
+                {
+                    return &frame;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    TEST_CASE(http2, settings_exchange)
+    {
+        auto conn = Connection::forStream(ConnectionLimits::defaults());
+        conn->upgrade(std::make_unique<Http2Session>(ConnectionLimits::defaults(), nullptr, handle));
+        conn->in = "SM\r\n\r\n" + frame(SETTINGS, 0, 0, {}) + frame(PING, 0, 0, "12345678");
+        conn->requestComplete();
+        std::string output;
+        for (const OutputSegment &segment : conn->out)
+        {
+            output.append(segment.bytes().substr(segment.data_offset));
+        }
+        // SETTINGS, the connection window, the acknowledgement and the PING answer
+        REQUIRE(output.length() > 9);
+        CHECK_EQ(int(output[3]), int(SETTINGS));
+        CHECK_EQ(int(output[4]), 0);
+        CHECK(output.find(frame(WINDOW_UPDATE, 0, 0, uint32Bytes(Http2Session::CONNECTION_WINDOW - 65535))) !=
+              std::string::npos);
+        CHECK(output.find(frame(SETTINGS, ACK, 0, {})) != std::string::npos);
+        CHECK(output.ends_with(frame(PING, ACK, 0, "12345678")));
+    }
+
+    TEST_CASE(http2, preface_must_end_with_settings)
+    {
+        auto conn = Connection::forStream(ConnectionLimits::defaults());
+        conn->upgrade(std::make_unique<Http2Session>(ConnectionLimits::defaults(), nullptr, handle));
+        conn->in = "SM\r\n\r\n" + frame(PING, 0, 0, "12345678");
+        conn->requestComplete();
+        std::string output;
+        for (const OutputSegment &segment : conn->out)
+        {
+            output.append(segment.bytes().substr(segment.data_offset));
+        }
+        CHECK(output.ends_with(frame(GOAWAY, 0, 0, uint32Bytes(0) + uint32Bytes(PROTOCOL_ERROR))));
+        CHECK(conn->close_after_write);
+    }
+
+    TEST_CASE(http2, get_request)
+    {
+        Client client;
+        client.send(frame(HEADERS, END_HEADERS | END_STREAM, 1, client.request("GET", "/")));
+        std::vector<Frame> frames = client.received();
+        const Frame *headers = find(frames, HEADERS, 1);
+        REQUIRE(headers);
+        CHECK_EQ(client.status(*headers), "200");
+        bool ended;
+        CHECK_EQ(body(frames, 1, ended), "0");
+        CHECK(ended);
+    }
+
+    TEST_CASE(http2, continuation)
+    {
+        Client client;
+        std::string block = client.request("GET", "/");
+        std::string first = block.substr(0, 3);
+        std::string second = block.substr(3, 2);
+        std::string rest = block.substr(5);
+        client.send(frame(HEADERS, END_STREAM, 1, first));
+        client.send(frame(CONTINUATION, 0, 1, second));
+        CHECK(client.received().empty()); // Nothing is served before END_HEADERS
+        client.send(frame(CONTINUATION, END_HEADERS, 1, rest));
+        std::vector<Frame> frames = client.received();
+        const Frame *headers = find(frames, HEADERS, 1);
+        REQUIRE(headers);
+        CHECK_EQ(client.status(*headers), "200");
+    }
+
+    TEST_CASE(http2, interleaved_continuation)
+    {
+        // Any frame other than a CONTINUATION of the same stream breaks the block
+        Client ping;
+        ping.send(frame(HEADERS, END_STREAM, 1, ping.request("GET", "/")));
+        ping.send(frame(PING, 0, 0, "12345678"));
+        CHECK_EQ(goaway(ping.received()), int64_t(PROTOCOL_ERROR));
+
+        Client other;
+        std::string block = other.request("GET", "/");
+        other.send(frame(HEADERS, END_STREAM, 1, block.substr(0, 2)));
+        other.send(frame(CONTINUATION, END_HEADERS, 3, block.substr(2)));
+        CHECK_EQ(goaway(other.received()), int64_t(PROTOCOL_ERROR));
+
+        Client stray;
+        stray.send(frame(CONTINUATION, END_HEADERS, 1, stray.request("GET", "/")));
+        CHECK_EQ(goaway(stray.received()), int64_t(PROTOCOL_ERROR));
+    }
+
+    TEST_CASE(http2, rst_stream_cancels_request)
+    {
+        Client client;
+        client.send(frame(HEADERS, END_HEADERS, 1, client.request("POST", "/", "10")));
+        client.send(frame(DATA, 0, 1, "12345"));
+        client.send(frame(RST_STREAM, 0, 1, uint32Bytes(CANCEL)));
+        // Data already in flight for the stream is dropped, and the connection goes on
+        client.send(frame(DATA, END_STREAM, 1, "67890"));
+        client.send(frame(HEADERS, END_HEADERS | END_STREAM, 3, client.request("GET", "/")));
+        std::vector<Frame> frames = client.received();
+        CHECK(!find(frames, HEADERS, 1));
+        CHECK_EQ(goaway(frames), int64_t(-1));
+        const Frame *headers = find(frames, HEADERS, 3);
+        REQUIRE(headers);
+        CHECK_EQ(client.status(*headers), "200");
+    }
+
+    TEST_CASE(http2, rst_stream_errors)
+    {
+        Client idle;
+        idle.send(frame(RST_STREAM, 0, 5, uint32Bytes(CANCEL)));
+        CHECK_EQ(goaway(idle.received()), int64_t(PROTOCOL_ERROR));
+
+        Client connection;
+        connection.send(frame(RST_STREAM, 0, 0, uint32Bytes(CANCEL)));
+        CHECK_EQ(goaway(connection.received()), int64_t(PROTOCOL_ERROR));
+
+        Client length;
+        length.send(frame(HEADERS, END_HEADERS, 1, length.request("POST", "/", "10")));
+        length.send(frame(RST_STREAM, 0, 1, std::string("\0\0\x08", 3)));
+        CHECK_EQ(goaway(length.received()), int64_t(FRAME_SIZE_ERROR));
+    }
+
+    TEST_CASE(http2, send_window)
+    {
+        // A stream window of 10 bytes holds the body back until the client opens it
+        Client client(setting(SETTINGS_INITIAL_WINDOW_SIZE, 10));
+        client.send(frame(HEADERS, END_HEADERS | END_STREAM, 1, client.request("GET", "/large")));
+        std::vector<Frame> frames = client.received();
+        REQUIRE(find(frames, HEADERS, 1));
+        bool ended;
+        CHECK_EQ(body(frames, 1, ended), LARGE_BODY.substr(0, 10));
+        CHECK(!ended);
+
+        client.send(frame(WINDOW_UPDATE, 0, 1, uint32Bytes(1000)));
+        CHECK_EQ(body(client.received(), 1, ended), LARGE_BODY.substr(10, 1000));
+        CHECK(!ended);
+
+        // Raising the initial window applies to the open stream as well
+        client.send(frame(SETTINGS, 0, 0, setting(SETTINGS_INITIAL_WINDOW_SIZE, 65535)));
+        CHECK_EQ(body(client.received(), 1, ended), LARGE_BODY.substr(1010));
+        CHECK(ended);
+    }
+
+    TEST_CASE(http2, connection_send_window)
+    {
+        // The connection window starts at 65535 bytes whatever the stream windows
+        Client client(setting(SETTINGS_INITIAL_WINDOW_SIZE, 1 << 20));
+        client.send(frame(HEADERS, END_HEADERS | END_STREAM, 1, client.request("GET", "/large")));
+        client.send(frame(HEADERS, END_HEADERS | END_STREAM, 3, client.request("GET", "/large")));
+        std::vector<Frame> frames = client.received();
+        bool first_ended;
+        bool second_ended;
+        size_t sent = body(frames, 1, first_ended).length() + body(frames, 3, second_ended).length();
+        CHECK_EQ(sent, size_t(65535));
+        CHECK(!first_ended || !second_ended);
+
+        client.send(frame(WINDOW_UPDATE, 0, 0, uint32Bytes(2 * LARGE_BODY.length())));
+        frames = client.received();
+        sent += body(frames, 1, first_ended).length() + body(frames, 3, second_ended).length();
+        CHECK_EQ(sent, 2 * LARGE_BODY.length());
+    }
+
+    TEST_CASE(http2, window_update_errors)
+    {
+        Client zero_stream;
+        zero_stream.send(frame(HEADERS, END_HEADERS, 1, zero_stream.request("POST", "/", "10")));
+        zero_stream.send(frame(WINDOW_UPDATE, 0, 1, uint32Bytes(0)));
+        std::vector<Frame> frames = zero_stream.received();
+        CHECK_EQ(reset(frames, 1), int64_t(PROTOCOL_ERROR));
+        CHECK_EQ(goaway(frames), int64_t(-1));
+
+        Client zero_connection;
+        zero_connection.send(frame(WINDOW_UPDATE, 0, 0, uint32Bytes(0)));
+        CHECK_EQ(goaway(zero_connection.received()), int64_t(PROTOCOL_ERROR));
+
+        // Windows must stay below 2^31 (RFC 9113 6.9.1)
+        Client overflow_stream;
+        overflow_stream.send(frame(HEADERS, END_HEADERS, 1, overflow_stream.request("POST", "/", "10")));
+        overflow_stream.send(frame(WINDOW_UPDATE, 0, 1, uint32Bytes(0x7FFFFFFF)));
+        CHECK_EQ(reset(overflow_stream.received(), 1), int64_t(FLOW_CONTROL_ERROR));
+
+        Client overflow_connection;
+        overflow_connection.send(frame(WINDOW_UPDATE, 0, 0, uint32Bytes(0x7FFFFFFF)));
+        CHECK_EQ(goaway(overflow_connection.received()), int64_t(FLOW_CONTROL_ERROR));
+
+        Client settings;
+        settings.send(frame(SETTINGS, 0, 0, setting(SETTINGS_INITIAL_WINDOW_SIZE, 0x80000000)));
+        CHECK_EQ(goaway(settings.received()), int64_t(FLOW_CONTROL_ERROR));
+
+        Client length;
+        length.send(frame(WINDOW_UPDATE, 0, 0, std::string("\0\0\x01", 3)));
+        CHECK_EQ(goaway(length.received()), int64_t(FRAME_SIZE_ERROR));
+    }
+
+    TEST_CASE(http2, body_longer_than_content_length)
+    {
+        Client client;
+        client.send(frame(HEADERS, END_HEADERS, 1, client.request("POST", "/", "4")));
+        client.send(frame(DATA, END_STREAM, 1, "too long"));
+        std::vector<Frame> frames = client.received();
+        CHECK_EQ(reset(frames, 1), int64_t(PROTOCOL_ERROR));
+        CHECK(!find(frames, HEADERS, 1));
+    }
+
+    TEST_CASE(http2, buffered_body_beyond_stream_window)
+    {
+        // A body without a sink is buffered; the stream window must still be
+        // reopened as it arrives, or the client stalls after the first window
+        constexpr size_t LENGTH = 3 * Http2Session::STREAM_WINDOW;
+        Client client;
+        client.send(frame(HEADERS, END_HEADERS, 1, client.request("POST", "/", std::to_string(LENGTH))));
+        int64_t stream_window = Http2Session::STREAM_WINDOW;
+        int64_t connection_window = Http2Session::CONNECTION_WINDOW;
+        const std::string chunk(Http2Session::MAX_FRAME_SIZE, 'b');
+        size_t sent = 0;
+        std::vector<Frame> frames;
+        while (sent < LENGTH)
+        {
+            size_t length = std::min(chunk.length(), LENGTH - sent);
+            REQUIRE(int64_t(length) <= stream_window);
+            REQUIRE(int64_t(length) <= connection_window);
+            sent += length;
+            client.send(frame(DATA, sent == LENGTH ? END_STREAM : 0, 1, std::string_view(chunk).substr(0, length)));
+            stream_window -= int64_t(length);
+            connection_window -= int64_t(length);
+            for (Frame &frame : client.received())
+            {
+                if (frame.type == WINDOW_UPDATE)
+                {
+                    (frame.stream_id == 0 ? connection_window : stream_window) += readUint32(frame.payload);
+                }
+                frames.push_back(std::move(frame));
+            }
+        }
+        const Frame *headers = find(frames, HEADERS, 1);
+        REQUIRE(headers);
+        CHECK_EQ(client.status(*headers), "200");
+        bool ended;
+        CHECK_EQ(body(frames, 1, ended), std::to_string(LENGTH));
+        CHECK(ended);
+        CHECK_EQ(reset(frames, 1), int64_t(-1));
+    }
+
+}
@@ -0,0 +1,330 @@
+#include "test.h"
+#include "multipart_parser.h"
+#include "thread_pool.h"
+#include "upload_receiver.h"
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+// multipart/form-data bodies as a client may send them: split anywhere,
+// with boundary-like data, padding, preamble and epilogue, or cut short;
+// and the upload receiver that streams their files to disk
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        constexpr std::string_view BOUNDARY = "xyzzy";
+
+        struct Part
+        {
+            std::string headers;
+            std::string data;
+            bool ended = false;
+        };
+
+        class Recorder : public MultipartParser::Handler
+        {
+        public:
+            std::vector<Part> parts;
+            size_t refuse_after = SIZE_MAX; // Parts accepted before onPartBegin() fails
+
+            bool onPartBegin(std::string_view headers) override
+            {
+                if (parts.size() == refuse_after)
+                {
+                    return false;
+                }
+                parts.push_back({std::string(headers), {}, false});
+                return true;
+            }
+
+            bool onPartData(std::string_view data) override
+            {
+                CHECK(!data.empty());
+                parts.back().data.append(data);
+                return true;
+            }
+
+            bool onPartEnd() override
+            {
+                parts.back().ended = true;
+                return true;
+            }
+        };
+
+        // Feeds `body` in pieces of `chunk` bytes the way a connection does:
+        // whatever the parser leaves unconsumed is passed again with more data
+        bool parse(Recorder &recorder, std::string_view body, size_t chunk = SIZE_MAX)
+        {
+            MultipartParser parser(std::string(BOUNDARY), recorder);
+            std::string buffer;
+            for (size_t offset = 0; offset < body.length() && !parser.failed();)
+            {
+                std::string_view piece = body.substr(offset, chunk);
+                offset += piece.length();
+                buffer.append(piece);
+                buffer.erase(0, parser.feed(buffer, offset == body.length()));
+            }
+            return parser.done() && !parser.failed();
+        }
+
+        const std::string TWO_PARTS = "--xyzzy\r\n"
+                                      "Content-Disposition: form-data; name=\"a\"; filename=\"a.txt\"\r\n"
+                                      "\r\n"
+                                      "first\r\n--xyz\r\n-- not a boundary\r\n"
+                                      "--xyzzy\r\n"
+                                      "Content-Disposition: form-data; name=\"b\"\r\n"
+                                      "Content-Type: text/plain\r\n"
+                                      "\r\n"
+                                      "second\r\n"
+                                      "--xyzzy--\r\n";
+
+        // One file part per (filename, content) pair
+        std::string uploadBody(const std::vector<std::pair<std::string, std::string>> &files)
+        {
+            std::string body;
+            for (const auto &[filename, content] : files)
+            {
+                body.append("--xyzzy\r\nContent-Disposition: form-data; name=\"file\"; filename=\"")
+                    .append(filename)
+                    .append("\"\r\n\r\n")
+                    .append(content)
+                    .append("\r\n");
+            }
+            return body.append("--xyzzy--\r\n");
+        }
+
+        std::string fileContent(const std::filesystem::path &path)
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::ostringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+
+        // A scratch directory for the upload receiver, removed again afterwards
+        class Scratch
+        {
+        public:
+            Scratch()
+                : path_(std::filesystem::temp_directory_path() / ("web_server_multipart_" + std::to_string(getpid())))
+            {
+                std::filesystem::remove_all(path_);
+                std::filesystem::create_directories(path_);
+            }
+            ~Scratch()
+            {
+                std::error_code ec;
+                std::filesystem::remove_all(path_, ec);
+            }
+
+            const std::filesystem::path &path() const { return path_; }
+
+            size_t entries() const
+            {
+                return static_cast<size_t>(std::distance(std::filesystem::directory_iterator(path_),
+                                                         std::filesystem::directory_iterator()));
+            }
+
+        private:
+            std::filesystem::path path_;
+        };
+    }
+
+    TEST_CASE(multipart, two_parts)
+    {
+        Recorder recorder;
+        CHECK(parse(recorder, TWO_PARTS));
+        REQUIRE_EQ(recorder.parts.size(), size_t(2));
+        CHECK_EQ(recorder.parts[0].headers, "Content-Disposition: form-data; name=\"a\"; filename=\"a.txt\"");
+        CHECK_EQ(recorder.parts[0].data, "first\r\n--xyz\r\n-- not a boundary");
+        CHECK(recorder.parts[0].ended);
+        CHECK_EQ(recorder.parts[1].headers, "Content-Disposition: form-data; name=\"b\"\r\nContent-Type: text/plain");
+        CHECK_EQ(recorder.parts[1].data, "second");
+        CHECK(recorder.parts[1].ended);
+    }
+
+    TEST_CASE(multipart, any_split)
+    {
+        // A boundary or header block cut at any byte is reassembled
+        for (size_t chunk = 1; chunk <= TWO_PARTS.length(); ++chunk)
+        {
+            Recorder recorder;
+            if (!CHECK(parse(recorder, TWO_PARTS, chunk)) || !CHECK_EQ(recorder.parts.size(), size_t(2)))
+            {
+                return;
+            }
+            if (!CHECK_EQ(recorder.parts[0].data, "first\r\n--xyz\r\n-- not a boundary") ||
+                !CHECK_EQ(recorder.parts[1].data, "second"))
+            {
+                return;
+            }
+        }
+    }
+
+    TEST_CASE(multipart, preamble_padding_and_epilogue)
+    {
+        Recorder recorder;
+        CHECK(parse(recorder, "This is the preamble.\r\n--xyzzy  \t\r\n\r\nbody\r\n--xyzzy--\r\nepilogue --xyzzy"));
+        REQUIRE_EQ(recorder.parts.size(), size_t(1));
+        CHECK_EQ(recorder.parts[0].headers, "");
+        CHECK_EQ(recorder.parts[0].data, "body");
+    }
+
+    TEST_CASE(multipart, empty_part)
+    {
+        Recorder recorder;
+        CHECK(parse(recorder, "--xyzzy\r\nName: x\r\n\r\n\r\n--xyzzy--"));
+        REQUIRE_EQ(recorder.parts.size(), size_t(1));
+        CHECK_EQ(recorder.parts[0].data, "");
+        CHECK(recorder.parts[0].ended);
+    }
+
+    TEST_CASE(multipart, truncated_body)
+    {
+        Recorder in_data;
+        CHECK(!parse(in_data, "--xyzzy\r\n\r\npart data without an end"));
+        Recorder in_closing;
+        CHECK(!parse(in_closing, "--xyzzy\r\n\r\ndata\r\n--xyz"));
+        Recorder in_headers;
+        CHECK(!parse(in_headers, "--xyzzy\r\nContent-Disposition: form-data"));
+        Recorder no_boundary;
+        CHECK(!parse(no_boundary, "no boundary at all"));
+        CHECK(no_boundary.parts.empty());
+    }
+
+    TEST_CASE(multipart, oversized_lines)
+    {
+        Recorder padding;
+        CHECK(!parse(padding, "--xyzzy" + std::string(200, ' ') + "\r\n\r\ndata\r\n--xyzzy--", 16));
+
+        Recorder headers;
+        CHECK(!parse(headers, "--xyzzy\r\nX: " + std::string(20000, 'h') + "\r\n\r\ndata\r\n--xyzzy--", 1000));
+        CHECK(headers.parts.empty());
+    }
+
+    TEST_CASE(multipart, handler_aborts)
+    {
+        Recorder recorder;
+        recorder.refuse_after = 1;
+        CHECK(!parse(recorder, TWO_PARTS));
+        CHECK_EQ(recorder.parts.size(), size_t(1));
+    }
+
+    TEST_CASE(multipart, filename)
+    {
+        CHECK_EQ(multipartFilename("Content-Disposition: form-data; name=\"f\"; filename=\"a b.txt\""), "a b.txt");
+        CHECK_EQ(multipartFilename("Content-Type: text/plain\r\ncontent-DISPOSITION: form-data; filename=\"x\""), "x");
+        CHECK_EQ(multipartFilename("Content-Disposition: form-data; name=\"field\""), "");
+        CHECK_EQ(multipartFilename("Content-Disposition: form-data; filename=\"unterminated"), "");
+        CHECK_EQ(multipartFilename("X-Content-Disposition: form-data; filename=\"x\""), "");
+        CHECK_EQ(multipartFilename(""), "");
+    }
+
+    TEST_CASE(multipart, boundary)
+    {
+        CHECK_EQ(multipartBoundary("multipart/form-data; boundary=abc"), "abc");
+        CHECK_EQ(multipartBoundary("Multipart/Form-Data ; charset=utf-8; BOUNDARY = \"a b\" "), "a b");
+        CHECK_EQ(multipartBoundary("multipart/form-data"), "");
+        CHECK_EQ(multipartBoundary("multipart/mixed; boundary=abc"), "");
+        CHECK_EQ(multipartBoundary("text/plain; boundary=abc"), "");
+        CHECK_EQ(multipartBoundary("multipart/form-data; boundary=" + std::string(70, 'b')), std::string(70, 'b'));
+        CHECK_EQ(multipartBoundary("multipart/form-data; boundary=" + std::string(71, 'b')), "");
+    }
+
+    TEST_CASE(multipart, receiver_writes_files)
+    {
+        // Without writer threads the files are written on the receiving thread
+        Scratch scratch;
+        std::string large(1 << 20, 'L');
+        std::string body = uploadBody({{"small.txt", "small"}, {"large.bin", large}, {"../escape", "x"}});
+        {
+            UploadReceiver receiver(std::string(BOUNDARY), scratch.path().string(), nullptr);
+            std::string buffer;
+            for (size_t offset = 0; offset < body.length(); offset += 4096)
+            {
+                buffer.append(body, offset, 4096);
+                buffer.erase(0, receiver.write(buffer, offset + 4096 >= body.length()));
+            }
+            CHECK(receiver.ok());
+            REQUIRE_EQ(receiver.fileCount(), size_t(3));
+            CHECK_EQ(receiver.file(0).size, size_t(5));
+            CHECK_EQ(fileContent(receiver.file(0).temp_path), "small");
+            CHECK_EQ(receiver.file(1).size, large.length());
+            CHECK(fileContent(receiver.file(1).temp_path) == large);
+            CHECK(UploadReceiver::temporaryFilename(std::filesystem::path(receiver.file(1).temp_path).filename().string()));
+            CHECK_EQ(receiver.file(2).error, "Invalid filename");
+            CHECK(receiver.file(2).temp_path.empty());
+        }
+        // Files the caller did not move into place are removed with the receiver
+        CHECK_EQ(scratch.entries(), size_t(0));
+    }
+
+    TEST_CASE(multipart, receiver_rejects_malformed_body)
+    {
+        Scratch scratch;
+        UploadReceiver receiver(std::string(BOUNDARY), scratch.path().string(), nullptr);
+        std::string body = "--xyzzy\r\nContent-Disposition: form-data; filename=\"a\"\r\n\r\ncut short";
+        CHECK_EQ(receiver.write(body, true), body.length());
+        CHECK(!receiver.ok());
+        CHECK_EQ(receiver.status(), "400 Bad Request");
+
+        UploadReceiver no_file(std::string(BOUNDARY), scratch.path().string(), nullptr);
+        no_file.write("--xyzzy\r\nContent-Disposition: form-data; name=\"field\"\r\n\r\nvalue\r\n--xyzzy--", true);
+        CHECK(!no_file.ok());
+        CHECK_EQ(no_file.status(), "400 Bad Request");
+    }
+
+    TEST_CASE(multipart, receiver_on_event_loop)
+    {
+        // With a wake function the receiver never blocks; it reports busy()
+        // while the writers are behind and wakes the loop once they caught up
+        Scratch scratch;
+        ThreadPool writers(2, 16);
+        std::mutex mutex;
+        std::condition_variable woken;
+        size_t wakes = 0;
+
+        std::string content(3 * UploadReceiver::MAX_PENDING_BYTES, 'E');
+        std::string body = uploadBody({{"first.bin", content}, {"second.bin", content}});
+        UploadReceiver receiver(std::string(BOUNDARY), scratch.path().string(), &writers);
+        receiver.wake = [&]
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++wakes;
+            woken.notify_all();
+        };
+        auto waitWhileBusy = [&]
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (receiver.busy())
+            {
+                size_t seen = wakes;
+                CHECK(woken.wait_for(lock, std::chrono::seconds(10), [&] { return wakes != seen; }));
+            }
+        };
+
+        std::string buffer;
+        constexpr size_t CHUNK = 256 * 1024;
+        for (size_t offset = 0; offset < body.length(); offset += CHUNK)
+        {
+            waitWhileBusy();
+            buffer.append(body, offset, CHUNK);
+            buffer.erase(0, receiver.write(buffer, offset + CHUNK >= body.length()));
+        }
+        waitWhileBusy(); // Until every file is written
+        CHECK(receiver.ok());
+        REQUIRE_EQ(receiver.fileCount(), size_t(2));
+        CHECK(receiver.file(0).error.empty());
+        CHECK_EQ(receiver.file(1).size, content.length());
+        CHECK(fileContent(receiver.file(0).temp_path) == content);
+        CHECK(fileContent(receiver.file(1).temp_path) == content);
+    }
+
+}
@@ -0,0 +1,223 @@
+#include "test.h"
+#include "request_parser.h"
+#include <string>
+
+// HTTP/1.1 request heads as clients send them, in pieces and malformed, and
+// the percent-decoding of targets and query strings
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        // The parse result, or the status line of the error
+        std::string outcome(std::string_view buffer, HttpRequest &request, RequestParser &parser)
+        {
+            switch (parser.parse(buffer, request))
+            {
+            case RequestParser::Result::Complete:
+                return "complete";
+            case RequestParser::Result::Incomplete:
+                return "incomplete";
+            case RequestParser::Result::Error:
+                break;
+            }
+            return parser.errorStatus();
+        }
+
+        std::string outcome(std::string_view buffer)
+        {
+            RequestParser parser;
+            HttpRequest request;
+            return outcome(buffer, request, parser);
+        }
+
+        std::string decoded(std::string_view value, bool plus_as_space = false)
+        {
+            std::string out = "stale";
+            urlDecode(value, out, plus_as_space);
+            return out;
+        }
+
+        // The value of `name` in `query`, or "<absent>"
+        std::string parameter(std::string_view query, std::string_view name)
+        {
+            std::string value;
+            return queryParameter(query, name, value) ? value : "<absent>";
+        }
+    }
+
+    TEST_CASE(request_parser, simple_request)
+    {
+        RequestParser parser;
+        HttpRequest request;
+        std::string head = "GET /a%20b/c.txt?x=1&y=2 HTTP/1.1\r\nHost: example.com\r\nX-Padded: \t value \t\r\n"
+                           "Empty:\r\n\r\n";
+        REQUIRE_EQ(outcome(head, request, parser), "complete");
+        CHECK_EQ(request.method, "GET");
+        CHECK_EQ(request.target, "/a%20b/c.txt?x=1&y=2");
+        CHECK_EQ(request.path, "/a%20b/c.txt");
+        CHECK_EQ(request.query, "x=1&y=2");
+        CHECK_EQ(request.version, "HTTP/1.1");
+        CHECK_EQ(request.header_count, size_t(3));
+        CHECK_EQ(request.header_length, head.length());
+        CHECK_EQ(request.header("host"), "example.com");
+        CHECK_EQ(request.header("X-PADDED"), "value");
+        CHECK_EQ(request.header("Empty"), "");
+        CHECK_EQ(request.header("Missing"), "");
+        CHECK_EQ(request.content_length, size_t(0));
+    }
+
+    TEST_CASE(request_parser, arrives_in_pieces)
+    {
+        // Parsed again after every read, the end of the head may straddle any two
+        std::string head = "POST /upload HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+        size_t head_length = head.find("\r\n\r\n") + 4;
+        RequestParser parser;
+        HttpRequest request;
+        for (size_t length = 0; length < head_length; ++length)
+        {
+            if (!CHECK_EQ(outcome(std::string_view(head).substr(0, length), request, parser), "incomplete"))
+            {
+                return;
+            }
+        }
+        REQUIRE_EQ(outcome(std::string_view(head).substr(0, head_length), request, parser), "complete");
+        CHECK_EQ(request.header_length, head_length);
+        CHECK_EQ(request.content_length, size_t(5));
+    }
+
+    TEST_CASE(request_parser, pipelined_requests)
+    {
+        std::string buffer = "GET /first?q HTTP/1.1\r\nA: 1\r\n\r\nGET /second HTTP/1.1\r\n\r\n";
+        RequestParser parser;
+        HttpRequest request;
+        REQUIRE_EQ(outcome(buffer, request, parser), "complete");
+        CHECK_EQ(request.target, "/first?q");
+        CHECK_EQ(request.query, "q");
+
+        // The same request object is reused: nothing of the first request remains
+        std::string_view rest = std::string_view(buffer).substr(request.header_length);
+        parser.reset();
+        REQUIRE_EQ(outcome(rest, request, parser), "complete");
+        CHECK_EQ(request.target, "/second");
+        CHECK_EQ(request.query, "");
+        CHECK_EQ(request.header_count, size_t(0));
+        CHECK_EQ(request.header("A"), "");
+        CHECK_EQ(request.header_length, rest.length());
+    }
+
+    TEST_CASE(request_parser, malformed_request_line)
+    {
+        CHECK_EQ(outcome("GET\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET /\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome(" GET / HTTP/1.1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET  / HTTP/1.1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / extra HTTP/1.1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("G(T / HTTP/1.1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/2.0\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / FTP/1.1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.0\r\n\r\n"), "complete");
+        // Only as the start of the HTTP/2 connection preface
+        CHECK_EQ(outcome("PRI * HTTP/2.0\r\n\r\n"), "complete");
+        CHECK_EQ(outcome("PRI / HTTP/2.0\r\n\r\n"), "400 Bad Request");
+    }
+
+    TEST_CASE(request_parser, malformed_headers)
+    {
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\nNo colon\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\n: value\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\nName : value\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\nA: 1\r\n folded\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\nN@me: value\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("GET / HTTP/1.1\r\nX-Colon: a:b\r\n\r\n"), "complete");
+    }
+
+    TEST_CASE(request_parser, content_length)
+    {
+        RequestParser parser;
+        HttpRequest request;
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 42\r\ncontent-length: 42\r\n\r\n", request, parser),
+                 "complete");
+        CHECK_EQ(request.content_length, size_t(42));
+
+        // Conflicting or unparsable lengths would let a proxy and us frame the body differently
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 42\r\nContent-Length: 43\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 4 2\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: +1\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length:\r\n\r\n"), "400 Bad Request");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 1234567890123456789\r\n\r\n"), "400 Bad Request");
+    }
+
+    TEST_CASE(request_parser, transfer_encoding)
+    {
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"), "501 Not Implemented");
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n"),
+                 "400 Bad Request");
+    }
+
+    TEST_CASE(request_parser, limits)
+    {
+        RequestParser parser;
+        parser.setLimits(64, 1000);
+        HttpRequest request;
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 1000\r\n\r\n", request, parser), "complete");
+        parser.reset();
+        CHECK_EQ(outcome("POST / HTTP/1.1\r\nContent-Length: 1001\r\n\r\n", request, parser), "413 Content Too Large");
+
+        // A head beyond the limit fails as soon as that much arrived, complete or not
+        std::string large = "GET / HTTP/1.1\r\nX: " + std::string(64, 'x');
+        parser.reset();
+        CHECK_EQ(outcome(large, request, parser), "431 Request Header Fields Too Large");
+        parser.reset();
+        CHECK_EQ(outcome(large + "\r\n\r\n", request, parser), "431 Request Header Fields Too Large");
+
+        std::string many = "GET / HTTP/1.1\r\n";
+        for (size_t i = 0; i <= HttpRequest::MAX_HEADERS; ++i)
+        {
+            many.append("H").append(std::to_string(i)).append(": v\r\n");
+        }
+        CHECK_EQ(outcome(many + "\r\n"), "431 Request Header Fields Too Large");
+    }
+
+    TEST_CASE(request_parser, keep_alive)
+    {
+        auto keepAlive = [](std::string head)
+        {
+            RequestParser parser;
+            HttpRequest request;
+            return parser.parse(head, request) == RequestParser::Result::Complete && request.keepAlive();
+        };
+        CHECK(keepAlive("GET / HTTP/1.1\r\n\r\n"));
+        CHECK(!keepAlive("GET / HTTP/1.1\r\nConnection: close\r\n\r\n"));
+        CHECK(!keepAlive("GET / HTTP/1.1\r\nConnection: Upgrade , CLOSE\r\n\r\n"));
+        CHECK(!keepAlive("GET / HTTP/1.0\r\n\r\n"));
+        CHECK(keepAlive("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"));
+        CHECK(keepAlive("GET / HTTP/1.1\r\nConnection: closed\r\n\r\n"));
+    }
+
+    TEST_CASE(request_parser, url_decode)
+    {
+        CHECK_EQ(decoded("/a%20b%2Fc%2f"), "/a b/c/");
+        CHECK_EQ(decoded("100%"), "100%");
+        CHECK_EQ(decoded("%4"), "%4");
+        CHECK_EQ(decoded("%zz%4g"), "%zz%4g");
+        CHECK_EQ(decoded("%00"), std::string(1, '\0'));
+        CHECK_EQ(decoded("a+b"), "a+b");
+        CHECK_EQ(decoded("a+b%2B", true), "a b+");
+        CHECK_EQ(decoded(""), "");
+    }
+
+    TEST_CASE(request_parser, query_parameter)
+    {
+        CHECK_EQ(parameter("q=hello+world&page=2", "q"), "hello world");
+        CHECK_EQ(parameter("q=hello+world&page=2", "page"), "2");
+        CHECK_EQ(parameter("q=1&q=2", "q"), "1");
+        CHECK_EQ(parameter("flag&x=1", "flag"), "");
+        CHECK_EQ(parameter("name=%C3%A9", "name"), "\xC3\xA9");
+        CHECK_EQ(parameter("query=1", "q"), "<absent>");
+        CHECK_EQ(parameter("", "q"), "<absent>");
+    }
+
+}
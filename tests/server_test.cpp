@@ -0,0 +1,496 @@
+#include "test.h"
+#include "test_server.h"
+#include "compression.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// End-to-end tests against the web_server executable, run once per connection
+// mode (--mode=threads|epoll|uring) so every transport answers the same requests
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        std::string fileContent(const std::filesystem::path &path)
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::ostringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+
+        // Bytes that are neither text nor repetitive, so no layer can shortcut them
+        std::string binaryContent(size_t size)
+        {
+            std::string content(size, '\0');
+            uint32_t state = 2463534242u;
+            for (char &c : content)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                c = static_cast<char>(state);
+            }
+            return content;
+        }
+    }
+
+    TEST_CASE(server, static_file)
+    {
+        TestServer server;
+        server.write("hello.txt", "Hello, world\n");
+        server.start();
+        Client client(server.port());
+        REQUIRE(client.connected());
+        Response response = client.get("/hello.txt");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, "Hello, world\n");
+        CHECK(response.header("Content-Type").starts_with("text/plain"));
+        CHECK(!response.header("ETag").empty());
+        CHECK(!response.header("Last-Modified").empty());
+    }
+
+    TEST_CASE(server, large_file)
+    {
+        // Beyond the file cache, so the body comes from the file itself
+        std::string content = binaryContent(3 * 1024 * 1024 + 17);
+        TestServer server;
+        server.write("large.bin", content);
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/large.bin");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body.size(), content.size());
+        CHECK(response.body == content);
+        // And again from the cached descriptor on the same connection
+        response = client.get("/large.bin");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body == content);
+    }
+
+    TEST_CASE(server, zerocopy_body_then_close)
+    {
+        // Cached and above --zerocopy-min, so sent with MSG_ZEROCOPY (threads and
+        // epoll); the connection closes right behind the send
+        std::string content = binaryContent(512 * 1024);
+        TestServer server({"--zerocopy-min=4096"});
+        server.write("cached.bin", content);
+        server.start();
+        for (int i = 0; i < 20; ++i)
+        {
+            Client client(server.port());
+            Response response = client.get("/cached.bin", "Connection: close\r\n");
+            CHECK_EQ(response.status, 200);
+            CHECK(response.body == content);
+            CHECK(client.closedByPeer(2000));
+        }
+    }
+
+    TEST_CASE(server, not_found)
+    {
+        TestServer server;
+        server.start();
+        Client client(server.port());
+        CHECK_EQ(client.get("/missing.html").status, 404);
+        CHECK_EQ(client.get("/missing/").status, 404);
+        // The connection survives an error response
+        CHECK_EQ(client.get("/still-missing").status, 404);
+    }
+
+    TEST_CASE(server, nul_in_path)
+    {
+        TestServer server;
+        server.write("test.txt", "<script>alert(1)</script>");
+        server.start();
+        Client client(server.port());
+        // The system calls would stop at the NUL and serve test.txt as text/html
+        Response response = client.get("/test.txt%00.html");
+        CHECK_EQ(response.status, 400);
+        CHECK(response.body.find("<script>") == std::string::npos);
+        CHECK_EQ(client.get("/test.txt%00").status, 400);
+        CHECK_EQ(client.get("/test.txt").status, 200);
+    }
+
+    TEST_CASE(server, templates_forbidden)
+    {
+        TestServer server;
+        server.start();
+        Client client(server.port());
+        CHECK_EQ(client.get("/templates/tree_template.html").status, 403);
+        // Spellings that only normalize to the templates directory
+        CHECK_EQ(client.get("//templates/tree_template.html").status, 403);
+        CHECK_EQ(client.get("/./templates/tree_template.html").status, 403);
+        CHECK_EQ(client.get("/docs/../templates/tree_template.html").status, 403);
+        CHECK_EQ(client.get("/%74emplates/tree_template.html").status, 403);
+        CHECK_EQ(client.get("/templates").status, 403);
+        CHECK_EQ(client.get("/templates/").status, 403);
+        CHECK_EQ(client.get("/templates%2f").status, 403);
+        CHECK_EQ(client.get("/templates%00").status, 400);
+    }
+
+    TEST_CASE(server, pipelined_keep_alive)
+    {
+        TestServer server;
+        server.write("a.txt", "first");
+        server.write("b.txt", "second");
+        server.start();
+        Client client(server.port());
+        client.send("GET /a.txt HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                    "GET /missing HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                    "GET /b.txt HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        Response first = client.receive();
+        Response second = client.receive();
+        Response third = client.receive();
+        CHECK_EQ(first.status, 200);
+        CHECK_EQ(first.body, "first");
+        CHECK_EQ(second.status, 404);
+        CHECK_EQ(third.status, 200);
+        CHECK_EQ(third.body, "second");
+        CHECK(!client.closedByPeer(100));
+    }
+
+    TEST_CASE(server, connection_close)
+    {
+        TestServer server;
+        server.write("a.txt", "body");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/a.txt", "Connection: close\r\n");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, "body");
+        CHECK(client.closedByPeer(2000));
+    }
+
+    TEST_CASE(server, byte_ranges)
+    {
+        TestServer server;
+        server.write("digits.txt", "0123456789");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/digits.txt", "Range: bytes=2-5\r\n");
+        CHECK_EQ(response.status, 206);
+        CHECK_EQ(response.body, "2345");
+        CHECK_EQ(response.header("Content-Range"), "bytes 2-5/10");
+
+        response = client.get("/digits.txt", "Range: bytes=-3\r\n");
+        CHECK_EQ(response.status, 206);
+        CHECK_EQ(response.body, "789");
+
+        response = client.get("/digits.txt", "Range: bytes=0-0,8-\r\n");
+        CHECK_EQ(response.status, 206);
+        CHECK(response.header("Content-Type").starts_with("multipart/byteranges; boundary="));
+        CHECK(response.body.find("Content-Range: bytes 0-0/10\r\n\r\n0\r\n") != std::string::npos);
+        CHECK(response.body.find("Content-Range: bytes 8-9/10\r\n\r\n89\r\n") != std::string::npos);
+
+        response = client.get("/digits.txt", "Range: bytes=20-30\r\n");
+        CHECK_EQ(response.status, 416);
+        CHECK_EQ(response.header("Content-Range"), "bytes */10");
+    }
+
+    TEST_CASE(server, conditional_get)
+    {
+        TestServer server;
+        server.write("page.html", "<p>cached</p>");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/page.html");
+        REQUIRE_EQ(response.status, 200);
+        std::string etag = response.header("ETag");
+        REQUIRE(!etag.empty());
+
+        response = client.get("/page.html", "If-None-Match: " + etag + "\r\n");
+        CHECK_EQ(response.status, 304);
+        CHECK(response.body.empty());
+        response = client.get("/page.html", "If-None-Match: \"other\"\r\n");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, "<p>cached</p>");
+    }
+
+    TEST_CASE(server, compressed_static_file)
+    {
+        if (!compressionSupported(ContentEncoding::Gzip))
+        {
+            return;
+        }
+        std::string css;
+        for (int i = 0; css.size() < 256 * 1024; ++i)
+        {
+            css += ".rule-" + std::to_string(i) + " { margin: 0; padding: 0; }\n";
+        }
+        TestServer server;
+        server.write("style.css", css);
+        server.start();
+        Client client(server.port());
+        // Compressed off the request path: the file goes out as it is until the
+        // compressed copy is ready, then encoded
+        Response response;
+        for (int i = 0; i < 100; ++i)
+        {
+            response = client.get("/style.css", "Accept-Encoding: gzip\r\n");
+            REQUIRE_EQ(response.status, 200);
+            if (!response.header("Content-Encoding").empty())
+            {
+                break;
+            }
+            CHECK(response.body == css);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        CHECK_EQ(response.header("Content-Encoding"), "gzip");
+        CHECK(response.body.size() < css.size() / 4);
+        CHECK(response.body.starts_with("\x1f\x8b"));
+        CHECK(response.header("ETag").find("-gzip") != std::string::npos);
+
+        // Without the header the file is sent as it is
+        response = client.get("/style.css");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.header("Content-Encoding").empty());
+        CHECK(response.body == css);
+    }
+
+    TEST_CASE(server, directory_listing)
+    {
+        TestServer server;
+        server.write("docs/readme.txt", "read me");
+        server.write("docs/guide/intro.txt", "intro");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/docs/");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.header("Content-Type").starts_with("text/html"));
+        CHECK(response.body.find("readme.txt") != std::string::npos);
+        CHECK(response.body.find("guide") != std::string::npos);
+    }
+
+    TEST_CASE(server, directory_listing_stays_in_root)
+    {
+        TestServer server;
+        server.write("docs/readme.txt", "read me");
+        std::filesystem::create_directory_symlink("/etc", server.root() / "etclink");
+        std::filesystem::create_directory_symlink("docs", server.root() / "docslink");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/etclink/");
+        CHECK_EQ(response.status, 403);
+        CHECK(response.body.find("passwd") == std::string::npos);
+        response = client.get("/docslink/");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("readme.txt") != std::string::npos);
+        // A link leading out of the root is listed as a file
+        response = client.get("/");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("docslink/") != std::string::npos);
+        CHECK(response.body.find("etclink/") == std::string::npos);
+    }
+
+    TEST_CASE(server, tree_api)
+    {
+        TestServer server;
+        server.write("docs/readme.txt", "read me");
+        server.write("docs/guide/intro.txt", "intro");
+        server.start();
+        Client client(server.port());
+        Response response = client.get("/__tree?path=/docs");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, "{\"path\":\"/docs\",\"offset\":0,\"total\":2,\"entries\":["
+                                "{\"name\":\"guide\",\"type\":\"directory\"},"
+                                "{\"name\":\"readme.txt\",\"type\":\"file\"}],\"next_offset\":null}");
+        response = client.get("/__tree?path=/docs&offset=0&limit=1");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("\"next_offset\":1") != std::string::npos);
+        CHECK_EQ(client.get("/__tree?path=/nowhere").status, 404);
+    }
+
+    TEST_CASE(server, tree_api_stays_in_root)
+    {
+        TestServer server;
+        server.write("docs/readme.txt", "read me");
+        // A sibling of the root sharing its name as a prefix, and links out of the root
+        std::filesystem::create_directories(server.directory() / "webprivate");
+        std::ofstream(server.directory() / "webprivate/secret.txt") << "secret";
+        std::filesystem::create_directory_symlink("/etc", server.root() / "etclink");
+        std::filesystem::create_directory_symlink("../webprivate", server.root() / "uplink");
+        std::filesystem::create_directory_symlink("docs", server.root() / "docslink");
+        server.start();
+        Client client(server.port());
+
+        Response response = client.get("/__tree?path=/../webprivate");
+        CHECK_EQ(response.status, 403);
+        CHECK(response.body.find("secret") == std::string::npos);
+        response = client.get("/__tree?path=/etclink");
+        CHECK_EQ(response.status, 403);
+        CHECK(response.body.find("passwd") == std::string::npos);
+        response = client.get("/__tree?path=/uplink");
+        CHECK_EQ(response.status, 403);
+        CHECK(response.body.find("secret") == std::string::npos);
+        CHECK_EQ(client.get("/__tree?path=/templates").status, 403);
+        CHECK_EQ(client.get("/__tree?path=//docs/../templates/").status, 403);
+        CHECK_EQ(client.get("/__tree?path=/templates%00").status, 400);
+
+        // Links within the root are followed; those leading out are not directories
+        response = client.get("/__tree?path=/docslink");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("\"readme.txt\"") != std::string::npos);
+        response = client.get("/__tree?path=/");
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("{\"name\":\"docslink\",\"type\":\"directory\"}") != std::string::npos);
+        CHECK(response.body.find("{\"name\":\"etclink\",\"type\":\"file\"}") != std::string::npos);
+        CHECK(response.body.find("{\"name\":\"uplink\",\"type\":\"file\"}") != std::string::npos);
+    }
+
+    TEST_CASE(server, upload)
+    {
+        TestServer server;
+        server.write("incoming/.keep", "");
+        server.start();
+        Client client(server.port());
+        std::string small = "small file\n";
+        std::string large = binaryContent(2 * 1024 * 1024);
+        std::string boundary = "test-boundary-7d93";
+        std::string body = multipartBody(boundary, {{"small.txt", small}, {"large.bin", large}});
+        client.send("POST /upload?path=/incoming HTTP/1.1\r\nHost: localhost\r\n"
+                    "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+        client.send(body);
+        Response response = client.receive();
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("\"stored\":2") != std::string::npos);
+        CHECK_EQ(fileContent(server.root() / "incoming/small.txt"), small);
+        CHECK(fileContent(server.root() / "incoming/large.bin") == large);
+
+        // Served back on the same connection
+        response = client.get("/incoming/small.txt");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, small);
+    }
+
+    TEST_CASE(server, upload_beyond_pending_limit)
+    {
+        // Far more than the 4 MiB an upload may have waiting for the disk, so
+        // the receiving side has to wait for the writer
+        TestServer server({"--upload-threads=1"});
+        server.write("incoming/.keep", "");
+        server.start();
+        Client client(server.port());
+        std::vector<std::pair<std::string, std::string>> files;
+        for (int i = 0; i < 3; ++i)
+        {
+            files.emplace_back("part" + std::to_string(i) + ".bin", binaryContent(8 * 1024 * 1024 + i));
+        }
+        std::string boundary = "test-boundary-51c0";
+        std::string body = multipartBody(boundary, files);
+        client.send("POST /upload?path=/incoming HTTP/1.1\r\nHost: localhost\r\n"
+                    "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+        client.send(body);
+        Response response = client.receive();
+        CHECK_EQ(response.status, 200);
+        CHECK(response.body.find("\"stored\":3") != std::string::npos);
+        for (const auto &[name, content] : files)
+        {
+            CHECK(fileContent(server.root() / "incoming" / name) == content);
+        }
+
+        // The connection is still in step with the client
+        response = client.get("/incoming/part0.bin", "Range: bytes=0-3\r\n");
+        CHECK_EQ(response.status, 206);
+        CHECK_EQ(response.body, files[0].second.substr(0, 4));
+    }
+
+    TEST_CASE(server, abandoned_upload_removes_temporary_files)
+    {
+        TestServer server;
+        server.write("incoming/.keep", "");
+        server.start();
+        {
+            Client client(server.port());
+            std::string boundary = "test-boundary-0f2e";
+            std::string body = multipartBody(boundary, {{"cut.bin", binaryContent(6 * 1024 * 1024)}});
+            client.send("POST /upload?path=/incoming HTTP/1.1\r\nHost: localhost\r\n"
+                        "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+            client.send(std::string_view(body).substr(0, body.size() / 2));
+        }
+        auto leftovers = [&]
+        {
+            size_t count = 0;
+            for (const auto &entry : std::filesystem::directory_iterator(server.root() / "incoming"))
+            {
+                count += entry.path().filename() != ".keep";
+            }
+            return count;
+        };
+        for (int i = 0; i < 50 && leftovers() > 0; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        CHECK_EQ(leftovers(), size_t(0));
+    }
+
+    TEST_CASE(server, concurrent_clients)
+    {
+        TestServer server({"--workers=2"});
+        server.write("a.txt", "aaaa");
+        server.start();
+        std::vector<std::unique_ptr<Client>> clients;
+        for (int i = 0; i < 32; ++i)
+        {
+            clients.push_back(std::make_unique<Client>(server.port()));
+            REQUIRE(clients.back()->connected());
+        }
+        for (int round = 0; round < 3; ++round)
+        {
+            for (auto &client : clients)
+            {
+                client->send("GET /a.txt HTTP/1.1\r\nHost: localhost\r\n\r\n");
+            }
+            for (auto &client : clients)
+            {
+                Response response = client->receive();
+                CHECK_EQ(response.status, 200);
+                CHECK_EQ(response.body, "aaaa");
+            }
+        }
+    }
+
+    TEST_CASE(server, idle_connections_free_workers)
+    {
+        // More idle persistent connections than workers must not delay a new client
+        TestServer server({"--workers=2", "--keep-alive-timeout=1500"});
+        server.write("a.txt", "aaaa");
+        server.start();
+        Client first(server.port());
+        Client second(server.port());
+        CHECK_EQ(first.get("/a.txt").status, 200);
+        CHECK_EQ(second.get("/a.txt").status, 200);
+
+        auto started = std::chrono::steady_clock::now();
+        Client third(server.port());
+        Response response = third.get("/a.txt");
+        CHECK_EQ(response.status, 200);
+        CHECK(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(1000));
+
+        // The idle connections are picked up again when they send, and closed
+        // once the keep-alive timeout passes
+        response = first.get("/a.txt");
+        CHECK_EQ(response.status, 200);
+        CHECK_EQ(response.body, "aaaa");
+        CHECK(second.closedByPeer(3000));
+    }
+
+    TEST_CASE(server, malformed_request)
+    {
+        TestServer server;
+        server.start();
+        Client client(server.port());
+        client.send("NOT A REQUEST\r\n\r\n");
+        Response response = client.receive();
+        CHECK_EQ(response.status / 100, 4);
+        CHECK(client.closedByPeer(2000));
+    }
+
+}
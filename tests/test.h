@@ -0,0 +1,99 @@
+#ifndef WEB_SERVER_TEST_H
+#define WEB_SERVER_TEST_H
+
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace web_server::test
+{
+
+    // Command line settings shared by the test cases
+    struct Options
+    {
+        std::string server; // The web_server executable, for the end-to-end suite
+        std::string mode = "threads";
+        std::string web;    // The repository's web/ directory, for the page templates
+    };
+
+    const Options &options();
+
+    // Thrown by REQUIRE to end the current test case
+    struct Abort
+    {
+    };
+
+    using TestFunction = void (*)();
+
+    // Adds a test case to `suite`; used by TEST_CASE at static initialization
+    bool registerTest(const char *suite, const char *name, TestFunction function);
+
+    // Marks the current test case as failed and prints where and why
+    void fail(const char *file, int line, const std::string &message);
+
+    template <typename T>
+    void describe(std::ostringstream &out, const T &value)
+    {
+        if constexpr (requires { out << value; })
+        {
+            out << value;
+        }
+        else
+        {
+            out << "<value>";
+        }
+    }
+
+    template <typename A, typename B>
+    bool checkEqual(const A &actual, const B &expected, const char *expression, const char *file, int line)
+    {
+        if (actual == expected)
+        {
+            return true;
+        }
+        std::ostringstream out;
+        out << expression << ": got \"";
+        describe(out, actual);
+        out << "\", expected \"";
+        describe(out, expected);
+        out << "\"";
+        fail(file, line, out.str());
+        return false;
+    }
+
+}
+
+// Defines a test case; `suite` selects it from the command line
+#define TEST_CASE(suite, name)                                                                          \
+    static void suite##_##name();                                                                       \
+    [[maybe_unused]] static const bool suite##_##name##_registered =                                    \
+        ::web_server::test::registerTest(#suite, #name, suite##_##name);                                \
+    static void suite##_##name()
+
+// Records a failure and carries on with the test case
+#define CHECK(condition)                                                                                \
+    ((condition) ? true : (::web_server::test::fail(__FILE__, __LINE__, "CHECK(" #condition ")"), false))
+
+#define CHECK_EQ(actual, expected)                                                                      \
+    ::web_server::test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+// Records a failure and ends the test case, for conditions the rest depends on
+#define REQUIRE(condition)                                                                              \
+    do                                                                                                  \
+    {                                                                                                   \
+        if (!CHECK(condition))                                                                          \
+        {                                                                                               \
+            throw ::web_server::test::Abort();                                                          \
+        }                                                                                               \
+    } while (false)
+
+#define REQUIRE_EQ(actual, expected)                                                                    \
+    do                                                                                                  \
+    {                                                                                                   \
+        if (!CHECK_EQ(actual, expected))                                                                \
+        {                                                                                               \
+            throw ::web_server::test::Abort();                                                          \
+        }                                                                                               \
+    } while (false)
+
+#endif
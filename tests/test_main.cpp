@@ -0,0 +1,115 @@
+#include "test.h"
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        struct TestCase
+        {
+            const char *suite;
+            const char *name;
+            TestFunction function;
+        };
+
+        // Function-local so that registration from other translation units
+        // does not depend on their initialization order
+        std::vector<TestCase> &registry()
+        {
+            static std::vector<TestCase> tests;
+            return tests;
+        }
+
+        Options settings;
+        bool current_failed = false;
+    }
+
+    const Options &options()
+    {
+        return settings;
+    }
+
+    bool registerTest(const char *suite, const char *name, TestFunction function)
+    {
+        registry().push_back({suite, name, function});
+        return true;
+    }
+
+    void fail(const char *file, int line, const std::string &message)
+    {
+        current_failed = true;
+        std::fprintf(stderr, "  %s:%d: %s\n", file, line, message.c_str());
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace web_server::test;
+
+    // With suite names, only those suites are run
+    std::vector<std::string> suites;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.starts_with("--server="))
+        {
+            settings.server = arg.substr(9);
+        }
+        else if (arg.starts_with("--mode="))
+        {
+            settings.mode = arg.substr(7);
+        }
+        else if (arg.starts_with("--web="))
+        {
+            settings.web = arg.substr(6);
+        }
+        else if (std::none_of(registry().begin(), registry().end(), [&](const TestCase &test)
+                              { return arg == test.suite; }))
+        {
+            std::fprintf(stderr, "Unknown suite: %s\n", arg.c_str());
+            return 2;
+        }
+        else
+        {
+            suites.push_back(arg);
+        }
+    }
+
+    size_t run = 0;
+    size_t failed = 0;
+    for (const TestCase &test : registry())
+    {
+        if (!suites.empty() && std::find(suites.begin(), suites.end(), test.suite) == suites.end())
+        {
+            continue;
+        }
+        std::printf("%s.%s\n", test.suite, test.name);
+        std::fflush(stdout);
+        current_failed = false;
+        try
+        {
+            test.function();
+        }
+        catch (const Abort &)
+        {
+        }
+        catch (const std::exception &e)
+        {
+            fail(__FILE__, __LINE__, std::string("unexpected exception: ") + e.what());
+        }
+        ++run;
+        if (current_failed)
+        {
+            ++failed;
+            std::printf("  FAILED\n");
+        }
+    }
+    std::printf("%zu of %zu test cases passed\n", run - failed, run);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
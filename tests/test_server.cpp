@@ -0,0 +1,344 @@
+#include "test_server.h"
+#include "test.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        constexpr int READ_TIMEOUT_MS = 5000;
+        constexpr auto START_TIMEOUT = std::chrono::seconds(10);
+
+        int connectLoopback(int port)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd == -1)
+            {
+                return -1;
+            }
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1)
+            {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        // A port nothing listens on right now, chosen by the kernel
+        int freePort()
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+                getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) == -1)
+            {
+                throw std::runtime_error("cannot find a free port");
+            }
+            close(fd);
+            return ntohs(address.sin_port);
+        }
+
+        std::string lower(std::string text)
+        {
+            for (char &c : text)
+            {
+                c = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+            }
+            return text;
+        }
+
+        std::string readLog(const std::filesystem::path &path)
+        {
+            std::ifstream file(path);
+            std::ostringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+    }
+
+    TestServer::TestServer(std::vector<std::string> arguments) : arguments_(std::move(arguments))
+    {
+        static std::atomic<unsigned> counter{0};
+        directory_ = std::filesystem::temp_directory_path() /
+                     ("web_server_test_" + std::to_string(getpid()) + "_" + std::to_string(counter++));
+        std::filesystem::remove_all(directory_);
+        std::filesystem::create_directories(root());
+        if (!options().web.empty())
+        {
+            std::filesystem::copy(std::filesystem::path(options().web) / "templates", root() / "templates",
+                                  std::filesystem::copy_options::recursive);
+        }
+    }
+
+    TestServer::~TestServer()
+    {
+        if (pid_ > 0)
+        {
+            kill(pid_, SIGKILL);
+            waitpid(pid_, nullptr, 0);
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(directory_, ec);
+    }
+
+    void TestServer::write(const std::string &relative, std::string_view content) const
+    {
+        std::filesystem::path path = root() / relative;
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    void TestServer::start()
+    {
+        if (options().server.empty())
+        {
+            throw std::runtime_error("--server=PATH is required for the end-to-end tests");
+        }
+        port_ = freePort();
+        std::vector<std::string> arguments = {std::filesystem::absolute(options().server).string(), "--mode=" + options().mode,
+                                              "--port=" + std::to_string(port_), "--bind=127.0.0.1",
+                                              "--log-level=warn", "--access-log=off"};
+        arguments.insert(arguments.end(), arguments_.begin(), arguments_.end());
+        std::vector<char *> argv;
+        for (std::string &argument : arguments)
+        {
+            argv.push_back(argument.data());
+        }
+        argv.push_back(nullptr);
+        std::string log = (directory_ / "server.log").string();
+
+        pid_ = fork();
+        if (pid_ == -1)
+        {
+            throw std::runtime_error("fork failed");
+        }
+        if (pid_ == 0)
+        {
+            // The server serves ./web
+            int output = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (chdir(directory_.c_str()) == -1 || output == -1)
+            {
+                _exit(127);
+            }
+            dup2(output, STDOUT_FILENO);
+            dup2(output, STDERR_FILENO);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + START_TIMEOUT;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            int status;
+            if (waitpid(pid_, &status, WNOHANG) == pid_)
+            {
+                pid_ = -1;
+                throw std::runtime_error("server exited during start-up: " + readLog(log));
+            }
+            int fd = connectLoopback(port_);
+            if (fd != -1)
+            {
+                close(fd);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        throw std::runtime_error("server did not start listening: " + readLog(log));
+    }
+
+    std::string Response::header(const std::string &name) const
+    {
+        auto it = headers.find(lower(name));
+        return it == headers.end() ? std::string() : it->second;
+    }
+
+    Client::Client(int port) : socket_(connectLoopback(port))
+    {
+    }
+
+    Client::~Client()
+    {
+        if (socket_ != -1)
+        {
+            close(socket_);
+        }
+    }
+
+    void Client::send(std::string_view data)
+    {
+        while (!data.empty())
+        {
+            ssize_t sent = ::send(socket_, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return;
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+    }
+
+    bool Client::fill()
+    {
+        pollfd descriptor{socket_, POLLIN, 0};
+        if (poll(&descriptor, 1, READ_TIMEOUT_MS) <= 0)
+        {
+            return false;
+        }
+        char chunk[16384];
+        ssize_t received = recv(socket_, chunk, sizeof(chunk), 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        buffer_.append(chunk, static_cast<size_t>(received));
+        return true;
+    }
+
+    Response Client::receive()
+    {
+        Response response;
+        size_t head_end;
+        while ((head_end = buffer_.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (!fill())
+            {
+                return response;
+            }
+        }
+        std::istringstream head(buffer_.substr(0, head_end));
+        buffer_.erase(0, head_end + 4);
+        std::string line;
+        std::getline(head, line);
+        if (line.size() < 12 || !line.starts_with("HTTP/1."))
+        {
+            return response;
+        }
+        response.status = std::atoi(line.c_str() + 9);
+        while (std::getline(head, line))
+        {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            size_t value = line.find_first_not_of(' ', colon + 1);
+            size_t end = line.find_last_not_of("\r ");
+            response.headers[lower(line.substr(0, colon))] =
+                value == std::string::npos || end < value ? std::string() : line.substr(value, end - value + 1);
+        }
+
+        if (response.status == 304 || response.status == 204 || response.status / 100 == 1)
+        {
+            return response;
+        }
+        if (lower(response.header("Transfer-Encoding")) == "chunked")
+        {
+            while (true)
+            {
+                size_t line_end;
+                while ((line_end = buffer_.find("\r\n")) == std::string::npos)
+                {
+                    if (!fill())
+                    {
+                        response.status = 0;
+                        return response;
+                    }
+                }
+                size_t size = std::strtoul(buffer_.c_str(), nullptr, 16);
+                while (buffer_.size() < line_end + 2 + size + 2)
+                {
+                    if (!fill())
+                    {
+                        response.status = 0;
+                        return response;
+                    }
+                }
+                response.body.append(buffer_, line_end + 2, size);
+                buffer_.erase(0, line_end + 2 + size + 2);
+                if (size == 0)
+                {
+                    return response;
+                }
+            }
+        }
+        std::string length = response.header("Content-Length");
+        if (!length.empty())
+        {
+            size_t size = std::stoull(length);
+            while (buffer_.size() < size)
+            {
+                if (!fill())
+                {
+                    response.status = 0;
+                    return response;
+                }
+            }
+            response.body = buffer_.substr(0, size);
+            buffer_.erase(0, size);
+            return response;
+        }
+        while (fill())
+        {
+        }
+        response.body = std::move(buffer_);
+        buffer_.clear();
+        return response;
+    }
+
+    Response Client::get(const std::string &target, const std::string &headers)
+    {
+        send("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n");
+        return receive();
+    }
+
+    bool Client::closedByPeer(int timeout_ms)
+    {
+        pollfd descriptor{socket_, POLLIN, 0};
+        if (poll(&descriptor, 1, timeout_ms) <= 0)
+        {
+            return false;
+        }
+        char byte;
+        return recv(socket_, &byte, 1, MSG_PEEK) == 0;
+    }
+
+    std::string multipartBody(const std::string &boundary,
+                              const std::vector<std::pair<std::string, std::string>> &files)
+    {
+        std::string body;
+        for (const auto &[name, content] : files)
+        {
+            body += "--" + boundary + "\r\n";
+            body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + name + "\"\r\n";
+            body += "Content-Type: application/octet-stream\r\n\r\n";
+            body += content;
+            body += "\r\n";
+        }
+        body += "--" + boundary + "--\r\n";
+        return body;
+    }
+
+}
@@ -0,0 +1,85 @@
+#ifndef WEB_SERVER_TEST_SERVER_H
+#define WEB_SERVER_TEST_SERVER_H
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace web_server::test
+{
+
+    // A web_server process (options().server) serving a scratch web root with
+    // the repository's templates, in the mode given on the command line and on
+    // a free loopback port. Stopped and removed again on destruction.
+    class TestServer
+    {
+    public:
+        explicit TestServer(std::vector<std::string> arguments = {});
+        ~TestServer();
+
+        TestServer(const TestServer &) = delete;
+        TestServer &operator=(const TestServer &) = delete;
+
+        // Files may be added before start(), or later for the paths the
+        // server has not looked at yet
+        void write(const std::string &relative, std::string_view content) const;
+        void start();
+
+        int port() const { return port_; }
+        // The directory holding web/, outside the web root
+        const std::filesystem::path &directory() const { return directory_; }
+        std::filesystem::path root() const { return directory_ / "web"; }
+
+    private:
+        std::filesystem::path directory_;
+        std::vector<std::string> arguments_;
+        int port_ = 0;
+        pid_t pid_ = -1;
+    };
+
+    struct Response
+    {
+        int status = 0;
+        std::map<std::string, std::string> headers; // Lower-case names
+        std::string body;
+
+        std::string header(const std::string &name) const;
+    };
+
+    // A blocking HTTP/1.1 client over loopback for the end-to-end tests; reads
+    // time out after five seconds
+    class Client
+    {
+    public:
+        explicit Client(int port);
+        ~Client();
+
+        Client(const Client &) = delete;
+        Client &operator=(const Client &) = delete;
+
+        bool connected() const { return socket_ != -1; }
+        void send(std::string_view data);
+        // The next response on the connection, with a Content-Length, chunked or
+        // close-delimited body. Status 0 if the connection closed first.
+        Response receive();
+        Response get(const std::string &target, const std::string &headers = "");
+        // True once the server has closed the connection, waiting up to `timeout_ms`
+        bool closedByPeer(int timeout_ms);
+
+    private:
+        int socket_;
+        std::string buffer_;
+
+        bool fill();
+    };
+
+    // A multipart/form-data body with one part per (filename, content)
+    std::string multipartBody(const std::string &boundary,
+                              const std::vector<std::pair<std::string, std::string>> &files);
+
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include "test.h"
+#include "timer_wheel.h"
+#include <random>
+#include <vector>
+
+// The connection deadlines: a timer fires on the first tick at or after its
+// deadline, never before it, whichever level of the wheel it started in
+
+namespace web_server::test
+{
+
+    namespace
+    {
+        using Clock = TimerWheel::Clock;
+
+        constexpr std::chrono::milliseconds TICK{10};
+        const Clock::time_point START = Clock::now();
+
+        Clock::time_point at(int64_t milliseconds)
+        {
+            return START + std::chrono::milliseconds(milliseconds);
+        }
+
+        // Advances `wheel` to `milliseconds` and returns the ids that expired, in order
+        std::vector<uint64_t> advance(TimerWheel &wheel, int64_t milliseconds)
+        {
+            std::vector<uint64_t> expired;
+            wheel.advance(at(milliseconds), [&expired](TimerWheel::Timer &timer)
+                          { expired.push_back(timer.id); });
+            return expired;
+        }
+
+        const std::vector<uint64_t> NONE;
+    }
+
+    TEST_CASE(timer_wheel, fires_on_the_tick_after_its_deadline)
+    {
+        TimerWheel wheel(TICK, START);
+        TimerWheel::Timer timer;
+        timer.id = 1;
+        wheel.schedule(timer, at(25)); // Rounded up to the tick at 30 ms
+        CHECK(timer.scheduled());
+        CHECK_EQ(wheel.size(), size_t(1));
+        CHECK(advance(wheel, 29) == NONE);
+        CHECK(advance(wheel, 30) == std::vector<uint64_t>{1});
+        CHECK(!timer.scheduled());
+        CHECK_EQ(wheel.size(), size_t(0));
+        CHECK(advance(wheel, 1000) == NONE);
+    }
+
+    TEST_CASE(timer_wheel, past_deadline_fires_on_next_advance)
+    {
+        TimerWheel wheel(TICK, START);
+        advance(wheel, 500);
+        TimerWheel::Timer timer;
+        timer.id = 7;
+        wheel.schedule(timer, at(100));
+        CHECK(advance(wheel, 505) == NONE); // Still within the tick already processed
+        CHECK(advance(wheel, 510) == std::vector<uint64_t>{7});
+    }
+
+    TEST_CASE(timer_wheel, reschedule_and_cancel)
+    {
+        TimerWheel wheel(TICK, START);
+        TimerWheel::Timer later;
+        TimerWheel::Timer cancelled;
+        later.id = 1;
+        cancelled.id = 2;
+        wheel.schedule(later, at(100));
+        wheel.schedule(cancelled, at(100));
+        wheel.schedule(later, at(5000)); // Moves it, across levels
+        wheel.cancel(cancelled);
+        CHECK(!cancelled.scheduled());
+        CHECK_EQ(wheel.size(), size_t(1));
+        CHECK(advance(wheel, 4990) == NONE);
+        CHECK(advance(wheel, 5000) == std::vector<uint64_t>{1});
+
+        // Rescheduled earlier than before, from a coarse level into the finest
+        wheel.schedule(later, at(900000));
+        wheel.schedule(later, at(5100));
+        CHECK(advance(wheel, 5100) == std::vector<uint64_t>{1});
+    }
+
+    TEST_CASE(timer_wheel, destroyed_timer_unlinks)
+    {
+        TimerWheel wheel(TICK, START);
+        TimerWheel::Timer kept;
+        kept.id = 1;
+        wheel.schedule(kept, at(50));
+        {
+            TimerWheel::Timer gone;
+            gone.id = 2;
+            wheel.schedule(gone, at(50));
+            CHECK_EQ(wheel.size(), size_t(2));
+        }
+        CHECK_EQ(wheel.size(), size_t(1));
+        CHECK(advance(wheel, 50) == std::vector<uint64_t>{1});
+    }
+
+    TEST_CASE(timer_wheel, callback_may_reschedule)
+    {
+        TimerWheel wheel(TICK, START);
+        TimerWheel::Timer timer;
+        timer.id = 3;
+        wheel.schedule(timer, at(20));
+        int fired = 0;
+        wheel.advance(at(20), [&](TimerWheel::Timer &expired)
+                      {
+                          ++fired;
+                          wheel.schedule(expired, at(0)); // In the past: lands in the next tick
+                      });
+        CHECK_EQ(fired, 1);
+        CHECK(timer.scheduled());
+        CHECK(advance(wheel, 30) == std::vector<uint64_t>{3});
+    }
+
+    TEST_CASE(timer_wheel, deadline_beyond_range_is_clamped)
+    {
+        TimerWheel wheel(TICK, START);
+        TimerWheel::Timer timer;
+        timer.id = 1;
+        wheel.schedule(timer, at(int64_t(1) << 40));
+        CHECK(timer.scheduled());
+        int64_t range = int64_t(1) << (TimerWheel::LEVEL_BITS * TimerWheel::LEVELS);
+        CHECK(advance(wheel, (range - 2) * TICK.count()) == NONE);
+        CHECK(advance(wheel, (range - 1) * TICK.count()) == std::vector<uint64_t>{1});
+    }
+
+    TEST_CASE(timer_wheel, poll_timeout)
+    {
+        TimerWheel wheel(TICK, START);
+        CHECK_EQ(wheel.pollTimeout(at(0)), -1);
+        TimerWheel::Timer soon;
+        wheel.schedule(soon, at(45));
+        CHECK_EQ(wheel.pollTimeout(at(0)), 50);
+        CHECK_EQ(wheel.pollTimeout(at(60)), 0); // Overdue
+        wheel.cancel(soon);
+
+        // A timer in a coarser level wakes the poll at the next cascade
+        TimerWheel::Timer distant;
+        wheel.schedule(distant, at(100000));
+        CHECK_EQ(wheel.pollTimeout(at(0)), int(TimerWheel::SLOTS * TICK.count()));
+    }
+
+    TEST_CASE(timer_wheel, random_deadlines)
+    {
+        // Deadlines over every level, rescheduled halfway, advanced in uneven steps
+        constexpr size_t COUNT = 2000;
+        constexpr int64_t HORIZON = 3000000; // Milliseconds, beyond the third level
+        TimerWheel wheel(TICK, START);
+        std::mt19937_64 random(42);
+        std::vector<TimerWheel::Timer> timers(COUNT);
+        std::vector<int64_t> deadlines(COUNT);
+        std::vector<int64_t> fired(COUNT, -1);
+        auto schedule = [&](size_t i, int64_t from)
+        {
+            deadlines[i] = from + int64_t(random() % HORIZON);
+            wheel.schedule(timers[i], at(deadlines[i]));
+        };
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            timers[i].id = i;
+            schedule(i, 0);
+        }
+
+        int64_t now = 0;
+        bool rescheduled = false;
+        while (wheel.size() > 0)
+        {
+            now += int64_t(random() % 5000);
+            wheel.advance(at(now), [&](TimerWheel::Timer &timer)
+                          { fired[timer.id] = now; });
+            if (!rescheduled && now >= HORIZON / 2)
+            {
+                rescheduled = true;
+                for (size_t i = 0; i < COUNT; i += 2)
+                {
+                    fired[i] = -1;
+                    schedule(i, now);
+                }
+            }
+        }
+
+        size_t early = 0;
+        size_t late = 0;
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            // Due at the tick the deadline rounds up to; fired by the first advance that reaches it
+            int64_t due = (deadlines[i] + TICK.count() - 1) / TICK.count() * TICK.count();
+            early += fired[i] < due;
+            late += fired[i] >= due + 5000 + TICK.count();
+        }
+        CHECK_EQ(early, size_t(0));
+        CHECK_EQ(late, size_t(0));
+    }
+
+}